@@ -0,0 +1,205 @@
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include "aggregate.h"
+
+// Payload record for one file with stored hits: header then MatchHit[stored]
+typedef struct {
+    int file;
+    int stored;
+} HitBlock;
+
+// Pack every local result with stored hits into one contiguous buffer.
+// Returns NULL (*bytes -1) if it cannot be allocated or outgrows an int.
+static char *pack_hits(const SearchResult *results, int file_count, int *bytes)
+{
+    size_t size = 0;
+    for (int i = 0; i < file_count; i++) {
+        if (results[i].hit_stored > 0)
+            size += sizeof(HitBlock) + results[i].hit_stored * sizeof(MatchHit);
+    }
+
+    char *buf = size <= INT_MAX ? malloc(size ? size : 1) : NULL;
+    *bytes = -1;
+    if (!buf)
+        return NULL;
+    char *p = buf;
+    for (int i = 0; i < file_count; i++) {
+        if (results[i].hit_stored <= 0)
+            continue;
+        HitBlock block = { i, results[i].hit_stored };
+        memcpy(p, &block, sizeof(block));
+        p += sizeof(block);
+        memcpy(p, results[i].hits, block.stored * sizeof(MatchHit));
+        p += block.stored * sizeof(MatchHit);
+    }
+
+    *bytes = (int)size;
+    return buf;
+}
+
+// Hand the gathered hit lists to the results they belong to (rank 0 only);
+// rank 0's own blocks are skipped since its results already hold them.
+// Returns 0, or -1 if a list cannot be allocated.
+static int unpack_hits(SearchResult *results, int file_count, const char *buf, const int *counts, const int *displs, int size)
+{
+    for (int r = 1; r < size; r++) {
+        const char *p = buf + displs[r];
+        const char *end = p + counts[r];
+        while (p < end) {
+            HitBlock block;
+            memcpy(&block, p, sizeof(block));
+            p += sizeof(block);
+            if (block.file >= 0 && block.file < file_count && !results[block.file].hits) {
+                results[block.file].hits = malloc(block.stored * sizeof(MatchHit));
+                if (!results[block.file].hits)
+                    return -1;
+                memcpy(results[block.file].hits, p, block.stored * sizeof(MatchHit));
+                results[block.file].hit_stored = block.stored;
+            }
+            p += block.stored * sizeof(MatchHit);
+        }
+    }
+    return 0;
+}
+
+static void aggregate_free(Aggregation *a)
+{
+    free(a->bits);
+    free(a->all_bits);
+    free(a->counts);
+    free(a->all_counts);
+    free(a->payload);
+    free(a->sizes);
+    memset(a, 0, sizeof(*a));
+}
+
+// Combine every rank's per-file results on rank 0 with a fixed number of
+// collectives, independent of the file count: found flags travel as a packed
+// bitmap (OR-reduced), hit counts as one MAX-reduced array and the stored hit
+// lists as one variable-length gather. aggregate_init() allocates the
+// buffers whose size is known up front and agrees across ranks that they
+// all have them, before the search, while the ranks are still in step.
+// aggregate_begin() posts all but the gather non-blocking as soon as this
+// rank's results are final, so a rank that runs out of work early has
+// started its side and packed its payload before it waits for the slowest
+// rank (e.g. in work_queue_close()); aggregate_end() posts the gather, whose
+// sizes it needs, and completes everything. Each whole file is searched by a
+// single rank, so MAX recovers its count; a file split into byte ranges only
+// records found, which is why counts are reduced only when with_hits is set.
+
+// Collective. Returns 0, or -1 on every rank if any of them runs out of
+// memory (nothing is left to free then).
+int aggregate_init(Aggregation *a, SearchResult *results, int file_count, int with_hits, int rank, int size,
+                   MPI_Comm comm)
+{
+    memset(a, 0, sizeof(*a));
+    a->results = results;
+    a->file_count = file_count;
+    a->with_hits = with_hits;
+    a->rank = rank;
+    a->size = size;
+    a->comm = comm;
+
+    int bitmap_bytes = (file_count + 7) / 8;
+    a->bits = calloc(bitmap_bytes ? bitmap_bytes : 1, 1);
+    a->all_bits = rank == 0 ? calloc(bitmap_bytes ? bitmap_bytes : 1, 1) : NULL;
+    int ok = a->bits && (rank != 0 || a->all_bits);
+    if (with_hits) {
+        a->counts = malloc((file_count ? file_count : 1) * sizeof(int));
+        a->all_counts = rank == 0 ? malloc((file_count ? file_count : 1) * sizeof(int)) : NULL;
+        a->sizes = rank == 0 ? malloc(size * sizeof(int)) : NULL;
+        ok = ok && a->counts && (rank != 0 || (a->all_counts && a->sizes));
+    }
+    MPI_Allreduce(MPI_IN_PLACE, &ok, 1, MPI_INT, MPI_LAND, comm);
+    if (!ok) {
+        aggregate_free(a);
+        return -1;
+    }
+    return 0;
+}
+
+// Post this rank's side of the aggregation
+void aggregate_begin(Aggregation *a)
+{
+    SearchResult *results = a->results;
+    int file_count = a->file_count;
+    int bitmap_bytes = (file_count + 7) / 8;
+    for (int i = 0; i < file_count; i++) {
+        if (results[i].found)
+            a->bits[i / 8] |= (unsigned char)(1u << (i % 8));
+    }
+    MPI_Ireduce(a->bits, a->all_bits, bitmap_bytes, MPI_UNSIGNED_CHAR, MPI_BOR, 0, a->comm, &a->reqs[a->nreq++]);
+
+    if (a->with_hits) {
+        for (int i = 0; i < file_count; i++)
+            a->counts[i] = results[i].hit_count;
+        MPI_Ireduce(a->counts, a->all_counts, file_count, MPI_INT, MPI_MAX, 0, a->comm, &a->reqs[a->nreq++]);
+
+        // A payload that cannot be packed is announced as size -1
+        a->payload = pack_hits(results, file_count, &a->payload_bytes);
+        MPI_Igather(&a->payload_bytes, 1, MPI_INT, a->sizes, 1, MPI_INT, 0, a->comm, &a->reqs[a->nreq++]);
+    }
+}
+
+// Complete an aggregation. Returns the number of files found on rank 0 (0
+// elsewhere), or -1 on every rank if the hit lists could not be gathered.
+int aggregate_end(Aggregation *a)
+{
+    int *displs = NULL;
+    char *all_payload = NULL;
+    int ok = 1;
+    if (a->with_hits) {
+        // Payload sizes must be known before the gather can be posted
+        MPI_Wait(&a->reqs[a->nreq - 1], MPI_STATUS_IGNORE);
+        a->nreq--;
+        if (a->rank == 0) {
+            displs = malloc(a->size * sizeof(int));
+            long long total = 0;
+            for (int r = 0; displs && r < a->size; r++) {
+                displs[r] = (int)total;
+                total += a->sizes[r];
+                ok = ok && a->sizes[r] >= 0 && total <= INT_MAX;
+            }
+            all_payload = displs && ok ? malloc(total ? total : 1) : NULL;
+            ok = ok && all_payload;
+        }
+        MPI_Bcast(&ok, 1, MPI_INT, 0, a->comm);
+        if (ok)
+            MPI_Igatherv(a->payload, a->payload_bytes, MPI_BYTE, all_payload, a->sizes, displs, MPI_BYTE, 0,
+                         a->comm, &a->reqs[a->nreq++]);
+    }
+
+    MPI_Waitall(a->nreq, a->reqs, MPI_STATUSES_IGNORE);
+
+    int found_count = 0;
+    if (a->rank == 0 && ok) {
+        SearchResult *results = a->results;
+        for (int i = 0; i < a->file_count; i++) {
+            results[i].found = (a->all_bits[i / 8] >> (i % 8)) & 1;
+            results[i].hit_count = a->with_hits ? a->all_counts[i] : results[i].found;
+            found_count += results[i].found;
+        }
+        if (a->with_hits)
+            ok = unpack_hits(results, a->file_count, all_payload, a->sizes, displs, a->size) == 0;
+    }
+    if (a->with_hits)
+        MPI_Bcast(&ok, 1, MPI_INT, 0, a->comm);
+
+    free(all_payload);
+    free(displs);
+    aggregate_free(a);
+    return ok ? found_count : -1;
+}
+
+// All steps at once, for callers with nothing to overlap (collective).
+// Returns the number of files found on rank 0, or -1 on every rank on
+// failure.
+int aggregate_results(SearchResult *results, int file_count, int with_hits, int rank, int size, MPI_Comm comm)
+{
+    Aggregation a;
+    if (aggregate_init(&a, results, file_count, with_hits, rank, size, comm) != 0)
+        return -1;
+    aggregate_begin(&a);
+    return aggregate_end(&a);
+}
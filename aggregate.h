@@ -0,0 +1,40 @@
+#ifndef AGGREGATE_H
+#define AGGREGATE_H
+
+#include <mpi.h>
+#include "matcher.h"
+
+#define MAX_FILENAME_LEN 512
+
+// Structure to store search results for accuracy comparison
+typedef struct {
+    const char *filename;  // base name, points into the searched file table
+    int found;
+    int hit_count;     // hits in the file (report mode), else equal to found
+    int hit_stored;
+    MatchHit *hits;    // first hit_stored hits, owned by this result
+} SearchResult;
+
+// One aggregation in flight, from aggregate_init() to aggregate_end()
+typedef struct {
+    SearchResult *results;
+    int file_count;
+    int with_hits;
+    int rank, size;
+    MPI_Comm comm;
+    MPI_Request reqs[3];
+    int nreq;
+    unsigned char *bits, *all_bits;
+    int *counts, *all_counts;
+    char *payload;
+    int payload_bytes;
+    int *sizes;
+} Aggregation;
+
+int aggregate_init(Aggregation *a, SearchResult *results, int file_count, int with_hits, int rank, int size,
+                   MPI_Comm comm);
+void aggregate_begin(Aggregation *a);
+int aggregate_end(Aggregation *a);
+int aggregate_results(SearchResult *results, int file_count, int with_hits, int rank, int size, MPI_Comm comm);
+
+#endif
@@ -2,10 +2,11 @@
 #include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
-#include <math.h>
+#include "approx_match.h"
+#include "doc_reader.h"
 
-#define MAX_WORD 256
-#define MAX_DIST 2  // allowed Levenshtein distance
+#define WORD_BITS 64
+#define HIGH_BIT ((uint64_t)1 << (WORD_BITS - 1))
 
 // Convert string to lowercase (in-place)
 void to_lower_str(char *s) {
@@ -28,13 +29,15 @@ int bounded_levenshtein(const char *s1, const char *s2, int max_dist) {
         int prev = dp[0];
         dp[0] = i;
         int min_in_row = dp[0];
+        int c1 = tolower((unsigned char)s1[i - 1]);
 
         for (int j = 1; j <= len2; j++) {
             int tmp = dp[j];
-            if (tolower(s1[i - 1]) == tolower(s2[j - 1])) {
+            if (c1 == tolower((unsigned char)s2[j - 1])) {
                 dp[j] = prev;
             } else {
-                dp[j] = 1 + fmin(fmin(dp[j], dp[j - 1]), prev);
+                int best = dp[j] < dp[j - 1] ? dp[j] : dp[j - 1];
+                dp[j] = 1 + (prev < best ? prev : best);
             }
             prev = tmp;
 
@@ -48,24 +51,357 @@ int bounded_levenshtein(const char *s1, const char *s2, int max_dist) {
     return dp[len2];
 }
 
-int approx_match(const char *filepath, const char *pattern) {
-    FILE *fp = fopen(filepath, "r");
-    if (!fp) return 0;
+// Precompute the match masks of a pattern: bit i of peq[c] is set when byte c
+// equals pattern[i] ignoring case. Patterns longer than one machine word are
+// split into 64-row blocks. Returns 0 on success.
+int myers_init(MyersPattern *mp, const char *pattern) {
+    memset(mp, 0, sizeof(*mp));
+    mp->m = (int)strlen(pattern);
+    mp->words = mp->m > 0 ? (mp->m + WORD_BITS - 1) / WORD_BITS : 1;
+    mp->peq = (uint64_t *)calloc((size_t)256 * mp->words, sizeof(uint64_t));
+    if (!mp->peq) return -1;
 
-    char word[MAX_WORD];
-    char lower_pattern[MAX_WORD];
-    strncpy(lower_pattern, pattern, MAX_WORD - 1);
-    lower_pattern[MAX_WORD - 1] = '\0';
-    to_lower_str(lower_pattern);  // pattern to lowercase
+    for (int c = 0; c < 256; c++) {
+        int lc = tolower(c);
+        uint64_t *masks = mp->peq + (size_t)c * mp->words;
+        for (int i = 0; i < mp->m; i++) {
+            if (tolower((unsigned char)pattern[i]) == lc)
+                masks[i / WORD_BITS] |= (uint64_t)1 << (i % WORD_BITS);
+        }
+    }
+    return 0;
+}
+
+void myers_free(MyersPattern *mp) {
+    free(mp->peq);
+    mp->peq = NULL;
+}
+
+// Edit distance between the whole pattern and text[0..n), computed one text
+// byte at a time over bit-vectors of vertical deltas (Myers / Hyyrö). Returns
+// max_dist + 1 as soon as the distance provably exceeds max_dist.
+int myers_distance(const MyersPattern *mp, const char *text, int n, int max_dist) {
+    int m = mp->m;
+    if (abs(n - m) > max_dist) return max_dist + 1;
+    if (m == 0) return n;
+
+    const unsigned char *t = (const unsigned char *)text;
+    int score = m;
+
+    if (mp->words == 1) {
+        uint64_t last = (uint64_t)1 << (m - 1);
+        uint64_t pv = ~(uint64_t)0, mv = 0;
+        for (int j = 0; j < n; j++) {
+            uint64_t eq = mp->peq[t[j]];
+            uint64_t xv = eq | mv;
+            uint64_t xh = (((eq & pv) + pv) ^ pv) | eq;
+            uint64_t ph = mv | ~(xh | pv);
+            uint64_t mh = pv & xh;
+            score += (ph & last) ? 1 : (mh & last) ? -1 : 0;
+            // Global distance: the top row grows by one per text byte
+            ph = (ph << 1) | 1;
+            mh <<= 1;
+            pv = mh | ~(xv | ph);
+            mv = ph & xv;
 
-    while (fscanf(fp, "%255s", word) == 1) {
-        to_lower_str(word);  // normalize word too
-        if (bounded_levenshtein(word, lower_pattern, MAX_DIST) <= MAX_DIST) {
-            fclose(fp);
-            return 1;
+            if (score - (n - j - 1) > max_dist) return max_dist + 1;
         }
+        return score;
     }
 
-    fclose(fp);
+    // Multi-word: blocks pass their bottom-row horizontal delta down as the
+    // next block's carry-in
+    int words = mp->words;
+    uint64_t pv_stack[(MAX_WORD + WORD_BITS - 1) / WORD_BITS * 2];
+    uint64_t *pv = words * 2 <= (int)(sizeof(pv_stack) / sizeof(pv_stack[0]))
+                   ? pv_stack : (uint64_t *)malloc((size_t)words * 2 * sizeof(uint64_t));
+    if (!pv) return max_dist + 1;
+    uint64_t *mv = pv + words;
+    for (int b = 0; b < words; b++) {
+        pv[b] = ~(uint64_t)0;
+        mv[b] = 0;
+    }
+    uint64_t last = (uint64_t)1 << ((m - 1) % WORD_BITS);
+
+    int result = -1;
+    for (int j = 0; j < n && result < 0; j++) {
+        const uint64_t *eqs = mp->peq + (size_t)t[j] * words;
+        int hin = 1;
+        for (int b = 0; b < words; b++) {
+            uint64_t eq = eqs[b];
+            uint64_t hin_neg = hin < 0 ? 1 : 0;
+            uint64_t xv = eq | mv[b];
+            eq |= hin_neg;
+            uint64_t xh = (((eq & pv[b]) + pv[b]) ^ pv[b]) | eq;
+            uint64_t ph = mv[b] | ~(xh | pv[b]);
+            uint64_t mh = pv[b] & xh;
+
+            if (b == words - 1)
+                score += (ph & last) ? 1 : (mh & last) ? -1 : 0;
+            int hout = (ph & HIGH_BIT) ? 1 : (mh & HIGH_BIT) ? -1 : 0;
+
+            ph = (ph << 1) | (hin > 0 ? 1 : 0);
+            mh = (mh << 1) | hin_neg;
+            pv[b] = mh | ~(xv | ph);
+            mv[b] = ph & xv;
+            hin = hout;
+        }
+        if (score - (n - j - 1) > max_dist) result = max_dist + 1;
+    }
+
+    if (pv != pv_stack) free(pv);
+    return result >= 0 ? result : score;
+}
+
+// Prepare a streaming substring search for an initialized pattern
+int myers_scan_init(MyersScanner *sc, const MyersPattern *mp) {
+    memset(sc, 0, sizeof(*sc));
+    sc->mp = mp;
+    sc->pv = (uint64_t *)malloc((size_t)mp->words * 2 * sizeof(uint64_t));
+    if (!sc->pv) return -1;
+    sc->mv = sc->pv + mp->words;
+    for (int b = 0; b < mp->words; b++) {
+        sc->pv[b] = ~(uint64_t)0;
+        sc->mv[b] = 0;
+    }
+    sc->score = mp->m;
+    sc->best_score = -1;
     return 0;
 }
+
+void myers_scan_free(MyersScanner *sc) {
+    free(sc->pv);
+    sc->pv = sc->mv = NULL;
+}
+
+// Record the best end of a finished run of matching positions
+static int myers_scan_emit(MyersScanner *sc, size_t *ends, int max_ends, int recorded) {
+    if (sc->best_score >= 0 && recorded < max_ends)
+        ends[recorded++] = sc->best_end;
+    sc->best_score = -1;
+    return recorded;
+}
+
+// Feed the next n bytes of the text to an approximate substring search:
+// D[0][j] = 0, so the pattern may start anywhere and a match ends at every
+// byte where the bottom row is <= max_dist. Each run of consecutive matching
+// ends is reported once, at its lowest-distance offset (absolute, inclusive).
+// Stops after max_ends offsets; returns how many were stored in ends.
+int myers_scan(MyersScanner *sc, const char *text, size_t n, int max_dist, size_t *ends, int max_ends) {
+    const MyersPattern *mp = sc->mp;
+    const unsigned char *t = (const unsigned char *)text;
+    if (mp->m == 0 || max_ends <= 0) return 0;
+    int words = mp->words;
+    uint64_t last = (uint64_t)1 << ((mp->m - 1) % WORD_BITS);
+    int recorded = 0;
+
+    for (size_t j = 0; j < n; j++) {
+        const uint64_t *eqs = mp->peq + (size_t)t[j] * words;
+        int hin = 0;
+        for (int b = 0; b < words; b++) {
+            uint64_t eq = eqs[b];
+            uint64_t hin_neg = hin < 0 ? 1 : 0;
+            uint64_t xv = eq | sc->mv[b];
+            eq |= hin_neg;
+            uint64_t xh = (((eq & sc->pv[b]) + sc->pv[b]) ^ sc->pv[b]) | eq;
+            uint64_t ph = sc->mv[b] | ~(xh | sc->pv[b]);
+            uint64_t mh = sc->pv[b] & xh;
+
+            if (b == words - 1)
+                sc->score += (ph & last) ? 1 : (mh & last) ? -1 : 0;
+            int hout = (ph & HIGH_BIT) ? 1 : (mh & HIGH_BIT) ? -1 : 0;
+
+            ph = (ph << 1) | (hin > 0 ? 1 : 0);
+            mh = (mh << 1) | hin_neg;
+            sc->pv[b] = mh | ~(xv | ph);
+            sc->mv[b] = ph & xv;
+            hin = hout;
+        }
+
+        if (sc->score <= max_dist) {
+            if (sc->best_score < 0 || sc->score < sc->best_score) {
+                sc->best_score = sc->score;
+                sc->best_end = sc->pos + j;
+            }
+        } else if (sc->best_score >= 0) {
+            recorded = myers_scan_emit(sc, ends, max_ends, recorded);
+            if (recorded == max_ends) {
+                sc->pos += j + 1;
+                return recorded;
+            }
+        }
+    }
+
+    sc->pos += n;
+    return recorded;
+}
+
+// Report a run of matching ends still open at the end of the text
+int myers_scan_finish(MyersScanner *sc, size_t *ends, int max_ends) {
+    return myers_scan_emit(sc, ends, max_ends, 0);
+}
+
+// Approximate substring search over the raw file bytes, so patterns may span
+// whitespace and punctuation. Returns 1 if some region of the file is within
+// max_dist edits of the pattern.
+int approx_substring_match(const char *filepath, const char *pattern, int max_dist) {
+    MyersPattern mp;
+    MyersScanner sc;
+    if (myers_init(&mp, pattern) != 0) return 0;
+    if (mp.m == 0 || myers_scan_init(&sc, &mp) != 0) {
+        myers_free(&mp);
+        return 0;
+    }
+
+    DocView doc;
+    size_t end;
+    int found = 0;
+    if (doc_open(filepath, &doc) == 0) {
+        found = myers_scan(&sc, doc.data, doc.len, max_dist, &end, 1) > 0 ||
+                myers_scan_finish(&sc, &end, 1) > 0;
+        doc_close(&doc);
+    }
+
+    myers_scan_free(&sc);
+    myers_free(&mp);
+    return found;
+}
+
+// End offsets of every approximate substring match in data[0..len). Stores
+// the first max_offsets and returns the total count.
+int approx_substring_find_all(const char *data, size_t len, const char *pattern, int max_dist,
+                              size_t *offsets, int max_offsets) {
+    MyersPattern mp;
+    MyersScanner sc;
+    if (myers_init(&mp, pattern) != 0) return 0;
+    if (mp.m == 0 || myers_scan_init(&sc, &mp) != 0) {
+        myers_free(&mp);
+        return 0;
+    }
+
+    // Past the cap, keep scanning into a scratch batch just to count
+    size_t scratch[64];
+    int count = 0;
+    while (sc.pos < len) {
+        size_t *dst = count < max_offsets ? offsets + count : scratch;
+        int room = count < max_offsets ? max_offsets - count : 64;
+        count += myers_scan(&sc, data + sc.pos, len - sc.pos, max_dist, dst, room);
+    }
+    if (count < max_offsets)
+        count += myers_scan_finish(&sc, offsets + count, 1);
+    else
+        count += myers_scan_finish(&sc, scratch, 1);
+
+    myers_scan_free(&sc);
+    myers_free(&mp);
+    return count;
+}
+
+// Compare each whitespace-delimited word of data[0..len) that starts in
+// [from, to) with the pattern. Words are split into MAX_WORD - 1 byte pieces,
+// as fscanf("%255s") would read them, counting pieces from the start of the
+// word even when it begins before `from`. Stores the start offsets of the
+// first max_offsets matching words and returns the number of matches,
+// stopping at the first one if stop_at_first.
+static int scan_words(const MyersPattern *mp, const char *data, size_t len, size_t from, size_t to,
+                      int max_dist, size_t *offsets, int max_offsets, int stop_at_first) {
+    const unsigned char *p = (const unsigned char *)data;
+    size_t i = from;
+    while (i > 0 && !isspace(p[i - 1])) i--;
+    int count = 0;
+    while (i < len) {
+        while (i < len && isspace(p[i])) i++;
+        size_t start = i;
+        if (start >= to) break;
+        while (i < len && !isspace(p[i]) && i - start < MAX_WORD - 1) i++;
+        if (i > start && start >= from &&
+            myers_distance(mp, data + start, (int)(i - start), max_dist) <= max_dist) {
+            if (count < max_offsets)
+                offsets[count] = start;
+            count++;
+            if (stop_at_first)
+                break;
+        }
+    }
+    return count;
+}
+
+// Myers form of a CLI pattern, cut to the longest word fscanf would return
+static int init_word_pattern(MyersPattern *mp, const char *pattern) {
+    char trimmed[MAX_WORD];
+    strncpy(trimmed, pattern, MAX_WORD - 1);
+    trimmed[MAX_WORD - 1] = '\0';
+
+    // Case folding is built into the match masks, so neither the pattern nor
+    // the words need lowercasing
+    return myers_init(mp, trimmed);
+}
+
+// Start offsets of every word of data[0..len) within max_dist edits of the
+// pattern. Stores the first max_offsets and returns the total count.
+int approx_find_all(const char *data, size_t len, const char *pattern, int max_dist,
+                    size_t *offsets, int max_offsets) {
+    MyersPattern mp;
+    if (init_word_pattern(&mp, pattern) != 0) return 0;
+    int count = scan_words(&mp, data, len, 0, len, max_dist, offsets, max_offsets, 0);
+    myers_free(&mp);
+    return count;
+}
+
+int approx_match(const char *filepath, const char *pattern, int max_dist) {
+    MyersPattern mp;
+    if (init_word_pattern(&mp, pattern) != 0) return 0;
+
+    DocView doc;
+    int found = 0;
+    if (doc_open(filepath, &doc) == 0) {
+        found = scan_words(&mp, doc.data, doc.len, 0, doc.len, max_dist, NULL, 0, 1) > 0;
+        doc_close(&doc);
+    }
+
+    myers_free(&mp);
+    return found;
+}
+
+// 1 if a word starting in [start, end) of data[0..len) is within max_dist
+// edits of the pattern
+int approx_match_range(const char *data, size_t len, size_t start, size_t end,
+                       const char *pattern, int max_dist) {
+    MyersPattern mp;
+    if (init_word_pattern(&mp, pattern) != 0) return 0;
+    int found = scan_words(&mp, data, len, start, end, max_dist, NULL, 0, 1) > 0;
+    myers_free(&mp);
+    return found;
+}
+
+// 1 if an approximate substring match ends in [start, end) of data[0..len).
+// A match within max_dist edits spans at most m + max_dist bytes, so the
+// scan starts that far back to see every alignment ending in the range;
+// runs of matches ending before `start` are discarded.
+int approx_substring_match_range(const char *data, size_t len, size_t start, size_t end,
+                                 const char *pattern, int max_dist) {
+    MyersPattern mp;
+    MyersScanner sc;
+    if (myers_init(&mp, pattern) != 0) return 0;
+    if (mp.m == 0 || myers_scan_init(&sc, &mp) != 0) {
+        myers_free(&mp);
+        return 0;
+    }
+
+    if (end > len) end = len;
+    size_t lookback = (size_t)mp.m + (size_t)max_dist;
+    size_t from = start > lookback ? start - lookback : 0;
+    size_t scratch[64], end_off;
+    sc.pos = from;
+    while (sc.pos < start)
+        myers_scan(&sc, data + sc.pos, start - sc.pos, max_dist, scratch, 64);
+    sc.best_score = -1;
+
+    int found = start < end &&
+                (myers_scan(&sc, data + start, end - start, max_dist, &end_off, 1) > 0 ||
+                 myers_scan_finish(&sc, &end_off, 1) > 0);
+
+    myers_scan_free(&sc);
+    myers_free(&mp);
+    return found;
+}
@@ -1,6 +1,46 @@
 #ifndef APPROX_MATCH_H
 #define APPROX_MATCH_H
 
-int approx_match(const char *filepath, const char *pattern);
+#include <stddef.h>
+#include <stdint.h>
+
+#define MAX_WORD 256
+#define MAX_DIST 2  // default allowed Levenshtein distance
+
+// Bit-parallel form of a pattern for Myers' edit-distance algorithm
+typedef struct {
+    int m;           // pattern length
+    int words;       // 64-bit blocks per mask
+    uint64_t *peq;   // 256 * words case-folded match masks
+} MyersPattern;
+
+// Streaming state of an approximate substring search
+typedef struct {
+    const MyersPattern *mp;
+    uint64_t *pv, *mv;   // vertical delta vectors, one word per block
+    int score;           // bottom-row distance at the current position
+    size_t pos;          // absolute offset of the next byte
+    int best_score;      // lowest distance in the current run of matches, -1 if none
+    size_t best_end;
+} MyersScanner;
+
+int bounded_levenshtein(const char *s1, const char *s2, int max_dist);
+int myers_init(MyersPattern *mp, const char *pattern);
+void myers_free(MyersPattern *mp);
+int myers_distance(const MyersPattern *mp, const char *text, int n, int max_dist);
+int myers_scan_init(MyersScanner *sc, const MyersPattern *mp);
+void myers_scan_free(MyersScanner *sc);
+int myers_scan(MyersScanner *sc, const char *text, size_t n, int max_dist, size_t *ends, int max_ends);
+int myers_scan_finish(MyersScanner *sc, size_t *ends, int max_ends);
+int approx_substring_match(const char *filepath, const char *pattern, int max_dist);
+int approx_substring_find_all(const char *data, size_t len, const char *pattern, int max_dist,
+                              size_t *offsets, int max_offsets);
+int approx_substring_match_range(const char *data, size_t len, size_t start, size_t end,
+                                 const char *pattern, int max_dist);
+int approx_match(const char *filepath, const char *pattern, int max_dist);
+int approx_match_range(const char *data, size_t len, size_t start, size_t end,
+                       const char *pattern, int max_dist);
+int approx_find_all(const char *data, size_t len, const char *pattern, int max_dist,
+                    size_t *offsets, int max_offsets);
 
 #endif
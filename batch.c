@@ -0,0 +1,285 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <limits.h>
+#include <mpi.h>
+#include <omp.h>
+#include "batch.h"
+#include "exact_match.h"
+#include "matcher.h"
+#include "scheduler.h"
+#include "trace.h"
+
+// Up to this many patterns, one vectorized literal scan per pattern beats a
+// single pass through the automaton
+#define PREFILTER_MAX_PATTERNS 4
+
+// Read one pattern per line, skipping blank lines. Returns 0 on success, -1
+// if the file cannot be read or memory runs out.
+int load_patterns(const char *path, char ***patterns, int *count)
+{
+    FILE *fp = fopen(path, "r");
+    if (!fp) return -1;
+
+    char **list = NULL;
+    int n = 0, cap = 0;
+    char line[1024];
+    while (fgets(line, sizeof(line), fp))
+    {
+        line[strcspn(line, "\r\n")] = '\0';
+        if (line[0] == '\0')
+            continue;
+        if (n == cap)
+        {
+            int grown = cap ? cap * 2 : 64;
+            char **bigger = realloc(list, grown * sizeof(char *));
+            if (!bigger)
+                break;
+            list = bigger;
+            cap = grown;
+        }
+        if (!(list[n] = strdup(line)))
+            break;
+        n++;
+    }
+    int failed = !feof(fp);
+    fclose(fp);
+    if (failed)
+    {
+        free_patterns(list, n);
+        return -1;
+    }
+
+    *patterns = list;
+    *count = n;
+    return 0;
+}
+
+void free_patterns(char **patterns, int count)
+{
+    for (int i = 0; i < count; i++)
+        free(patterns[i]);
+    free(patterns);
+}
+
+// One (file, pattern) hit
+typedef struct {
+    int file;
+    int pattern;
+} BatchHit;
+
+typedef struct {
+    BatchHit *hits;
+    int count;
+    int cap;
+} HitList;
+
+static int add_hit(HitList *list, int file, int pattern)
+{
+    if (list->count == list->cap)
+    {
+        if (list->cap > INT_MAX / 2)
+            return -1;
+        int grown = list->cap ? list->cap * 2 : 256;
+        BatchHit *bigger = realloc(list->hits, grown * sizeof(BatchHit));
+        if (!bigger)
+            return -1;
+        list->hits = bigger;
+        list->cap = grown;
+    }
+    list->hits[list->count].file = file;
+    list->hits[list->count].pattern = pattern;
+    list->count++;
+    return 0;
+}
+
+static int compare_hits(const void *a, const void *b)
+{
+    const BatchHit *ha = (const BatchHit *)a;
+    const BatchHit *hb = (const BatchHit *)b;
+    if (ha->pattern != hb->pattern)
+        return ha->pattern < hb->pattern ? -1 : 1;
+    return ha->file < hb->file ? -1 : ha->file > hb->file;
+}
+
+// First of the sorted hits of pattern (count if none)
+static int first_hit(const BatchHit *hits, int count, int pattern)
+{
+    int lo = 0, hi = count;
+    while (lo < hi)
+    {
+        int mid = lo + (hi - lo) / 2;
+        if (hits[mid].pattern < pattern)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+// Collective: gather every rank's hits on rank 0 (*all, sorted by pattern
+// then file; *total of them). Returns 0, or -1 on every rank if rank 0 runs
+// out of memory or the hits overflow an int count.
+static int gather_hits(const HitList *local, int rank, int size, BatchHit **all, int *total)
+{
+    int *counts = rank == 0 ? malloc(size * sizeof(int)) : NULL;
+    int *displs = rank == 0 ? malloc(size * sizeof(int)) : NULL;
+    int ok = rank != 0 || (counts && displs);
+    MPI_Gather(&local->count, 1, MPI_INT, counts, 1, MPI_INT, 0, MPI_COMM_WORLD);
+
+    *all = NULL;
+    *total = 0;
+    if (rank == 0 && ok)
+    {
+        long long sum = 0;
+        for (int r = 0; r < size; r++)
+        {
+            displs[r] = (int)sum;
+            sum += counts[r];
+        }
+        ok = sum <= INT_MAX && (*all = malloc((sum > 0 ? sum : 1) * sizeof(BatchHit))) != NULL;
+        *total = ok ? (int)sum : 0;
+    }
+    MPI_Bcast(&ok, 1, MPI_INT, 0, MPI_COMM_WORLD);
+
+    if (ok)
+    {
+        // Counts are in hits, not ints, so they stay within range
+        MPI_Datatype hit_type;
+        MPI_Type_contiguous(2, MPI_INT, &hit_type);
+        MPI_Type_commit(&hit_type);
+        MPI_Gatherv(local->hits, local->count, hit_type, *all, counts, displs, hit_type, 0, MPI_COMM_WORLD);
+        MPI_Type_free(&hit_type);
+        if (rank == 0)
+            qsort(*all, *total, sizeof(BatchHit), compare_hits);
+    }
+    free(counts);
+    free(displs);
+    return ok ? 0 : -1;
+}
+
+// Search every pattern in one pass per file. Exact mode scans each file once
+// with a single Aho-Corasick automaton over the whole pattern set (or, for a
+// handful of patterns, with the SIMD literal scanner); approximate mode still
+// runs one matcher per pattern. Files are assigned to ranks by size
+// (assign_owners), each rank collects its (file, pattern) hits, and rank 0
+// gathers them and prints them by pattern, so memory follows the number of
+// hits rather than files x patterns. Returns the number of (pattern, file)
+// hits on rank 0 (0 elsewhere), or -1 on every rank on failure.
+int search_batch(const PathTable *files, char **patterns, int pattern_count, int mode, int rank, int size)
+{
+    int file_count = files->count;
+
+    // The automaton matches case-insensitively, so patterns that differ only
+    // in case share a trie node; report them through their first occurrence
+    int *canonical = malloc((pattern_count > 0 ? pattern_count : 1) * sizeof(int));
+    for (int p = 0; canonical && p < pattern_count; p++)
+    {
+        canonical[p] = p;
+        for (int q = 0; q < p; q++)
+        {
+            if (strcasecmp(patterns[p], patterns[q]) == 0)
+            {
+                canonical[p] = q;
+                break;
+            }
+        }
+    }
+
+    int *owner = malloc((file_count > 0 ? file_count : 1) * sizeof(int));
+    if (owner && assign_owners(files, size, owner) != 0)
+    {
+        free(owner);
+        owner = NULL;
+    }
+
+    int use_automaton = mode == 0 && pattern_count > PREFILTER_MAX_PATTERNS;
+    ACAutomaton *ac = use_automaton ? ac_build_patterns(patterns, pattern_count) : NULL;
+
+    HitList local = {NULL, 0, 0};
+    int failed = !canonical || !owner || (use_automaton && !ac);
+    if (!failed)
+    {
+#pragma omp parallel
+        {
+            unsigned char *row = malloc(pattern_count > 0 ? pattern_count : 1);
+            if (!row)
+            {
+#pragma omp atomic write
+                failed = 1;
+            }
+
+#pragma omp for schedule(dynamic)
+            for (int i = 0; i < file_count; i++)
+            {
+                if (!row || owner[i] != rank)
+                    continue;
+                memset(row, 0, pattern_count);
+                TRACE_BEGIN(scan_start);
+                if (use_automaton)
+                {
+                    exact_match_multi(path_at(files, i), ac, row);
+                }
+                else
+                {
+                    for (int p = 0; p < pattern_count; p++)
+                    {
+                        if (canonical[p] == p)
+                            row[p] = (unsigned char)do_search(path_at(files, i), patterns[p], mode);
+                    }
+                }
+                TRACE_END(scan_start, TRACE_SCAN, path_at(files, i), 0);
+
+#pragma omp critical(batch_hits)
+                for (int p = 0; p < pattern_count; p++)
+                {
+                    if (row[p] && add_hit(&local, i, p) != 0)
+                        failed = 1;
+                }
+            }
+            free(row);
+        }
+    }
+
+    if (ac)
+        ac_free(ac);
+    free(owner);
+
+    int ok = !failed;
+    MPI_Allreduce(MPI_IN_PLACE, &ok, 1, MPI_INT, MPI_LAND, MPI_COMM_WORLD);
+    BatchHit *all = NULL;
+    int hit_count = 0;
+    if (ok)
+    {
+        TRACE_BEGIN(gather_start);
+        ok = gather_hits(&local, rank, size, &all, &hit_count) == 0;
+        TRACE_END(gather_start, TRACE_GATHER, NULL, (size_t)local.count * sizeof(BatchHit));
+    }
+    free(local.hits);
+    if (!ok)
+    {
+        if (rank == 0)
+            printf("[BATCH] Out of memory\n");
+        free(canonical);
+        return -1;
+    }
+
+    int total_hits = 0;
+    if (rank == 0)
+    {
+        for (int p = 0; p < pattern_count; p++)
+        {
+            int from = first_hit(all, hit_count, canonical[p]);
+            int to = first_hit(all, hit_count, canonical[p] + 1);
+            printf("[BATCH] Pattern \"%s\": %d files\n", patterns[p], to - from);
+            for (int h = from; h < to; h++)
+                printf("[BATCH]   Found in %s\n", path_at(files, all[h].file));
+            total_hits += to - from;
+        }
+    }
+
+    free(all);
+    free(canonical);
+    return total_hits;
+}
@@ -0,0 +1,10 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include "path_table.h"
+
+int load_patterns(const char *path, char ***patterns, int *count);
+void free_patterns(char **patterns, int count);
+int search_batch(const PathTable *files, char **patterns, int pattern_count, int mode, int rank, int size);
+
+#endif
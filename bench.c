@@ -0,0 +1,197 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "bench.h"
+
+int bench_parse_format(const char *name)
+{
+    if (strcmp(name, "text") == 0) return BENCH_TEXT;
+    if (strcmp(name, "json") == 0) return BENCH_JSON;
+    if (strcmp(name, "csv") == 0) return BENCH_CSV;
+    return -1;
+}
+
+// qsort comparator for ascending doubles
+int bench_compare_doubles(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+// Median, nearest-rank 95th percentile and minimum. Sorts samples in place.
+void bench_stats(double *samples, int n, BenchStats *stats)
+{
+    memset(stats, 0, sizeof(*stats));
+    if (n <= 0)
+        return;
+
+    qsort(samples, n, sizeof(double), bench_compare_doubles);
+    stats->min = samples[0];
+    stats->median = n % 2 ? samples[n / 2] : (samples[n / 2 - 1] + samples[n / 2]) / 2.0;
+    int rank95 = (95 * n + 99) / 100;
+    stats->p95 = samples[rank95 - 1];
+}
+
+// Evict path (a file, or every file below a directory) from the page cache.
+// Dirty pages are written back first, since only clean pages can be dropped.
+// Unlike /proc/sys/vm/drop_caches this needs no privileges and leaves the
+// rest of the machine's cache alone.
+void bench_drop_caches(const char *path)
+{
+    struct stat st;
+    if (stat(path, &st) != 0)
+        return;
+
+    if (S_ISREG(st.st_mode))
+    {
+        int fd = open(path, O_RDONLY);
+        if (fd < 0)
+            return;
+        fdatasync(fd);
+        posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+        close(fd);
+        return;
+    }
+
+    if (!S_ISDIR(st.st_mode))
+        return;
+
+    DIR *d = opendir(path);
+    if (!d)
+        return;
+    struct dirent *entry;
+    char child[PATH_MAX];
+    while ((entry = readdir(d)))
+    {
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0)
+            continue;
+        if (snprintf(child, sizeof(child), "%s/%s", path, entry->d_name) < (int)sizeof(child))
+            bench_drop_caches(child);
+    }
+    closedir(d);
+}
+
+static double gb_per_second(const BenchResult *r)
+{
+    return r->search.median > 0 ? r->bytes / r->search.median / 1e9 : 0.0;
+}
+
+// Write s as a quoted JSON string
+void bench_write_json_string(FILE *out, const char *s)
+{
+    fputc('"', out);
+    for (; *s; s++)
+    {
+        unsigned char c = (unsigned char)*s;
+        if (c == '"' || c == '\\')
+            fprintf(out, "\\%c", c);
+        else if (c < 0x20)
+            fprintf(out, "\\u%04x", c);
+        else
+            fputc(c, out);
+    }
+    fputc('"', out);
+}
+
+static void write_json_stats(FILE *out, const char *name, const BenchStats *s)
+{
+    fprintf(out, "\"%s\": {\"median\": %.6f, \"p95\": %.6f, \"min\": %.6f}", name, s->median, s->p95, s->min);
+}
+
+static void write_json(FILE *out, const BenchReport *report)
+{
+    fprintf(out, "{\n  \"docs_dir\": ");
+    bench_write_json_string(out, report->docs_dir);
+    fprintf(out, ",\n  \"pattern\": ");
+    bench_write_json_string(out, report->pattern);
+    fprintf(out, ",\n  \"mode\": %d,\n  \"warmup\": %d,\n  \"iterations\": %d,\n  \"cache\": \"%s\",\n",
+            report->mode, report->warmup, report->iters, report->cold ? "cold" : "warm");
+
+    fprintf(out, "  \"methods\": [");
+    for (int m = 0; m < report->result_count; m++)
+    {
+        const BenchResult *r = &report->results[m];
+        fprintf(out, "%s\n    {\"method\": \"%s\", \"ranks\": %d, \"threads\": %d, \"found\": %d, \"bytes\": %llu,\n     ",
+                m ? "," : "", r->method, r->ranks, r->threads, r->found, r->bytes);
+        write_json_stats(out, "preprocess", &r->preprocess);
+        fprintf(out, ",\n     ");
+        write_json_stats(out, "search", &r->search);
+        fprintf(out, ",\n     ");
+        write_json_stats(out, "total", &r->total);
+        fprintf(out, ",\n     ");
+        write_json_stats(out, "first_result", &r->first);
+        fprintf(out, ",\n     \"search_gbps\": %.6f}", gb_per_second(r));
+    }
+    fprintf(out, "\n  ],\n  \"matches\": [");
+
+    int count = report->matches ? report->matches->count : 0;
+    for (int i = 0; i < count; i++)
+    {
+        fprintf(out, "%s\n    ", i ? "," : "");
+        bench_write_json_string(out, path_at(report->matches, i));
+    }
+    fprintf(out, "%s]\n}\n", count ? "\n  " : "");
+}
+
+static void write_csv(FILE *out, const BenchReport *report)
+{
+    fprintf(out, "method,ranks,threads,cache,warmup,iterations,found,bytes,"
+                 "preprocess_median,preprocess_p95,preprocess_min,"
+                 "search_median,search_p95,search_min,"
+                 "total_median,total_p95,total_min,"
+                 "first_result_median,first_result_p95,first_result_min,search_gbps\n");
+    for (int m = 0; m < report->result_count; m++)
+    {
+        const BenchResult *r = &report->results[m];
+        fprintf(out, "%s,%d,%d,%s,%d,%d,%d,%llu,%.6f,%.6f,%.6f,%.6f,%.6f,%.6f,%.6f,%.6f,%.6f,%.6f,%.6f,%.6f,%.6f\n",
+                r->method, r->ranks, r->threads, report->cold ? "cold" : "warm",
+                report->warmup, report->iters, r->found, r->bytes,
+                r->preprocess.median, r->preprocess.p95, r->preprocess.min,
+                r->search.median, r->search.p95, r->search.min,
+                r->total.median, r->total.p95, r->total.min,
+                r->first.median, r->first.p95, r->first.min, gb_per_second(r));
+    }
+}
+
+static void write_text(FILE *out, const BenchReport *report)
+{
+    fprintf(out, "=== BENCHMARK (%d iterations after %d warmup, %s cache) ===\n",
+            report->iters, report->warmup, report->cold ? "cold" : "warm");
+    fprintf(out, "Method      | Phase         | Median    | p95       | Min\n");
+    fprintf(out, "------------|---------------|-----------|-----------|----------\n");
+    for (int m = 0; m < report->result_count; m++)
+    {
+        const BenchResult *r = &report->results[m];
+        const char *phases[4] = {"Preprocessing", "Search", "Total", "First result"};
+        const BenchStats *stats[4] = {&r->preprocess, &r->search, &r->total, &r->first};
+        for (int p = 0; p < 4; p++)
+        {
+            fprintf(out, "%-11s | %-13s | %8.4f  | %8.4f  | %8.4f\n",
+                    p ? "" : r->method, phases[p], stats[p]->median, stats[p]->p95, stats[p]->min);
+        }
+    }
+
+    fprintf(out, "\nMethod      | Ranks | Threads | Found | Scanned MB | Search GB/s\n");
+    fprintf(out, "------------|-------|---------|-------|------------|------------\n");
+    for (int m = 0; m < report->result_count; m++)
+    {
+        const BenchResult *r = &report->results[m];
+        fprintf(out, "%-11s | %5d | %7d | %5d | %10.1f | %10.3f\n",
+                r->method, r->ranks, r->threads, r->found, r->bytes / 1e6, gb_per_second(r));
+    }
+}
+
+void bench_write(FILE *out, int format, const BenchReport *report)
+{
+    if (format == BENCH_JSON)
+        write_json(out, report);
+    else if (format == BENCH_CSV)
+        write_csv(out, report);
+    else
+        write_text(out, report);
+}
@@ -0,0 +1,51 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <stdio.h>
+#include "path_table.h"
+
+#define DEFAULT_BENCH_WARMUP 1
+#define DEFAULT_BENCH_ITERS 5
+
+enum { BENCH_TEXT, BENCH_JSON, BENCH_CSV };
+
+// Summary of one phase over the measured iterations
+typedef struct {
+    double median;
+    double p95;
+    double min;
+} BenchStats;
+
+// One benchmarked method
+typedef struct {
+    const char *method;
+    int ranks;
+    int threads;                // OpenMP threads per rank
+    int found;                  // files found in the last iteration
+    unsigned long long bytes;   // text bytes searched per iteration
+    BenchStats preprocess;
+    BenchStats search;
+    BenchStats total;
+    BenchStats first;           // until the first match (total if none)
+} BenchResult;
+
+typedef struct {
+    const char *docs_dir;
+    const char *pattern;
+    int mode;
+    int warmup;
+    int iters;
+    int cold;                   // page cache dropped before every iteration
+    const BenchResult *results;
+    int result_count;
+    const PathTable *matches;   // files found by the first method
+} BenchReport;
+
+int bench_parse_format(const char *name);
+int bench_compare_doubles(const void *a, const void *b);
+void bench_write_json_string(FILE *out, const char *s);
+void bench_stats(double *samples, int n, BenchStats *stats);
+void bench_drop_caches(const char *path);
+void bench_write(FILE *out, int format, const BenchReport *report);
+
+#endif
@@ -0,0 +1,186 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <sys/stat.h>
+#include <omp.h>
+#include "synth.h"
+
+// Deterministic synthetic corpus: text files with log-normally distributed
+// sizes and a Zipfian vocabulary, with a pattern planted exactly in some files
+// and as a fuzzy variant in others. truth.csv records what went where, so
+// search results can be checked against it.
+
+#define FILES_PER_DIR 1000
+#define MIN_FILE_BYTES 64
+#define MAX_VARIANT_TRIES 64
+
+typedef struct {
+    const char *out_dir;
+    int files;
+    double median_kb;
+    double sigma;
+    int vocab_size;
+    double zipf_s;
+    char pattern[256];
+    double exact_fraction;
+    double fuzzy_fraction;
+    int edits;
+    int per_file;
+    unsigned long long seed;
+} CorpusSpec;
+
+typedef struct {
+    size_t bytes;
+    int exact;
+    int fuzzy;
+} FileTruth;
+
+static void usage(void)
+{
+    printf("Usage: gen_corpus <out_dir> [--files=<n>] [--size-kb=<median>] [--sigma=<s>] "
+           "[--vocab=<words>] [--zipf=<s>] [--pattern=<text>] [--exact=<fraction>] "
+           "[--fuzzy=<fraction>] [--edits=<k>] [--per-file=<n>] [--seed=<n>]\n");
+}
+
+// Variant within spec->edits edits of the pattern that does not contain it,
+// so an exact search never finds a fuzzy plant
+static void fuzzy_variant(const CorpusSpec *spec, SynthRng *rng, char *out, size_t size)
+{
+    for (int t = 0; t < MAX_VARIANT_TRIES; t++)
+    {
+        synth_mutate(rng, spec->pattern, spec->edits, out, size);
+        if (!strstr(out, spec->pattern))
+            return;
+    }
+}
+
+// Generate file i (its own random stream, so files can be made in parallel)
+static int generate_file(const CorpusSpec *spec, const SynthVocab *vocab, int i, FileTruth *truth)
+{
+    SynthRng rng;
+    synth_seed(&rng, spec->seed * 0x100000001b3ULL + (unsigned long long)i);
+
+    double kb = spec->median_kb * exp(spec->sigma * synth_normal(&rng));
+    size_t len = (size_t)(kb * 1024.0);
+    if (len < MIN_FILE_BYTES)
+        len = MIN_FILE_BYTES;
+
+    char *buf = malloc(len);
+    if (!buf)
+        return -1;
+    synth_text(&rng, vocab, buf, len);
+
+    // Fuzzy first, so exact plants are never overwritten by a variant
+    memset(truth, 0, sizeof(*truth));
+    truth->bytes = len;
+    if (synth_uniform(&rng) < spec->fuzzy_fraction)
+    {
+        char variant[512];
+        for (int n = 0; n < spec->per_file; n++)
+        {
+            fuzzy_variant(spec, &rng, variant, sizeof(variant));
+            truth->fuzzy += synth_plant(&rng, buf, len, variant, 1);
+        }
+    }
+    if (synth_uniform(&rng) < spec->exact_fraction)
+        truth->exact = synth_plant(&rng, buf, len, spec->pattern, spec->per_file);
+
+    char path[4096];
+    snprintf(path, sizeof(path), "%s/%03d", spec->out_dir, i / FILES_PER_DIR);
+    mkdir(path, 0755);
+    snprintf(path, sizeof(path), "%s/%03d/doc%07d.txt", spec->out_dir, i / FILES_PER_DIR, i);
+    FILE *fp = fopen(path, "wb");
+    int rc = fp && fwrite(buf, 1, len, fp) == len ? 0 : -1;
+    if (fp)
+        fclose(fp);
+    free(buf);
+    return rc;
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc < 2 || argv[1][0] == '-')
+    {
+        usage();
+        return 1;
+    }
+
+    CorpusSpec spec = {argv[1], 100, 64.0, 1.0, 20000, 1.0, "", 0.1, 0.1, 2, 1, 1};
+    for (int i = 2; i < argc; i++)
+    {
+        if (strncmp(argv[i], "--files=", 8) == 0 && atoi(argv[i] + 8) > 0)
+            spec.files = atoi(argv[i] + 8);
+        else if (strncmp(argv[i], "--size-kb=", 10) == 0 && atof(argv[i] + 10) > 0)
+            spec.median_kb = atof(argv[i] + 10);
+        else if (strncmp(argv[i], "--sigma=", 8) == 0 && atof(argv[i] + 8) >= 0)
+            spec.sigma = atof(argv[i] + 8);
+        else if (strncmp(argv[i], "--vocab=", 8) == 0 && atoi(argv[i] + 8) > 0)
+            spec.vocab_size = atoi(argv[i] + 8);
+        else if (strncmp(argv[i], "--zipf=", 7) == 0 && atof(argv[i] + 7) >= 0)
+            spec.zipf_s = atof(argv[i] + 7);
+        else if (strncmp(argv[i], "--pattern=", 10) == 0 && argv[i][10] != '\0')
+            snprintf(spec.pattern, sizeof(spec.pattern), "%s", argv[i] + 10);
+        else if (strncmp(argv[i], "--exact=", 8) == 0)
+            spec.exact_fraction = atof(argv[i] + 8);
+        else if (strncmp(argv[i], "--fuzzy=", 8) == 0)
+            spec.fuzzy_fraction = atof(argv[i] + 8);
+        else if (strncmp(argv[i], "--edits=", 8) == 0 && atoi(argv[i] + 8) > 0)
+            spec.edits = atoi(argv[i] + 8);
+        else if (strncmp(argv[i], "--per-file=", 11) == 0 && atoi(argv[i] + 11) > 0)
+            spec.per_file = atoi(argv[i] + 11);
+        else if (strncmp(argv[i], "--seed=", 7) == 0)
+            spec.seed = strtoull(argv[i] + 7, NULL, 10);
+        else
+        {
+            usage();
+            return 1;
+        }
+    }
+
+    SynthRng rng;
+    synth_seed(&rng, spec.seed);
+    if (spec.pattern[0] == '\0')
+        synth_pattern(&rng, spec.pattern, 8);
+
+    mkdir(spec.out_dir, 0755);
+    SynthVocab vocab;
+    if (synth_vocab_init(&vocab, spec.vocab_size, spec.zipf_s, &rng) != 0)
+    {
+        printf("Out of memory building the vocabulary\n");
+        return 1;
+    }
+
+    FileTruth *truth = calloc(spec.files, sizeof(FileTruth));
+    int failed = 0;
+#pragma omp parallel for schedule(dynamic) reduction(+:failed)
+    for (int i = 0; i < spec.files; i++)
+        failed += generate_file(&spec, &vocab, i, &truth[i]) != 0;
+
+    char path[4096];
+    snprintf(path, sizeof(path), "%s/truth.csv", spec.out_dir);
+    FILE *fp = fopen(path, "w");
+    size_t total = 0;
+    int exact_files = 0, fuzzy_files = 0;
+    if (fp)
+        fprintf(fp, "path,bytes,exact,fuzzy\n");
+    for (int i = 0; i < spec.files; i++)
+    {
+        total += truth[i].bytes;
+        exact_files += truth[i].exact > 0;
+        fuzzy_files += truth[i].fuzzy > 0;
+        if (fp)
+            fprintf(fp, "%s/%03d/doc%07d.txt,%zu,%d,%d\n", spec.out_dir, i / FILES_PER_DIR, i,
+                    truth[i].bytes, truth[i].exact, truth[i].fuzzy);
+    }
+    if (fp)
+        fclose(fp);
+
+    printf("Wrote %d files (%.1f MB) to %s: pattern \"%s\" planted exactly in %d files, "
+           "within %d edits in %d files\n",
+           spec.files - failed, total / 1e6, spec.out_dir, spec.pattern, exact_files, spec.edits, fuzzy_files);
+
+    free(truth);
+    synth_vocab_free(&vocab);
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,410 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "synth.h"
+#include "exact_match.h"
+#include "approx_match.h"
+#include "simd_scan.h"
+#include "index.h"
+#include "postings.h"
+#include "doc_reader.h"
+#include "bench.h"
+
+// Matching kernels timed in isolation on synthetic in-memory text, across
+// input sizes, pattern lengths and planted hit densities. Exact kernels see
+// exact plants; approximate kernels see variants within MAX_DIST edits.
+
+#define AC_PATTERNS 16
+#define DEFAULT_MIN_TIME 0.1
+#define MIN_REPS 3
+#define MAX_REPS 1000
+#define BENCH_SEED 42
+#define VOCAB_SIZE 20000
+#define ZIPF_S 1.0
+#define TOKENIZE_DOC "/bench/tokenize.txt"
+#define TOKENIZE_INDEX "/tmp/bench_kernels.idx"
+
+static const size_t default_sizes[] = {64 << 10, 4 << 20};
+static const int default_lengths[] = {4, 8, 16, 64};
+static const int default_densities[] = {0, 16, 1024};  // planted hits per MiB
+
+// One text buffer prepared for every kernel
+typedef struct {
+    const char *data;
+    size_t len;
+    char **patterns;       // patterns[0] is the one planted
+    const char *pattern;
+    ACAutomaton *ac;       // over all AC_PATTERNS patterns
+    MyersPattern mp;
+    char **words;          // whitespace-delimited words, NUL-terminated
+    int *word_lens;
+    int word_count;
+    char **lines;          // lines, NUL-terminated
+    int line_count;
+    char *split;           // backing store of words and lines
+    char *line_split;
+    unsigned char *postings[CODEC_COUNT];  // one list, in every codec
+    uint32_t posting_count;
+    uint32_t *decoded;
+} KernelInput;
+
+typedef struct {
+    const char *name;
+    long (*run)(const KernelInput *in);
+    int fuzzy;             // runs on the buffer with approximate plants
+    int per_pattern;       // 0: independent of the pattern, run once per buffer
+} Kernel;
+
+static long k_literal(const KernelInput *in)
+{
+    return exact_find_all(in->data, in->len, in->pattern, NULL, 0);
+}
+
+static long k_ac_scan(const KernelInput *in)
+{
+    unsigned char hits[AC_PATTERNS] = {0};
+    int32_t state = 0;
+    return ac_scan(in->ac, in->data, in->len, &state, hits);
+}
+
+static long k_ac_search_line(const KernelInput *in)
+{
+    long found = 0;
+    for (int i = 0; i < in->line_count; i++)
+        found += ac_search_line(in->ac, in->lines[i]);
+    return found;
+}
+
+static long k_bounded_levenshtein(const KernelInput *in)
+{
+    long found = 0;
+    for (int i = 0; i < in->word_count; i++)
+        found += bounded_levenshtein(in->words[i], in->pattern, MAX_DIST) <= MAX_DIST;
+    return found;
+}
+
+static long k_myers_distance(const KernelInput *in)
+{
+    long found = 0;
+    for (int i = 0; i < in->word_count; i++)
+        found += myers_distance(&in->mp, in->words[i], in->word_lens[i], MAX_DIST) <= MAX_DIST;
+    return found;
+}
+
+static long k_approx_words(const KernelInput *in)
+{
+    return approx_find_all(in->data, in->len, in->pattern, MAX_DIST, NULL, 0);
+}
+
+static long k_approx_substring(const KernelInput *in)
+{
+    return approx_substring_find_all(in->data, in->len, in->pattern, MAX_DIST, NULL, 0);
+}
+
+// The index tokenizer (lowercasing, vocabulary hashing and writing the index)
+static long k_index_build(const KernelInput *in)
+{
+    PathTable files;
+    path_table_init(&files);
+    path_table_add(&files, TOKENIZE_DOC);
+    int rc = index_build(&files, TOKENIZE_INDEX);
+    path_table_free(&files);
+    return rc == 0 ? in->word_count : -1;
+}
+
+// Decode the whole posting list of the input (doc and frequency per word)
+static long decode_postings(const KernelInput *in, PostingCodec codec)
+{
+    postings_decode(codec, in->postings[codec], in->posting_count, in->decoded, in->decoded + in->posting_count);
+    return in->posting_count ? (long)in->decoded[in->posting_count - 1] : 0;
+}
+
+static long k_postings_raw(const KernelInput *in)
+{
+    return decode_postings(in, CODEC_RAW);
+}
+
+static long k_postings_varint(const KernelInput *in)
+{
+    return decode_postings(in, CODEC_VARINT);
+}
+
+static long k_postings_bp128(const KernelInput *in)
+{
+    return decode_postings(in, CODEC_BP128);
+}
+
+static const Kernel kernels[] = {
+    {"literal_find", k_literal, 0, 1},
+    {"ac_scan", k_ac_scan, 0, 1},
+    {"ac_search_line", k_ac_search_line, 0, 1},
+    {"bounded_levenshtein", k_bounded_levenshtein, 1, 1},
+    {"myers_distance", k_myers_distance, 1, 1},
+    {"approx_words", k_approx_words, 1, 1},
+    {"approx_substring", k_approx_substring, 1, 1},
+    {"index_build", k_index_build, 0, 0},
+    {"postings_raw", k_postings_raw, 0, 0},
+    {"postings_varint", k_postings_varint, 0, 0},
+    {"postings_bp128", k_postings_bp128, 0, 0},
+};
+#define KERNEL_COUNT ((int)(sizeof(kernels) / sizeof(kernels[0])))
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Run a kernel at least MIN_REPS times and for at least min_time seconds;
+// returns the median time of one run
+static double time_kernel(const Kernel *k, const KernelInput *in, double min_time, long *result)
+{
+    static double samples[MAX_REPS];
+    int reps = 0;
+    double start = now();
+    while (reps < MAX_REPS && (reps < MIN_REPS || now() - start < min_time))
+    {
+        double t0 = now();
+        *result = k->run(in);
+        samples[reps++] = now() - t0;
+    }
+    qsort(samples, reps, sizeof(double), bench_compare_doubles);
+    return samples[reps / 2];
+}
+
+// Split a copy of data into NUL-terminated pieces at any of the delimiters
+static char *split_text(const char *data, size_t len, const char *delims, char ***pieces, int *count)
+{
+    char *copy = malloc(len + 1);
+    memcpy(copy, data, len);
+    copy[len] = '\0';
+
+    int cap = 1024, n = 0;
+    char **list = malloc(cap * sizeof(char *));
+    char *save;
+    for (char *tok = strtok_r(copy, delims, &save); tok; tok = strtok_r(NULL, delims, &save))
+    {
+        if (n == cap)
+        {
+            cap *= 2;
+            list = realloc(list, cap * sizeof(char *));
+        }
+        list[n++] = tok;
+    }
+    *pieces = list;
+    *count = n;
+    return copy;
+}
+
+static void input_init(KernelInput *in, const char *data, size_t len, char **patterns)
+{
+    memset(in, 0, sizeof(*in));
+    in->data = data;
+    in->len = len;
+    in->patterns = patterns;
+    in->pattern = patterns[0];
+    in->ac = ac_build_patterns(patterns, AC_PATTERNS);
+    myers_init(&in->mp, in->pattern);
+
+    in->split = split_text(data, len, " \n", &in->words, &in->word_count);
+    in->word_lens = malloc((in->word_count + 1) * sizeof(int));
+    for (int i = 0; i < in->word_count; i++)
+        in->word_lens[i] = (int)strlen(in->words[i]);
+    in->line_split = split_text(data, len, "\n", &in->lines, &in->line_count);
+
+    // A term's postings: every word is a document, and the term occurs in
+    // those starting like the first word (lengths stand in for frequencies)
+    uint32_t *ids = malloc((in->word_count + 1) * sizeof(uint32_t));
+    uint32_t *tfs = malloc((in->word_count + 1) * sizeof(uint32_t));
+    for (int i = 0; i < in->word_count; i++)
+    {
+        if (in->words[i][0] == in->words[0][0])
+        {
+            ids[in->posting_count] = (uint32_t)i;
+            tfs[in->posting_count++] = (uint32_t)in->word_lens[i];
+        }
+    }
+    for (int c = 0; c < CODEC_COUNT; c++)
+    {
+        in->postings[c] = malloc(postings_bound(in->posting_count));
+        postings_encode((PostingCodec)c, ids, tfs, in->posting_count, in->postings[c]);
+    }
+    in->decoded = malloc((2 * (size_t)in->posting_count + 1) * sizeof(uint32_t));
+    free(ids);
+    free(tfs);
+}
+
+static void input_free(KernelInput *in)
+{
+    if (in->ac)
+        ac_free(in->ac);
+    myers_free(&in->mp);
+    free(in->words);
+    free(in->word_lens);
+    free(in->lines);
+    free(in->split);
+    free(in->line_split);
+    for (int c = 0; c < CODEC_COUNT; c++)
+        free(in->postings[c]);
+    free(in->decoded);
+}
+
+static void usage(void)
+{
+    printf("Usage: bench_kernels [--kernel=<name>] [--size=<bytes>] [--length=<n>] "
+           "[--density=<hits per MiB>] [--min-time=<seconds>] [--csv]\n");
+}
+
+int main(int argc, char *argv[])
+{
+    const char *only = NULL;
+    size_t sizes[8];
+    int lengths[8], densities[8];
+    int size_count = 0, length_count = 0, density_count = 0;
+    double min_time = DEFAULT_MIN_TIME;
+    int csv = 0;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strncmp(argv[i], "--kernel=", 9) == 0)
+            only = argv[i] + 9;
+        else if (strncmp(argv[i], "--size=", 7) == 0 && atol(argv[i] + 7) > 0 && size_count < 8)
+            sizes[size_count++] = (size_t)atol(argv[i] + 7);
+        else if (strncmp(argv[i], "--length=", 9) == 0 && atoi(argv[i] + 9) > 0 && length_count < 8)
+            lengths[length_count++] = atoi(argv[i] + 9);
+        else if (strncmp(argv[i], "--density=", 10) == 0 && atoi(argv[i] + 10) >= 0 && density_count < 8)
+            densities[density_count++] = atoi(argv[i] + 10);
+        else if (strncmp(argv[i], "--min-time=", 11) == 0 && atof(argv[i] + 11) > 0)
+            min_time = atof(argv[i] + 11);
+        else if (strcmp(argv[i], "--csv") == 0)
+            csv = 1;
+        else
+        {
+            usage();
+            return 1;
+        }
+    }
+    if (size_count == 0)
+    {
+        size_count = sizeof(default_sizes) / sizeof(default_sizes[0]);
+        memcpy(sizes, default_sizes, sizeof(default_sizes));
+    }
+    if (length_count == 0)
+    {
+        length_count = sizeof(default_lengths) / sizeof(default_lengths[0]);
+        memcpy(lengths, default_lengths, sizeof(default_lengths));
+    }
+    if (density_count == 0)
+    {
+        density_count = sizeof(default_densities) / sizeof(default_densities[0]);
+        memcpy(densities, default_densities, sizeof(default_densities));
+    }
+
+    SynthRng rng;
+    synth_seed(&rng, BENCH_SEED);
+    SynthVocab vocab;
+    if (synth_vocab_init(&vocab, VOCAB_SIZE, ZIPF_S, &rng) != 0)
+        return 1;
+
+    if (csv)
+        printf("kernel,bytes,pattern_len,hits_per_mib,matches,median_ms,mb_per_s\n");
+    else
+    {
+        printf("Literal scanner backend: %s\n", literal_scanner_backend());
+        printf("Postings decoder backend: %s\n", postings_backend());
+        printf("%-20s | %9s | %3s | %8s | %8s | %10s | %9s\n",
+               "Kernel", "Bytes", "Len", "Hits/MiB", "Matches", "Median ms", "MB/s");
+        printf("---------------------|-----------|-----|----------|----------|------------|----------\n");
+    }
+
+    for (int s = 0; s < size_count; s++)
+    {
+        size_t len = sizes[s];
+        char *base = malloc(len);
+        char *exact_buf = malloc(len);
+        char *fuzzy_buf = malloc(len);
+        synth_seed(&rng, BENCH_SEED + len);
+        synth_text(&rng, &vocab, base, len);
+
+        for (int l = 0; l < length_count; l++)
+        {
+            int plen = lengths[l];
+            if (plen >= MAX_WORD - MAX_DIST)
+                continue;
+            // Seeded per case, so filtering the matrix does not change the data
+            synth_seed(&rng, (BENCH_SEED + len) * 31 + plen);
+            char *patterns[AC_PATTERNS];
+            for (int p = 0; p < AC_PATTERNS; p++)
+            {
+                patterns[p] = malloc(plen + 1);
+                synth_pattern(&rng, patterns[p], plen);
+            }
+
+            for (int d = 0; d < density_count; d++)
+            {
+                int plants = (int)((double)densities[d] * len / (1 << 20) + 0.5);
+                memcpy(exact_buf, base, len);
+                memcpy(fuzzy_buf, base, len);
+                synth_plant(&rng, exact_buf, len, patterns[0], plants);
+                char variant[MAX_WORD];
+                for (int n = 0; n < plants; n++)
+                {
+                    synth_mutate(&rng, patterns[0], MAX_DIST, variant, sizeof(variant));
+                    synth_plant(&rng, fuzzy_buf, len, variant, 1);
+                }
+
+                KernelInput exact_in, fuzzy_in;
+                input_init(&exact_in, exact_buf, len, patterns);
+                input_init(&fuzzy_in, fuzzy_buf, len, patterns);
+
+                for (int k = 0; k < KERNEL_COUNT; k++)
+                {
+                    const Kernel *kernel = &kernels[k];
+                    if (only && strcmp(only, kernel->name) != 0)
+                        continue;
+                    if (!kernel->per_pattern && l > 0)
+                        continue;
+
+                    const KernelInput *in = kernel->fuzzy ? &fuzzy_in : &exact_in;
+                    if (!kernel->per_pattern)
+                    {
+                        char *copy = malloc(len);
+                        memcpy(copy, in->data, len);
+                        doc_register(TOKENIZE_DOC, copy, len);
+                    }
+
+                    long matches;
+                    double t = time_kernel(kernel, in, min_time, &matches);
+                    double mbps = t > 0 ? len / t / 1e6 : 0.0;
+                    if (csv)
+                        printf("%s,%zu,%d,%d,%ld,%.4f,%.1f\n", kernel->name, len,
+                               kernel->per_pattern ? plen : 0, densities[d], matches, t * 1e3, mbps);
+                    else
+                        printf("%-20s | %9zu | %3d | %8d | %8ld | %10.4f | %9.1f\n", kernel->name, len,
+                               kernel->per_pattern ? plen : 0, densities[d], matches, t * 1e3, mbps);
+                    fflush(stdout);
+
+                    if (!kernel->per_pattern)
+                        doc_unregister_all();
+                }
+
+                input_free(&exact_in);
+                input_free(&fuzzy_in);
+            }
+
+            for (int p = 0; p < AC_PATTERNS; p++)
+                free(patterns[p]);
+        }
+
+        free(base);
+        free(exact_buf);
+        free(fuzzy_buf);
+    }
+
+    unlink(TOKENIZE_INDEX);
+    synth_vocab_free(&vocab);
+    return 0;
+}
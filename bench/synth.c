@@ -0,0 +1,194 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "synth.h"
+
+#define VOCAB_ALPHABET "abcdefghijklmnop"
+#define MIN_WORD_LEN 2
+#define MAX_WORD_LEN 10
+#define WORDS_PER_LINE 12
+
+void synth_seed(SynthRng *rng, uint64_t seed)
+{
+    rng->state = seed;
+}
+
+// splitmix64
+uint64_t synth_next(SynthRng *rng)
+{
+    uint64_t z = (rng->state += 0x9e3779b97f4a7c15ULL);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+// Uniform in [0, 1)
+double synth_uniform(SynthRng *rng)
+{
+    return (synth_next(rng) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+// Standard normal (Box-Muller)
+double synth_normal(SynthRng *rng)
+{
+    double u1 = synth_uniform(rng), u2 = synth_uniform(rng);
+    if (u1 < 1e-300) u1 = 1e-300;
+    return sqrt(-2.0 * log(u1)) * cos(2.0 * M_PI * u2);
+}
+
+int synth_vocab_init(SynthVocab *v, int size, double zipf_s, SynthRng *rng)
+{
+    v->count = size;
+    v->words = calloc(size, sizeof(char *));
+    v->cdf = malloc(size * sizeof(double));
+    if (!v->words || !v->cdf)
+    {
+        synth_vocab_free(v);
+        return -1;
+    }
+
+    int letters = (int)strlen(VOCAB_ALPHABET);
+    double sum = 0.0;
+    for (int r = 0; r < size; r++)
+    {
+        int len = MIN_WORD_LEN + (int)(synth_next(rng) % (MAX_WORD_LEN - MIN_WORD_LEN + 1));
+        v->words[r] = malloc(len + 1);
+        if (!v->words[r])
+        {
+            synth_vocab_free(v);
+            return -1;
+        }
+        for (int k = 0; k < len; k++)
+            v->words[r][k] = VOCAB_ALPHABET[synth_next(rng) % letters];
+        v->words[r][len] = '\0';
+
+        sum += 1.0 / pow(r + 1, zipf_s);
+        v->cdf[r] = sum;
+    }
+    for (int r = 0; r < size; r++)
+        v->cdf[r] /= sum;
+    return 0;
+}
+
+void synth_vocab_free(SynthVocab *v)
+{
+    if (v->words)
+    {
+        for (int r = 0; r < v->count; r++)
+            free(v->words[r]);
+    }
+    free(v->words);
+    free(v->cdf);
+    v->words = NULL;
+    v->cdf = NULL;
+    v->count = 0;
+}
+
+// Draw a word by rank (binary search of the cumulative distribution)
+const char *synth_word(const SynthVocab *v, SynthRng *rng)
+{
+    double u = synth_uniform(rng);
+    int lo = 0, hi = v->count - 1;
+    while (lo < hi)
+    {
+        int mid = (lo + hi) / 2;
+        if (v->cdf[mid] < u)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return v->words[lo];
+}
+
+// Fill buf[0..len) with vocabulary words, WORDS_PER_LINE to a line
+void synth_text(SynthRng *rng, const SynthVocab *v, char *buf, size_t len)
+{
+    size_t pos = 0;
+    int on_line = 0;
+    while (pos < len)
+    {
+        const char *w = synth_word(v, rng);
+        size_t wlen = strlen(w);
+        if (pos + wlen + 1 > len)
+            break;
+        memcpy(buf + pos, w, wlen);
+        pos += wlen;
+        buf[pos++] = ++on_line == WORDS_PER_LINE ? '\n' : ' ';
+        if (on_line == WORDS_PER_LINE)
+            on_line = 0;
+    }
+    memset(buf + pos, ' ', len - pos);
+    if (len > 0)
+        buf[len - 1] = '\n';
+}
+
+// Random pattern of len letters that never occur in vocabulary text
+void synth_pattern(SynthRng *rng, char *out, int len)
+{
+    int letters = (int)strlen(SYNTH_PATTERN_ALPHABET);
+    for (int k = 0; k < len; k++)
+        out[k] = SYNTH_PATTERN_ALPHABET[synth_next(rng) % letters];
+    out[len] = '\0';
+}
+
+// Copy of pattern with `edits` random substitutions, insertions and
+// deletions, so it lies within `edits` Levenshtein distance of the original
+void synth_mutate(SynthRng *rng, const char *pattern, int edits, char *out, size_t size)
+{
+    int letters = (int)strlen(SYNTH_PATTERN_ALPHABET);
+    snprintf(out, size, "%s", pattern);
+    for (int e = 0; e < edits; e++)
+    {
+        size_t n = strlen(out);
+        int op = (int)(synth_next(rng) % 3);
+        if (n <= 1 && op == 2)
+            op = 1;
+        if (n + 1 >= size && op == 1)
+            op = 0;
+        size_t at = (size_t)(synth_next(rng) % (n + (op == 1)));
+
+        if (op == 0 && n > 0)
+        {
+            char c;
+            do
+                c = SYNTH_PATTERN_ALPHABET[synth_next(rng) % letters];
+            while (c == out[at]);
+            out[at] = c;
+        }
+        else if (op == 1)
+        {
+            memmove(out + at + 1, out + at, n - at + 1);
+            out[at] = SYNTH_PATTERN_ALPHABET[synth_next(rng) % letters];
+        }
+        else if (op == 2)
+        {
+            memmove(out + at, out + at + 1, n - at);
+        }
+    }
+}
+
+// Overwrite count random words of buf[0..len) with text, each followed by a
+// space. Returns the number planted (positions too close to the end are
+// skipped; later plants may overwrite earlier ones at high densities).
+int synth_plant(SynthRng *rng, char *buf, size_t len, const char *text, int count)
+{
+    size_t tlen = strlen(text);
+    if (len < tlen + 2)
+        return 0;
+
+    int planted = 0;
+    for (int n = 0; n < count; n++)
+    {
+        size_t pos = (size_t)(synth_next(rng) % (len - tlen - 1));
+        while (pos > 0 && pos < len && buf[pos - 1] != ' ' && buf[pos - 1] != '\n')
+            pos++;
+        if (pos + tlen + 1 >= len)
+            continue;
+        memcpy(buf + pos, text, tlen);
+        if (buf[pos + tlen] != '\n')
+            buf[pos + tlen] = ' ';
+        planted++;
+    }
+    return planted;
+}
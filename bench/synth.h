@@ -0,0 +1,40 @@
+#ifndef SYNTH_H
+#define SYNTH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Deterministic synthetic text shared by the corpus generator and the kernel
+// microbenchmarks. Vocabulary words use only the letters a-p and planted
+// patterns only q-z, so a pattern never occurs by accident: every hit in the
+// generated text is one that was planted.
+
+#define SYNTH_PATTERN_ALPHABET "qrstuvwxyz"
+
+typedef struct {
+    uint64_t state;
+} SynthRng;
+
+// Vocabulary with Zipfian word frequencies: rank r is drawn with probability
+// proportional to 1 / r^s
+typedef struct {
+    char **words;
+    int count;
+    double *cdf;
+} SynthVocab;
+
+void synth_seed(SynthRng *rng, uint64_t seed);
+uint64_t synth_next(SynthRng *rng);
+double synth_uniform(SynthRng *rng);
+double synth_normal(SynthRng *rng);
+
+int synth_vocab_init(SynthVocab *v, int size, double zipf_s, SynthRng *rng);
+void synth_vocab_free(SynthVocab *v);
+const char *synth_word(const SynthVocab *v, SynthRng *rng);
+
+void synth_text(SynthRng *rng, const SynthVocab *v, char *buf, size_t len);
+void synth_pattern(SynthRng *rng, char *out, int len);
+void synth_mutate(SynthRng *rng, const char *pattern, int edits, char *out, size_t size);
+int synth_plant(SynthRng *rng, char *buf, size_t len, const char *text, int count);
+
+#endif
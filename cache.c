@@ -0,0 +1,296 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include "cache.h"
+#include "doc_reader.h"
+#include "extract.h"
+
+// Extracted text is stored once per distinct source content as
+// <dir>/<hash>-v<extractor version>.txt. The manifest maps a source path to the size, mtime and
+// content hash it had when last seen; it is append-only, later lines win, and
+// every process appends with a single O_APPEND write per line, so ranks,
+// threads and runs can share it.
+
+#define MANIFEST_BUCKETS 4096
+
+typedef struct ManifestEntry {
+    char *path;
+    long long size;
+    long long mtime_ns;
+    uint64_t hash;
+    struct ManifestEntry *next;
+} ManifestEntry;
+
+static char cache_dir[PATH_MAX] = DEFAULT_CACHE_DIR;
+static int cache_enabled = 1;
+static int cache_loaded = 0;
+static ManifestEntry *manifest[MANIFEST_BUCKETS];
+static pthread_mutex_t cache_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static unsigned path_bucket(const char *path)
+{
+    unsigned h = 2166136261u;
+    for (const unsigned char *p = (const unsigned char *)path; *p; p++)
+        h = (h ^ *p) * 16777619u;
+    return h % MANIFEST_BUCKETS;
+}
+
+// Use dir for the cache, or disable caching with NULL. Call before the first
+// fetch.
+void cache_set_dir(const char *dir)
+{
+    cache_enabled = dir != NULL;
+    if (dir)
+        snprintf(cache_dir, sizeof(cache_dir), "%s", dir);
+}
+
+// Directory holding the cache, or NULL with caching off
+const char *cache_get_dir(void)
+{
+    return cache_enabled ? cache_dir : NULL;
+}
+
+// Insert or update a manifest entry (cache_lock held)
+static void manifest_put(const char *path, long long size, long long mtime_ns, uint64_t hash)
+{
+    unsigned b = path_bucket(path);
+    ManifestEntry *e;
+    for (e = manifest[b]; e; e = e->next) {
+        if (strcmp(e->path, path) == 0)
+            break;
+    }
+    if (!e) {
+        e = malloc(sizeof(ManifestEntry));
+        if (!e) return;
+        e->path = strdup(path);
+        if (!e->path) {
+            free(e);
+            return;
+        }
+        e->next = manifest[b];
+        manifest[b] = e;
+    }
+    e->size = size;
+    e->mtime_ns = mtime_ns;
+    e->hash = hash;
+}
+
+// Create the cache directory and read the manifest (cache_lock held)
+static void cache_load(void)
+{
+    cache_loaded = 1;
+    if (mkdir(cache_dir, 0755) != 0 && errno != EEXIST) {
+        cache_enabled = 0;
+        return;
+    }
+
+    char path[PATH_MAX + 16];
+    snprintf(path, sizeof(path), "%s/%s", cache_dir, CACHE_MANIFEST);
+    FILE *fp = fopen(path, "r");
+    if (!fp) return;
+
+    char line[PATH_MAX + 96];
+    while (fgets(line, sizeof(line), fp)) {
+        unsigned long long hash;
+        long long size, mtime_ns;
+        int consumed;
+        if (sscanf(line, "%llx %lld %lld %n", &hash, &size, &mtime_ns, &consumed) != 3)
+            continue;
+        char *src = line + consumed;
+        src[strcspn(src, "\n")] = '\0';
+        if (*src)
+            manifest_put(src, size, mtime_ns, (uint64_t)hash);
+    }
+    fclose(fp);
+}
+
+static void manifest_append(const CacheKey *key)
+{
+    char path[PATH_MAX + 16], line[PATH_MAX + 96];
+    snprintf(path, sizeof(path), "%s/%s", cache_dir, CACHE_MANIFEST);
+    int n = snprintf(line, sizeof(line), "%016llx %lld %lld %s\n",
+                     (unsigned long long)key->hash, key->size, key->mtime_ns, key->path);
+    if (n <= 0 || n >= (int)sizeof(line))
+        return;
+
+    int fd = open(path, O_WRONLY | O_CREAT | O_APPEND, 0644);
+    if (fd < 0) return;
+    if (write(fd, line, n) != n) {
+        // A torn line fails to parse on load and is skipped
+    }
+    close(fd);
+}
+
+// Blobs are named by source hash and extractor version, so text from an
+// older extractor is never served
+static void blob_path(uint64_t hash, char *out, size_t size)
+{
+    snprintf(out, size, "%s/%016llx-v%d.txt", cache_dir, (unsigned long long)hash, EXTRACT_VERSION);
+}
+
+// FNV-1a over the whole file
+static int hash_file(const char *path, uint64_t *hash)
+{
+    DocView doc;
+    if (doc_open(path, &doc) != 0)
+        return -1;
+    uint64_t h = 14695981039346656037ULL;
+    for (size_t i = 0; i < doc.len; i++)
+        h = (h ^ (unsigned char)doc.data[i]) * 1099511628211ULL;
+    *hash = h ^ (uint64_t)doc.len;
+    doc_close(&doc);
+    return 0;
+}
+
+// Write data to a fresh file next to path and rename it over path, so a
+// reader (or a link into the cache) at path is never written through
+static int replace_file(const char *path, const char *data, size_t len, mode_t mode)
+{
+    char tmp[PATH_MAX + 16];
+    if (snprintf(tmp, sizeof(tmp), "%s.XXXXXX", path) >= (int)sizeof(tmp))
+        return -1;
+    int fd = mkstemp(tmp);
+    if (fd < 0)
+        return -1;
+
+    size_t done = 0;
+    while (done < len) {
+        ssize_t n = write(fd, data + done, len - done);
+        if (n <= 0) break;
+        done += (size_t)n;
+    }
+    close(fd);
+    if (done != len || chmod(tmp, mode) != 0 || rename(tmp, path) != 0) {
+        unlink(tmp);
+        return -1;
+    }
+    return 0;
+}
+
+// Replace the file at path with len bytes of data. Returns 0 on success.
+int cache_write_file(const char *path, const char *data, size_t len)
+{
+    return replace_file(path, data, len, 0644);
+}
+
+// Point output_path at the cached text: a hard link made under a fresh name
+// and renamed into place, or a copy when the cache is on another file system
+static int link_blob(const char *blob, const char *output_path)
+{
+    struct stat blob_st, out_st;
+    if (stat(blob, &blob_st) != 0)
+        return -1;
+    if (lstat(output_path, &out_st) == 0 && out_st.st_ino == blob_st.st_ino && out_st.st_dev == blob_st.st_dev)
+        return 0;
+
+    char tmp[PATH_MAX + 16];
+    if (snprintf(tmp, sizeof(tmp), "%s.XXXXXX", output_path) >= (int)sizeof(tmp))
+        return -1;
+    int fd = mkstemp(tmp);
+    if (fd < 0)
+        return -1;
+    close(fd);
+    unlink(tmp);  // mkstemp only reserved the name for the link
+    if (link(blob, tmp) == 0) {
+        // rename() leaves both names when another writer linked output_path
+        // to the blob meanwhile
+        int rc = rename(tmp, output_path);
+        if (rc != 0 || (lstat(tmp, &out_st) == 0 && out_st.st_ino == blob_st.st_ino))
+            unlink(tmp);
+        return rc == 0 ? 0 : -1;
+    }
+    if (errno != EXDEV)
+        return -1;
+
+    DocView doc;
+    if (doc_open(blob, &doc) != 0)
+        return -1;
+    int rc = cache_write_file(output_path, doc.data, doc.len);
+    doc_close(&doc);
+    return rc;
+}
+
+// Make output_path hold the text of src if the cache has it. An unchanged
+// source (same size and mtime as recorded) is served without reading it; a
+// changed one is hashed, and still hits when identical content was extracted
+// before. Returns 1 on a hit, 0 on a miss (key then identifies src for
+// cache_store), -1 if caching is disabled or src cannot be read.
+int cache_fetch(const char *src, const char *output_path, CacheKey *key)
+{
+    memset(key, 0, sizeof(*key));
+
+    pthread_mutex_lock(&cache_lock);
+    if (!cache_loaded)
+        cache_load();
+    int enabled = cache_enabled;
+    pthread_mutex_unlock(&cache_lock);
+    if (!enabled)
+        return -1;
+
+    struct stat st;
+    if (!realpath(src, key->path) || stat(key->path, &st) != 0)
+        return -1;
+    key->size = (long long)st.st_size;
+    key->mtime_ns = (long long)st.st_mtim.tv_sec * 1000000000LL + st.st_mtim.tv_nsec;
+
+    int current = 0;
+    pthread_mutex_lock(&cache_lock);
+    for (ManifestEntry *e = manifest[path_bucket(key->path)]; e; e = e->next) {
+        if (strcmp(e->path, key->path) == 0) {
+            if (e->size == key->size && e->mtime_ns == key->mtime_ns) {
+                key->hash = e->hash;
+                key->hashed = 1;
+                current = 1;
+            }
+            break;
+        }
+    }
+    pthread_mutex_unlock(&cache_lock);
+
+    if (!key->hashed) {
+        if (hash_file(key->path, &key->hash) != 0)
+            return -1;
+        key->hashed = 1;
+    }
+
+    char blob[PATH_MAX + 32];
+    blob_path(key->hash, blob, sizeof(blob));
+    if (access(blob, R_OK) != 0 || link_blob(blob, output_path) != 0)
+        return 0;
+
+    if (!current) {
+        // Same content under a new path, size or mtime: remember it
+        pthread_mutex_lock(&cache_lock);
+        manifest_put(key->path, key->size, key->mtime_ns, key->hash);
+        pthread_mutex_unlock(&cache_lock);
+        manifest_append(key);
+    }
+    return 1;
+}
+
+// Save text extracted from the source identified by key (from a missed
+// cache_fetch) and link it to output_path. Returns 0 on success.
+int cache_store(const CacheKey *key, const char *text, size_t len, const char *output_path)
+{
+    if (!cache_enabled || !key->hashed)
+        return -1;
+
+    // Written under a unique name and renamed, so readers never see a
+    // partial blob; read-only, as every copy of the text links to it
+    char blob[PATH_MAX + 32];
+    blob_path(key->hash, blob, sizeof(blob));
+    if (replace_file(blob, text, len, 0444) != 0)
+        return -1;
+
+    pthread_mutex_lock(&cache_lock);
+    manifest_put(key->path, key->size, key->mtime_ns, key->hash);
+    pthread_mutex_unlock(&cache_lock);
+    manifest_append(key);
+
+    return link_blob(blob, output_path);
+}
@@ -0,0 +1,26 @@
+#ifndef CACHE_H
+#define CACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <limits.h>
+
+#define DEFAULT_CACHE_DIR "/tmp/docsearch_cache"
+#define CACHE_MANIFEST "manifest"
+
+// Identity of one source document as the cache sees it
+typedef struct {
+    char path[PATH_MAX];    // absolute path of the source
+    long long size;
+    long long mtime_ns;
+    uint64_t hash;          // content hash, valid when hashed is set
+    int hashed;
+} CacheKey;
+
+void cache_set_dir(const char *dir);
+const char *cache_get_dir(void);
+int cache_fetch(const char *src, const char *output_path, CacheKey *key);
+int cache_store(const CacheKey *key, const char *text, size_t len, const char *output_path);
+int cache_write_file(const char *path, const char *data, size_t len);
+
+#endif
@@ -0,0 +1,224 @@
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "doc_reader.h"
+#include "trace.h"
+
+#define READ_CHUNK (1 << 20)
+#define READ_ALIGN 4096
+#define REGISTRY_BUCKETS 1024
+
+// Documents extracted in memory, looked up by the path they would have on disk
+typedef struct DocEntry {
+    char *path;
+    char *data;
+    size_t len;
+    int refs;                // the registry's, plus one per open view
+    struct DocEntry *next;
+} DocEntry;
+
+static DocEntry *registry[REGISTRY_BUCKETS];
+static pthread_rwlock_t registry_lock = PTHREAD_RWLOCK_INITIALIZER;
+
+static unsigned path_bucket(const char *path)
+{
+    unsigned h = 2166136261u;
+    for (const unsigned char *p = (const unsigned char *)path; *p; p++)
+        h = (h ^ *p) * 16777619u;
+    return h % REGISTRY_BUCKETS;
+}
+
+// Drop one reference to e; the last one frees it
+static void entry_release(DocEntry *e)
+{
+    if (__atomic_sub_fetch(&e->refs, 1, __ATOMIC_ACQ_REL) == 0) {
+        free(e->path);
+        free(e->data);
+        free(e);
+    }
+}
+
+// Serve path from data (taking ownership of it, which may be NULL when len
+// is 0) instead of the file system. Re-registering a path replaces its text
+// for views opened from then on. Returns 0 on success.
+int doc_register(const char *path, char *data, size_t len)
+{
+    DocEntry *e = malloc(sizeof(DocEntry));
+    if (!e) return -1;
+    e->path = strdup(path);
+    if (!e->path) {
+        free(e);
+        return -1;
+    }
+    e->data = data;
+    e->len = len;
+    e->refs = 1;
+
+    unsigned b = path_bucket(path);
+    pthread_rwlock_wrlock(&registry_lock);
+    for (DocEntry **pp = &registry[b]; *pp; pp = &(*pp)->next) {
+        if (strcmp((*pp)->path, path) == 0) {
+            DocEntry *old = *pp;
+            *pp = old->next;
+            entry_release(old);
+            break;
+        }
+    }
+    e->next = registry[b];
+    registry[b] = e;
+    pthread_rwlock_unlock(&registry_lock);
+    return 0;
+}
+
+// Drop one registered document. Views of it still open keep its text until
+// they are closed.
+void doc_unregister(const char *path)
+{
+    unsigned b = path_bucket(path);
+    pthread_rwlock_wrlock(&registry_lock);
+    for (DocEntry **pp = &registry[b]; *pp; pp = &(*pp)->next) {
+        if (strcmp((*pp)->path, path) == 0) {
+            DocEntry *old = *pp;
+            *pp = old->next;
+            entry_release(old);
+            break;
+        }
+    }
+    pthread_rwlock_unlock(&registry_lock);
+}
+
+// Drop every registered document; open views keep theirs until closed.
+void doc_unregister_all(void)
+{
+    pthread_rwlock_wrlock(&registry_lock);
+    for (int b = 0; b < REGISTRY_BUCKETS; b++) {
+        DocEntry *e = registry[b];
+        while (e) {
+            DocEntry *next = e->next;
+            entry_release(e);
+            e = next;
+        }
+        registry[b] = NULL;
+    }
+    pthread_rwlock_unlock(&registry_lock);
+}
+
+static int registry_lookup(const char *path, DocView *doc)
+{
+    int found = 0;
+    pthread_rwlock_rdlock(&registry_lock);
+    for (DocEntry *e = registry[path_bucket(path)]; e; e = e->next) {
+        if (strcmp(e->path, path) == 0) {
+            __atomic_add_fetch(&e->refs, 1, __ATOMIC_RELAXED);
+            doc->data = e->data ? e->data : "";
+            doc->len = e->len;
+            doc->entry = e;
+            found = 1;
+            break;
+        }
+    }
+    pthread_rwlock_unlock(&registry_lock);
+    return found;
+}
+
+// Read the whole descriptor into a page-aligned heap buffer, one chunk per
+// read() call. size_hint is the expected size (0 if unknown).
+static int read_chunks(int fd, size_t size_hint, DocView *doc)
+{
+    size_t cap = size_hint > 0 ? size_hint + 1 : READ_CHUNK;  // +1 to see EOF without growing
+    size_t len = 0;
+    char *buf = NULL;
+    if (posix_memalign((void **)&buf, READ_ALIGN, cap) != 0)
+        return -1;
+
+    for (;;) {
+        if (len == cap) {
+            char *grown = NULL;
+            if (posix_memalign((void **)&grown, READ_ALIGN, cap * 2) != 0) {
+                free(buf);
+                return -1;
+            }
+            memcpy(grown, buf, len);
+            free(buf);
+            buf = grown;
+            cap *= 2;
+        }
+        size_t want = cap - len < READ_CHUNK ? cap - len : READ_CHUNK;
+        ssize_t n = read(fd, buf + len, want);
+        if (n < 0) {
+            free(buf);
+            return -1;
+        }
+        if (n == 0)
+            break;
+        len += (size_t)n;
+    }
+
+    doc->data = buf;
+    doc->len = len;
+    doc->heap = buf;
+    return 0;
+}
+
+static int open_view(const char *path, DocView *doc)
+{
+    memset(doc, 0, sizeof(*doc));
+
+    if (registry_lookup(path, doc))
+        return 0;
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return -1;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        return -1;
+    }
+
+    if (S_ISREG(st.st_mode) && st.st_size == 0) {
+        doc->data = "";
+        close(fd);
+        return 0;
+    }
+
+    if (S_ISREG(st.st_mode)) {
+        void *map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map != MAP_FAILED) {
+            madvise(map, (size_t)st.st_size, MADV_SEQUENTIAL);
+            doc->data = (const char *)map;
+            doc->len = (size_t)st.st_size;
+            doc->map = map;
+            close(fd);
+            return 0;
+        }
+    }
+
+    int rc = read_chunks(fd, S_ISREG(st.st_mode) ? (size_t)st.st_size : 0, doc);
+    close(fd);
+    return rc;
+}
+
+// Open path as a contiguous (pointer, length) view. Returns 0 on success,
+// -1 if the file cannot be opened or read.
+int doc_open(const char *path, DocView *doc)
+{
+    TRACE_BEGIN(t);
+    int rc = open_view(path, doc);
+    TRACE_END(t, TRACE_OPEN, path, rc == 0 ? doc->len : 0);
+    return rc;
+}
+
+void doc_close(DocView *doc)
+{
+    if (doc->map)
+        munmap(doc->map, doc->len);
+    free(doc->heap);
+    if (doc->entry)
+        entry_release(doc->entry);
+    memset(doc, 0, sizeof(*doc));
+}
@@ -0,0 +1,28 @@
+#ifndef DOC_READER_H
+#define DOC_READER_H
+
+#include <stddef.h>
+
+struct DocEntry;
+
+// Read-only view of a whole document as one contiguous buffer. Documents
+// registered in memory are served from there, and stay valid until the view
+// is closed even if they are replaced or unregistered meanwhile; regular
+// files are mmap'd, and anything that cannot be mapped is read in large
+// aligned chunks.
+typedef struct {
+    const char *data;
+    size_t len;
+    void *map;        // mapping to munmap, NULL if not mapped
+    char *heap;       // buffer to free, NULL if not read
+    struct DocEntry *entry;  // registered document held, NULL if none
+} DocView;
+
+int doc_open(const char *path, DocView *doc);
+void doc_close(DocView *doc);
+
+int doc_register(const char *path, char *data, size_t len);
+void doc_unregister(const char *path);
+void doc_unregister_all(void);
+
+#endif
@@ -2,97 +2,242 @@
 #include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
+#include "exact_match.h"
+#include "simd_scan.h"
+#include "doc_reader.h"
+#include "trace.h"
 
 #define ALPHABET_SIZE 256
 
-typedef struct ACNode {
-    struct ACNode *children[ALPHABET_SIZE];
-    struct ACNode *fail;
-    int is_end;
-} ACNode;
+// Compiled Aho-Corasick automaton. Everything lives in one arena allocation:
+// a dense DFA table with goto-on-fail transitions already resolved, so the
+// scanner does exactly one table lookup per input byte.
+//
+// Bytes are first mapped to classes (case-folded, and every byte that occurs
+// in no pattern shares class 0), which keeps rows short enough to stay in
+// cache. Table entries are row offsets (state * class_count); an entry is
+// stored bitwise-inverted when the target state ends at least one pattern.
+struct ACAutomaton {
+    unsigned char byte_class[ALPHABET_SIZE];
+    int class_count;
+    int state_count;
+    int32_t *delta;        // state_count * class_count entries
+    int32_t *pattern_at;   // pattern ending exactly at a state, -1 if none
+    int32_t *output;       // next state on the fail chain that ends a pattern, -1 if none
+};
 
 // Convert to lowercase for case-insensitive matching
 char to_lower(char c) {
     return (char)tolower((unsigned char)c);
 }
 
-// Create a new node
-ACNode* ac_create_node() {
-    ACNode *node = (ACNode *)calloc(1, sizeof(ACNode));
-    return node;
-}
+// Build one automaton for a whole pattern set; pattern IDs are array positions.
+// Patterns equal up to case share a state, which reports the first of them.
+ACAutomaton* ac_build_patterns(char **patterns, int count) {
+    TRACE_BEGIN(build_start);
 
-// Build automaton from a single pattern
-void ac_build_trie(ACNode *root, const char *pattern) {
-    ACNode *node = root;
-    for (int i = 0; pattern[i]; ++i) {
-        unsigned char c = (unsigned char)to_lower(pattern[i]);
-        if (!node->children[c]) {
-            node->children[c] = ac_create_node();
+    // Alphabet compression: one class per distinct (lowercased) pattern byte
+    unsigned char byte_class[ALPHABET_SIZE];
+    int class_of[ALPHABET_SIZE] = {0};
+    int class_count = 1;
+    int max_states = 1;
+    for (int p = 0; p < count; ++p) {
+        for (int i = 0; patterns[p][i]; ++i) {
+            unsigned char c = (unsigned char)to_lower(patterns[p][i]);
+            if (!class_of[c])
+                class_of[c] = class_count++;
+            max_states++;
         }
-        node = node->children[c];
     }
-    node->is_end = 1;
-}
+    for (int b = 0; b < ALPHABET_SIZE; ++b)
+        byte_class[b] = (unsigned char)class_of[(unsigned char)to_lower((char)b)];
 
-// Build failure links (trivial for single pattern)
-void ac_build_failures(ACNode *root) {
-    root->fail = NULL;
-    for (int c = 0; c < ALPHABET_SIZE; ++c) {
-        if (root->children[c]) {
-            root->children[c]->fail = root;
-        }
+    size_t table_size = (size_t)max_states * class_count * sizeof(int32_t);
+    size_t arena_size = sizeof(ACAutomaton) + table_size + 2 * (size_t)max_states * sizeof(int32_t);
+    char *arena = (char *)malloc(arena_size);
+    int32_t *fail = (int32_t *)malloc(max_states * sizeof(int32_t));
+    int32_t *queue = (int32_t *)malloc(max_states * sizeof(int32_t));
+    if (!arena || !fail || !queue) {
+        free(arena);
+        free(fail);
+        free(queue);
+        return NULL;
     }
-}
 
-// Search a line using the automaton
-int ac_search_line(ACNode *root, const char *line) {
-    ACNode *node = root;
-    for (int i = 0; line[i]; ++i) {
-        unsigned char c = (unsigned char)to_lower(line[i]);
+    ACAutomaton *ac = (ACAutomaton *)arena;
+    memcpy(ac->byte_class, byte_class, sizeof(byte_class));
+    ac->class_count = class_count;
+    ac->delta = (int32_t *)(arena + sizeof(ACAutomaton));
+    ac->pattern_at = (int32_t *)(arena + sizeof(ACAutomaton) + table_size);
+    ac->output = ac->pattern_at + max_states;
 
-        while (node && !node->children[c])
-            node = node->fail;
+    // Trie: state 0 is the root, so 0 also marks "no child" while building
+    int32_t *delta = ac->delta;
+    memset(delta, 0, table_size);
+    for (int s = 0; s < max_states; ++s)
+        ac->pattern_at[s] = -1;
+    int states = 1;
+    for (int p = 0; p < count; ++p) {
+        if (!patterns[p][0])
+            continue;
+        int s = 0;
+        for (int i = 0; patterns[p][i]; ++i) {
+            int c = byte_class[(unsigned char)patterns[p][i]];
+            if (!delta[s * class_count + c])
+                delta[s * class_count + c] = states++;
+            s = delta[s * class_count + c];
+        }
+        if (ac->pattern_at[s] < 0)
+            ac->pattern_at[s] = p;
+    }
+    ac->state_count = states;
 
-        if (!node)
-            node = root;
-        else
-            node = node->children[c];
+    // Breadth-first: fail links, output links, and missing transitions filled
+    // in from the fail state (whose row is already complete)
+    int head = 0, tail = 0;
+    fail[0] = 0;
+    ac->output[0] = -1;
+    for (int c = 0; c < class_count; ++c) {
+        int t = delta[c];
+        if (t) {
+            fail[t] = 0;
+            ac->output[t] = -1;
+            queue[tail++] = t;
+        }
+    }
+    while (head < tail) {
+        int s = queue[head++];
+        for (int c = 0; c < class_count; ++c) {
+            int t = delta[s * class_count + c];
+            if (t) {
+                int f = delta[fail[s] * class_count + c];
+                fail[t] = f;
+                ac->output[t] = ac->pattern_at[f] >= 0 ? f : ac->output[f];
+                queue[tail++] = t;
+            } else {
+                delta[s * class_count + c] = delta[fail[s] * class_count + c];
+            }
+        }
+    }
 
-        if (node && node->is_end)
-            return 1;
+    // Encode targets as row offsets, inverted for accepting states
+    for (size_t e = 0; e < (size_t)states * class_count; ++e) {
+        int t = delta[e];
+        int accepting = ac->pattern_at[t] >= 0 || ac->output[t] >= 0;
+        delta[e] = accepting ? ~(t * class_count) : t * class_count;
     }
-    return 0;
+
+    free(fail);
+    free(queue);
+    TRACE_END(build_start, TRACE_AC_BUILD, NULL, arena_size);
+    return ac;
 }
 
 // Free memory
-void ac_free(ACNode *node) {
-    for (int c = 0; c < ALPHABET_SIZE; ++c) {
-        if (node->children[c])
-            ac_free(node->children[c]);
+void ac_free(ACAutomaton *ac) {
+    free(ac);
+}
+
+// Run the automaton over buf, continuing from *state (0 to start).
+// With hits == NULL, stops and returns 1 at the first match; otherwise sets
+// hits[id] for every pattern found and returns the number newly set.
+int ac_scan(const ACAutomaton *ac, const char *buf, size_t len, int32_t *state, unsigned char *hits) {
+    const int32_t *delta = ac->delta;
+    const unsigned char *cls = ac->byte_class;
+    const unsigned char *p = (const unsigned char *)buf;
+    int32_t row = *state;
+    int new_hits = 0;
+
+    for (size_t i = 0; i < len; ++i) {
+        int32_t next = delta[row + cls[p[i]]];
+        row = next ^ (next >> 31);
+        if (next < 0) {
+            if (!hits) {
+                *state = row;
+                return 1;
+            }
+            int s = row / ac->class_count;
+            for (int o = ac->pattern_at[s] >= 0 ? s : ac->output[s]; o >= 0; o = ac->output[o]) {
+                int id = ac->pattern_at[o];
+                if (!hits[id]) {
+                    hits[id] = 1;
+                    new_hits++;
+                }
+            }
+        }
     }
-    free(node);
+
+    *state = row;
+    return new_hits;
 }
 
-// Final exact match function with Aho-Corasick and case-insensitivity
-int exact_match(const char *filepath, const char *pattern) {
-    FILE *fp = fopen(filepath, "r");
-    if (!fp) return 0;
+// Search a line using the automaton
+int ac_search_line(const ACAutomaton *ac, const char *line) {
+    int32_t state = 0;
+    return ac_scan(ac, line, strlen(line), &state, NULL);
+}
 
-    ACNode *root = ac_create_node();
-    ac_build_trie(root, pattern);
-    ac_build_failures(root);
+// Final exact match function, case-insensitive. A single literal needs no
+// automaton: the vectorized scanner finds candidates by the pattern's rarest
+// bytes and verifies only those.
+int exact_match(const char *filepath, const char *pattern) {
+    LiteralScanner ls;
+    if (literal_scanner_init(&ls, pattern) != 0) return 0;
 
-    char line[1024];
+    DocView doc;
     int found = 0;
-    while (fgets(line, sizeof(line), fp)) {
-        if (ac_search_line(root, line)) {
-            found = 1;
+    if (doc_open(filepath, &doc) == 0) {
+        found = literal_find(&ls, doc.data, doc.len) >= 0;
+        doc_close(&doc);
+    }
+
+    literal_scanner_free(&ls);
+    return found;
+}
+
+// Start offsets of every (possibly overlapping) occurrence of the pattern in
+// data[0..len). Stores the first max_offsets and returns the total count.
+int exact_find_all(const char *data, size_t len, const char *pattern, size_t *offsets, int max_offsets) {
+    LiteralScanner ls;
+    if (literal_scanner_init(&ls, pattern) != 0) return 0;
+
+    int count = 0;
+    size_t pos = 0;
+    while (pos < len) {
+        long at = literal_find(&ls, data + pos, len - pos);
+        if (at < 0)
             break;
-        }
+        if (count < max_offsets)
+            offsets[count] = pos + (size_t)at;
+        count++;
+        pos += (size_t)at + 1;
     }
 
-    fclose(fp);
-    ac_free(root);
+    literal_scanner_free(&ls);
+    return count;
+}
+
+// 1 if an occurrence of the pattern starts in [start, end) of data[0..len)
+int exact_match_range(const char *data, size_t len, size_t start, size_t end, const char *pattern) {
+    LiteralScanner ls;
+    if (literal_scanner_init(&ls, pattern) != 0) return 0;
+
+    size_t stop = end + ls.len - 1 < len ? end + ls.len - 1 : len;
+    int found = start < stop && literal_find(&ls, data + start, stop - start) >= 0;
+
+    literal_scanner_free(&ls);
     return found;
 }
+
+// Scan a file once with a multi-pattern automaton, setting hits[id] for every
+// pattern that occurs. Returns the number of patterns hit.
+int exact_match_multi(const char *filepath, const ACAutomaton *ac, unsigned char *hits) {
+    DocView doc;
+    if (doc_open(filepath, &doc) != 0) return 0;
+
+    int32_t state = 0;
+    int hit_count = ac_scan(ac, doc.data, doc.len, &state, hits);
+
+    doc_close(&doc);
+    return hit_count;
+}
@@ -1,6 +1,19 @@
 #ifndef EXACT_MATCH_H
 #define EXACT_MATCH_H
 
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct ACAutomaton ACAutomaton;
+
+ACAutomaton* ac_build_patterns(char **patterns, int count);
+void ac_free(ACAutomaton *ac);
+int ac_scan(const ACAutomaton *ac, const char *buf, size_t len, int32_t *state, unsigned char *hits);
+int ac_search_line(const ACAutomaton *ac, const char *line);
+
 int exact_match(const char *filepath, const char *pattern);
+int exact_match_range(const char *data, size_t len, size_t start, size_t end, const char *pattern);
+int exact_find_all(const char *data, size_t len, const char *pattern, size_t *offsets, int max_offsets);
+int exact_match_multi(const char *filepath, const ACAutomaton *ac, unsigned char *hits);
 
 #endif
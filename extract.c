@@ -0,0 +1,683 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <limits.h>
+#include <ctype.h>
+#include <math.h>
+#include <unistd.h>
+#include <zlib.h>
+#include "extract.h"
+#include "doc_reader.h"
+#include "trace.h"
+
+#define INFLATE_CHUNK (64 * 1024)
+#define PDF_MAX_OPERANDS 8
+#define PDF_DICT_LOOKBACK 4096
+#define PDF_WORD_GAP -250.0  // TJ adjustment (1/1000 em) treated as a space
+
+typedef void (*sink_fn)(void *ctx, const char *buf, size_t len);
+
+//================================ Text buffer ==================================
+
+static int tb_reserve(TextBuffer *tb, size_t extra)
+{
+    if (tb->len + extra <= tb->cap)
+        return 0;
+    size_t cap = tb->cap ? tb->cap : 4096;
+    while (cap < tb->len + extra)
+        cap *= 2;
+    char *grown = realloc(tb->data, cap);
+    if (!grown)
+        return -1;
+    tb->data = grown;
+    tb->cap = cap;
+    return 0;
+}
+
+static void tb_append(TextBuffer *tb, const char *s, size_t n)
+{
+    if (n == 0 || tb_reserve(tb, n) != 0)
+        return;
+    memcpy(tb->data + tb->len, s, n);
+    tb->len += n;
+}
+
+static void tb_putc(TextBuffer *tb, char c)
+{
+    tb_append(tb, &c, 1);
+}
+
+// Start a new line unless the text already ends with one
+static void tb_newline(TextBuffer *tb)
+{
+    if (tb->len > 0 && tb->data[tb->len - 1] != '\n')
+        tb_putc(tb, '\n');
+}
+
+static void tb_put_utf8(TextBuffer *tb, unsigned long cp)
+{
+    char u[4];
+    if (cp < 0x80) {
+        tb_putc(tb, (char)cp);
+    } else if (cp < 0x800) {
+        u[0] = (char)(0xC0 | (cp >> 6));
+        u[1] = (char)(0x80 | (cp & 0x3F));
+        tb_append(tb, u, 2);
+    } else if (cp < 0x10000) {
+        u[0] = (char)(0xE0 | (cp >> 12));
+        u[1] = (char)(0x80 | ((cp >> 6) & 0x3F));
+        u[2] = (char)(0x80 | (cp & 0x3F));
+        tb_append(tb, u, 3);
+    } else if (cp < 0x110000) {
+        u[0] = (char)(0xF0 | (cp >> 18));
+        u[1] = (char)(0x80 | ((cp >> 12) & 0x3F));
+        u[2] = (char)(0x80 | ((cp >> 6) & 0x3F));
+        u[3] = (char)(0x80 | (cp & 0x3F));
+        tb_append(tb, u, 4);
+    }
+}
+
+void text_buffer_free(TextBuffer *tb)
+{
+    free(tb->data);
+    memset(tb, 0, sizeof(*tb));
+}
+
+static void tb_sink(void *ctx, const char *buf, size_t len)
+{
+    tb_append((TextBuffer *)ctx, buf, len);
+}
+
+// Inflate src and pass the output to sink one chunk at a time, so callers
+// never need the whole decompressed stream. window_bits is -MAX_WBITS for raw
+// deflate (ZIP members) or MAX_WBITS + 32 for zlib/gzip (PDF streams).
+// Returns 0 when the stream ended cleanly; output seen before an error has
+// still been delivered.
+static int inflate_stream(const unsigned char *src, size_t len, int window_bits, sink_fn sink, void *ctx)
+{
+    if (len > UINT_MAX)
+        return -1;
+
+    z_stream zs;
+    memset(&zs, 0, sizeof(zs));
+    if (inflateInit2(&zs, window_bits) != Z_OK)
+        return -1;
+
+    unsigned char *out = malloc(INFLATE_CHUNK);
+    if (!out) {
+        inflateEnd(&zs);
+        return -1;
+    }
+
+    zs.next_in = (Bytef *)src;
+    zs.avail_in = (uInt)len;
+    int rc;
+    do {
+        zs.next_out = out;
+        zs.avail_out = INFLATE_CHUNK;
+        rc = inflate(&zs, Z_NO_FLUSH);
+        if (rc != Z_OK && rc != Z_STREAM_END)
+            break;
+        sink(ctx, (const char *)out, INFLATE_CHUNK - zs.avail_out);
+    } while (rc != Z_STREAM_END && (zs.avail_in > 0 || zs.avail_out == 0));
+
+    free(out);
+    inflateEnd(&zs);
+    return rc == Z_STREAM_END ? 0 : -1;
+}
+
+//==================================== DOCX =====================================
+
+static uint16_t rd16(const unsigned char *p)
+{
+    return (uint16_t)(p[0] | p[1] << 8);
+}
+
+static uint32_t rd32(const unsigned char *p)
+{
+    return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+// Locate member name through the ZIP central directory. Returns 0 and the
+// member's compression method and compressed bytes, or -1 (also for ZIP64).
+static int zip_find(const unsigned char *zip, size_t len, const char *name,
+                    int *method, const unsigned char **data, size_t *comp_size)
+{
+    if (len < 30)
+        return -1;
+
+    // End of central directory record, possibly followed by a comment
+    size_t min = len > 22 + 65535 ? len - 22 - 65535 : 0;
+    size_t eocd = len - 22;
+    while (rd32(zip + eocd) != 0x06054b50) {
+        if (eocd == min)
+            return -1;
+        eocd--;
+    }
+
+    uint16_t entries = rd16(zip + eocd + 10);
+    uint32_t cd_size = rd32(zip + eocd + 12);
+    uint32_t cd_off = rd32(zip + eocd + 16);
+    if (cd_off > len || cd_size > len - cd_off)
+        return -1;
+
+    size_t name_len = strlen(name);
+    size_t p = cd_off, end = (size_t)cd_off + cd_size;
+    for (int i = 0; i < entries && p + 46 <= end; i++) {
+        if (rd32(zip + p) != 0x02014b50)
+            return -1;
+        uint16_t fn_len = rd16(zip + p + 28);
+        size_t next = p + 46 + fn_len + rd16(zip + p + 30) + rd16(zip + p + 32);
+        if (p + 46 + fn_len > end)
+            return -1;
+
+        if (fn_len == name_len && memcmp(zip + p + 46, name, name_len) == 0) {
+            uint32_t csize = rd32(zip + p + 20);
+            uint32_t local = rd32(zip + p + 42);
+            if (local > len - 30 || rd32(zip + local) != 0x04034b50)
+                return -1;
+            size_t off = (size_t)local + 30 + rd16(zip + local + 26) + rd16(zip + local + 28);
+            if (off > len || csize > len - off)
+                return -1;
+            *method = rd16(zip + p + 10);
+            *data = zip + off;
+            *comp_size = csize;
+            return 0;
+        }
+        p = next;
+    }
+    return -1;
+}
+
+// Streaming WordprocessingML stripper: keeps the contents of <w:t> runs,
+// turns paragraph ends and breaks into newlines and tabs into tabs, and
+// decodes entities. State carries over between inflated chunks.
+typedef struct {
+    TextBuffer *out;
+    int in_tag;
+    int in_text;          // inside a <w:t> run
+    int in_tabs;          // inside <w:tabs> (tab stop definitions, not tabs)
+    char tag[32];         // start of the current tag, enough for its name
+    int tag_len;
+    char prev;            // last byte of the current tag
+    char entity[12];
+    int entity_len;       // -1 outside an entity
+} XmlStrip;
+
+static int tag_is(const char *name, size_t len, const char *want)
+{
+    return len == strlen(want) && memcmp(name, want, len) == 0;
+}
+
+static void xml_end_tag(XmlStrip *xs)
+{
+    xs->tag[xs->tag_len] = '\0';
+    const char *name = xs->tag;
+    int closing = name[0] == '/';
+    if (closing)
+        name++;
+    int self_closing = xs->prev == '/';
+    size_t len = strcspn(name, " \t\r\n/");
+
+    if (tag_is(name, len, "w:t"))
+        xs->in_text = !closing && !self_closing;
+    else if (closing && tag_is(name, len, "w:p"))
+        tb_newline(xs->out);
+    else if (tag_is(name, len, "w:tabs"))
+        xs->in_tabs = !closing && !self_closing;
+    else if (!closing && !xs->in_tabs && tag_is(name, len, "w:tab"))
+        tb_putc(xs->out, '\t');
+    else if (!closing && (tag_is(name, len, "w:br") || tag_is(name, len, "w:cr")))
+        tb_putc(xs->out, '\n');
+}
+
+static void xml_end_entity(XmlStrip *xs)
+{
+    xs->entity[xs->entity_len] = '\0';
+    const char *e = xs->entity;
+    if (strcmp(e, "amp") == 0) tb_putc(xs->out, '&');
+    else if (strcmp(e, "lt") == 0) tb_putc(xs->out, '<');
+    else if (strcmp(e, "gt") == 0) tb_putc(xs->out, '>');
+    else if (strcmp(e, "quot") == 0) tb_putc(xs->out, '"');
+    else if (strcmp(e, "apos") == 0) tb_putc(xs->out, '\'');
+    else if (e[0] == '#' && (e[1] == 'x' || e[1] == 'X')) tb_put_utf8(xs->out, strtoul(e + 2, NULL, 16));
+    else if (e[0] == '#') tb_put_utf8(xs->out, strtoul(e + 1, NULL, 10));
+    xs->entity_len = -1;
+}
+
+static void xml_strip_feed(void *ctx, const char *buf, size_t len)
+{
+    XmlStrip *xs = (XmlStrip *)ctx;
+    for (size_t i = 0; i < len; i++) {
+        char c = buf[i];
+        if (xs->in_tag) {
+            if (c == '>') {
+                xml_end_tag(xs);
+                xs->in_tag = 0;
+            } else {
+                if (xs->tag_len < (int)sizeof(xs->tag) - 1)
+                    xs->tag[xs->tag_len++] = c;
+                xs->prev = c;
+            }
+        } else if (c == '<') {
+            xs->in_tag = 1;
+            xs->tag_len = 0;
+            xs->prev = 0;
+            xs->entity_len = -1;
+        } else if (!xs->in_text) {
+            continue;
+        } else if (xs->entity_len >= 0) {
+            if (c == ';')
+                xml_end_entity(xs);
+            else if (xs->entity_len < (int)sizeof(xs->entity) - 1)
+                xs->entity[xs->entity_len++] = c;
+        } else if (c == '&') {
+            xs->entity_len = 0;
+        } else {
+            tb_putc(xs->out, c);
+        }
+    }
+}
+
+// Append the text of a DOCX file's main document part to out. Returns 0 on
+// success, -1 if the file is not a readable DOCX.
+int extract_docx(const char *path, TextBuffer *out)
+{
+    DocView doc;
+    if (doc_open(path, &doc) != 0)
+        return -1;
+
+    int method, rc = -1;
+    const unsigned char *data;
+    size_t comp_size;
+    if (zip_find((const unsigned char *)doc.data, doc.len, "word/document.xml", &method, &data, &comp_size) == 0) {
+        XmlStrip xs;
+        memset(&xs, 0, sizeof(xs));
+        xs.out = out;
+        xs.entity_len = -1;
+        if (method == 0) {
+            xml_strip_feed(&xs, (const char *)data, comp_size);
+            rc = 0;
+        } else if (method == 8) {
+            rc = inflate_stream(data, comp_size, -MAX_WBITS, xml_strip_feed, &xs);
+        }
+    }
+
+    doc_close(&doc);
+    return rc;
+}
+
+//===================================== PDF =====================================
+
+// Text-showing state for one content stream
+typedef struct {
+    TextBuffer *out;
+    TextBuffer str;        // string operands since the last operator
+    double nums[PDF_MAX_OPERANDS];
+    int num_count;
+    int in_array;
+    double y;              // baseline of the last positioned text
+    int have_y;
+} PdfText;
+
+static void pdf_push_number(PdfText *pt, double v)
+{
+    if (pt->in_array) {
+        // Large negative kerning inside TJ is how most producers space words
+        if (v < PDF_WORD_GAP)
+            tb_putc(&pt->str, ' ');
+        return;
+    }
+    if (pt->num_count == PDF_MAX_OPERANDS) {
+        memmove(pt->nums, pt->nums + 1, (PDF_MAX_OPERANDS - 1) * sizeof(double));
+        pt->num_count--;
+    }
+    pt->nums[pt->num_count++] = v;
+}
+
+static void pdf_move_to(PdfText *pt, double y)
+{
+    if (pt->have_y && fabs(y - pt->y) > 0.5)
+        tb_newline(pt->out);
+    pt->y = y;
+    pt->have_y = 1;
+}
+
+static void pdf_operator(PdfText *pt, const char *op, size_t len)
+{
+    double last = pt->num_count > 0 ? pt->nums[pt->num_count - 1] : 0;
+
+    if (tag_is(op, len, "Tj") || tag_is(op, len, "TJ")) {
+        tb_append(pt->out, pt->str.data, pt->str.len);
+    } else if (tag_is(op, len, "'") || tag_is(op, len, "\"")) {
+        tb_newline(pt->out);
+        tb_append(pt->out, pt->str.data, pt->str.len);
+    } else if (tag_is(op, len, "T*")) {
+        tb_newline(pt->out);
+    } else if ((tag_is(op, len, "Td") || tag_is(op, len, "TD")) && pt->num_count >= 2) {
+        pdf_move_to(pt, (pt->have_y ? pt->y : 0) + last);
+    } else if (tag_is(op, len, "Tm") && pt->num_count >= 6) {
+        pdf_move_to(pt, last);
+    }
+
+    pt->str.len = 0;
+    pt->num_count = 0;
+}
+
+// Append a literal string "(...)" starting at buf[i] to pt->str; returns the
+// index just past it
+static size_t pdf_literal(PdfText *pt, const char *buf, size_t len, size_t i)
+{
+    int depth = 1;
+    for (i++; i < len; i++) {
+        char c = buf[i];
+        if (c == '\\' && i + 1 < len) {
+            char e = buf[++i];
+            switch (e) {
+            case 'n': c = '\n'; break;
+            case 'r': c = '\r'; break;
+            case 't': c = '\t'; break;
+            case 'b': case 'f': continue;
+            case '\r':
+                if (i + 1 < len && buf[i + 1] == '\n') i++;
+                continue;
+            case '\n':
+                continue;
+            default:
+                if (e >= '0' && e <= '7') {
+                    int v = e - '0';
+                    for (int k = 0; k < 2 && i + 1 < len && buf[i + 1] >= '0' && buf[i + 1] <= '7'; k++)
+                        v = v * 8 + (buf[++i] - '0');
+                    c = (char)v;
+                } else {
+                    c = e;
+                }
+            }
+        } else if (c == '(') {
+            depth++;
+        } else if (c == ')' && --depth == 0) {
+            return i + 1;
+        }
+        if ((unsigned char)c >= 0x20 || c == '\n' || c == '\t')
+            tb_putc(&pt->str, c);
+    }
+    return len;
+}
+
+// Append a hex string "<...>" starting at buf[i]; returns the index past it
+static size_t pdf_hex(PdfText *pt, const char *buf, size_t len, size_t i)
+{
+    int hi = -1;
+    for (i++; i < len && buf[i] != '>'; i++) {
+        if (!isxdigit((unsigned char)buf[i]))
+            continue;
+        int v = isdigit((unsigned char)buf[i]) ? buf[i] - '0' : (tolower((unsigned char)buf[i]) - 'a' + 10);
+        if (hi < 0) {
+            hi = v;
+        } else {
+            char c = (char)(hi << 4 | v);
+            if ((unsigned char)c >= 0x20)
+                tb_putc(&pt->str, c);
+            hi = -1;
+        }
+    }
+    return i < len ? i + 1 : len;
+}
+
+static int pdf_delimiter(char c)
+{
+    return isspace((unsigned char)c) || strchr("()<>[]{}/%", c) != NULL;
+}
+
+// Skip inline image data: from after "BI" to just past the "EI" operator
+static size_t pdf_skip_inline_image(const char *buf, size_t len, size_t i)
+{
+    const char *id = memmem(buf + i, len - i, "ID", 2);
+    if (!id)
+        return len;
+    for (size_t k = (size_t)(id - buf) + 3; k + 2 <= len; k++) {
+        if (buf[k] == 'E' && buf[k + 1] == 'I' && isspace((unsigned char)buf[k - 1]) &&
+            (k + 2 == len || pdf_delimiter(buf[k + 2])))
+            return k + 2;
+    }
+    return len;
+}
+
+// Walk one decoded content stream and append the text shown by Tj, TJ, '
+// and " to out, breaking lines when the text position moves vertically
+static void pdf_content_text(const char *buf, size_t len, TextBuffer *out)
+{
+    PdfText pt;
+    memset(&pt, 0, sizeof(pt));
+    pt.out = out;
+
+    size_t i = 0;
+    while (i < len) {
+        char c = buf[i];
+        if (isspace((unsigned char)c)) {
+            i++;
+        } else if (c == '%') {
+            while (i < len && buf[i] != '\n' && buf[i] != '\r')
+                i++;
+        } else if (c == '(') {
+            i = pdf_literal(&pt, buf, len, i);
+        } else if (c == '<') {
+            i = i + 1 < len && buf[i + 1] == '<' ? i + 2 : pdf_hex(&pt, buf, len, i);
+        } else if (c == '[') {
+            pt.in_array = 1;
+            i++;
+        } else if (c == ']') {
+            pt.in_array = 0;
+            i++;
+        } else if (c == '/') {
+            for (i++; i < len && !pdf_delimiter(buf[i]); i++)
+                ;
+        } else if (isdigit((unsigned char)c) || c == '-' || c == '+' || c == '.') {
+            char *end;
+            double v = strtod(buf + i, &end);
+            if (end == buf + i || (size_t)(end - buf) > len) {
+                i++;
+                continue;
+            }
+            pdf_push_number(&pt, v);
+            i = (size_t)(end - buf);
+        } else if (isalpha((unsigned char)c) || c == '\'' || c == '"' || c == '*') {
+            size_t start = i;
+            for (i++; i < len && !pdf_delimiter(buf[i]); i++)
+                ;
+            if (tag_is(buf + start, i - start, "BI"))
+                i = pdf_skip_inline_image(buf, len, i);
+            else
+                pdf_operator(&pt, buf + start, i - start);
+        } else {
+            i++;
+        }
+    }
+
+    text_buffer_free(&pt.str);
+}
+
+static int region_has(const char *p, size_t n, const char *needle)
+{
+    return memmem(p, n, needle, strlen(needle)) != NULL;
+}
+
+// Streams that never carry page text: images, fonts, metadata, object and
+// cross-reference streams, or filters other than FlateDecode
+static int pdf_skip_stream(const char *dict, size_t n)
+{
+    static const char *skip[] = {
+        "/Image", "/XRef", "/ObjStm", "/Metadata", "/EmbeddedFile",
+        "/Length1", "/Length2", "/Length3", "/Type1C", "/CIDFontType0C", "/OpenType",
+        "/ASCII85Decode", "/ASCIIHexDecode", "/LZWDecode", "/RunLengthDecode",
+        "/DCTDecode", "/JPXDecode", "/CCITTFaxDecode", "/JBIG2Decode", "/Crypt",
+    };
+    for (size_t k = 0; k < sizeof(skip) / sizeof(skip[0]); k++) {
+        if (region_has(dict, n, skip[k]))
+            return 1;
+    }
+    return 0;
+}
+
+// Direct /Length value of a stream dictionary, or -1 if absent or indirect
+static long pdf_direct_length(const char *dict, size_t n)
+{
+    const char *p = memmem(dict, n, "/Length", 7);
+    if (!p || !isspace((unsigned char)p[7]))
+        return -1;
+    const char *end = dict + n;
+    char *after;
+    long v = strtol(p + 7, &after, 10);
+    if (after == p + 7 || after >= end)
+        return -1;
+    // "N G R" is an indirect reference
+    const char *q = after;
+    while (q < end && isspace((unsigned char)*q)) q++;
+    if (q < end && isdigit((unsigned char)*q)) {
+        while (q < end && isdigit((unsigned char)*q)) q++;
+        while (q < end && isspace((unsigned char)*q)) q++;
+        if (q < end && *q == 'R')
+            return -1;
+    }
+    return v;
+}
+
+// Decode every text-bearing stream in the file and collect shown text
+static void pdf_native(const char *buf, size_t len, TextBuffer *out)
+{
+    TextBuffer decoded = {0};
+    size_t pos = 0;
+    const char *s;
+    while (pos < len && (s = memmem(buf + pos, len - pos, "stream", 6)) != NULL) {
+        size_t at = (size_t)(s - buf);
+        pos = at + 6;
+        if (at >= 3 && memcmp(s - 3, "end", 3) == 0)
+            continue;
+
+        size_t data = at + 6;
+        if (data < len && buf[data] == '\r') data++;
+        if (data < len && buf[data] == '\n') data++;
+
+        // The stream dictionary sits between "obj" and "stream"
+        size_t from = at > PDF_DICT_LOOKBACK ? at - PDF_DICT_LOOKBACK : 0;
+        const char *dict = NULL;
+        for (size_t k = at; k >= from + 3; k--) {
+            if (memcmp(buf + k - 3, "obj", 3) == 0) {
+                dict = buf + k;
+                break;
+            }
+        }
+        if (!dict)
+            continue;
+        size_t dict_len = (size_t)(s - dict);
+
+        long length = pdf_direct_length(dict, dict_len);
+        size_t end;
+        if (length >= 0 && (size_t)length <= len - data) {
+            end = data + (size_t)length;
+        } else {
+            const char *e = memmem(buf + data, len - data, "endstream", 9);
+            if (!e)
+                break;
+            end = (size_t)(e - buf);
+        }
+        pos = end;
+
+        if (pdf_skip_stream(dict, dict_len))
+            continue;
+
+        decoded.len = 0;
+        if (region_has(dict, dict_len, "/FlateDecode"))
+            inflate_stream((const unsigned char *)buf + data, end - data, MAX_WBITS + 32, tb_sink, &decoded);
+        else if (!region_has(dict, dict_len, "/Filter"))
+            tb_append(&decoded, buf + data, end - data);
+
+        if (decoded.len > 0) {
+            // Keep a terminator after the data for strtod
+            tb_putc(&decoded, '\0');
+            decoded.len--;
+            pdf_content_text(decoded.data, decoded.len, out);
+            tb_newline(out);
+        }
+    }
+    text_buffer_free(&decoded);
+}
+
+// Native output is trusted when it is mostly readable text; fonts with custom
+// encodings (CID fonts, Type 3) decode to binary-looking glyph codes
+static int looks_like_text(const TextBuffer *tb)
+{
+    size_t readable = 0, letters = 0;
+    for (size_t i = 0; i < tb->len; i++) {
+        unsigned char c = (unsigned char)tb->data[i];
+        if (isalpha(c)) letters++;
+        if (isprint(c) || isspace(c) || c >= 0x80) readable++;
+    }
+    return letters > 0 && readable * 10 >= tb->len * 9;
+}
+
+// Last resort for PDFs the native decoder cannot read
+static int pdf_subprocess(const char *path, TextBuffer *out)
+{
+    char tmp[] = "/tmp/docsearch_pdfXXXXXX";
+    int fd = mkstemp(tmp);
+    if (fd < 0)
+        return -1;
+    close(fd);
+
+    char cmd[1200];
+    snprintf(cmd, sizeof(cmd), "pdftotext \"%s\" \"%s\" 2>/dev/null", path, tmp);
+    int rc = -1;
+    TRACE_BEGIN(t);
+    int status = system(cmd);
+    TRACE_END(t, TRACE_SUBPROCESS, path, 0);
+    if (status == 0) {
+        DocView doc;
+        if (doc_open(tmp, &doc) == 0) {
+            tb_append(out, doc.data, doc.len);
+            doc_close(&doc);
+            rc = 0;
+        }
+    }
+    unlink(tmp);
+    return rc;
+}
+
+// Append the text of a PDF to out: decode FlateDecode content streams and
+// interpret their text operators, falling back to pdftotext for encrypted
+// files or when the result does not look like text. Returns 0 on success.
+int extract_pdf(const char *path, TextBuffer *out)
+{
+    DocView doc;
+    if (doc_open(path, &doc) != 0)
+        return -1;
+
+    TextBuffer native = {0};
+    int encrypted = region_has(doc.data, doc.len, "/Encrypt");
+    if (!encrypted)
+        pdf_native(doc.data, doc.len, &native);
+    doc_close(&doc);
+
+    size_t start = out->len;
+    if (!encrypted && looks_like_text(&native))
+        tb_append(out, native.data, native.len);
+    else if (pdf_subprocess(path, out) != 0)
+        tb_append(out, native.data, native.len);  // better than nothing
+
+    text_buffer_free(&native);
+    return out->len > start ? 0 : -1;
+}
+
+// Extract a PDF or DOCX document into out. Returns 0 on success, -1 for
+// other formats or unreadable files.
+int extract_text(const char *path, TextBuffer *out)
+{
+    const char *ext = strrchr(path, '.');
+    if (ext && strcmp(ext, ".docx") == 0)
+        return extract_docx(path, out);
+    if (ext && strcmp(ext, ".pdf") == 0)
+        return extract_pdf(path, out);
+    return -1;
+}
@@ -0,0 +1,23 @@
+#ifndef EXTRACT_H
+#define EXTRACT_H
+
+#include <stddef.h>
+
+// Version of the text the extractors produce. Cached text is kept per
+// version; bump it whenever a change alters extraction output.
+#define EXTRACT_VERSION 1
+
+// Growable buffer the extractors append plain text to
+typedef struct {
+    char *data;
+    size_t len;
+    size_t cap;
+} TextBuffer;
+
+void text_buffer_free(TextBuffer *tb);
+
+int extract_docx(const char *path, TextBuffer *out);
+int extract_pdf(const char *path, TextBuffer *out);
+int extract_text(const char *path, TextBuffer *out);
+
+#endif
@@ -2,12 +2,18 @@
 #include <stdlib.h>
 #include <string.h>
 #include <dirent.h>
+#include <limits.h>
 #include <unistd.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <omp.h>
 #include <mpi.h>
 #include "file_utils.h"
+#include "scheduler.h"
+#include "extract.h"
+#include "doc_reader.h"
+#include "cache.h"
+#include "trace.h"
 
 int is_supported_file(const char *filename)
 {
@@ -17,229 +23,315 @@ int is_supported_file(const char *filename)
                    strcmp(ext, ".docx") == 0);
 }
 
-void list_files(const char *directory, char files[][512], int *count)
+// Walk dir and its subdirectories, one OpenMP task per directory. Each
+// thread collects into its own table, so no locking is needed. Running out
+// of memory sets *failed.
+static void walk_dir(const char *dir, PathTable *locals, int *failed)
 {
-    DIR *dir = opendir(directory);
-    if (!dir) {
-        *count = 0;
+    DIR *d = opendir(dir);
+    if (!d)
         return;
-    }
-    
+
     struct dirent *entry;
-    *count = 0;
-    while ((entry = readdir(dir)))
+    char path[PATH_MAX];
+    while ((entry = readdir(d)))
     {
-        if (entry->d_type == DT_REG && is_supported_file(entry->d_name))
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0)
+            continue;
+        if (snprintf(path, sizeof(path), "%s/%s", dir, entry->d_name) >= (int)sizeof(path))
+            continue;
+
+        int type = entry->d_type;
+        if (type == DT_UNKNOWN)
         {
-            snprintf(files[*count], 512, "%s/%s", directory, entry->d_name);
-            (*count)++;
+            struct stat st;
+            if (lstat(path, &st) != 0)
+                continue;
+            type = S_ISDIR(st.st_mode) ? DT_DIR : S_ISREG(st.st_mode) ? DT_REG : DT_UNKNOWN;
+        }
+
+        if (type == DT_DIR)
+        {
+            char *sub = strdup(path);
+            if (!sub)
+            {
+#pragma omp atomic write
+                *failed = 1;
+                continue;
+            }
+#pragma omp task firstprivate(sub)
+            {
+                walk_dir(sub, locals, failed);
+                free(sub);
+            }
+        }
+        else if (type == DT_REG && is_supported_file(entry->d_name))
+        {
+            if (path_table_add(&locals[omp_get_thread_num()], path) < 0)
+            {
+#pragma omp atomic write
+                *failed = 1;
+            }
         }
     }
-    closedir(dir);
+    closedir(d);
 }
 
-void preprocess_files(const char *src_dir, const char *out_dir, char output_files[][512], int *count, int mode)
+// Every supported file under directory, recursively. Files come back sorted
+// so every caller sees the same list in the same order. Returns 0, or -1
+// (files left empty) if memory runs out.
+int list_files(const char *directory, PathTable *files)
 {
-    // Create output directory
-    char mkdir_cmd[1024];
-    snprintf(mkdir_cmd, sizeof(mkdir_cmd), "mkdir -p \"%s\"", out_dir);
-    system(mkdir_cmd);
-    
-    char input_files[1000][512];
-    int total = 0;
+    path_table_init(files);
+    int threads = omp_get_max_threads();
+    PathTable *locals = malloc(threads * sizeof(PathTable));
+    if (!locals)
+        return -1;
+    for (int t = 0; t < threads; t++)
+        path_table_init(&locals[t]);
 
-    list_files(src_dir, input_files, &total);
-    *count = 0;
+    int failed = 0;
+#pragma omp parallel num_threads(threads)
+#pragma omp single
+    walk_dir(directory, locals, &failed);
 
-    int rank = 0, size = 1;
+    for (int t = 0; t < threads; t++)
+    {
+        if (!failed && path_table_append(files, &locals[t]) != 0)
+            failed = 1;
+        path_table_free(&locals[t]);
+    }
+    free(locals);
+    if (failed || path_table_sort(files) != 0)
+    {
+        path_table_free(files);
+        path_table_init(files);
+        return -1;
+    }
+    return 0;
+}
 
-    // Get MPI info if in MPI mode
-    if (mode == 3 || mode == 4)
+// Path of the text a document is searched through: .txt files are used in
+// place, everything else becomes <out_dir>/<name>.txt, where name is the path
+// below src_dir, extension included, with '_' escaped as "__" and '/' as
+// "_-". Every '_' of a name starts an escape, so no two documents share one
+// (a_b/c.pdf is a__b_-c.pdf.txt, a/b_c.pdf is a_-b__c.pdf.txt).
+void text_path(const char *src_dir, const char *file, const char *out_dir, char *output_path, size_t size)
+{
+    const char *ext = strrchr(file, '.');
+    if (strcmp(ext, ".txt") == 0)
     {
-        MPI_Comm_rank(MPI_COMM_WORLD, &rank);
-        MPI_Comm_size(MPI_COMM_WORLD, &size);
+        snprintf(output_path, size, "%s", file);
+        return;
     }
 
-    //=================================== SERIAL MODE =========================================
-    if (mode == 1)
+    size_t dir_len = strlen(src_dir);
+    const char *rel = strncmp(file, src_dir, dir_len) == 0 && file[dir_len] == '/'
+                      ? file + dir_len + 1 : strrchr(file, '/') + 1;
+    char name[PATH_MAX];
+    size_t n = 0;
+    for (const char *c = rel; *c && n + 2 < sizeof(name); c++)
     {
-        for (int i = 0; i < total; i++)
+        if (*c == '_' || *c == '/')
         {
-            const char *file = input_files[i];
-            const char *ext = strrchr(file, '.');
-            char base[256];
-            sscanf(strrchr(file, '/') + 1, "%[^.]", base);
-
-            if (strcmp(ext, ".txt") == 0)
-            {
-                snprintf(output_files[*count], 512, "%s", file);
-            }
-            else if (strcmp(ext, ".pdf") == 0)
-            {
-                snprintf(output_files[*count], 512, "%s/%s.txt", out_dir, base);
-                char cmd[1024];
-                snprintf(cmd, sizeof(cmd), "pdftotext \"%s\" \"%s\" 2>/dev/null", file, output_files[*count]);
-                system(cmd);
-            }
-            else if (strcmp(ext, ".docx") == 0)
-            {
-                char orig_output[512];
-                snprintf(orig_output, sizeof(orig_output), "/tmp/%s.txt", base);
-                char cmd[1024];
-                snprintf(cmd, sizeof(cmd), "libreoffice --headless --convert-to txt:Text \"%s\" --outdir /tmp > /dev/null 2>&1", file);
-                system(cmd);
-                snprintf(output_files[*count], 512, "%s/%s.txt", out_dir, base);
-                rename(orig_output, output_files[*count]);
-            }
+            name[n++] = '_';
+            name[n++] = *c == '_' ? '_' : '-';
+        }
+        else
+        {
+            name[n++] = *c;
+        }
+    }
+    name[n] = '\0';
+    snprintf(output_path, size, "%s/%s.txt", out_dir, name);
+}
 
-            (*count)++;
+// Fill output_files with the text path of every input, in input order.
+// Returns 0, or -1 (output_files left empty) if memory runs out.
+static int text_paths(const char *src_dir, const PathTable *inputs, const char *out_dir, PathTable *output_files)
+{
+    char output_path[PATH_MAX];
+    path_table_init(output_files);
+    for (int i = 0; i < inputs->count; i++)
+    {
+        text_path(src_dir, path_at(inputs, i), out_dir, output_path, sizeof(output_path));
+        if (path_table_add(output_files, output_path) < 0)
+        {
+            path_table_free(output_files);
+            path_table_init(output_files);
+            return -1;
         }
     }
+    return 0;
+}
+
+// Extract the text of one document in process and register it in memory
+// under output_path, where the matchers will look for it. Text already in the
+// extraction cache is linked to output_path instead; fresh text is added to
+// the cache (or, with caching off, written to output_path) for readers in
+// other processes and later runs. Returns 0, or -1 if no text could be
+// extracted (output_path is left as it was).
+int convert_file(const char *file, const char *output_path)
+{
+    const char *ext = strrchr(file, '.');
+    if (strcmp(ext, ".txt") == 0)
+        return 0;
+
+    CacheKey key;
+    TRACE_BEGIN(cache_start);
+    int cached = cache_fetch(file, output_path, &key) == 1;
+    TRACE_END(cache_start, TRACE_CACHE, file, 0);
+    if (cached)
+        return 0;
+
+    TextBuffer text = {0};
+    TRACE_BEGIN(extract_start);
+    int rc = extract_text(file, &text);
+    TRACE_END(extract_start, TRACE_EXTRACT, file, text.len);
+    if (rc != 0)
+    {
+        text_buffer_free(&text);
+        return -1;
+    }
+
+    // Replaced rather than rewritten: output_path may be a link into the cache
+    if (cache_store(&key, text.data, text.len, output_path) != 0)
+        cache_write_file(output_path, text.data, text.len);
+    if (doc_register(output_path, text.data, text.len) != 0)
+        text_buffer_free(&text);
+    return 0;
+}
+
+static void make_dir(const char *dir)
+{
+    char mkdir_cmd[1024];
+    snprintf(mkdir_cmd, sizeof(mkdir_cmd), "mkdir -p \"%s\"", dir);
+    system(mkdir_cmd);
+}
+
+// Returns 0, or -1 (output_files left empty) if memory runs out
+int preprocess_files(const char *src_dir, const char *out_dir, PathTable *output_files, int mode)
+{
+    // Create output directory
+    make_dir(out_dir);
+    
+    PathTable inputs;
+    path_table_init(output_files);
+    if (list_files(src_dir, &inputs) != 0)
+        return -1;
+    if (text_paths(src_dir, &inputs, out_dir, output_files) != 0)
+    {
+        path_table_free(&inputs);
+        return -1;
+    }
+
+    //=================================== SERIAL MODE =========================================
+    if (mode == 1)
+    {
+        for (int i = 0; i < inputs.count; i++)
+            convert_file(path_at(&inputs, i), path_at(output_files, i));
+    }
 
     //============================================== OPENMP MODE ====================================================
     else if (mode == 2)
     {
-        // to ensure thread-safe access to the count variable
-        char temp_output_files[1000][512];
-        int temp_count = 0;
-
 #pragma omp parallel for schedule(dynamic)
-        for (int i = 0; i < total; i++)
-        {
-            const char *file = input_files[i];
-            const char *ext = strrchr(file, '.');
-            char base[256];
-            sscanf(strrchr(file, '/') + 1, "%[^.]", base);
+        for (int i = 0; i < inputs.count; i++)
+            convert_file(path_at(&inputs, i), path_at(output_files, i));
+    }
 
-            char output_path[512];
+    path_table_free(&inputs);
+    return 0;
+}
 
-            if (strcmp(ext, ".txt") == 0)
-            {
-                snprintf(output_path, 512, "%s", file);
-            }
-            else if (strcmp(ext, ".pdf") == 0)
-            {
-                snprintf(output_path, 512, "%s/%s.txt", out_dir, base);
-                char cmd[1024];
-                snprintf(cmd, sizeof(cmd), "pdftotext \"%s\" \"%s\" 2>/dev/null", file, output_path);
-                system(cmd);
-            }
-            else if (strcmp(ext, ".docx") == 0)
-            {
-                char orig_output[512];
-                snprintf(orig_output, sizeof(orig_output), "/tmp/%s_%d.txt", base, omp_get_thread_num());
-                char cmd[1024];
-                snprintf(cmd, sizeof(cmd), "libreoffice --headless --convert-to txt:Text \"%s\" --outdir /tmp > /dev/null 2>&1", file);
-                system(cmd);
-                snprintf(output_path, 512, "%s/%s.txt", out_dir, base);
-                rename(orig_output, output_path);
-            }
+// Collective over comm: rank 0 walks the input tree and assigns every
+// document to a rank by input size; the input list and the owner map
+// (*owner, owner[i] is the rank converting document i; free() it) are
+// broadcast at their actual size. Every rank derives the same text paths
+// (output_files) without converting anything yet. Returns 0, or -1 on every
+// rank (with the tables left empty and *owner NULL) if any of them runs out
+// of memory.
+int plan_files(const char *src_dir, const char *out_dir, PathTable *inputs, PathTable *output_files, int **owner, MPI_Comm comm)
+{
+    int rank, size;
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &size);
 
-#pragma omp critical
-            {
-                snprintf(temp_output_files[temp_count], 512, "%s", output_path);
-                temp_count++;
-            }
-        }
-        
-        // Copy results back
-        for (int i = 0; i < temp_count; i++) {
-            snprintf(output_files[i], 512, "%s", temp_output_files[i]);
-        }
-        *count = temp_count;
+    make_dir(out_dir);
+
+    *owner = NULL;
+    path_table_init(inputs);
+    path_table_init(output_files);
+    int ok = rank != 0 || list_files(src_dir, inputs) == 0;
+    MPI_Bcast(&ok, 1, MPI_INT, 0, comm);
+    if (!ok)
+        return -1;
+    TRACE_BEGIN(bcast_start);
+    if (path_table_bcast(inputs, 0, comm) != 0)
+    {
+        path_table_free(inputs);
+        path_table_init(inputs);
+        return -1;
     }
 
-    // MPI MODE (mode 3) or MPI + OpenMP MODE (mode 4)
-    else if (mode == 3 || mode == 4)
+    int total = inputs->count;
+    *owner = malloc((total > 0 ? total : 1) * sizeof(int));
+    ok = *owner != NULL;
+    MPI_Allreduce(MPI_IN_PLACE, &ok, 1, MPI_INT, MPI_LAND, comm);
+    if (ok)
     {
-        // In MPI mode, only rank 0 do all preprocessing
-
-        if (rank == 0) {
-            if (mode == 3) {
-                //====================================== Pure MPI ===============================================
-                for (int i = 0; i < total; i++)
-                {
-                    const char *file = input_files[i];
-                    const char *ext = strrchr(file, '.');
-                    char base[256];
-                    sscanf(strrchr(file, '/') + 1, "%[^.]", base);
-
-                    if (strcmp(ext, ".txt") == 0)
-                    {
-                        snprintf(output_files[*count], 512, "%s", file);
-                    }
-                    else if (strcmp(ext, ".pdf") == 0)
-                    {
-                        snprintf(output_files[*count], 512, "%s/%s.txt", out_dir, base);
-                        char cmd[1024];
-                        snprintf(cmd, sizeof(cmd), "pdftotext \"%s\" \"%s\" 2>/dev/null", file, output_files[*count]);
-                        system(cmd);
-                    }
-                    else if (strcmp(ext, ".docx") == 0)
-                    {
-                        char orig_output[512];
-                        snprintf(orig_output, sizeof(orig_output), "/tmp/%s.txt", base);
-                        char cmd[1024];
-                        snprintf(cmd, sizeof(cmd), "libreoffice --headless --convert-to txt:Text \"%s\" --outdir /tmp > /dev/null 2>&1", file);
-                        system(cmd);
-                        snprintf(output_files[*count], 512, "%s/%s.txt", out_dir, base);
-                        rename(orig_output, output_files[*count]);
-                    }
-
-                    (*count)++;
-                }
-            } else {
-                //======================================= MPI + OpenMP ========================================
-                char temp_output_files[1000][512];
-                int temp_count = 0;
+        if (rank == 0)
+            ok = assign_owners(inputs, size, *owner) == 0;
+        MPI_Bcast(&ok, 1, MPI_INT, 0, comm);
+    }
+    if (ok)
+        MPI_Bcast(*owner, total, MPI_INT, 0, comm);
+    TRACE_END(bcast_start, TRACE_BCAST, NULL, inputs->blob_len);
 
-#pragma omp parallel for schedule(dynamic)
-                for (int i = 0; i < total; i++)
-                {
-                    const char *file = input_files[i];
-                    const char *ext = strrchr(file, '.');
-                    char base[256];
-                    sscanf(strrchr(file, '/') + 1, "%[^.]", base);
-
-                    char output_path[512];
-
-                    if (strcmp(ext, ".txt") == 0)
-                    {
-                        snprintf(output_path, 512, "%s", file);
-                    }
-                    else if (strcmp(ext, ".pdf") == 0)
-                    {
-                        snprintf(output_path, 512, "%s/%s.txt", out_dir, base);
-                        char cmd[1024];
-                        snprintf(cmd, sizeof(cmd), "pdftotext \"%s\" \"%s\" 2>/dev/null", file, output_path);
-                        system(cmd);
-                    }
-                    else if (strcmp(ext, ".docx") == 0)
-                    {
-                        char orig_output[512];
-                        snprintf(orig_output, sizeof(orig_output), "/tmp/%s_%d.txt", base, omp_get_thread_num());
-                        char cmd[1024];
-                        snprintf(cmd, sizeof(cmd), "libreoffice --headless --convert-to txt:Text \"%s\" --outdir /tmp > /dev/null 2>&1", file);
-                        system(cmd);
-                        snprintf(output_path, 512, "%s/%s.txt", out_dir, base);
-                        rename(orig_output, output_path);
-                    }
-
-#pragma omp critical
-                    {
-                        snprintf(temp_output_files[temp_count], 512, "%s", output_path);
-                        temp_count++;
-                    }
-                }
-                
-                // Copy results back
-                for (int i = 0; i < temp_count; i++) {
-                    snprintf(output_files[i], 512, "%s", temp_output_files[i]);
-                }
-                *count = temp_count;
-            }
-        }
-        
-       
+    ok = ok && text_paths(src_dir, inputs, out_dir, output_files) == 0;
+    MPI_Allreduce(MPI_IN_PLACE, &ok, 1, MPI_INT, MPI_LAND, comm);
+    if (ok)
+        return 0;
+    path_table_free(inputs);
+    path_table_init(inputs);
+    path_table_free(output_files);
+    path_table_init(output_files);
+    free(*owner);
+    *owner = NULL;
+    return -1;
+}
+
+// MPI MODE (mode 3) or MPI + OpenMP MODE (mode 4): collective. Every rank
+// converts its own share of the documents (with OpenMP threads when threaded
+// is set) instead of leaving all extraction to rank 0. Every rank derives the
+// same output paths, so converted paths are never sent back; a rank only
+// needs to read the text it produced itself. With inputs set, it receives the
+// source documents, index for index with output_files. Returns 0, or -1 on
+// every rank if plan_files() fails.
+int preprocess_files_mpi(const char *src_dir, const char *out_dir, PathTable *inputs, PathTable *output_files, int **owner, int threaded)
+{
+    int rank;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+
+    PathTable sources;
+    if (inputs)
+        path_table_init(inputs);
+    if (plan_files(src_dir, out_dir, &sources, output_files, owner, MPI_COMM_WORLD) != 0)
+        return -1;
+
+#pragma omp parallel for schedule(dynamic) if (threaded)
+    for (int i = 0; i < sources.count; i++)
+    {
+        if ((*owner)[i] == rank)
+            convert_file(path_at(&sources, i), path_at(output_files, i));
     }
-}
\ No newline at end of file
+
+    if (inputs)
+        *inputs = sources;
+    else
+        path_table_free(&sources);
+    TRACE_BEGIN(barrier_start);
+    MPI_Barrier(MPI_COMM_WORLD);
+    TRACE_END(barrier_start, TRACE_BARRIER, NULL, 0);
+    return 0;
+}
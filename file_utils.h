@@ -1,8 +1,15 @@
 #ifndef FILE_UTILS_H
 #define FILE_UTILS_H
 
+#include <mpi.h>
+#include "path_table.h"
+
 int is_supported_file(const char *filename);
-void list_files(const char *directory, char files[][512], int *count);
-void preprocess_files(const char *src_dir, const char *out_dir, char output_files[][512], int *count, int mode);
+int list_files(const char *directory, PathTable *files);
+int preprocess_files(const char *src_dir, const char *out_dir, PathTable *output_files, int mode);
+void text_path(const char *src_dir, const char *file, const char *out_dir, char *output_path, size_t size);
+int convert_file(const char *file, const char *output_path);
+int plan_files(const char *src_dir, const char *out_dir, PathTable *inputs, PathTable *output_files, int **owner, MPI_Comm comm);
+int preprocess_files_mpi(const char *src_dir, const char *out_dir, PathTable *inputs, PathTable *output_files, int **owner, int threaded);
 
 #endif
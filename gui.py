@@ -3,7 +3,8 @@ from tkinter import filedialog, messagebox, ttk
 import subprocess
 import time
 import os
-import re
+import json
+import tempfile
 
 # open a folder
 def browse_folder():
@@ -15,13 +16,14 @@ def browse_folder():
 def count_supported_files(folder):
     supported_exts = ('.txt', '.pdf', '.docx')
     count = 0
-    for entry in os.listdir(folder):
-        if entry.lower().endswith(supported_exts):
-            count += 1
+    for _, _, files in os.walk(folder):
+        for entry in files:
+            if entry.lower().endswith(supported_exts):
+                count += 1
     return count
 
-def extract_performance_data(output):
-    """Extract detailed performance data from the C program output"""
+def extract_performance_data(report):
+    """Collect performance data from the benchmark report (JSON) of the C program"""
     data = {
         'matches': [],
         'total_files': 0,
@@ -30,108 +32,55 @@ def extract_performance_data(output):
         'preprocessing_times': {},
         'search_times': {},
         'found_counts': {},
+        'threads': {},
+        'ranks': {},
         'speedups': {},
         'efficiency': {},
         'insights': []
     }
-    
-    lines = output.splitlines()
-    
-    # Extract matches from SERIAL output
+
+    # Matches of the serial reference run
     seen_filenames = set()
-    for line in lines:
-        if line.startswith("[SERIAL]") and "Found in" in line:
-            full_path = line.split("Found in")[-1].strip()
-            filename = os.path.basename(full_path)
-            if filename not in seen_filenames:
-                data['matches'].append(filename)
-                seen_filenames.add(filename)
-    
+    for path in report.get('matches', []):
+        filename = os.path.basename(path)
+        if filename not in seen_filenames:
+            data['matches'].append(filename)
+            seen_filenames.add(filename)
+
     data['match_count'] = len(data['matches'])
-    
-    # Extract timing data using regex patterns
-    time_patterns = {
-        'serial': r'\[SERIAL\] Total: ([\d.]+) seconds, Found: (\d+)',
-        'openmp': r'\[OPENMP\] Total: ([\d.]+) seconds, Found: (\d+)',
-        'mpi': r'\[MPI\] Total: ([\d.]+) seconds, Found: (\d+)',
-        'hybrid': r'\[MPI\+OPENMP\] Total: ([\d.]+) seconds, Found: (\d+)'
-    }
-    
-    preprocessing_patterns = {
-        'serial': r'\[SERIAL\] Preprocessing: ([\d.]+) seconds',
-        'openmp': r'\[OPENMP\] Preprocessing: ([\d.]+) seconds',
-        'mpi': r'\[MPI\] Preprocessing: ([\d.]+) seconds',
-        'hybrid': r'\[MPI\+OPENMP\] Preprocessing: ([\d.]+) seconds'
-    }
-    
-    search_patterns = {
-        'serial': r'\[SERIAL\] Search: ([\d.]+) seconds',
-        'openmp': r'\[OPENMP\] Search: ([\d.]+) seconds',
-        'mpi': r'\[MPI\] Search: ([\d.]+) seconds',
-        'hybrid': r'\[MPI\+OPENMP\] Search: ([\d.]+) seconds'
-    }
-    
-    # Extract total times and found counts
-    for method, pattern in time_patterns.items():
-        match = re.search(pattern, output)
-        if match:
-            data['times'][method] = float(match.group(1))
-            data['found_counts'][method] = int(match.group(2))
-    
-    # Extract preprocessing times
-    for method, pattern in preprocessing_patterns.items():
-        match = re.search(pattern, output)
-        if match:
-            data['preprocessing_times'][method] = float(match.group(1))
-    
-    # Extract search times
-    for method, pattern in search_patterns.items():
-        match = re.search(pattern, output)
-        if match:
-            data['search_times'][method] = float(match.group(1))
-    
-    # Extract speedup data from the speedup table
-    speedup_section = False
-    for line in lines:
-        if "=== SPEEDUP ANALYSIS ===" in line:
-            speedup_section = True
-            continue
-        elif speedup_section and line.startswith("Total"):
-            # Parse speedup line: "Total           | 5.23x  | 3.45x  | 6.78x"
-            parts = line.split('|')
-            if len(parts) >= 4:
-                try:
-                    data['speedups']['openmp'] = float(parts[1].strip().rstrip('x'))
-                    data['speedups']['mpi'] = float(parts[2].strip().rstrip('x'))
-                    data['speedups']['hybrid'] = float(parts[3].strip().rstrip('x'))
-                except:
-                    pass
-            break
-    
-    # Extract efficiency data
-    for line in lines:
-        if "OpenMP:" in line and "% (16 threads)" in line:
-            match = re.search(r'([\d.]+)%', line)
-            if match:
-                data['efficiency']['openmp'] = float(match.group(1))
-        elif "MPI:" in line and "processes)" in line:
-            match = re.search(r'([\d.]+)%', line)
-            if match:
-                data['efficiency']['mpi'] = float(match.group(1))
-        elif "Hybrid:" in line and "processes ×" in line:
-            match = re.search(r'([\d.]+)%', line)
-            if match:
-                data['efficiency']['hybrid'] = float(match.group(1))
-    
-    # Extract performance insights
-    insights_section = False
-    for line in lines:
-        if "=== PERFORMANCE INSIGHTS ===" in line:
-            insights_section = True
-            continue
-        elif insights_section and line.startswith("✓"):
-            data['insights'].append(line[2:])  # Remove the checkmark
-    
+
+    for entry in report.get('methods', []):
+        method = entry['method']
+        data['times'][method] = entry['total']['median']
+        data['preprocessing_times'][method] = entry['preprocess']['median']
+        data['search_times'][method] = entry['search']['median']
+        data['found_counts'][method] = entry['found']
+        data['threads'][method] = entry['threads']
+        data['ranks'][method] = entry['ranks']
+
+    times = data['times']
+    if 'serial' not in times:
+        return data
+
+    # Speedup over serial, and efficiency per thread/process actually used
+    for method in ('openmp', 'mpi', 'hybrid'):
+        if method in times and times[method] > 0:
+            speedup = times['serial'] / times[method]
+            data['speedups'][method] = speedup
+            workers = data['ranks'][method] * data['threads'][method]
+            data['efficiency'][method] = speedup / workers * 100
+
+    pre = data['preprocessing_times']
+    search = data['search_times']
+    if pre.get('openmp', 0) > 0 and pre['openmp'] < pre['serial']:
+        data['insights'].append(f"OpenMP preprocessing shows {pre['serial'] / pre['openmp']:.2f}x speedup")
+    if pre.get('hybrid', 0) > 0 and pre['hybrid'] < pre['serial']:
+        data['insights'].append(f"Hybrid preprocessing shows {pre['serial'] / pre['hybrid']:.2f}x speedup")
+    if search.get('hybrid', 0) > 0 and search['hybrid'] < search.get('mpi', 0):
+        data['insights'].append(f"Hybrid search is {search['mpi'] / search['hybrid']:.2f}x faster than pure MPI")
+    if search.get('openmp', 0) > 0 and search['openmp'] < search['serial']:
+        data['insights'].append(f"OpenMP search shows {search['serial'] / search['openmp']:.2f}x speedup")
+
     return data
 
 def format_time(seconds):
@@ -161,13 +110,18 @@ def run_search():
     progress_var.set("Running search...")
     root.update()
 
-    cmd = ["mpirun", "-np", np, "./docsearch", docs_folder, pattern, mode]
+    report_file = tempfile.NamedTemporaryFile(suffix=".json", delete=False)
+    report_file.close()
+    cmd = ["mpirun", "-np", np, "./docsearch", docs_folder, pattern, mode,
+           "--bench=all", "--warmup=0", "--iters=1", "--format=json", "--report=" + report_file.name]
 
     try:
         start = time.time()
-        result = subprocess.run(cmd, capture_output=True, text=True, check=True)
+        subprocess.run(cmd, capture_output=True, text=True, check=True)
         end = time.time()
         wall_time = end - start
+        with open(report_file.name) as f:
+            report = json.load(f)
     except subprocess.CalledProcessError as e:
         output_text.config(state=tk.NORMAL)
         output_text.delete(1.0, tk.END)
@@ -179,9 +133,15 @@ def run_search():
         messagebox.showerror("Error", "MPI or docsearch executable not found. Please ensure they are installed and in PATH.")
         progress_var.set("Ready")
         return
+    except ValueError:
+        messagebox.showerror("Error", "docsearch did not produce a readable benchmark report.")
+        progress_var.set("Ready")
+        return
+    finally:
+        os.unlink(report_file.name)
 
     # Extract performance data
-    data = extract_performance_data(result.stdout)
+    data = extract_performance_data(report)
     total_files = count_supported_files(docs_folder)
 
     # Clear and populate output
@@ -245,11 +205,11 @@ def run_search():
         output_text.insert(tk.END, "=" * 50 + "\n")
         
         if 'openmp' in data['efficiency']:
-            output_text.insert(tk.END, f"OpenMP:      {data['efficiency']['openmp']:.1f}% (16 threads)\n")
+            output_text.insert(tk.END, f"OpenMP:      {data['efficiency']['openmp']:.1f}% ({data['threads']['openmp']} threads)\n")
         if 'mpi' in data['efficiency']:
-            output_text.insert(tk.END, f"MPI:         {data['efficiency']['mpi']:.1f}% ({np} processes)\n")
+            output_text.insert(tk.END, f"MPI:         {data['efficiency']['mpi']:.1f}% ({data['ranks']['mpi']} processes)\n")
         if 'hybrid' in data['efficiency']:
-            output_text.insert(tk.END, f"Hybrid:      {data['efficiency']['hybrid']:.1f}% ({np} processes × threads)\n")
+            output_text.insert(tk.END, f"Hybrid:      {data['efficiency']['hybrid']:.1f}% ({data['ranks']['hybrid']} processes × {data['threads']['hybrid']} threads)\n")
 
     # === PERFORMANCE INSIGHTS ===
     if data['insights']:
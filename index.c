@@ -0,0 +1,801 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "index.h"
+#include "approx_match.h"
+#include "doc_reader.h"
+#include "trace.h"
+
+#define INDEX_MAGIC "DSIX"
+#define INDEX_VERSION 3
+
+static PostingCodec build_codec = DEFAULT_CODEC;
+
+// One term while the index is being built: its text lives in the build arena,
+// its postings (and their term frequencies) grow as documents are added in
+// doc-ID order.
+typedef struct {
+    uint32_t str_off;
+    uint32_t str_len;
+    uint32_t *ids;
+    uint32_t *tfs;
+    uint32_t count;
+    uint32_t cap;
+} BuildTerm;
+
+typedef struct {
+    char *arena;
+    size_t arena_len, arena_cap;
+    BuildTerm *terms;
+    uint32_t term_count, term_cap;
+    uint32_t *slots;       // open-addressing table of term index + 1 (0 = empty)
+    uint32_t slot_cap;
+} IndexBuilder;
+
+static uint32_t hash_term(const char *s, size_t len)
+{
+    uint32_t h = 2166136261u;  // FNV-1a
+    for (size_t i = 0; i < len; i++) {
+        h ^= (unsigned char)s[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+static int builder_append(IndexBuilder *b, const char *s, size_t len, uint32_t *off)
+{
+    if (b->arena_len + len + 1 > b->arena_cap) {
+        size_t cap = b->arena_cap ? b->arena_cap * 2 : 1 << 16;
+        while (cap < b->arena_len + len + 1) cap *= 2;
+        char *arena = realloc(b->arena, cap);
+        if (!arena) return -1;
+        b->arena = arena;
+        b->arena_cap = cap;
+    }
+    *off = (uint32_t)b->arena_len;
+    memcpy(b->arena + b->arena_len, s, len);
+    b->arena[b->arena_len + len] = '\0';
+    b->arena_len += len + 1;
+    return 0;
+}
+
+static int builder_grow_slots(IndexBuilder *b)
+{
+    uint32_t cap = b->slot_cap ? b->slot_cap * 2 : 1024;
+    uint32_t *slots = calloc(cap, sizeof(uint32_t));
+    if (!slots) return -1;
+    for (uint32_t t = 0; t < b->term_count; t++) {
+        BuildTerm *term = &b->terms[t];
+        uint32_t h = hash_term(b->arena + term->str_off, term->str_len) & (cap - 1);
+        while (slots[h]) h = (h + 1) & (cap - 1);
+        slots[h] = t + 1;
+    }
+    free(b->slots);
+    b->slots = slots;
+    b->slot_cap = cap;
+    return 0;
+}
+
+// Record that `doc` contains the token `s[0..len)` (already lowercased)
+static int builder_add(IndexBuilder *b, const char *s, size_t len, uint32_t doc)
+{
+    if ((b->term_count + 1) * 2 > b->slot_cap && builder_grow_slots(b) != 0)
+        return -1;
+
+    uint32_t mask = b->slot_cap - 1;
+    uint32_t h = hash_term(s, len) & mask;
+    while (b->slots[h]) {
+        BuildTerm *term = &b->terms[b->slots[h] - 1];
+        if (term->str_len == len && memcmp(b->arena + term->str_off, s, len) == 0)
+            break;
+        h = (h + 1) & mask;
+    }
+
+    BuildTerm *term;
+    if (b->slots[h]) {
+        term = &b->terms[b->slots[h] - 1];
+    } else {
+        if (b->term_count == b->term_cap) {
+            uint32_t cap = b->term_cap ? b->term_cap * 2 : 1024;
+            BuildTerm *terms = realloc(b->terms, cap * sizeof(BuildTerm));
+            if (!terms) return -1;
+            b->terms = terms;
+            b->term_cap = cap;
+        }
+        term = &b->terms[b->term_count];
+        memset(term, 0, sizeof(*term));
+        if (builder_append(b, s, len, &term->str_off) != 0) return -1;
+        term->str_len = (uint32_t)len;
+        b->slots[h] = ++b->term_count;
+    }
+
+    if (term->count > 0 && term->ids[term->count - 1] == doc) {
+        term->tfs[term->count - 1]++;
+        return 0;
+    }
+    if (term->count == term->cap) {
+        uint32_t cap = term->cap ? term->cap * 2 : 4;
+        uint32_t *ids = realloc(term->ids, cap * sizeof(uint32_t));
+        if (!ids) return -1;
+        term->ids = ids;
+        uint32_t *tfs = realloc(term->tfs, cap * sizeof(uint32_t));
+        if (!tfs) return -1;
+        term->tfs = tfs;
+        term->cap = cap;
+    }
+    term->ids[term->count] = doc;
+    term->tfs[term->count++] = 1;
+    return 0;
+}
+
+static void builder_free(IndexBuilder *b)
+{
+    for (uint32_t t = 0; t < b->term_count; t++) {
+        free(b->terms[t].ids);
+        free(b->terms[t].tfs);
+    }
+    free(b->terms);
+    free(b->slots);
+    free(b->arena);
+}
+
+// Tokenize one document the same way approx_match() does: whitespace-delimited
+// words, lowercased. Words are kept whole; index_lookup() applies the
+// MAX_WORD - 1 split that fscanf("%255s") does when it compares them.
+static int index_document(IndexBuilder *b, const char *path, uint32_t doc, uint32_t *token_count)
+{
+    *token_count = 0;
+    DocView view;
+    if (doc_open(path, &view) != 0) return 0;
+
+    // Lowercase each word into a reusable buffer before hashing it
+    const unsigned char *p = (const unsigned char *)view.data;
+    size_t len = view.len, i = 0;
+    char *word = NULL;
+    size_t word_cap = 0;
+    int rc = 0;
+    while (rc == 0 && i < len) {
+        while (i < len && isspace(p[i])) i++;
+        size_t start = i;
+        while (i < len && !isspace(p[i])) i++;
+        size_t word_len = i - start;
+        if (word_len == 0)
+            break;
+
+        if (word_len > word_cap) {
+            size_t cap = word_cap ? word_cap : MAX_WORD;
+            while (cap < word_len) cap *= 2;
+            char *grown = realloc(word, cap);
+            if (!grown) {
+                rc = -1;
+                break;
+            }
+            word = grown;
+            word_cap = cap;
+        }
+        for (size_t k = 0; k < word_len; k++)
+            word[k] = (char)tolower(p[start + k]);
+        rc = builder_add(b, word, word_len, doc);
+        (*token_count)++;
+    }
+
+    free(word);
+    doc_close(&view);
+    return rc;
+}
+
+static int compare_build_terms(const void *a, const void *b, void *arena)
+{
+    const BuildTerm *ta = (const BuildTerm *)a;
+    const BuildTerm *tb = (const BuildTerm *)b;
+    return strcmp((const char *)arena + ta->str_off, (const char *)arena + tb->str_off);
+}
+
+// Sort context for doc IDs by path
+typedef struct {
+    const char *arena;
+    const IndexDoc *docs;
+} DocPaths;
+
+static int compare_doc_paths(const void *a, const void *b, void *ctx)
+{
+    const DocPaths *d = (const DocPaths *)ctx;
+    return strcmp(d->arena + d->docs[*(const uint32_t *)a].path_off,
+                  d->arena + d->docs[*(const uint32_t *)b].path_off);
+}
+
+// Term-frequency factor of BM25 for a term occurring tf times in a document
+// of doc_len tokens; the full score multiplies it by the term's IDF
+double bm25_weight(uint32_t tf, uint32_t doc_len, double avg_doc_len)
+{
+    double norm = 1.0 - BM25_B + BM25_B * (avg_doc_len > 0 ? doc_len / avg_doc_len : 1.0);
+    return tf * (BM25_K1 + 1.0) / (tf + BM25_K1 * norm);
+}
+
+static int write_all(FILE *fp, const void *data, size_t size)
+{
+    return fwrite(data, 1, size, fp) == size ? 0 : -1;
+}
+
+// Posting encoding of the indexes written from now on
+void index_set_codec(PostingCodec codec)
+{
+    build_codec = codec;
+}
+
+// Encode every term of b into one buffer; post_offs[t] receives the offset
+// of term t's list. Returns the buffer (caller frees), or NULL.
+static unsigned char *encode_postings(const IndexBuilder *b, uint64_t *post_offs, uint64_t *size)
+{
+    size_t cap = 1 << 16, len = 0;
+    unsigned char *buf = malloc(cap);
+    for (uint32_t t = 0; t < b->term_count && buf; t++) {
+        size_t need = len + postings_bound(b->terms[t].count);
+        if (need > cap) {
+            while (cap < need) cap *= 2;
+            unsigned char *grown = realloc(buf, cap);
+            if (!grown) {
+                free(buf);
+                return NULL;
+            }
+            buf = grown;
+        }
+        post_offs[t] = len;
+        len += postings_encode(build_codec, b->terms[t].ids, b->terms[t].tfs, b->terms[t].count, buf + len);
+    }
+    *size = len;
+    return buf;
+}
+
+// Write the terms of b and docs[0..count) (paths in b's arena) as an index
+// at index_path, replacing it atomically. Sorts b's terms.
+static int write_index(IndexBuilder *b, const IndexDoc *docs, uint32_t count, const char *index_path)
+{
+    uint32_t *order = malloc((count > 0 ? count : 1) * sizeof(uint32_t));
+    uint64_t *post_offs = malloc((b->term_count > 0 ? b->term_count : 1) * sizeof(uint64_t));
+    if (!order || !post_offs) {
+        free(order);
+        free(post_offs);
+        return -1;
+    }
+    for (uint32_t i = 0; i < count; i++)
+        order[i] = i;
+    DocPaths paths = { b->arena, docs };
+    qsort_r(b->terms, b->term_count, sizeof(BuildTerm), compare_build_terms, b->arena);
+    qsort_r(order, count, sizeof(uint32_t), compare_doc_paths, &paths);
+
+    uint64_t postings_size;
+    unsigned char *postings = encode_postings(b, post_offs, &postings_size);
+    char tmp_path[1024];
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", index_path);
+    FILE *fp = postings ? fopen(tmp_path, "wb") : NULL;
+    if (!fp) {
+        free(order);
+        free(post_offs);
+        free(postings);
+        return -1;
+    }
+
+    IndexHeader h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, INDEX_MAGIC, 4);
+    h.version = INDEX_VERSION;
+    h.doc_count = count;
+    h.term_count = b->term_count;
+    h.docs_off = sizeof(IndexHeader);
+    h.order_off = h.docs_off + (uint64_t)count * sizeof(IndexDoc);
+    h.terms_off = (h.order_off + (uint64_t)count * sizeof(uint32_t) + 7) & ~(uint64_t)7;
+    h.strings_off = h.terms_off + (uint64_t)b->term_count * sizeof(IndexTerm);
+    h.strings_size = b->arena_len;
+    h.postings_off = (h.strings_off + h.strings_size + 7) & ~(uint64_t)7;
+    h.postings_size = postings_size;
+    h.codec = build_codec;
+
+    for (uint32_t t = 0; t < b->term_count; t++)
+        h.postings_count += b->terms[t].count;
+    for (uint32_t i = 0; i < count; i++)
+        h.total_tokens += docs[i].token_count;
+    double avg_doc_len = count > 0 ? (double)h.total_tokens / count : 0.0;
+
+    static const char pad[8] = { 0 };
+    int rc = 0;
+    rc |= write_all(fp, &h, sizeof(h));
+    rc |= write_all(fp, docs, (size_t)count * sizeof(IndexDoc));
+    rc |= write_all(fp, order, (size_t)count * sizeof(uint32_t));
+    rc |= write_all(fp, pad, h.terms_off - (h.order_off + (uint64_t)count * sizeof(uint32_t)));
+
+    for (uint32_t t = 0; t < b->term_count && rc == 0; t++) {
+        const BuildTerm *bt = &b->terms[t];
+        IndexTerm term = { bt->str_off, bt->str_len, bt->count, 0.0f, post_offs[t] };
+        for (uint32_t p = 0; p < bt->count; p++) {
+            double w = bm25_weight(bt->tfs[p], docs[bt->ids[p]].token_count, avg_doc_len);
+            if (w > term.max_weight)
+                term.max_weight = (float)w;
+        }
+        rc |= write_all(fp, &term, sizeof(term));
+    }
+
+    rc |= write_all(fp, b->arena, b->arena_len);
+    rc |= write_all(fp, pad, h.postings_off - (h.strings_off + h.strings_size));
+    rc |= write_all(fp, postings, postings_size);
+
+    if (fclose(fp) != 0) rc = -1;
+    if (rc == 0 && rename(tmp_path, index_path) != 0) rc = -1;
+    if (rc != 0) remove(tmp_path);
+    free(order);
+    free(post_offs);
+    free(postings);
+    return rc;
+}
+
+// Tokenize every document once and write the inverted index to index_path.
+// Doc IDs are positions in `files`. Returns 0 on success, -1 on failure.
+int index_build(const PathTable *files, const char *index_path)
+{
+    TRACE_BEGIN(build_start);
+    int count = files->count;
+    IndexBuilder b;
+    memset(&b, 0, sizeof(b));
+
+    IndexDoc *docs = calloc(count > 0 ? count : 1, sizeof(IndexDoc));
+    if (!docs)
+        return -1;
+
+    int rc = 0;
+    for (int i = 0; i < count && rc == 0; i++)
+        rc = index_document(&b, path_at(files, i), (uint32_t)i, &docs[i].token_count);
+
+    // Document paths go into the same blob as the terms
+    for (int i = 0; i < count && rc == 0; i++)
+        rc = builder_append(&b, path_at(files, i), strlen(path_at(files, i)), &docs[i].path_off);
+
+    if (rc == 0)
+        rc = write_index(&b, docs, (uint32_t)count, index_path);
+
+    builder_free(&b);
+    free(docs);
+    TRACE_END(build_start, TRACE_INDEX_BUILD, index_path, 0);
+    return rc;
+}
+
+// Append a term with room for `cap` postings to b (terms arrive in order,
+// so the hash table is not used)
+static BuildTerm *builder_push(IndexBuilder *b, const char *s, uint32_t len, uint32_t cap)
+{
+    if (b->term_count == b->term_cap) {
+        uint32_t grown_cap = b->term_cap ? b->term_cap * 2 : 1024;
+        BuildTerm *terms = realloc(b->terms, grown_cap * sizeof(BuildTerm));
+        if (!terms) return NULL;
+        b->terms = terms;
+        b->term_cap = grown_cap;
+    }
+    BuildTerm *term = &b->terms[b->term_count];
+    memset(term, 0, sizeof(*term));
+    term->ids = malloc((cap > 0 ? cap : 1) * sizeof(uint32_t));
+    term->tfs = malloc((cap > 0 ? cap : 1) * sizeof(uint32_t));
+    if (!term->ids || !term->tfs || builder_append(b, s, len, &term->str_off) != 0) {
+        free(term->ids);
+        free(term->tfs);
+        return NULL;
+    }
+    term->str_len = len;
+    term->cap = cap;
+    b->term_count++;
+    return term;
+}
+
+// Merge the live documents of count indexes into one at index_path without
+// re-tokenizing them. Documents keep their order (parts in turn, doc IDs
+// ascending within each), so the postings of a term are the concatenation
+// of its postings in every part. dead[p] (or dead itself) may be NULL;
+// otherwise documents d with dead[p][d] set are dropped. Returns 0 on
+// success, -1 on failure.
+int index_merge(const DocIndex *parts, const unsigned char *const *dead, int count, const char *index_path)
+{
+    TRACE_BEGIN(merge_start);
+    IndexBuilder b;
+    memset(&b, 0, sizeof(b));
+
+    uint64_t total = 0;
+    for (int p = 0; p < count; p++)
+        total += parts[p].doc_count;
+    uint32_t **remap = calloc(count > 0 ? count : 1, sizeof(uint32_t *));
+    uint32_t *slots = malloc((total > 0 ? total : 1) * sizeof(uint32_t));
+    IndexDoc *docs = malloc((total > 0 ? total : 1) * sizeof(IndexDoc));
+    uint32_t *cursor = calloc(count > 0 ? count : 1, sizeof(uint32_t));
+    int rc = remap && slots && docs && cursor ? 0 : -1;
+
+    // New doc IDs, UINT32_MAX for dropped documents
+    uint32_t live = 0;
+    uint64_t next = 0;
+    for (int p = 0; p < count && rc == 0; p++) {
+        const unsigned char *gone = dead ? dead[p] : NULL;
+        remap[p] = slots + next;
+        next += parts[p].doc_count;
+        for (uint32_t d = 0; d < parts[p].doc_count && rc == 0; d++) {
+            if (gone && gone[d]) {
+                remap[p][d] = UINT32_MAX;
+                continue;
+            }
+            const char *path = parts[p].strings + parts[p].docs[d].path_off;
+            docs[live].token_count = parts[p].docs[d].token_count;
+            rc = builder_append(&b, path, strlen(path), &docs[live].path_off);
+            remap[p][d] = live++;
+        }
+    }
+
+    // k-way merge of the sorted dictionaries
+    while (rc == 0) {
+        const char *least = NULL;
+        uint32_t least_len = 0, cap = 0;
+        for (int p = 0; p < count; p++) {
+            if (cursor[p] == parts[p].term_count)
+                continue;
+            const IndexTerm *term = &parts[p].terms[cursor[p]];
+            const char *s = parts[p].strings + term->str_off;
+            int cmp = least ? strcmp(s, least) : -1;
+            if (cmp < 0) {
+                least = s;
+                least_len = term->str_len;
+                cap = 0;
+            }
+            if (cmp <= 0)
+                cap += term->post_count;
+        }
+        if (!least)
+            break;
+
+        BuildTerm *merged = builder_push(&b, least, least_len, cap);
+        if (!merged) {
+            rc = -1;
+            break;
+        }
+        for (int p = 0; p < count; p++) {
+            if (cursor[p] == parts[p].term_count)
+                continue;
+            const IndexTerm *term = &parts[p].terms[cursor[p]];
+            if (strcmp(parts[p].strings + term->str_off, b.arena + merged->str_off) != 0)
+                continue;
+            // Decode in place, then keep the live documents under their new IDs
+            uint32_t *ids = merged->ids + merged->count, *tfs = merged->tfs + merged->count;
+            postings_decode(parts[p].codec, parts[p].postings + term->post_off, term->post_count, ids, tfs);
+            for (uint32_t i = 0; i < term->post_count; i++) {
+                uint32_t doc = remap[p][ids[i]];
+                if (doc == UINT32_MAX)
+                    continue;
+                merged->ids[merged->count] = doc;
+                merged->tfs[merged->count++] = tfs[i];
+            }
+            cursor[p]++;
+        }
+        // A term only dropped documents contained disappears
+        if (merged->count == 0) {
+            free(merged->ids);
+            free(merged->tfs);
+            b.term_count--;
+        }
+    }
+
+    if (rc == 0)
+        rc = write_index(&b, docs, live, index_path);
+
+    builder_free(&b);
+    free(remap);
+    free(slots);
+    free(docs);
+    free(cursor);
+    TRACE_END(merge_start, TRACE_INDEX_MERGE, index_path, 0);
+    return rc;
+}
+
+// [off, off + len) lies within [start, end), without overflowing
+static int section_fits(uint64_t off, uint64_t len, uint64_t start, uint64_t end)
+{
+    return off >= start && off <= end && len <= end - off;
+}
+
+// Check that every section, and every offset the search follows from the
+// documents and terms into them, stays inside the mapped file
+static int index_valid(const char *base, uint64_t size)
+{
+    const IndexHeader *h = (const IndexHeader *)base;
+    if (memcmp(h->magic, INDEX_MAGIC, 4) != 0 || h->version != INDEX_VERSION || h->codec >= CODEC_COUNT)
+        return 0;
+    if (h->docs_off % sizeof(uint32_t) || h->order_off % sizeof(uint32_t) || h->terms_off % sizeof(uint64_t) ||
+        !section_fits(h->postings_off, h->postings_size, 0, size) ||
+        !section_fits(h->strings_off, h->strings_size, 0, h->postings_off) ||
+        !section_fits(h->terms_off, (uint64_t)h->term_count * sizeof(IndexTerm), 0, h->strings_off) ||
+        !section_fits(h->order_off, (uint64_t)h->doc_count * sizeof(uint32_t), 0, h->terms_off) ||
+        !section_fits(h->docs_off, (uint64_t)h->doc_count * sizeof(IndexDoc), sizeof(IndexHeader), h->order_off))
+        return 0;
+
+    // Every string ends inside the blob once its last byte is a NUL
+    const char *strings = base + h->strings_off;
+    if (h->strings_size > 0 && strings[h->strings_size - 1] != '\0')
+        return 0;
+
+    const IndexDoc *docs = (const IndexDoc *)(base + h->docs_off);
+    const uint32_t *order = (const uint32_t *)(base + h->order_off);
+    for (uint32_t d = 0; d < h->doc_count; d++) {
+        if (docs[d].path_off >= h->strings_size || order[d] >= h->doc_count)
+            return 0;
+    }
+    const IndexTerm *terms = (const IndexTerm *)(base + h->terms_off);
+    for (uint32_t t = 0; t < h->term_count; t++) {
+        if ((uint64_t)terms[t].str_off + terms[t].str_len >= h->strings_size ||
+            strings[terms[t].str_off + terms[t].str_len] != '\0' ||
+            terms[t].post_count > h->doc_count ||
+            terms[t].post_off > h->postings_size ||
+            (terms[t].post_count > 0 && terms[t].post_off == h->postings_size))
+            return 0;
+    }
+    return 1;
+}
+
+// Map an index file read-only. Returns 0 on success, -1 if missing or corrupt.
+int index_open(const char *index_path, DocIndex *idx)
+{
+    memset(idx, 0, sizeof(*idx));
+
+    int fd = open(index_path, O_RDONLY);
+    if (fd < 0) return -1;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(IndexHeader)) {
+        close(fd);
+        return -1;
+    }
+
+    void *map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) return -1;
+
+    const IndexHeader *h = (const IndexHeader *)map;
+    if (!index_valid((const char *)map, (uint64_t)st.st_size)) {
+        munmap(map, st.st_size);
+        return -1;
+    }
+
+    const char *base = (const char *)map;
+    idx->map = map;
+    idx->map_size = st.st_size;
+    idx->doc_count = h->doc_count;
+    idx->term_count = h->term_count;
+    idx->docs = (const IndexDoc *)(base + h->docs_off);
+    idx->path_order = (const uint32_t *)(base + h->order_off);
+    idx->terms = (const IndexTerm *)(base + h->terms_off);
+    idx->strings = base + h->strings_off;
+    idx->postings = (const unsigned char *)(base + h->postings_off);
+    idx->postings_size = h->postings_size;
+    idx->postings_count = h->postings_count;
+    idx->codec = (PostingCodec)h->codec;
+    idx->total_tokens = h->total_tokens;
+    idx->avg_doc_len = h->doc_count > 0 ? (double)h->total_tokens / h->doc_count : 0.0;
+    return 0;
+}
+
+void index_close(DocIndex *idx)
+{
+    if (idx->map)
+        munmap(idx->map, idx->map_size);
+    memset(idx, 0, sizeof(*idx));
+}
+
+// Position c at the first posting of term
+void index_cursor(const DocIndex *idx, uint32_t term, PostingCursor *c)
+{
+    const IndexTerm *t = &idx->terms[term];
+    posting_open(c, idx->codec, idx->postings + t->post_off, t->post_count);
+}
+
+// Doc ID of `path`, or -1 if the document is not in the index
+int index_find_doc(const DocIndex *idx, const char *path)
+{
+    int lo = 0, hi = (int)idx->doc_count - 1;
+    while (lo <= hi) {
+        int mid = lo + (hi - lo) / 2;
+        uint32_t doc = idx->path_order[mid];
+        int cmp = strcmp(idx->strings + idx->docs[doc].path_off, path);
+        if (cmp == 0) return (int)doc;
+        if (cmp < 0) lo = mid + 1;
+        else hi = mid - 1;
+    }
+    return -1;
+}
+
+// Patterns containing whitespace can span tokens, so only the scanners can
+// answer them; everything else is fully determined by the term dictionary, in
+// either mode.
+int index_can_answer(const char *pattern)
+{
+    size_t len = strlen(pattern);
+    if (len == 0 || len >= MAX_WORD) return 0;
+    for (size_t i = 0; i < len; i++) {
+        if (isspace((unsigned char)pattern[i])) return 0;
+    }
+    return 1;
+}
+
+// Indices of the dictionary terms a pattern matches
+typedef struct {
+    uint32_t *ids;
+    uint32_t count, cap;
+} TermList;
+
+static int term_list_add(TermList *l, uint32_t t)
+{
+    if (l->count == l->cap) {
+        uint32_t cap = l->cap ? l->cap * 2 : 16;
+        uint32_t *ids = realloc(l->ids, cap * sizeof(uint32_t));
+        if (!ids) return -1;
+        l->ids = ids;
+        l->cap = cap;
+    }
+    l->ids[l->count++] = t;
+    return 0;
+}
+
+// First term after `from` that does not start with prefix[0..len)
+static uint32_t skip_prefix(const DocIndex *idx, uint32_t from, const char *prefix, int len)
+{
+    uint32_t lo = from + 1, hi = idx->term_count;
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        if (strncmp(idx->strings + idx->terms[mid].str_off, prefix, len) > 0)
+            hi = mid;
+        else
+            lo = mid + 1;
+    }
+    return lo;
+}
+
+// Levenshtein automaton over the sorted dictionary, walked as an implicit
+// trie: terms sharing a prefix with the previous term reuse its DP rows, and
+// once every cell of a row exceeds max_dist the whole subtree of terms with
+// that prefix is skipped by binary search. Words of MAX_WORD or more bytes
+// are left to the caller.
+static int fuzzy_walk(const DocIndex *idx, const char *needle, int m, int max_dist, TermList *out)
+{
+    int width = m + 1;
+    int *rows = malloc((size_t)MAX_WORD * width * sizeof(int));
+    if (!rows) return -1;
+    for (int i = 0; i <= m; i++)
+        rows[i] = i;
+
+    const char *prev = "";
+    int valid_depth = 0;  // rows[0..valid_depth] belong to prefixes of prev
+    uint32_t t = 0;
+    while (t < idx->term_count) {
+        const IndexTerm *term = &idx->terms[t];
+        const char *s = idx->strings + term->str_off;
+        int len = (int)term->str_len;
+        if (len >= MAX_WORD) {
+            t++;
+            continue;
+        }
+
+        int d = 0;
+        while (d < valid_depth && d < len && prev[d] == s[d])
+            d++;
+
+        int pruned = 0;
+        while (d < len && !pruned) {
+            const int *up = rows + d * width;
+            int *cur = rows + (d + 1) * width;
+            cur[0] = d + 1;
+            int best = cur[0];
+            for (int i = 1; i <= m; i++) {
+                int v = up[i - 1] + (s[d] != needle[i - 1]);
+                if (up[i] + 1 < v) v = up[i] + 1;
+                if (cur[i - 1] + 1 < v) v = cur[i - 1] + 1;
+                cur[i] = v;
+                if (v < best) best = v;
+            }
+            d++;
+            pruned = best > max_dist;
+        }
+        prev = s;
+        valid_depth = d;
+
+        if (pruned) {
+            t = skip_prefix(idx, t, s, d);
+            continue;
+        }
+        if (rows[len * width + m] <= max_dist && term_list_add(out, t) != 0) {
+            free(rows);
+            return -1;
+        }
+        t++;
+    }
+
+    free(rows);
+    return 0;
+}
+
+// Dictionary terms matching `pattern`: mode 0 takes every term containing
+// the pattern, mode 1 every term within max_dist edits of it. Stores their
+// indices in *terms (caller frees) and returns the count, or -1 on failure.
+int index_match_terms(const DocIndex *idx, const char *pattern, int mode, int max_dist, uint32_t **terms)
+{
+    TermList out = { NULL, 0, 0 };
+    *terms = NULL;
+
+    char needle[MAX_WORD];
+    size_t plen = strlen(pattern);
+    if (plen >= sizeof(needle))
+        return -1;
+    for (size_t i = 0; i <= plen; i++)
+        needle[i] = (char)tolower((unsigned char)pattern[i]);
+
+    int rc = 0;
+    if (mode == 0) {
+        for (uint32_t t = 0; t < idx->term_count && rc == 0; t++) {
+            const IndexTerm *term = &idx->terms[t];
+            const char *s = idx->strings + term->str_off;
+            if (term->str_len >= plen && memmem(s, term->str_len, needle, plen) != NULL)
+                rc = term_list_add(&out, t);
+        }
+        if (rc != 0) {
+            free(out.ids);
+            return -1;
+        }
+        *terms = out.ids;
+        return (int)out.count;
+    }
+
+    MyersPattern mp;
+    if (fuzzy_walk(idx, needle, (int)plen, max_dist, &out) != 0 || myers_init(&mp, needle) != 0) {
+        free(out.ids);
+        return -1;
+    }
+
+    // approx_match() sees long words as MAX_WORD - 1 byte pieces
+    for (uint32_t t = 0; t < idx->term_count && rc == 0; t++) {
+        const IndexTerm *term = &idx->terms[t];
+        if (term->str_len < MAX_WORD)
+            continue;
+        const char *s = idx->strings + term->str_off;
+        int match = 0;
+        for (uint32_t off = 0; off < term->str_len && !match; off += MAX_WORD - 1) {
+            uint32_t n = term->str_len - off < MAX_WORD - 1 ? term->str_len - off : MAX_WORD - 1;
+            match = myers_distance(&mp, s + off, (int)n, max_dist) <= max_dist;
+        }
+        if (match)
+            rc = term_list_add(&out, t);
+    }
+    myers_free(&mp);
+
+    if (rc != 0) {
+        free(out.ids);
+        return -1;
+    }
+    *terms = out.ids;
+    return (int)out.count;
+}
+
+// Per-document hit flags for `pattern`, from the postings of every term it
+// matches (see index_match_terms). Caller frees the returned array.
+unsigned char *index_lookup(const DocIndex *idx, const char *pattern, int mode, int max_dist)
+{
+    uint32_t *terms;
+    int count = index_match_terms(idx, pattern, mode, max_dist, &terms);
+    unsigned char *hits = count >= 0 ? calloc(idx->doc_count > 0 ? idx->doc_count : 1, 1) : NULL;
+    if (!hits) {
+        free(terms);
+        return NULL;
+    }
+
+    PostingCursor c;
+    for (int k = 0; k < count; k++) {
+        for (index_cursor(idx, terms[k], &c); posting_doc(&c) != POSTING_END; posting_next(&c))
+            hits[posting_doc(&c)] = 1;
+    }
+    free(terms);
+    return hits;
+}
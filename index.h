@@ -0,0 +1,82 @@
+#ifndef INDEX_H
+#define INDEX_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "path_table.h"
+#include "postings.h"
+
+#define INDEX_FILENAME "docsearch.idx"
+
+// BM25 parameters; the per-term score bounds in the index depend on them
+#define BM25_K1 1.2
+#define BM25_B 0.75
+
+// On-disk layout (all sections are arrays of fixed-size records, so the
+// whole file can be mmap'd and used in place):
+//   IndexHeader | IndexDoc[doc_count] | uint32 path_order[doc_count]
+//   | IndexTerm[term_count] (sorted by term) | string blob | encoded postings
+// Each term's postings (doc IDs with the occurrences of the term in each
+// document) are encoded on their own in the header's codec; see postings.h.
+typedef struct {
+    char magic[4];
+    uint32_t version;
+    uint32_t doc_count;
+    uint32_t term_count;
+    uint64_t docs_off;
+    uint64_t order_off;
+    uint64_t terms_off;
+    uint64_t strings_off;
+    uint64_t strings_size;
+    uint64_t postings_off;
+    uint64_t postings_size;   // bytes
+    uint64_t postings_count;
+    uint32_t codec;           // PostingCodec
+    uint32_t reserved;
+    uint64_t total_tokens;
+} IndexHeader;
+
+typedef struct {
+    uint32_t path_off;     // offset of the NUL-terminated path in the string blob
+    uint32_t token_count;  // number of tokens in the document
+} IndexDoc;
+
+typedef struct {
+    uint32_t str_off;      // offset of the NUL-terminated term in the string blob
+    uint32_t str_len;
+    uint32_t post_count;
+    float max_weight;      // highest BM25 term-frequency factor in the postings
+    uint64_t post_off;     // byte offset of the encoded list in the postings
+} IndexTerm;
+
+typedef struct {
+    void *map;
+    size_t map_size;
+    uint32_t doc_count;
+    uint32_t term_count;
+    const IndexDoc *docs;
+    const uint32_t *path_order;
+    const IndexTerm *terms;
+    const char *strings;
+    const unsigned char *postings;
+    uint64_t postings_size;   // bytes
+    uint64_t postings_count;
+    PostingCodec codec;
+    uint64_t total_tokens;
+    double avg_doc_len;    // tokens per document
+} DocIndex;
+
+void index_set_codec(PostingCodec codec);
+int index_build(const PathTable *files, const char *index_path);
+int index_merge(const DocIndex *parts, const unsigned char *const *dead, int count, const char *index_path);
+int index_open(const char *index_path, DocIndex *idx);
+void index_close(DocIndex *idx);
+
+void index_cursor(const DocIndex *idx, uint32_t term, PostingCursor *c);
+int index_find_doc(const DocIndex *idx, const char *path);
+int index_can_answer(const char *pattern);
+double bm25_weight(uint32_t tf, uint32_t doc_len, double avg_doc_len);
+int index_match_terms(const DocIndex *idx, const char *pattern, int mode, int max_dist, uint32_t **terms);
+unsigned char *index_lookup(const DocIndex *idx, const char *pattern, int mode, int max_dist);
+
+#endif
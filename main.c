@@ -1,20 +1,77 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <sys/time.h>
 #include <mpi.h>
 #include <omp.h>
 #include "file_utils.h"
 #include "matcher.h"
+#include "approx_match.h"
+#include "index.h"
+#include "batch.h"
+#include "query.h"
+#include "ranking.h"
+#include "scheduler.h"
+#include "aggregate.h"
+#include "doc_reader.h"
+#include "cache.h"
+#include "server.h"
+#include "bench.h"
+#include "stream.h"
+#include "update.h"
+#include "shard.h"
+#include "trace.h"
 
-#define MAX_FILES 1000
-#define MAX_FILENAME_LEN 512
+#define DEFAULT_MAX_HITS 10
+#define QUERY_DIR "/tmp/doc_query"
+#define RANK_DIR "/tmp/doc_rank"
 
-// Structure to store search results for accuracy comparison
+enum { METHOD_SERIAL, METHOD_OPENMP, METHOD_MPI, METHOD_HYBRID, METHOD_COUNT };
+
+static const char *method_names[METHOD_COUNT] = {"serial", "openmp", "mpi", "hybrid"};
+static const char *method_labels[METHOD_COUNT] = {"SERIAL", "OPENMP", "MPI", "MPI+OPENMP"};
+static const char *method_titles[METHOD_COUNT] = {"SERIAL", "OPENMP", "MPI", "MPI + OPENMP"};
+static const char *method_dirs[METHOD_COUNT] = {"/tmp/doc_serial", "/tmp/doc_openmp", "/tmp/doc_mpi", "/tmp/doc_hybrid"};
+
+// Search settings shared by every pipeline
 typedef struct {
-    char filename[MAX_FILENAME_LEN];
+    const char *pattern;
+    int mode;
+    int use_index;
+    int max_hits;
+    size_t split_bytes;
+    int threads;        // OpenMP threads in total, split across ranks in hybrid
+    int stream;         // search documents while the rest are still extracted
+    int count_bytes;    // measure the text bytes searched
+} SearchConfig;
+
+// One preprocessing + search run of a method. Result filenames point into
+// files, so both are released together by free_run.
+typedef struct {
+    PathTable files;
+    SearchResult *results;
     int found;
-} SearchResult;
+    int threads;        // OpenMP threads per rank
+    double preprocess_time;
+    double search_time;
+    double total_time;
+    double first_result_time;   // until the first match, or total_time if none
+    unsigned long long bytes;
+} PipelineRun;
+
+// Per-file progress output; off while benchmarking
+static int verbose = 1;
+
+// Start of the current pipeline and when this process first found a match
+// after it (-1 until then), for time-to-first-result
+static double pipeline_start;
+static double first_hit = -1.0;
+
+static void record_hit(void)
+{
+#pragma omp critical(first_hit)
+    if (first_hit < 0)
+        first_hit = omp_get_wtime() - pipeline_start;
+}
 
 // Comparison function for qsort
 int compare_results(const void *a, const void *b) {
@@ -24,52 +81,111 @@ int compare_results(const void *a, const void *b) {
 }
 
 // Function to normalize file paths for comparison (remove temp directory prefixes)
-void normalize_filename(const char *path, char *normalized) {
+const char *normalize_filename(const char *path) {
     const char *filename = strrchr(path, '/');
-    if (filename) {
-        strcpy(normalized, filename + 1);
-    } else {
-        strcpy(normalized, path);
+    return filename ? filename + 1 : path;
+}
+
+// Reset a result slot before its file is searched
+void init_result(const char *path, SearchResult *result)
+{
+    result->filename = normalize_filename(path);
+    result->found = 0;
+    result->hit_count = 0;
+    result->hit_stored = 0;
+    result->hits = NULL;
+}
+
+// Search one file. With max_hits > 0 every hit is counted and the first
+// max_hits are kept with their positions; otherwise stop at the first hit.
+int search_file(const char *path, const char *pattern, int mode, int max_hits, SearchResult *result)
+{
+    TRACE_BEGIN(scan_start);
+    if (max_hits <= 0)
+    {
+        result->found = do_search(path, pattern, mode);
+        result->hit_count = result->found;
+    }
+    else
+    {
+        MatchReport report;
+        result->found = do_search_report(path, pattern, mode, max_hits, &report);
+        result->hit_count = report.count;
+        result->hit_stored = report.stored;
+        result->hits = report.hits;
     }
+    TRACE_END(scan_start, TRACE_SCAN, path, 0);
+    return result->found;
+}
+
+void print_hits(const char *tag, const SearchResult *result)
+{
+    for (int h = 0; h < result->hit_stored; h++)
+    {
+        printf("%s   line %d, offset %zu: %s\n", tag, result->hits[h].line,
+               result->hits[h].offset, result->hits[h].snippet);
+    }
+    if (result->hits && result->hit_count > result->hit_stored)
+        printf("%s   ... %d more hits\n", tag, result->hit_count - result->hit_stored);
+}
+
+int total_hits(const SearchResult *results, int file_count)
+{
+    int total = 0;
+    for (int i = 0; i < file_count; i++)
+        total += results[i].hit_count;
+    return total;
+}
+
+SearchResult *alloc_results(int file_count)
+{
+    return calloc(file_count > 0 ? file_count : 1, sizeof(SearchResult));
+}
+
+void free_results(SearchResult *results, int file_count)
+{
+    if (!results)
+        return;
+    for (int i = 0; i < file_count; i++)
+        free(results[i].hits);
+    free(results);
 }
 
 // Serial
-int search_serial(char files[][512], int file_count, const char *pattern, int mode, SearchResult *results)
+int search_serial(const PathTable *files, const char *pattern, int mode, int max_hits, SearchResult *results)
 {
+    int file_count = files->count;
     int found_count = 0;
     for (int i = 0; i < file_count; i++)
     {
-        normalize_filename(files[i], results[i].filename);
-        results[i].found = do_search(files[i], pattern, mode);
-        if (results[i].found)
+        init_result(path_at(files, i), &results[i]);
+        if (search_file(path_at(files, i), pattern, mode, max_hits, &results[i]))
         {
-            printf("[SERIAL] Found in %s\n", files[i]);
+            record_hit();
+            if (verbose)
+            {
+                printf("[SERIAL] Found in %s\n", path_at(files, i));
+                print_hits("[SERIAL]", &results[i]);
+            }
             found_count++;
         }
     }
-    if (found_count == 0)
+    if (verbose && found_count == 0)
         printf("[SERIAL] No match found.\n");
     return found_count;
 }
 
 // OpenMP - Fixed version with proper synchronization
-int search_openmp(char files[][512], int file_count, const char *pattern, int mode, SearchResult *results)
+int search_openmp(const PathTable *files, const char *pattern, int mode, int max_hits, int threads, SearchResult *results)
 {
-    omp_set_num_threads(1);
-
-#pragma omp parallel
-    {
-#pragma omp single
-        {
-            int actual_threads = omp_get_num_threads();
-            printf("[OPENMP] Using %d threads\n", actual_threads);
-        }
-    }
+    int file_count = files->count;
+    omp_set_num_threads(threads);
+    if (verbose)
+        printf("[OPENMP] Using %d threads\n", threads);
 
     // Pre-populate filenames to avoid race conditions
     for (int i = 0; i < file_count; i++) {
-        normalize_filename(files[i], results[i].filename);
-        results[i].found = 0;
+        init_result(path_at(files, i), &results[i]);
     }
 
     int found_count = 0;
@@ -77,147 +193,333 @@ int search_openmp(char files[][512], int file_count, const char *pattern, int mo
 #pragma omp parallel for schedule(dynamic) reduction(+:found_count)
     for (int i = 0; i < file_count; i++)
     {
-        int search_result = do_search(files[i], pattern, mode);
-        results[i].found = search_result;
+        int search_result = search_file(path_at(files, i), pattern, mode, max_hits, &results[i]);
         if (search_result)
         {
             found_count++;
+            record_hit();
+            if (verbose)
 #pragma omp critical
             {
-                printf("[OPENMP] Thread %d found in %s\n", omp_get_thread_num(), files[i]);
+                printf("[OPENMP] Thread %d found in %s\n", omp_get_thread_num(), path_at(files, i));
+                print_hits("[OPENMP]", &results[i]);
             }
         }
     }
 
-    if (found_count == 0)
+    if (verbose && found_count == 0)
         printf("[OPENMP] No match found.\n");
     return found_count;
 }
 
-// MPI
-int search_mpi(char files[][512], int file_count, const char *pattern, int mode, int rank, int size, SearchResult *results)
+// Pull work items from the shared queue until it runs dry. Whole files go
+// through search_file; pieces of split files only record whether they hit.
+static int run_work_items(WorkQueue *queue, const WorkItem *items, const PathTable *files, const char *pattern, int mode, int max_hits, int rank, const char *tag, SearchResult *results)
 {
     int local_found_count = 0;
-    
-    // Initialize results array with normalized filenames
-    for (int i = 0; i < file_count; i++) {
-        normalize_filename(files[i], results[i].filename);
-        results[i].found = 0;
-    }
 
-    // Each process searches its assigned files
-    for (int i = rank; i < file_count; i += size)
+    for (;;)
     {
-        results[i].found = do_search(files[i], pattern, mode);
-        if (results[i].found)
+        int k;
+        TRACE_BEGIN(wait_start);
+#pragma omp critical(work_queue)
+        k = work_queue_next(queue);
+        TRACE_END(wait_start, TRACE_QUEUE_WAIT, NULL, 0);
+        if (k < 0)
+            break;
+
+        const WorkItem *item = &items[k];
+        int i = item->file;
+        if (item->whole)
+        {
+            if (search_file(path_at(files, i), pattern, mode, max_hits, &results[i]))
+            {
+                local_found_count++;
+                record_hit();
+                if (verbose)
+#pragma omp critical
+                {
+                    printf("%s Rank %d Thread %d found in %s\n", tag, rank, omp_get_thread_num(), path_at(files, i));
+                    print_hits(tag, &results[i]);
+                }
+            }
+        }
+        else
         {
-            printf("[MPI] Rank %d found in %s\n", rank, files[i]);
+            TRACE_BEGIN(scan_start);
+            int hit = do_search_range(path_at(files, i), pattern, mode, item->start, item->end);
+            TRACE_END(scan_start, TRACE_SCAN, path_at(files, i), item->end - item->start);
+            if (!hit)
+                continue;
             local_found_count++;
+            record_hit();
+#pragma omp critical
+            {
+                if (verbose)
+                    printf("%s Rank %d Thread %d found in %s [bytes %zu-%zu]\n", tag, rank, omp_get_thread_num(), path_at(files, i), item->start, item->end);
+                results[i].found = 1;
+                results[i].hit_count = 1;
+            }
         }
     }
 
-    // Gather all results to rank 0
-    if (rank == 0) {
-        // Receive results from other processes
-        for (int proc = 1; proc < size; proc++) {
-            for (int i = proc; i < file_count; i += size) {
-                int remote_result;
-                MPI_Recv(&remote_result, 1, MPI_INT, proc, i, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-                results[i].found = remote_result;
-                if (remote_result) local_found_count++;
-            }
-        }
-    } else {
-        // Send results to rank 0
-        for (int i = rank; i < file_count; i += size) {
-            MPI_Send(&results[i].found, 1, MPI_INT, 0, i, MPI_COMM_WORLD);
-        }
+    return local_found_count;
+}
+
+// Plan the search (see plan_work): *items holds every rank's share, rank r's
+// from (*first)[r] (free() both). Collective when size > 1: if any rank runs
+// out of memory, all of them return -1.
+static int plan_search(const PathTable *files, const int *owner, size_t split_bytes, int rank, int size,
+                       const char *tag, WorkItem **items, int **first)
+{
+    *items = NULL;
+    *first = malloc((size + 1) * sizeof(int));
+    int item_count = *first ? plan_work(files, owner, size, split_bytes, items, *first) : -1;
+    int ok = item_count >= 0;
+    if (size > 1)
+        MPI_Allreduce(MPI_IN_PLACE, &ok, 1, MPI_INT, MPI_LAND, MPI_COMM_WORLD);
+    if (ok)
+        return item_count;
+    if (rank == 0)
+        printf("%s Out of memory planning the search\n", tag);
+    if (item_count >= 0)
+        free(*items);
+    free(*first);
+    *items = NULL;
+    *first = NULL;
+    return -1;
+}
+
+// MPI
+// Files are ordered largest first and handed out one at a time through
+// shared counters, so a rank that drew a big file does not hold up the rest.
+// Files over split_bytes are searched as independent byte ranges. With owner
+// set, each rank starts on the files it converted itself (owner[i] == rank),
+// whose text it holds in memory, then takes over files and ranges of the
+// ranks still busy, reading their text from disk.
+int search_mpi(const PathTable *files, const int *owner, const char *pattern, int mode, int max_hits, size_t split_bytes, int rank, int size, SearchResult *results)
+{
+    int file_count = files->count;
+
+    // Initialize results array with normalized filenames
+    for (int i = 0; i < file_count; i++) {
+        init_result(path_at(files, i), &results[i]);
     }
 
-    if (rank == 0 && local_found_count == 0)
+    // Hit reporting needs whole files (positions, per-file counts)
+    WorkItem *items;
+    int *first;
+    if (plan_search(files, owner, max_hits > 0 ? 0 : split_bytes, rank, size, "[MPI]", &items, &first) < 0)
+        return -1;
+
+    WorkQueue queue;
+    if (work_queue_open(&queue, first, MPI_COMM_WORLD) != 0)
+    {
+        if (rank == 0)
+            printf("[MPI] Cannot open the work queue\n");
+        free(items);
+        free(first);
+        return -1;
+    }
+    Aggregation aggregation;
+    if (aggregate_init(&aggregation, results, file_count, max_hits > 0, rank, size, MPI_COMM_WORLD) != 0)
+    {
+        if (rank == 0)
+            printf("[MPI] Out of memory gathering the results\n");
+        work_queue_close(&queue);
+        free(items);
+        free(first);
+        return -1;
+    }
+    run_work_items(&queue, items, files, pattern, mode, max_hits, rank, "[MPI]", results);
+
+    // This rank's results are final: post the aggregation before waiting for
+    // the other ranks to drain the queue
+    TRACE_BEGIN(gather_start);
+    aggregate_begin(&aggregation);
+    work_queue_close(&queue);
+    free(items);
+    free(first);
+    int found_count = aggregate_end(&aggregation);
+    TRACE_END(gather_start, TRACE_GATHER, NULL, 0);
+
+    if (verbose && rank == 0 && found_count == 0)
     {
         printf("[MPI] No match found.\n");
     }
     
-    return local_found_count;
+    return found_count;
+}
+
+// OpenMP threads per process in hybrid mode: the total thread budget split
+// across the ranks
+int hybrid_threads(int threads, int size)
+{
+    int per_rank = threads / size;
+    if (per_rank < 1) per_rank = 1;
+
+    // Threads take turns on the queue, which needs at least serialized MPI
+    int thread_level;
+    MPI_Query_thread(&thread_level);
+    if (thread_level < MPI_THREAD_SERIALIZED)
+        per_rank = 1;
+    return per_rank;
 }
 
 // Optimized Hybrid MPI+OpenMP
-int search_mpi_openmp(char files[][512], int file_count, const char *pattern, int mode, int rank, int size, SearchResult *results)
+// Same work queue as search_mpi; every thread draws from it directly
+int search_mpi_openmp(const PathTable *files, const int *owner, const char *pattern, int mode, int max_hits, size_t split_bytes, int threads, int rank, int size, SearchResult *results)
 {
-    // Set optimal number of OpenMP threads per MPI process
-    int optimal_threads = 16 / size; // Distribute threads across MPI processes
-    if (optimal_threads < 1) optimal_threads = 1;
-    if (optimal_threads > 8) optimal_threads = 8; // Cap to avoid oversubscription
-    
-    omp_set_num_threads(optimal_threads);
-    
-    if (rank == 0) {
-        printf("[MPI+OPENMP] Using %d MPI processes with %d OpenMP threads each\n", size, optimal_threads);
+    int file_count = files->count;
+
+    omp_set_num_threads(threads);
+    if (verbose && rank == 0) {
+        printf("[MPI+OPENMP] Using %d MPI processes with %d OpenMP threads each\n", size, threads);
     }
 
-    int local_found_count = 0;
-    
     // Initialize results array with normalized filenames
     for (int i = 0; i < file_count; i++) {
-        normalize_filename(files[i], results[i].filename);
-        results[i].found = 0;
+        init_result(path_at(files, i), &results[i]);
     }
 
-    // Create array of files this process will handle
-    int *my_files = malloc(file_count * sizeof(int));
-    int my_file_count = 0;
-    for (int i = rank; i < file_count; i += size) {
-        my_files[my_file_count++] = i;
+    WorkItem *items;
+    int *first;
+    if (plan_search(files, owner, max_hits > 0 ? 0 : split_bytes, rank, size, "[MPI+OPENMP]", &items, &first) < 0)
+        return -1;
+
+    WorkQueue queue;
+    if (work_queue_open(&queue, first, MPI_COMM_WORLD) != 0)
+    {
+        if (rank == 0)
+            printf("[MPI+OPENMP] Cannot open the work queue\n");
+        free(items);
+        free(first);
+        return -1;
     }
+    Aggregation aggregation;
+    if (aggregate_init(&aggregation, results, file_count, max_hits > 0, rank, size, MPI_COMM_WORLD) != 0)
+    {
+        if (rank == 0)
+            printf("[MPI+OPENMP] Out of memory gathering the results\n");
+        work_queue_close(&queue);
+        free(items);
+        free(first);
+        return -1;
+    }
+#pragma omp parallel
+    run_work_items(&queue, items, files, pattern, mode, max_hits, rank, "[MPI+OPENMP]", results);
+
+    // This rank's results are final: post the aggregation before waiting for
+    // the other ranks to drain the queue
+    TRACE_BEGIN(gather_start);
+    aggregate_begin(&aggregation);
+    work_queue_close(&queue);
+    free(items);
+    free(first);
+    int found_count = aggregate_end(&aggregation);
+    TRACE_END(gather_start, TRACE_GATHER, NULL, 0);
 
-    // Use OpenMP to parallelize within each MPI process
-#pragma omp parallel for schedule(dynamic, 1) reduction(+:local_found_count)
-    for (int j = 0; j < my_file_count; j++)
+    if (verbose && rank == 0 && found_count == 0)
     {
-        int i = my_files[j];
-        int search_result = do_search(files[i], pattern, mode);
-        results[i].found = search_result;
-        if (search_result)
+        printf("[MPI+OPENMP] No match found.\n");
+    }
+    
+    return found_count;
+}
+
+// Streaming: extraction and search overlap instead of running as two phases.
+// Each rank works through the documents it owns (owner[i] == rank), plain
+// text first since it is ready as listed, then largest first, and its threads
+// search every document as soon as it is produced, releasing extracted text
+// once searched. Matches are reported as they are found; results meet on
+// rank 0 when size > 1 (collective then).
+int search_stream(const PathTable *inputs, const PathTable *files, const int *owner, const char *pattern, int mode, int max_hits, int threads, int rank, int size, const char *tag, SearchResult *results)
+{
+    int file_count = files->count;
+    for (int i = 0; i < file_count; i++) {
+        init_result(path_at(files, i), &results[i]);
+    }
+
+    WorkItem *all, *items;
+    int *first;
+    if (plan_search(inputs, owner, 0, rank, size, tag, &all, &first) < 0)
+        return -1;
+    items = all + first[rank];
+    int item_count = first[rank + 1] - first[rank];
+    free(first);
+    int *order = malloc((item_count > 0 ? item_count : 1) * sizeof(int));
+    int ok = order != NULL;
+    if (size > 1)
+        MPI_Allreduce(MPI_IN_PLACE, &ok, 1, MPI_INT, MPI_LAND, MPI_COMM_WORLD);
+    if (!ok)
+    {
+        if (rank == 0)
+            printf("%s Out of memory planning the search\n", tag);
+        free(all);
+        free(order);
+        return -1;
+    }
+    int n = 0;
+    for (int pass = 0; pass < 2; pass++)
+    {
+        for (int k = 0; k < item_count; k++)
+        {
+            int i = items[k].file;
+            int ready = strcmp(path_at(inputs, i), path_at(files, i)) == 0;
+            if (ready == (pass == 0))
+                order[n++] = i;
+        }
+    }
+    free(all);
+
+    StreamQueue queue;
+    stream_queue_init(&queue, item_count, threads);
+    int local_found_count = 0;
+
+#pragma omp parallel num_threads(threads) reduction(+:local_found_count)
+    for (;;)
+    {
+        int slot;
+        TRACE_BEGIN(wait_start);
+        StreamTask task = stream_queue_next(&queue, &slot);
+        TRACE_END(wait_start, TRACE_QUEUE_WAIT, NULL, 0);
+        if (task == STREAM_DONE)
+            break;
+
+        int i = order[slot];
+        if (task == STREAM_PRODUCE)
+        {
+            convert_file(path_at(inputs, i), path_at(files, i));
+            stream_queue_push(&queue, slot);
+            continue;
+        }
+
+        if (search_file(path_at(files, i), pattern, mode, max_hits, &results[i]))
         {
             local_found_count++;
+            record_hit();
+            if (verbose)
 #pragma omp critical
             {
-                printf("[MPI+OPENMP] Rank %d Thread %d found in %s\n", rank, omp_get_thread_num(), files[i]);
+                printf("%s Rank %d Thread %d found in %s\n", tag, rank, omp_get_thread_num(), path_at(files, i));
+                print_hits(tag, &results[i]);
+                fflush(stdout);
             }
         }
+        doc_unregister(path_at(files, i));
     }
 
-    free(my_files);
-
-    // Gather all results to rank 0
-    if (rank == 0) {
-        // Receive results from other processes
-        for (int proc = 1; proc < size; proc++) {
-            int remote_count;
-            MPI_Recv(&remote_count, 1, MPI_INT, proc, 999, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-            local_found_count += remote_count;
-            
-            for (int i = proc; i < file_count; i += size) {
-                int remote_result;
-                MPI_Recv(&remote_result, 1, MPI_INT, proc, i, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-                results[i].found = remote_result;
-            }
-        }
-    } else {
-        // Send local count first, then individual results
-        MPI_Send(&local_found_count, 1, MPI_INT, 0, 999, MPI_COMM_WORLD);
-        for (int i = rank; i < file_count; i += size) {
-            MPI_Send(&results[i].found, 1, MPI_INT, 0, i, MPI_COMM_WORLD);
-        }
-    }
+    stream_queue_destroy(&queue);
+    free(order);
 
-    if (rank == 0 && local_found_count == 0)
-    {
-        printf("[MPI+OPENMP] No match found.\n");
-    }
-    
-    return local_found_count;
+    if (size == 1)
+        return local_found_count;
+    TRACE_BEGIN(gather_start);
+    int found_count = aggregate_results(results, file_count, max_hits > 0, rank, size, MPI_COMM_WORLD);
+    TRACE_END(gather_start, TRACE_GATHER, NULL, 0);
+    if (found_count < 0 && rank == 0)
+        printf("%s Out of memory gathering the results\n", tag);
+    return found_count;
 }
 
 // Function to compare accuracy between methods
@@ -268,232 +570,675 @@ void compare_accuracy(SearchResult *ref_results, SearchResult *test_results, int
     }
 }
 
-double get_time_in_seconds()
+// Build the inverted index of a preprocessed corpus into out_dir
+int build_index(const PathTable *files, const char *out_dir)
+{
+    char index_path[MAX_FILENAME_LEN];
+    snprintf(index_path, sizeof(index_path), "%s/%s", out_dir, INDEX_FILENAME);
+    if (index_build(files, index_path) != 0) {
+        printf("[INDEX] Failed to build %s, falling back to full scans\n", index_path);
+        return 0;
+    }
+    return 1;
+}
+
+// Map the index of out_dir and route word queries through it
+int attach_index(const char *out_dir, DocIndex *idx)
+{
+    char index_path[MAX_FILENAME_LEN];
+    snprintf(index_path, sizeof(index_path), "%s/%s", out_dir, INDEX_FILENAME);
+    if (index_open(index_path, idx) != 0)
+        return 0;
+    matcher_set_index(idx);
+    return 1;
+}
+
+void detach_index(DocIndex *idx)
+{
+    matcher_set_index(NULL);
+    index_close(idx);
+}
+
+// Rank 0 preprocesses docs_dir into out_dir (OpenMP) and indexes it, then
+// every rank maps the index. Collective; returns 1 once all ranks have it.
+int prepare_index(const char *docs_dir, const char *out_dir, PathTable *files, DocIndex *idx, int rank)
+{
+    path_table_init(files);
+    memset(idx, 0, sizeof(*idx));
+    int built = 0;
+    if (rank == 0)
+        built = preprocess_files(docs_dir, out_dir, files, 2) == 0 && build_index(files, out_dir);
+    MPI_Bcast(&built, 1, MPI_INT, 0, MPI_COMM_WORLD);
+    int attached = built && attach_index(out_dir, idx);
+    MPI_Allreduce(MPI_IN_PLACE, &attached, 1, MPI_INT, MPI_LAND, MPI_COMM_WORLD);
+    return attached;
+}
+
+// Text bytes behind the searched files. With owner set, each rank counts
+// the files it searched and the sum lands on rank 0 (collective).
+unsigned long long corpus_bytes(const PathTable *files, const int *owner, int rank)
+{
+    unsigned long long bytes = 0;
+    for (int i = 0; i < files->count; i++)
+    {
+        if (owner && owner[i] != rank)
+            continue;
+        DocView doc;
+        if (doc_open(path_at(files, i), &doc) == 0)
+        {
+            bytes += doc.len;
+            doc_close(&doc);
+        }
+    }
+
+    unsigned long long total = bytes;
+    if (owner)
+        MPI_Reduce(&bytes, &total, 1, MPI_UNSIGNED_LONG_LONG, MPI_SUM, 0, MPI_COMM_WORLD);
+    return total;
+}
+
+// Preprocess docs_dir and search it with one method. Serial and OpenMP run on
+// rank 0 only (other ranks return an empty run); MPI and hybrid are collective.
+void run_pipeline(int method, const char *docs_dir, const SearchConfig *cfg, int rank, int size, PipelineRun *run)
 {
-    struct timeval tv;
-    gettimeofday(&tv, NULL);
-    return (tv.tv_sec + tv.tv_usec / 1000000.0);
+    const char *out_dir = method_dirs[method];
+    int distributed = method == METHOD_MPI || method == METHOD_HYBRID;
+
+    memset(run, 0, sizeof(*run));
+    path_table_init(&run->files);
+    run->threads = method == METHOD_OPENMP ? cfg->threads :
+                   method == METHOD_HYBRID ? hybrid_threads(cfg->threads, size) : 1;
+    if (!distributed && rank != 0)
+        return;
+    omp_set_num_threads(run->threads);
+
+    // Preprocessing (and index build); streaming only lists and assigns here
+    double start = MPI_Wtime();
+    pipeline_start = omp_get_wtime();
+    first_hit = -1.0;
+    int *owner = NULL;
+    DocIndex index;
+    int indexed = 0;
+    PathTable inputs;
+    path_table_init(&inputs);
+    int prepared;
+    if (cfg->stream)
+    {
+        prepared = plan_files(docs_dir, out_dir, &inputs, &run->files, &owner,
+                              distributed ? MPI_COMM_WORLD : MPI_COMM_SELF) == 0;
+    }
+    else if (distributed)
+    {
+        prepared = preprocess_files_mpi(docs_dir, out_dir, NULL, &run->files, &owner, method == METHOD_HYBRID) == 0;
+        int built = 0;
+        if (rank == 0)
+            built = prepared && cfg->use_index && build_index(&run->files, out_dir);
+        MPI_Bcast(&built, 1, MPI_INT, 0, MPI_COMM_WORLD);
+        indexed = built && attach_index(out_dir, &index);
+    }
+    else
+    {
+        prepared = preprocess_files(docs_dir, out_dir, &run->files, method == METHOD_SERIAL ? 1 : 2) == 0;
+        indexed = prepared && cfg->use_index && build_index(&run->files, out_dir) && attach_index(out_dir, &index);
+    }
+    run->results = alloc_results(run->files.count);
+    run->preprocess_time = MPI_Wtime() - start;
+
+    // Preprocessing fails together on every rank of a distributed method
+    if (!prepared)
+    {
+        if (rank == 0)
+            printf("[%s] Out of memory listing %s\n", method_labels[method], docs_dir);
+        run->found = -1;
+        path_table_free(&inputs);
+        return;
+    }
+
+    // Search
+    if (distributed)
+    {
+        TRACE_BEGIN(barrier_start);
+        MPI_Barrier(MPI_COMM_WORLD);
+        TRACE_END(barrier_start, TRACE_BARRIER, NULL, 0);
+    }
+    double search_start = MPI_Wtime();
+    if (cfg->stream)
+    {
+        run->found = search_stream(&inputs, &run->files, owner, cfg->pattern, cfg->mode, cfg->max_hits,
+                                   run->threads, rank, distributed ? size : 1, method_labels[method], run->results);
+    }
+    else switch (method)
+    {
+    case METHOD_SERIAL:
+        run->found = search_serial(&run->files, cfg->pattern, cfg->mode, cfg->max_hits, run->results);
+        break;
+    case METHOD_OPENMP:
+        run->found = search_openmp(&run->files, cfg->pattern, cfg->mode, cfg->max_hits, run->threads, run->results);
+        break;
+    case METHOD_MPI:
+        run->found = search_mpi(&run->files, owner, cfg->pattern, cfg->mode, cfg->max_hits,
+                                cfg->split_bytes, rank, size, run->results);
+        break;
+    default:
+        run->found = search_mpi_openmp(&run->files, owner, cfg->pattern, cfg->mode, cfg->max_hits,
+                                       cfg->split_bytes, run->threads, rank, size, run->results);
+        break;
+    }
+    run->search_time = MPI_Wtime() - search_start;
+    run->total_time = run->preprocess_time + run->search_time;
+
+    // Earliest match on any rank; the ranks start each pipeline together
+    double first = first_hit >= 0 ? first_hit : run->total_time;
+    if (distributed)
+        MPI_Reduce(rank == 0 ? MPI_IN_PLACE : &first, &first, 1, MPI_DOUBLE, MPI_MIN, 0, MPI_COMM_WORLD);
+    run->first_result_time = run->found > 0 && first < run->total_time ? first : run->total_time;
+
+    if (cfg->count_bytes)
+        run->bytes = corpus_bytes(&run->files, distributed ? owner : NULL, rank);
+    if (indexed) detach_index(&index);
+    doc_unregister_all();
+    path_table_free(&inputs);
+    free(owner);
+}
+
+void free_run(PipelineRun *run)
+{
+    free_results(run->results, run->files.count);
+    path_table_free(&run->files);
+    run->results = NULL;
+}
+
+void print_run(int method, const SearchConfig *cfg, const PipelineRun *run)
+{
+    const char *label = method_labels[method];
+    printf("[%s] Preprocessing: %.4f seconds\n", label, run->preprocess_time);
+    printf("[%s] Search: %.4f seconds\n", label, run->search_time);
+    if (run->found > 0)
+        printf("[%s] First result: %.4f seconds\n", label, run->first_result_time);
+    if (cfg->max_hits > 0)
+        printf("[%s] Hits: %d\n", label, total_hits(run->results, run->files.count));
+    printf("[%s] Total: %.4f seconds, Found: %d files\n", label, run->total_time, run->found);
+}
+
+// Run the selected method (all of them with method < 0) warmup + iters times
+// and report timing statistics of the measured iterations on rank 0.
+// Collective. Returns 0, or 1 if the report cannot be written.
+int run_benchmark(const char *docs_dir, SearchConfig *cfg, int method, int warmup, int iters,
+                  int cold, int format, const char *report_path, int rank, int size)
+{
+    int first = method < 0 ? 0 : method;
+    int last = method < 0 ? METHOD_COUNT - 1 : method;
+    BenchResult results[METHOD_COUNT];
+    int result_count = 0;
+    PathTable matches;
+    path_table_init(&matches);
+
+    // Four phases per iteration; every rank keeps its own samples
+    size_t n = (size_t)iters;
+    double *samples = malloc(4 * n * sizeof(double));
+    int ok = samples != NULL;
+    MPI_Allreduce(MPI_IN_PLACE, &ok, 1, MPI_INT, MPI_LAND, MPI_COMM_WORLD);
+    if (!ok)
+    {
+        if (rank == 0)
+            printf("[BENCH] Out of memory for %d iterations\n", iters);
+        free(samples);
+        return 1;
+    }
+
+    verbose = 0;
+    for (int m = first; m <= last; m++)
+    {
+        BenchResult *result = &results[result_count++];
+        memset(result, 0, sizeof(*result));
+        result->method = method_names[m];
+        result->ranks = m == METHOD_MPI || m == METHOD_HYBRID ? size : 1;
+
+        for (int it = -warmup; it < iters; it++)
+        {
+            if (cold)
+            {
+                bench_drop_caches(docs_dir);
+                bench_drop_caches(method_dirs[m]);
+                if (cache_get_dir())
+                    bench_drop_caches(cache_get_dir());
+                MPI_Barrier(MPI_COMM_WORLD);
+            }
+
+            PipelineRun run;
+            cfg->count_bytes = it == iters - 1;
+            run_pipeline(m, docs_dir, cfg, rank, size, &run);
+            if (it >= 0)
+            {
+                samples[it] = run.preprocess_time;
+                samples[n + it] = run.search_time;
+                samples[2 * n + it] = run.total_time;
+                samples[3 * n + it] = run.first_result_time;
+            }
+            if (it == iters - 1)
+            {
+                result->threads = run.threads;
+                result->found = run.found;
+                result->bytes = run.bytes;
+                for (int i = 0; m == first && i < run.files.count; i++)
+                {
+                    if (run.results[i].found)
+                        path_table_add(&matches, path_at(&run.files, i));
+                }
+            }
+            free_run(&run);
+        }
+
+        bench_stats(samples, iters, &result->preprocess);
+        bench_stats(samples + n, iters, &result->search);
+        bench_stats(samples + 2 * n, iters, &result->total);
+        bench_stats(samples + 3 * n, iters, &result->first);
+        MPI_Barrier(MPI_COMM_WORLD);
+    }
+    free(samples);
+
+    int rc = 0;
+    if (rank == 0)
+    {
+        BenchReport report = {docs_dir, cfg->pattern, cfg->mode, warmup, iters, cold,
+                              results, result_count, &matches};
+        FILE *out = report_path ? fopen(report_path, "w") : stdout;
+        if (out)
+        {
+            bench_write(out, format, &report);
+            if (out != stdout)
+                fclose(out);
+        }
+        else
+        {
+            printf("[BENCH] Cannot write %s\n", report_path);
+            rc = 1;
+        }
+    }
+    MPI_Bcast(&rc, 1, MPI_INT, 0, MPI_COMM_WORLD);
+    path_table_free(&matches);
+    return rc;
+}
+
+// Method named on the command line, or -1
+int parse_method(const char *name)
+{
+    for (int m = 0; m < METHOD_COUNT; m++)
+    {
+        if (strcmp(name, method_names[m]) == 0)
+            return m;
+    }
+    return -1;
+}
+
+// Edit distance given on the command line: a whole number from 0 to
+// MAX_WORD, or -1
+static int parse_max_dist(const char *text)
+{
+    char *end;
+    long dist = strtol(text, &end, 10);
+    if (end == text || *end != '\0' || dist < 0 || dist > MAX_WORD)
+        return -1;
+    return (int)dist;
 }
 
 int main(int argc, char *argv[])
 {
-    if (argc != 4)
+    if (argc < 4)
     {
-        printf("Usage: mpirun -np <n> ./docsearch <docs_folder> <pattern> <mode: 0=exact, 1=approx>\n");
+        printf("Usage: mpirun -np <n> ./docsearch <docs_folder> <pattern> <mode: 0=exact, 1=approx> [--index] [--batch] [--query] [--rank[=<k>]] [--codec=<raw|varint|bp128>] [--max-dist=<k>] [--substring] [--hits[=<n>]] [--split=<MB>] [--cache=<dir>] [--no-cache] [--serve=<socket>] [--threads=<n>] [--bench=<serial|openmp|mpi|hybrid|all>] [--warmup=<n>] [--iters=<n>] [--cold] [--format=<text|json|csv>] [--report=<file>] [--stream] [--update] [--watch] [--shards] [--trace=<file>]\n");
         return 1;
     }
 
     const char *docs_dir = argv[1];
     const char *pattern = argv[2];
     int mode = atoi(argv[3]);
+    int use_index = 0;
+    int batch = 0;
+    int query = 0;
+    int top_k = 0;      // > 0: ranked retrieval of the best top_k documents
+    int max_hits = 0;  // 0 = stop at the first hit in each file
+    const char *serve_path = NULL;
+    size_t split_bytes = (size_t)DEFAULT_SPLIT_MB << 20;  // 0 = never split files
+    int threads = omp_get_max_threads();
+    int bench = 0;
+    int bench_method = -1;  // -1 = every method
+    int warmup = DEFAULT_BENCH_WARMUP;
+    int iters = DEFAULT_BENCH_ITERS;
+    int cold = 0;
+    int format = BENCH_TEXT;
+    const char *report_path = NULL;
+    const char *trace_path = NULL;
+    int stream = 0;
+    int update = 0;
+    int watch = 0;
+    int shards = 0;
 
-    char files[MAX_FILES][512];
-    int file_count = 0;
+    for (int i = 4; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--index") == 0)
+            use_index = 1;
+        else if (strcmp(argv[i], "--batch") == 0)
+            batch = 1;
+        else if (strcmp(argv[i], "--query") == 0)
+            query = 1;
+        else if (strcmp(argv[i], "--rank") == 0)
+            top_k = DEFAULT_TOP_K;
+        else if (strncmp(argv[i], "--rank=", 7) == 0 && atoi(argv[i] + 7) > 0)
+            top_k = atoi(argv[i] + 7);
+        else if (strncmp(argv[i], "--codec=", 8) == 0 && postings_parse_codec(argv[i] + 8) >= 0)
+            index_set_codec((PostingCodec)postings_parse_codec(argv[i] + 8));
+        else if (strncmp(argv[i], "--max-dist=", 11) == 0 && parse_max_dist(argv[i] + 11) >= 0)
+            matcher_set_max_dist(parse_max_dist(argv[i] + 11));
+        else if (strcmp(argv[i], "--substring") == 0)
+            matcher_set_substring(1);
+        else if (strcmp(argv[i], "--hits") == 0)
+            max_hits = DEFAULT_MAX_HITS;
+        else if (strncmp(argv[i], "--hits=", 7) == 0 && atoi(argv[i] + 7) > 0)
+            max_hits = atoi(argv[i] + 7);
+        else if (strncmp(argv[i], "--split=", 8) == 0 && atoi(argv[i] + 8) >= 0)
+            split_bytes = (size_t)atoi(argv[i] + 8) << 20;
+        else if (strncmp(argv[i], "--cache=", 8) == 0 && argv[i][8] != '\0')
+            cache_set_dir(argv[i] + 8);
+        else if (strcmp(argv[i], "--no-cache") == 0)
+            cache_set_dir(NULL);
+        else if (strncmp(argv[i], "--serve=", 8) == 0 && argv[i][8] != '\0')
+            serve_path = argv[i] + 8;
+        else if (strncmp(argv[i], "--threads=", 10) == 0 && atoi(argv[i] + 10) > 0)
+            threads = atoi(argv[i] + 10);
+        else if (strcmp(argv[i], "--bench=all") == 0)
+            bench = 1;
+        else if (strncmp(argv[i], "--bench=", 8) == 0 && parse_method(argv[i] + 8) >= 0)
+        {
+            bench = 1;
+            bench_method = parse_method(argv[i] + 8);
+        }
+        else if (strncmp(argv[i], "--warmup=", 9) == 0 && atoi(argv[i] + 9) >= 0)
+            warmup = atoi(argv[i] + 9);
+        else if (strncmp(argv[i], "--iters=", 8) == 0 && atoi(argv[i] + 8) > 0)
+            iters = atoi(argv[i] + 8);
+        else if (strcmp(argv[i], "--cold") == 0)
+            cold = 1;
+        else if (strcmp(argv[i], "--warm") == 0)
+            cold = 0;
+        else if (strncmp(argv[i], "--format=", 9) == 0 && bench_parse_format(argv[i] + 9) >= 0)
+            format = bench_parse_format(argv[i] + 9);
+        else if (strncmp(argv[i], "--report=", 9) == 0 && argv[i][9] != '\0')
+            report_path = argv[i] + 9;
+        else if (strcmp(argv[i], "--stream") == 0)
+            stream = 1;
+        else if (strcmp(argv[i], "--update") == 0)
+            update = 1;
+        else if (strcmp(argv[i], "--watch") == 0)
+            update = watch = 1;
+        else if (strcmp(argv[i], "--shards") == 0)
+            shards = 1;
+        else if (strncmp(argv[i], "--trace=", 8) == 0 && argv[i][8] != '\0')
+            trace_path = argv[i] + 8;
+        else
+        {
+            printf("Unknown option: %s\n", argv[i]);
+            return 1;
+        }
+    }
 
     int rank = 0, size = 1;
-    MPI_Init(&argc, &argv);
+    int thread_level;
+    MPI_Init_thread(&argc, &argv, MPI_THREAD_SERIALIZED, &thread_level);
     MPI_Comm_rank(MPI_COMM_WORLD, &rank);
     MPI_Comm_size(MPI_COMM_WORLD, &size);
 
-    // Results storage for accuracy comparison
-    SearchResult serial_results[MAX_FILES];
-    SearchResult openmp_results[MAX_FILES];
-    SearchResult mpi_results[MAX_FILES];
-    SearchResult hybrid_results[MAX_FILES];
-    
-    // Timing storage
-    double serial_time = 0.0, openmp_time = 0.0, mpi_time = 0.0, hybrid_time = 0.0;
-    int serial_found = 0, openmp_found = 0;
+    if (trace_path)
+    {
+#ifdef DOCSEARCH_TRACE
+        // Common time origin, so the ranks line up in the trace
+        MPI_Barrier(MPI_COMM_WORLD);
+        TRACE_OPEN(trace_path);
+#else
+        if (rank == 0)
+            printf("[TRACE] Built without tracing (make TRACE=1), ignoring --trace\n");
+#endif
+    }
 
-    // Storage for timing breakdown
-    double serial_preprocess_time = 0.0, serial_search_time = 0.0;
-    double openmp_preprocess_time = 0.0, openmp_search_time = 0.0;
+    // === SERVER (corpus stays resident, queries arrive on a socket) ===
+    if (serve_path)
+    {
+        int rc = run_server(docs_dir, serve_path, use_index, rank, size);
+        TRACE_CLOSE(MPI_COMM_WORLD);
+        MPI_Finalize();
+        return rc;
+    }
 
-    // === SERIAL (Full Pipeline) ===
-    if (rank == 0)
+    // === UPDATE (incremental segmented index, optionally following the tree) ===
+    if (update)
     {
-        printf("=== SERIAL METHOD (Preprocessing + Search) ===\n");
-        file_count = 0;
-        
-        // Measure preprocessing time
-        double preprocess_start = get_time_in_seconds();
-        preprocess_files(docs_dir, "/tmp/doc_serial", files, &file_count, 1);
-        double preprocess_end = get_time_in_seconds();
-        serial_preprocess_time = preprocess_end - preprocess_start;
-        
-        // Measure search time
-        double search_start = get_time_in_seconds();
-        serial_found = search_serial(files, file_count, pattern, mode, serial_results);
-        double search_end = get_time_in_seconds();
-        serial_search_time = search_end - search_start;
-        
-        serial_time = serial_preprocess_time + serial_search_time;
-        printf("[SERIAL] Preprocessing: %.4f seconds\n", serial_preprocess_time);
-        printf("[SERIAL] Search: %.4f seconds\n", serial_search_time);
-        printf("[SERIAL] Total: %.4f seconds, Found: %d files\n\n", serial_time, serial_found);
+        if (rank == 0)
+            printf("=== UPDATE METHOD ===\n");
+        int rc = run_update(docs_dir, pattern, mode, watch, rank, size);
+        TRACE_CLOSE(MPI_COMM_WORLD);
+        MPI_Finalize();
+        return rc;
     }
 
-    // === OPENMP (Full Pipeline) ===
-    if (rank == 0)
+    // === SHARDED (per-rank index shards, scatter-gather queries) ===
+    if (shards)
     {
-        printf("=== OPENMP METHOD (Preprocessing + Search) ===\n");
-        file_count = 0;
-        
-        // Measure preprocessing time
-        double preprocess_start = get_time_in_seconds();
-        preprocess_files(docs_dir, "/tmp/doc_openmp", files, &file_count, 2);
-        double preprocess_end = get_time_in_seconds();
-        openmp_preprocess_time = preprocess_end - preprocess_start;
-        
-        // Measure search time
-        double search_start = get_time_in_seconds();
-        openmp_found = search_openmp(files, file_count, pattern, mode, openmp_results);
-        double search_end = get_time_in_seconds();
-        openmp_search_time = search_end - search_start;
-        
-        openmp_time = openmp_preprocess_time + openmp_search_time;
-        printf("[OPENMP] Preprocessing: %.4f seconds\n", openmp_preprocess_time);
-        printf("[OPENMP] Search: %.4f seconds\n", openmp_search_time);
-        printf("[OPENMP] Total: %.4f seconds, Found: %d files\n\n", openmp_time, openmp_found);
-        
-        // Compare with serial
-        compare_accuracy(serial_results, openmp_results, file_count, "OPENMP");
-        printf("\n");
+        if (rank == 0)
+            printf("=== SHARDED METHOD ===\n");
+        int rc = run_shards(docs_dir, pattern, mode, query, top_k, batch, threads, rank, size);
+        TRACE_CLOSE(MPI_COMM_WORLD);
+        MPI_Finalize();
+        return rc;
     }
 
-    // === MPI (Full Pipeline) ===
-    MPI_Barrier(MPI_COMM_WORLD);
-    if (rank == 0) printf("=== MPI METHOD (Preprocessing + Search) ===\n");
-    double t5 = MPI_Wtime();
+    // === BATCH (pattern file, one pass over the corpus) ===
+    if (batch)
+    {
+        char **patterns = NULL;
+        int pattern_count = 0;
+        int loaded = load_patterns(pattern, &patterns, &pattern_count) == 0;
+        MPI_Allreduce(MPI_IN_PLACE, &loaded, 1, MPI_INT, MPI_LAND, MPI_COMM_WORLD);
+        if (!loaded)
+        {
+            if (rank == 0) printf("[BATCH] Cannot read pattern file %s\n", pattern);
+            if (patterns) free_patterns(patterns, pattern_count);
+            TRACE_CLOSE(MPI_COMM_WORLD);
+            MPI_Finalize();
+            return 1;
+        }
 
-    // MPI preprocessing - only rank 0 does preprocessing
-    double mpi_preprocess_time = 0.0, mpi_search_time = 0.0;
-    if (rank == 0)
+        double t0 = MPI_Wtime();
+        double batch_preprocess_time = 0.0;
+        PathTable batch_files;
+        path_table_init(&batch_files);
+        int prepared = 1;
+        if (rank == 0)
+        {
+            printf("=== BATCH METHOD (%d patterns) ===\n", pattern_count);
+            prepared = preprocess_files(docs_dir, "/tmp/doc_batch", &batch_files, 2) == 0;
+            batch_preprocess_time = MPI_Wtime() - t0;
+        }
+        MPI_Bcast(&prepared, 1, MPI_INT, 0, MPI_COMM_WORLD);
+        prepared = prepared && path_table_bcast(&batch_files, 0, MPI_COMM_WORLD) == 0;
+        if (!prepared && rank == 0)
+            printf("[BATCH] Out of memory listing %s\n", docs_dir);
+
+        double search_start = MPI_Wtime();
+        int batch_hits = prepared ? search_batch(&batch_files, patterns, pattern_count, mode, rank, size) : -1;
+        double batch_search_time = MPI_Wtime() - search_start;
+
+        if (rank == 0 && batch_hits >= 0)
+        {
+            printf("[BATCH] Preprocessing: %.4f seconds\n", batch_preprocess_time);
+            printf("[BATCH] Search: %.4f seconds\n", batch_search_time);
+            printf("[BATCH] Total: %.4f seconds, Hits: %d (pattern, file) pairs\n", MPI_Wtime() - t0, batch_hits);
+        }
+
+        free_patterns(patterns, pattern_count);
+        path_table_free(&batch_files);
+        TRACE_CLOSE(MPI_COMM_WORLD);
+        MPI_Finalize();
+        return batch_hits >= 0 ? 0 : 1;
+    }
+
+    if (stream && use_index)
     {
-        file_count = 0;
-        double preprocess_start = MPI_Wtime();
-        preprocess_files(docs_dir, "/tmp/doc_mpi", files, &file_count, 1); // Use serial preprocessing
-        double preprocess_end = MPI_Wtime();
-        mpi_preprocess_time = preprocess_end - preprocess_start;
+        if (rank == 0)
+            printf("[STREAM] The index needs the whole corpus converted first, ignoring --index\n");
+        use_index = 0;
     }
+    // === QUERY / RANKED (answered from the index) ===
+    if (query || top_k > 0)
+    {
+        const char *tag = query ? "[QUERY]" : "[RANK]";
+        const char *out_dir = query ? QUERY_DIR : RANK_DIR;
+        double t0 = MPI_Wtime();
+        PathTable index_files;
+        DocIndex index;
+        if (rank == 0)
+            printf("=== %s METHOD ===\n", query ? "QUERY" : "RANKED");
+        int attached = prepare_index(docs_dir, out_dir, &index_files, &index, rank);
+        double index_preprocess_time = MPI_Wtime() - t0;
 
-    // Broadcast the preprocessed files to all processes
-    MPI_Bcast(&file_count, 1, MPI_INT, 0, MPI_COMM_WORLD);
-    MPI_Bcast(files, MAX_FILES * 512, MPI_CHAR, 0, MPI_COMM_WORLD);
+        int found = -1;
+        double search_start = MPI_Wtime();
+        if (!attached)
+        {
+            if (rank == 0)
+                printf("%s Cannot build the index in %s\n", tag, out_dir);
+        }
+        else if (query)
+            found = search_query(&index, pattern, mode, rank, size);
+        else
+            found = search_ranked(&index, pattern, mode, matcher_get_max_dist(), top_k, threads, rank, size);
+        double index_search_time = MPI_Wtime() - search_start;
 
-    // MPI search phase
-    MPI_Barrier(MPI_COMM_WORLD);
-    double search_start = MPI_Wtime();
-    int mpi_found = search_mpi(files, file_count, pattern, mode, rank, size, mpi_results);
-    double search_end = MPI_Wtime();
-    mpi_search_time = search_end - search_start;
-    
-    double t6 = MPI_Wtime();
-    mpi_time = t6 - t5;
-    
-    if (rank == 0) {
-        printf("[MPI] Preprocessing: %.4f seconds\n", mpi_preprocess_time);
-        printf("[MPI] Search: %.4f seconds\n", mpi_search_time);
-        printf("[MPI] Total: %.4f seconds, Found: %d files\n", mpi_time, mpi_found);
-        compare_accuracy(serial_results, mpi_results, file_count, "MPI");
-        printf("\n");
+        if (rank == 0 && found >= 0)
+        {
+            printf("%s Preprocessing + index: %.4f seconds\n", tag, index_preprocess_time);
+            // Only bp128 unpacks through the SIMD backend
+            printf("%s Postings: %llu in %.2f MB (%s", tag, (unsigned long long)index.postings_count,
+                   index.postings_size / (1024.0 * 1024.0), postings_codec_name(index.codec));
+            if (index.codec == CODEC_BP128)
+                printf(", %s decoding", postings_backend());
+            printf(")\n");
+            printf("%s Search: %.4f seconds\n", tag, index_search_time);
+            printf("%s Total: %.4f seconds, Found: %d files\n", tag, MPI_Wtime() - t0, found);
+        }
+
+        detach_index(&index);
+        doc_unregister_all();
+        path_table_free(&index_files);
+        TRACE_CLOSE(MPI_COMM_WORLD);
+        MPI_Finalize();
+        return found < 0;
     }
 
-    // === MPI + OpenMP (Full Pipeline) ===
-    MPI_Barrier(MPI_COMM_WORLD);
-    if (rank == 0) printf("=== MPI + OPENMP METHOD (Preprocessing + Search) ===\n");
-    double t7 = MPI_Wtime();
+    SearchConfig cfg = {pattern, mode, use_index, max_hits, split_bytes, threads, stream, 0};
 
-    // Hybrid preprocessing - only rank 0 does preprocessing with OpenMP
-    double hybrid_preprocess_time = 0.0, hybrid_search_time = 0.0;
-    if (rank == 0)
+    // === BENCHMARK (repeated runs of selected methods, statistics only) ===
+    if (bench)
     {
-        file_count = 0;
-        double preprocess_start = MPI_Wtime();
-        preprocess_files(docs_dir, "/tmp/doc_hybrid", files, &file_count, 4); // Use hybrid preprocessing
-        double preprocess_end = MPI_Wtime();
-        hybrid_preprocess_time = preprocess_end - preprocess_start;
+        int rc = run_benchmark(docs_dir, &cfg, bench_method, warmup, iters, cold, format, report_path, rank, size);
+        TRACE_CLOSE(MPI_COMM_WORLD);
+        MPI_Finalize();
+        return rc;
     }
 
-    // Broadcast the preprocessed files to all processes
-    MPI_Bcast(&file_count, 1, MPI_INT, 0, MPI_COMM_WORLD);
-    MPI_Bcast(files, MAX_FILES * 512, MPI_CHAR, 0, MPI_COMM_WORLD);
+    // Every method once, each checked against the serial reference
+    PipelineRun runs[METHOD_COUNT];
+    for (int m = 0; m < METHOD_COUNT; m++)
+    {
+        if (m >= METHOD_MPI)
+            MPI_Barrier(MPI_COMM_WORLD);
+        if (rank == 0)
+            printf("=== %s METHOD (Preprocessing + Search) ===\n", method_titles[m]);
+
+        run_pipeline(m, docs_dir, &cfg, rank, size, &runs[m]);
+
+        // A failed run (found < 0) has already said why
+        if (rank == 0 && runs[m].found >= 0)
+        {
+            print_run(m, &cfg, &runs[m]);
+            if (m != METHOD_SERIAL)
+            {
+                printf("\n");
+                compare_accuracy(runs[METHOD_SERIAL].results, runs[m].results, runs[m].files.count, method_labels[m]);
+            }
+            printf("\n");
+        }
+    }
+
+    if (rank == 0)
+    {
+        const PipelineRun *serial = &runs[METHOD_SERIAL];
+        const PipelineRun *openmp = &runs[METHOD_OPENMP];
+        const PipelineRun *mpi = &runs[METHOD_MPI];
+        const PipelineRun *hybrid = &runs[METHOD_HYBRID];
 
-    // Hybrid search phase
-    MPI_Barrier(MPI_COMM_WORLD);
-    search_start = MPI_Wtime();
-    int hybrid_found = search_mpi_openmp(files, file_count, pattern, mode, rank, size, hybrid_results);
-     search_end = MPI_Wtime();
-    hybrid_search_time = search_end - search_start;
-    
-    double t8 = MPI_Wtime();
-    hybrid_time = t8 - t7;
-    
-    if (rank == 0) {
-        printf("[MPI+OPENMP] Preprocessing: %.4f seconds\n", hybrid_preprocess_time);
-        printf("[MPI+OPENMP] Search: %.4f seconds\n", hybrid_search_time);
-        printf("[MPI+OPENMP] Total: %.4f seconds, Found: %d files\n", hybrid_time, hybrid_found);
-        compare_accuracy(serial_results, hybrid_results, file_count, "MPI+OPENMP");
-        
         // Final summary with detailed breakdown
-        printf("\n=== PERFORMANCE SUMMARY ===\n");
+        printf("=== PERFORMANCE SUMMARY ===\n");
         printf("Method          | Preprocessing | Search    | Total     | Found\n");
         printf("----------------|---------------|-----------|-----------|------\n");
         printf("Serial          | %8.4f      | %8.4f  | %8.4f  | %d\n", 
-               serial_preprocess_time, serial_search_time, serial_time, serial_found);
+               serial->preprocess_time, serial->search_time, serial->total_time, serial->found);
         printf("OpenMP          | %8.4f      | %8.4f  | %8.4f  | %d\n", 
-               openmp_preprocess_time, openmp_search_time, openmp_time, openmp_found);
+               openmp->preprocess_time, openmp->search_time, openmp->total_time, openmp->found);
         printf("MPI             | %8.4f      | %8.4f  | %8.4f  | %d\n", 
-               mpi_preprocess_time, mpi_search_time, mpi_time, mpi_found);
+               mpi->preprocess_time, mpi->search_time, mpi->total_time, mpi->found);
         printf("MPI+OpenMP      | %8.4f      | %8.4f  | %8.4f  | %d\n", 
-               hybrid_preprocess_time, hybrid_search_time, hybrid_time, hybrid_found);
+               hybrid->preprocess_time, hybrid->search_time, hybrid->total_time, hybrid->found);
         
         // Calculate speedups for both phases and total
         printf("\n=== SPEEDUP ANALYSIS ===\n");
         printf("Phase           | OpenMP | MPI    | MPI+OpenMP\n");
         printf("----------------|--------|--------|-----------\n");
         printf("Preprocessing   | %5.2fx  | %5.2fx  | %5.2fx\n", 
-               serial_preprocess_time / openmp_preprocess_time,
-               serial_preprocess_time / mpi_preprocess_time,
-               serial_preprocess_time / hybrid_preprocess_time);
+               serial->preprocess_time / openmp->preprocess_time,
+               serial->preprocess_time / mpi->preprocess_time,
+               serial->preprocess_time / hybrid->preprocess_time);
         printf("Search          | %5.2fx  | %5.2fx  | %5.2fx\n", 
-               serial_search_time / openmp_search_time,
-               serial_search_time / mpi_search_time,
-               serial_search_time / hybrid_search_time);
+               serial->search_time / openmp->search_time,
+               serial->search_time / mpi->search_time,
+               serial->search_time / hybrid->search_time);
         printf("Total           | %5.2fx  | %5.2fx  | %5.2fx\n", 
-               serial_time / openmp_time,
-               serial_time / mpi_time,
-               serial_time / hybrid_time);
+               serial->total_time / openmp->total_time,
+               serial->total_time / mpi->total_time,
+               serial->total_time / hybrid->total_time);
         
-        // Calculate efficiency
+        // Calculate efficiency against the threads and processes actually used
         printf("\n=== EFFICIENCY ANALYSIS ===\n");
         printf("OpenMP:    %.1f%% (%d threads)\n", 
-               (serial_time / openmp_time) / 16.0 * 100, omp_get_num_threads());
+               (serial->total_time / openmp->total_time) / openmp->threads * 100, openmp->threads);
         printf("MPI:       %.1f%% (%d processes)\n", 
-               (serial_time / mpi_time) / size * 100, size);
+               (serial->total_time / mpi->total_time) / size * 100, size);
         printf("Hybrid:    %.1f%% (%d processes × %d threads)\n", 
-               (serial_time / hybrid_time) / (size * (16/size)) * 100, size, 16/size);
+               (serial->total_time / hybrid->total_time) / (size * hybrid->threads) * 100, size, hybrid->threads);
                
         // Performance insights
         printf("\n=== PERFORMANCE INSIGHTS ===\n");
-        if (openmp_preprocess_time < serial_preprocess_time) {
+        if (openmp->preprocess_time < serial->preprocess_time) {
             printf("✓ OpenMP preprocessing shows %.2fx speedup\n", 
-                   serial_preprocess_time / openmp_preprocess_time);
+                   serial->preprocess_time / openmp->preprocess_time);
         }
-        if (hybrid_preprocess_time < serial_preprocess_time) {
+        if (hybrid->preprocess_time < serial->preprocess_time) {
             printf("✓ Hybrid preprocessing shows %.2fx speedup\n", 
-                   serial_preprocess_time / hybrid_preprocess_time);
+                   serial->preprocess_time / hybrid->preprocess_time);
         }
-        if (hybrid_search_time < mpi_search_time) {
+        if (hybrid->search_time < mpi->search_time) {
             printf("✓ Hybrid search is %.2fx faster than pure MPI\n", 
-                   mpi_search_time / hybrid_search_time);
+                   mpi->search_time / hybrid->search_time);
         }
-        if (openmp_search_time < serial_search_time) {
+        if (openmp->search_time < serial->search_time) {
             printf("✓ OpenMP search shows %.2fx speedup\n", 
-                   serial_search_time / openmp_search_time);
+                   serial->search_time / openmp->search_time);
         }
     }
 
+    for (int m = 0; m < METHOD_COUNT; m++)
+        free_run(&runs[m]);
+
+    TRACE_CLOSE(MPI_COMM_WORLD);
     MPI_Finalize();
     return 0;
 }
\ No newline at end of file
@@ -1,8 +1,206 @@
+#include <stdlib.h>
+#include <string.h>
 #include "matcher.h"
 #include "exact_match.h"
 #include "approx_match.h"
+#include "doc_reader.h"
+
+// Index used to answer word queries, and the hit flags of the last query
+// looked up in it (every file of a search run asks for the same pattern)
+static const DocIndex *active_index = NULL;
+static unsigned char *cached_hits = NULL;
+static char *cached_pattern = NULL;
+static int cached_mode = -1;
+
+// Edit distance allowed by approximate queries, and whether they match any
+// region of the raw text instead of whole whitespace-delimited tokens
+static int approx_max_dist = MAX_DIST;
+static int approx_substring = 0;
+
+void matcher_set_index(const DocIndex *idx)
+{
+#pragma omp critical(matcher_index)
+    {
+        active_index = idx;
+        free(cached_hits);
+        free(cached_pattern);
+        cached_hits = NULL;
+        cached_pattern = NULL;
+        cached_mode = -1;
+    }
+}
+
+void matcher_set_max_dist(int max_dist)
+{
+    approx_max_dist = max_dist;
+    matcher_set_index(active_index);  // drop hits cached for the old distance
+}
+
+int matcher_get_max_dist(void)
+{
+    return approx_max_dist;
+}
+
+void matcher_set_substring(int substring)
+{
+    approx_substring = substring;
+}
+
+int matcher_get_substring(void)
+{
+    return approx_substring;
+}
+
+// Returns 0/1 if the index answered the query, -1 if the file must be scanned
+static int index_search(const char *filepath, const char *pattern, int mode)
+{
+    if (!active_index || !index_can_answer(pattern) || (mode != 0 && approx_substring))
+        return -1;
+
+    int doc = index_find_doc(active_index, filepath);
+    if (doc < 0)
+        return -1;
+
+    int result = -1;
+#pragma omp critical(matcher_index)
+    {
+        if (!cached_hits || cached_mode != mode || strcmp(cached_pattern, pattern) != 0) {
+            free(cached_hits);
+            free(cached_pattern);
+            cached_hits = index_lookup(active_index, pattern, mode, approx_max_dist);
+            cached_pattern = cached_hits ? strdup(pattern) : NULL;
+            cached_mode = mode;
+            if (!cached_pattern) {
+                free(cached_hits);
+                cached_hits = NULL;
+            }
+        }
+        if (cached_hits)
+            result = cached_hits[doc];
+    }
+    return result;
+}
 
 int do_search(const char *filepath, const char *pattern, int mode)
 {
- return (mode == 0) ? exact_match(filepath, pattern) : approx_match(filepath, pattern);
+    int result = index_search(filepath, pattern, mode);
+    if (result >= 0)
+        return result;
+    if (mode == 0)
+        return exact_match(filepath, pattern);
+    if (approx_substring)
+        return approx_substring_match(filepath, pattern, approx_max_dist);
+    return approx_match(filepath, pattern, approx_max_dist);
+}
+
+// Scan a file for one query term with its own mode and edit distance,
+// without consulting the index (the query engine filters by it first). Terms
+// spanning several words can only match approximately as substrings.
+int do_scan(const char *filepath, const char *pattern, int mode, int max_dist)
+{
+    if (mode == 0)
+        return exact_match(filepath, pattern);
+    if (approx_substring || strpbrk(pattern, " \t\n\r\f\v"))
+        return approx_substring_match(filepath, pattern, max_dist);
+    return approx_match(filepath, pattern, max_dist);
+}
+
+// Search only the matches that start (end, for approximate substring
+// matches) in bytes [start, end) of the file, so one large file can be split
+// across workers. An index answer covers the whole file, which is harmless
+// since per-range results are OR-ed per file.
+int do_search_range(const char *filepath, const char *pattern, int mode, size_t start, size_t end)
+{
+    int result = index_search(filepath, pattern, mode);
+    if (result >= 0)
+        return result;
+
+    DocView doc;
+    if (doc_open(filepath, &doc) != 0)
+        return 0;
+
+    int found;
+    if (mode == 0)
+        found = exact_match_range(doc.data, doc.len, start, end, pattern);
+    else if (approx_substring)
+        found = approx_substring_match_range(doc.data, doc.len, start, end, pattern, approx_max_dist);
+    else
+        found = approx_match_range(doc.data, doc.len, start, end, pattern, approx_max_dist);
+
+    doc_close(&doc);
+    return found;
+}
+
+// Fill in line numbers and context snippets for ascending hit offsets
+static void describe_hits(const DocView *doc, const size_t *offsets, MatchReport *report)
+{
+    size_t scanned = 0;
+    int line = 1;
+    for (int h = 0; h < report->stored; h++) {
+        MatchHit *hit = &report->hits[h];
+        size_t off = offsets[h];
+        while (scanned < off) {
+            const char *nl = memchr(doc->data + scanned, '\n', off - scanned);
+            if (!nl)
+                break;
+            line++;
+            scanned = (size_t)(nl - doc->data) + 1;
+        }
+        hit->offset = off;
+        hit->line = line;
+
+        size_t start = off > SNIPPET_LEN / 2 ? off - SNIPPET_LEN / 2 : 0;
+        size_t end = start + SNIPPET_LEN < doc->len ? start + SNIPPET_LEN : doc->len;
+        for (size_t i = start; i < end; i++) {
+            unsigned char c = (unsigned char)doc->data[i];
+            hit->snippet[i - start] = (c < 0x20 || c == 0x7f) ? ' ' : (char)c;
+        }
+        hit->snippet[end - start] = '\0';
+    }
+}
+
+// Like do_search(), but collects every hit in the file: the total count plus
+// offset, line and snippet for the first max_hits of them. A word index can
+// only rule files out, so files it reports as matching are still scanned.
+int do_search_report(const char *filepath, const char *pattern, int mode, int max_hits, MatchReport *report)
+{
+    memset(report, 0, sizeof(*report));
+    if (index_search(filepath, pattern, mode) == 0)
+        return 0;
+
+    DocView doc;
+    if (doc_open(filepath, &doc) != 0)
+        return 0;
+
+    size_t *offsets = max_hits > 0 ? malloc(max_hits * sizeof(size_t)) : NULL;
+    if (max_hits > 0 && !offsets) {
+        doc_close(&doc);
+        return 0;
+    }
+
+    if (mode == 0)
+        report->count = exact_find_all(doc.data, doc.len, pattern, offsets, max_hits);
+    else if (approx_substring)
+        report->count = approx_substring_find_all(doc.data, doc.len, pattern, approx_max_dist, offsets, max_hits);
+    else
+        report->count = approx_find_all(doc.data, doc.len, pattern, approx_max_dist, offsets, max_hits);
+
+    report->stored = report->count < max_hits ? report->count : max_hits;
+    if (report->stored > 0) {
+        report->hits = malloc(report->stored * sizeof(MatchHit));
+        if (report->hits)
+            describe_hits(&doc, offsets, report);
+        else
+            report->stored = 0;
+    }
+
+    free(offsets);
+    doc_close(&doc);
+    return report->count > 0;
+}
+
+void free_match_report(MatchReport *report)
+{
+    free(report->hits);
+    memset(report, 0, sizeof(*report));
 }
@@ -1,6 +1,34 @@
 #ifndef MATCHER_H
 #define MATCHER_H
 
+#include <stddef.h>
+#include "index.h"
+
+#define SNIPPET_LEN 60
+
+// One hit: byte offset of the match start (for approximate substring
+// matches, of its last byte), 1-based line number and surrounding text
+typedef struct {
+    size_t offset;
+    int line;
+    char snippet[SNIPPET_LEN + 1];
+} MatchHit;
+
+typedef struct {
+    int count;        // hits in the file
+    int stored;       // entries of hits[], at most the per-file cap
+    MatchHit *hits;
+} MatchReport;
+
+void matcher_set_index(const DocIndex *idx);
+void matcher_set_max_dist(int max_dist);
+int matcher_get_max_dist(void);
+void matcher_set_substring(int substring);
+int matcher_get_substring(void);
 int do_search(const char *filepath, const char *pattern, int mode);
+int do_scan(const char *filepath, const char *pattern, int mode, int max_dist);
+int do_search_range(const char *filepath, const char *pattern, int mode, size_t start, size_t end);
+int do_search_report(const char *filepath, const char *pattern, int mode, int max_hits, MatchReport *report);
+void free_match_report(MatchReport *report);
 
 #endif
@@ -0,0 +1,138 @@
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <string.h>
+#include "path_table.h"
+
+#define BCAST_CHUNK (1 << 30)
+
+void path_table_init(PathTable *t)
+{
+    memset(t, 0, sizeof(*t));
+}
+
+void path_table_free(PathTable *t)
+{
+    free(t->blob);
+    free(t->offsets);
+    memset(t, 0, sizeof(*t));
+}
+
+static int reserve(PathTable *t, int entries, size_t bytes)
+{
+    if (t->count + entries > t->cap)
+    {
+        int cap = t->cap ? t->cap : 256;
+        while (cap < t->count + entries)
+            cap *= 2;
+        size_t *offsets = realloc(t->offsets, cap * sizeof(size_t));
+        if (!offsets) return -1;
+        t->offsets = offsets;
+        t->cap = cap;
+    }
+    if (t->blob_len + bytes > t->blob_cap)
+    {
+        size_t cap = t->blob_cap ? t->blob_cap : 16384;
+        while (cap < t->blob_len + bytes)
+            cap *= 2;
+        char *blob = realloc(t->blob, cap);
+        if (!blob) return -1;
+        t->blob = blob;
+        t->blob_cap = cap;
+    }
+    return 0;
+}
+
+// Append a copy of path. Returns its index, or -1 on allocation failure.
+int path_table_add(PathTable *t, const char *path)
+{
+    size_t len = strlen(path) + 1;
+    if (reserve(t, 1, len) != 0)
+        return -1;
+    memcpy(t->blob + t->blob_len, path, len);
+    t->offsets[t->count] = t->blob_len;
+    t->blob_len += len;
+    return t->count++;
+}
+
+// Append every entry of other. Returns 0 on success.
+int path_table_append(PathTable *t, const PathTable *other)
+{
+    if (reserve(t, other->count, other->blob_len) != 0)
+        return -1;
+    memcpy(t->blob + t->blob_len, other->blob, other->blob_len);
+    for (int i = 0; i < other->count; i++)
+        t->offsets[t->count + i] = t->blob_len + other->offsets[i];
+    t->blob_len += other->blob_len;
+    t->count += other->count;
+    return 0;
+}
+
+static int compare_offsets(const void *a, const void *b, void *blob)
+{
+    return strcmp((const char *)blob + *(const size_t *)a, (const char *)blob + *(const size_t *)b);
+}
+
+// Sort entries by path and repack the blob in that order, so a sorted table
+// is laid out identically no matter how it was filled. Returns 0 on success.
+int path_table_sort(PathTable *t)
+{
+    if (t->count < 2)
+        return 0;
+    char *blob = malloc(t->blob_cap);
+    if (!blob)
+        return -1;
+
+    qsort_r(t->offsets, t->count, sizeof(size_t), compare_offsets, t->blob);
+
+    size_t len = 0;
+    for (int i = 0; i < t->count; i++)
+    {
+        size_t n = strlen(t->blob + t->offsets[i]) + 1;
+        memcpy(blob + len, t->blob + t->offsets[i], n);
+        t->offsets[i] = len;
+        len += n;
+    }
+    free(t->blob);
+    t->blob = blob;
+    return 0;
+}
+
+// Collective: replace t on every rank with root's table. Only the blob is
+// sent (its size first); receivers rebuild the offsets from the terminators.
+int path_table_bcast(PathTable *t, int root, MPI_Comm comm)
+{
+    int rank;
+    MPI_Comm_rank(comm, &rank);
+
+    unsigned long long sizes[2] = { t->blob_len, (unsigned long long)t->count };
+    MPI_Bcast(sizes, 2, MPI_UNSIGNED_LONG_LONG, root, comm);
+
+    int ok = 1;
+    if (rank != root)
+    {
+        path_table_free(t);
+        ok = reserve(t, (int)sizes[1], (size_t)sizes[0]) == 0;
+    }
+    MPI_Allreduce(MPI_IN_PLACE, &ok, 1, MPI_INT, MPI_LAND, comm);
+    if (!ok)
+        return -1;
+
+    for (size_t off = 0; off < sizes[0]; off += BCAST_CHUNK)
+    {
+        size_t n = sizes[0] - off < BCAST_CHUNK ? sizes[0] - off : BCAST_CHUNK;
+        MPI_Bcast(t->blob + off, (int)n, MPI_CHAR, root, comm);
+    }
+
+    if (rank != root)
+    {
+        t->blob_len = (size_t)sizes[0];
+        t->count = (int)sizes[1];
+        size_t off = 0;
+        for (int i = 0; i < t->count; i++)
+        {
+            t->offsets[i] = off;
+            off += strlen(t->blob + off) + 1;
+        }
+    }
+    return 0;
+}
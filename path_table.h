@@ -0,0 +1,30 @@
+#ifndef PATH_TABLE_H
+#define PATH_TABLE_H
+
+#include <stddef.h>
+#include <mpi.h>
+
+// Growable list of paths stored back to back in one string blob; entry i
+// is the NUL-terminated string at blob + offsets[i]
+typedef struct {
+    char *blob;
+    size_t blob_len;
+    size_t blob_cap;
+    size_t *offsets;
+    int count;
+    int cap;
+} PathTable;
+
+static inline const char *path_at(const PathTable *t, int i)
+{
+    return t->blob + t->offsets[i];
+}
+
+void path_table_init(PathTable *t);
+void path_table_free(PathTable *t);
+int path_table_add(PathTable *t, const char *path);
+int path_table_append(PathTable *t, const PathTable *other);
+int path_table_sort(PathTable *t);
+int path_table_bcast(PathTable *t, int root, MPI_Comm comm);
+
+#endif
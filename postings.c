@@ -0,0 +1,406 @@
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "postings.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HAVE_X86_SIMD 1
+#endif
+
+// Block unpackers turn POSTING_BLOCK values of `bits` bits back into
+// integers. Stored values are one less than what they encode: with gaps set
+// they are doc ID gaps, summed up from base; otherwise term frequencies.
+typedef void (*unpack_fn)(const unsigned char *in, int bits, int gaps, uint32_t base, uint32_t *out);
+
+static unpack_fn unpack_impl = NULL;
+static const char *unpack_name = "scalar";
+static pthread_once_t dispatch_once = PTHREAD_ONCE_INIT;
+
+static const char *codec_names[CODEC_COUNT] = {"raw", "varint", "bp128"};
+
+const char *postings_codec_name(PostingCodec codec)
+{
+    return codec >= 0 && codec < CODEC_COUNT ? codec_names[codec] : "unknown";
+}
+
+// Codec called name, or -1
+int postings_parse_codec(const char *name)
+{
+    for (int c = 0; c < CODEC_COUNT; c++)
+    {
+        if (strcmp(name, codec_names[c]) == 0)
+            return c;
+    }
+    return -1;
+}
+
+static int bit_width(uint32_t v)
+{
+    return v ? 32 - __builtin_clz(v) : 0;
+}
+
+static unsigned char *put_varint(unsigned char *p, uint32_t v)
+{
+    while (v >= 0x80)
+    {
+        *p++ = (unsigned char)(v | 0x80);
+        v >>= 7;
+    }
+    *p++ = (unsigned char)v;
+    return p;
+}
+
+static inline uint32_t get_varint(const unsigned char **p)
+{
+    const unsigned char *s = *p;
+    uint32_t v = *s & 0x7f;
+    for (int shift = 7; *s++ & 0x80; shift += 7)
+        v |= (uint32_t)(*s & 0x7f) << shift;
+    *p = s;
+    return v;
+}
+
+// Value i of a block sits in lane i % 4 of the 128-bit words, at bit
+// (i / 4) * bits of that lane's 32-bit stream
+static void pack_block(const uint32_t *values, int bits, unsigned char *out)
+{
+    uint32_t words[32 * 4];
+    memset(words, 0, (size_t)bits * 4 * sizeof(uint32_t));
+    for (int i = 0; i < POSTING_BLOCK && bits > 0; i++)
+    {
+        int lane = i % 4, bit = (i / 4) * bits;
+        int w = bit / 32, off = bit % 32;
+        words[w * 4 + lane] |= values[i] << off;
+        if (off + bits > 32)
+            words[(w + 1) * 4 + lane] |= values[i] >> (32 - off);
+    }
+    memcpy(out, words, (size_t)bits * 4 * sizeof(uint32_t));
+}
+
+static void unpack_scalar(const unsigned char *in, int bits, int gaps, uint32_t base, uint32_t *out)
+{
+    uint32_t words[32 * 4];
+    memcpy(words, in, (size_t)bits * 4 * sizeof(uint32_t));
+    uint32_t mask = bits == 32 ? UINT32_MAX : (1u << bits) - 1;
+    for (int i = 0; i < POSTING_BLOCK; i++)
+    {
+        uint32_t v = 0;
+        if (bits > 0)
+        {
+            int lane = i % 4, bit = (i / 4) * bits;
+            int w = bit / 32, off = bit % 32;
+            v = words[w * 4 + lane] >> off;
+            if (off + bits > 32)
+                v |= words[(w + 1) * 4 + lane] << (32 - off);
+            v &= mask;
+        }
+        base = gaps ? base + v + 1 : v + 1;
+        out[i] = base;
+    }
+}
+
+#ifdef HAVE_X86_SIMD
+// Four values per step: shift each lane's current word down, pull in the
+// next word where a value straddles two, then add one and, for gaps, take
+// the running sum across the lanes. Inlined once per bit width, so every
+// shift is an immediate and the loop unrolls.
+static inline __attribute__((always_inline)) void unpack_sse2_width(const unsigned char *in, const int bits,
+                                                                    const int gaps, uint32_t base, uint32_t *out)
+{
+    const __m128i ones = _mm_set1_epi32(1);
+    const __m128i mask = _mm_set1_epi32(bits == 32 ? -1 : (int)((1u << bits) - 1));
+    const __m128i *src = (const __m128i *)in;
+    __m128i word = bits > 0 ? _mm_loadu_si128(src++) : _mm_setzero_si128();
+    __m128i carry = _mm_set1_epi32((int)base);
+    int shift = 0;
+#pragma GCC unroll 32
+    for (int i = 0; i < POSTING_BLOCK / 4; i++)
+    {
+        __m128i v = _mm_srli_epi32(word, shift);
+        shift += bits;
+        if (shift >= 32)
+        {
+            shift -= 32;
+            if (i < POSTING_BLOCK / 4 - 1)
+                word = _mm_loadu_si128(src++);
+            if (shift > 0)
+                v = _mm_or_si128(v, _mm_slli_epi32(word, bits - shift));
+        }
+        v = _mm_add_epi32(_mm_and_si128(v, mask), ones);
+        if (gaps)
+        {
+            v = _mm_add_epi32(v, _mm_slli_si128(v, 4));
+            v = _mm_add_epi32(v, _mm_slli_si128(v, 8));
+            v = _mm_add_epi32(v, carry);
+            carry = _mm_shuffle_epi32(v, 0xff);
+        }
+        _mm_storeu_si128((__m128i *)(out + 4 * i), v);
+    }
+}
+
+#define UNPACK_WIDTH(b)                                       \
+    case b:                                                   \
+        if (gaps)                                             \
+            unpack_sse2_width(in, b, 1, base, out);           \
+        else                                                  \
+            unpack_sse2_width(in, b, 0, base, out);           \
+        break;
+
+static void unpack_sse2(const unsigned char *in, int bits, int gaps, uint32_t base, uint32_t *out)
+{
+    switch (bits)
+    {
+        UNPACK_WIDTH(0) UNPACK_WIDTH(1) UNPACK_WIDTH(2) UNPACK_WIDTH(3) UNPACK_WIDTH(4)
+        UNPACK_WIDTH(5) UNPACK_WIDTH(6) UNPACK_WIDTH(7) UNPACK_WIDTH(8) UNPACK_WIDTH(9)
+        UNPACK_WIDTH(10) UNPACK_WIDTH(11) UNPACK_WIDTH(12) UNPACK_WIDTH(13) UNPACK_WIDTH(14)
+        UNPACK_WIDTH(15) UNPACK_WIDTH(16) UNPACK_WIDTH(17) UNPACK_WIDTH(18) UNPACK_WIDTH(19)
+        UNPACK_WIDTH(20) UNPACK_WIDTH(21) UNPACK_WIDTH(22) UNPACK_WIDTH(23) UNPACK_WIDTH(24)
+        UNPACK_WIDTH(25) UNPACK_WIDTH(26) UNPACK_WIDTH(27) UNPACK_WIDTH(28) UNPACK_WIDTH(29)
+        UNPACK_WIDTH(30) UNPACK_WIDTH(31) UNPACK_WIDTH(32)
+    }
+}
+#endif
+
+static void select_backend(void)
+{
+    unpack_impl = unpack_scalar;
+    unpack_name = "scalar";
+#ifdef HAVE_X86_SIMD
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("sse2"))
+    {
+        unpack_impl = unpack_sse2;
+        unpack_name = "sse2";
+    }
+#endif
+}
+
+const char *postings_backend(void)
+{
+    pthread_once(&dispatch_once, select_backend);
+    return unpack_name;
+}
+
+// Upper bound on the encoded size of count postings in any codec
+size_t postings_bound(uint32_t count)
+{
+    size_t blocks = (count + POSTING_BLOCK - 1) / POSTING_BLOCK;
+    return blocks * (sizeof(PostingSkip) + 4) + (size_t)count * 10 + 4;
+}
+
+// Encode count postings (ascending doc IDs, frequencies >= 1) into out,
+// which must hold postings_bound(count) bytes and be 4-byte aligned.
+// Returns the bytes used, a multiple of 4.
+size_t postings_encode(PostingCodec codec, const uint32_t *ids, const uint32_t *tfs, uint32_t count,
+                       unsigned char *out)
+{
+    uint32_t blocks = (count + POSTING_BLOCK - 1) / POSTING_BLOCK;
+    unsigned char *start = out + (size_t)blocks * sizeof(PostingSkip);
+    unsigned char *p = start;
+    uint32_t prev = UINT32_MAX;  // so the first gap is the first doc ID
+    for (uint32_t b = 0; b < blocks; b++)
+    {
+        const uint32_t *bi = ids + (size_t)b * POSTING_BLOCK, *bt = tfs + (size_t)b * POSTING_BLOCK;
+        uint32_t n = count - b * POSTING_BLOCK < POSTING_BLOCK ? count - b * POSTING_BLOCK : POSTING_BLOCK;
+        PostingSkip skip = {bi[n - 1], (uint32_t)(p - start)};
+        memcpy(out + (size_t)b * sizeof(PostingSkip), &skip, sizeof(skip));
+
+        if (codec == CODEC_RAW)
+        {
+            memcpy(p, bi, n * sizeof(uint32_t));
+            memcpy(p + n * sizeof(uint32_t), bt, n * sizeof(uint32_t));
+            p += 2 * n * sizeof(uint32_t);
+        }
+        else if (codec == CODEC_BP128 && n == POSTING_BLOCK)
+        {
+            uint32_t gaps[POSTING_BLOCK], counts[POSTING_BLOCK], gap_or = 0, count_or = 0;
+            for (uint32_t i = 0; i < n; i++)
+            {
+                gaps[i] = bi[i] - (i ? bi[i - 1] : prev) - 1;
+                counts[i] = bt[i] - 1;
+                gap_or |= gaps[i];
+                count_or |= counts[i];
+            }
+            int gap_bits = bit_width(gap_or), count_bits = bit_width(count_or);
+            p[0] = (unsigned char)gap_bits;
+            p[1] = (unsigned char)count_bits;
+            p[2] = p[3] = 0;
+            pack_block(gaps, gap_bits, p + 4);
+            pack_block(counts, count_bits, p + 4 + gap_bits * 16);
+            p += 4 + (gap_bits + count_bits) * 16;
+        }
+        else
+        {
+            for (uint32_t i = 0; i < n; i++)
+                p = put_varint(p, bi[i] - (i ? bi[i - 1] : prev) - 1);
+            for (uint32_t i = 0; i < n; i++)
+                p = put_varint(p, bt[i] - 1);
+        }
+        prev = bi[n - 1];
+    }
+    while ((p - out) % 4)
+        *p++ = 0;
+    return (size_t)(p - out);
+}
+
+static inline int bit_packed(PostingCodec codec, uint32_t n)
+{
+    return codec == CODEC_BP128 && n == POSTING_BLOCK;
+}
+
+// Doc IDs of block b into ids; *tf_data is left at the block's frequencies
+static void decode_ids(PostingCodec codec, const PostingSkip *skips, const unsigned char *blocks, uint32_t b,
+                       uint32_t n, uint32_t *ids, const unsigned char **tf_data)
+{
+    const unsigned char *p = blocks + skips[b].offset;
+    uint32_t prev = b ? skips[b - 1].last_doc : UINT32_MAX;
+    if (codec == CODEC_RAW)
+    {
+        memcpy(ids, p, n * sizeof(uint32_t));
+        *tf_data = p + n * sizeof(uint32_t);
+    }
+    else if (bit_packed(codec, n))
+    {
+        unpack_impl(p + 4, p[0], 1, prev, ids);
+        *tf_data = p;
+    }
+    else
+    {
+        for (uint32_t i = 0; i < n; i++)
+        {
+            prev += get_varint(&p) + 1;
+            ids[i] = prev;
+        }
+        *tf_data = p;
+    }
+}
+
+static void decode_tfs(PostingCodec codec, const unsigned char *p, uint32_t n, uint32_t *tfs)
+{
+    if (codec == CODEC_RAW)
+    {
+        memcpy(tfs, p, n * sizeof(uint32_t));
+    }
+    else if (bit_packed(codec, n))
+    {
+        unpack_impl(p + 4 + p[0] * 16, p[1], 0, 0, tfs);
+    }
+    else
+    {
+        for (uint32_t i = 0; i < n; i++)
+            tfs[i] = get_varint(&p) + 1;
+    }
+}
+
+static inline uint32_t block_size(uint32_t count, uint32_t b)
+{
+    uint32_t left = count - b * POSTING_BLOCK;
+    return left < POSTING_BLOCK ? left : POSTING_BLOCK;
+}
+
+// Decode a whole list; tfs may be NULL
+void postings_decode(PostingCodec codec, const unsigned char *data, uint32_t count, uint32_t *ids, uint32_t *tfs)
+{
+    pthread_once(&dispatch_once, select_backend);
+    uint32_t blocks = (count + POSTING_BLOCK - 1) / POSTING_BLOCK;
+    const PostingSkip *skips = (const PostingSkip *)data;
+    const unsigned char *payload = data + (size_t)blocks * sizeof(PostingSkip);
+    for (uint32_t b = 0; b < blocks; b++)
+    {
+        uint32_t n = block_size(count, b);
+        const unsigned char *tf_data;
+        decode_ids(codec, skips, payload, b, n, ids + (size_t)b * POSTING_BLOCK, &tf_data);
+        if (tfs)
+            decode_tfs(codec, tf_data, n, tfs + (size_t)b * POSTING_BLOCK);
+    }
+}
+
+static void cursor_load(PostingCursor *c, uint32_t b)
+{
+    c->block = b;
+    c->pos = 0;
+    c->tfs_ready = 0;
+    if (b < c->block_count)
+    {
+        c->n = block_size(c->count, b);
+        decode_ids(c->codec, c->skips, c->blocks, b, c->n, c->ids, &c->tf_data);
+    }
+}
+
+void posting_open(PostingCursor *c, PostingCodec codec, const unsigned char *data, uint32_t count)
+{
+    pthread_once(&dispatch_once, select_backend);
+    c->codec = codec;
+    c->count = count;
+    c->block_count = (count + POSTING_BLOCK - 1) / POSTING_BLOCK;
+    c->skips = (const PostingSkip *)data;
+    c->blocks = data + (size_t)c->block_count * sizeof(PostingSkip);
+    cursor_load(c, 0);
+}
+
+void posting_next(PostingCursor *c)
+{
+    if (c->block >= c->block_count)
+        return;
+    if (++c->pos == c->n)
+        cursor_load(c, c->block + 1);
+}
+
+// Move to the first posting with a doc ID >= doc and return that ID (or
+// POSTING_END). Blocks whose last doc ID is below doc are passed over by
+// galloping through the skip table; only the block landed on is decoded.
+uint32_t posting_seek(PostingCursor *c, uint32_t doc)
+{
+    if (c->block >= c->block_count)
+        return POSTING_END;
+    if (c->ids[c->pos] >= doc)
+        return c->ids[c->pos];
+
+    if (c->skips[c->block].last_doc < doc)
+    {
+        uint32_t lo = c->block + 1, hi = lo, step = 1;
+        while (hi < c->block_count && c->skips[hi].last_doc < doc)
+        {
+            lo = hi + 1;
+            hi += step;
+            step *= 2;
+        }
+        if (hi > c->block_count)
+            hi = c->block_count;
+        while (lo < hi)
+        {
+            uint32_t mid = lo + (hi - lo) / 2;
+            if (c->skips[mid].last_doc < doc)
+                lo = mid + 1;
+            else
+                hi = mid;
+        }
+        cursor_load(c, lo);
+        if (c->block >= c->block_count)
+            return POSTING_END;
+    }
+
+    uint32_t lo = c->pos, hi = c->n - 1;  // ids[n - 1] >= doc
+    while (lo < hi)
+    {
+        uint32_t mid = lo + (hi - lo) / 2;
+        if (c->ids[mid] < doc)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    c->pos = lo;
+    return c->ids[lo];
+}
+
+// Term frequency of the posting under the cursor
+uint32_t posting_tf(PostingCursor *c)
+{
+    if (!c->tfs_ready)
+    {
+        decode_tfs(c->codec, c->tf_data, c->n, c->tfs);
+        c->tfs_ready = 1;
+    }
+    return c->tfs[c->pos];
+}
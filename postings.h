@@ -0,0 +1,65 @@
+#ifndef POSTINGS_H
+#define POSTINGS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define POSTING_BLOCK 128
+#define POSTING_END UINT32_MAX
+
+// Posting list encodings. Every list is cut into blocks of POSTING_BLOCK
+// postings (the last one may be shorter) behind a table of skip entries, so
+// a cursor can jump over blocks without decoding them:
+//   raw     doc IDs, then term frequencies, as plain uint32
+//   varint  gaps between doc IDs (minus one), then frequencies (minus one),
+//           as LEB128 varints
+//   bp128   full blocks bit-packed at the width of their largest value,
+//           four interleaved 32-bit lanes (SIMD-BP128 layout) so a block
+//           unpacks with vector shifts; the last partial block as varint
+typedef enum { CODEC_RAW, CODEC_VARINT, CODEC_BP128, CODEC_COUNT } PostingCodec;
+
+#define DEFAULT_CODEC CODEC_BP128
+
+typedef struct {
+    uint32_t last_doc;   // highest doc ID in the block
+    uint32_t offset;     // block data, in bytes after the skip table
+} PostingSkip;
+
+// Forward iterator over one encoded list. Doc IDs are decoded a block at a
+// time; term frequencies only for blocks that ask for one.
+typedef struct {
+    PostingCodec codec;
+    const PostingSkip *skips;
+    const unsigned char *blocks;
+    uint32_t count;
+    uint32_t block_count;
+    uint32_t block;              // decoded block (block_count once exhausted)
+    uint32_t n;                  // postings in it
+    uint32_t pos;
+    const unsigned char *tf_data;
+    int tfs_ready;
+    uint32_t ids[POSTING_BLOCK];
+    uint32_t tfs[POSTING_BLOCK];
+} PostingCursor;
+
+const char *postings_codec_name(PostingCodec codec);
+int postings_parse_codec(const char *name);
+const char *postings_backend(void);
+
+size_t postings_bound(uint32_t count);
+size_t postings_encode(PostingCodec codec, const uint32_t *ids, const uint32_t *tfs, uint32_t count,
+                       unsigned char *out);
+void postings_decode(PostingCodec codec, const unsigned char *data, uint32_t count, uint32_t *ids, uint32_t *tfs);
+
+void posting_open(PostingCursor *c, PostingCodec codec, const unsigned char *data, uint32_t count);
+void posting_next(PostingCursor *c);
+uint32_t posting_seek(PostingCursor *c, uint32_t doc);
+uint32_t posting_tf(PostingCursor *c);
+
+// Doc ID under the cursor, or POSTING_END
+static inline uint32_t posting_doc(const PostingCursor *c)
+{
+    return c->block < c->block_count ? c->ids[c->pos] : POSTING_END;
+}
+
+#endif
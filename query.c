@@ -0,0 +1,836 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <mpi.h>
+#include <omp.h>
+#include "query.h"
+#include "matcher.h"
+#include "trace.h"
+
+#define REDUCE_CHUNK (1 << 30)  // hit flags per MPI_Reduce, within an int count
+
+// Queries are evaluated in two steps. query_filter() computes, bottom-up, the
+// sorted doc IDs each node can match from the index postings: exactly for
+// single words the index answers, as a superset for phrases (every word of
+// the phrase must be present) and for terms it cannot answer (all documents).
+// AND intersects its operands rarest first by galloping through the longer
+// lists, so a compound query costs about as much as its most selective term.
+// Word operands with longer posting lists than that are never decoded whole:
+// the candidates are probed against their postings, skipping every block
+// that cannot hold one.
+// Only when the root list is not exact are its documents verified with the
+// matchers, short-circuiting on the lists of the exact nodes.
+
+enum { TOK_END, TOK_TERM, TOK_AND, TOK_OR, TOK_NOT, TOK_LPAREN, TOK_RPAREN };
+
+typedef struct {
+    int type;
+    char *text;
+    int mode;
+    int max_dist;
+} Token;
+
+typedef struct {
+    Token *tokens;
+    int count;
+    int pos;
+    char *err;
+    size_t err_size;
+} Parser;
+
+static void free_tokens(Token *tokens, int count)
+{
+    for (int i = 0; i < count; i++)
+        free(tokens[i].text);
+    free(tokens);
+}
+
+// Optional "~" or "~k" after a term: fuzzy within k edits (default max_dist)
+static const char *parse_fuzzy(const char *p, Token *t, int max_dist)
+{
+    if (*p != '~')
+        return p;
+    p++;
+    t->mode = 1;
+    t->max_dist = max_dist;
+    if (!isdigit((unsigned char)*p))
+        return p;
+    char *end;
+    t->max_dist = (int)strtol(p, &end, 10);
+    return end;
+}
+
+static int is_word_char(char c)
+{
+    return c && !isspace((unsigned char)c) && c != '(' && c != ')' && c != '"';
+}
+
+// Split the query into tokens. Returns the token count, or -1 with err set.
+static int tokenize(const char *query, int mode, int max_dist, Token **out, char *err, size_t err_size)
+{
+    int count = 0, cap = 16;
+    Token *tokens = malloc(cap * sizeof(Token));
+    const char *p = query;
+    while (tokens)
+    {
+        while (isspace((unsigned char)*p))
+            p++;
+        if (count + 1 >= cap)
+        {
+            Token *grown = realloc(tokens, 2 * cap * sizeof(Token));
+            if (!grown)
+                break;
+            tokens = grown;
+            cap *= 2;
+        }
+
+        Token *t = &tokens[count];
+        memset(t, 0, sizeof(*t));
+        t->mode = mode;
+        t->max_dist = max_dist;
+        if (*p == '\0')
+        {
+            t->type = TOK_END;
+            *out = tokens;
+            return count + 1;
+        }
+        if (*p == '(' || *p == ')')
+        {
+            t->type = *p++ == '(' ? TOK_LPAREN : TOK_RPAREN;
+            count++;
+            continue;
+        }
+
+        t->type = TOK_TERM;
+        if (*p == '"')
+        {
+            const char *end = strchr(p + 1, '"');
+            if (!end || end == p + 1)
+            {
+                snprintf(err, err_size, end ? "Empty phrase" : "Unterminated phrase");
+                free_tokens(tokens, count);
+                return -1;
+            }
+            t->text = strndup(p + 1, end - p - 1);
+            t->mode = 0;
+            p = parse_fuzzy(end + 1, t, max_dist);
+        }
+        else
+        {
+            int forced = *p == '=';
+            if (forced)
+            {
+                t->mode = 0;
+                p++;
+            }
+            const char *start = p;
+            while (is_word_char(*p) && *p != '~')
+                p++;
+            if (p == start)
+            {
+                snprintf(err, err_size, "Expected a term at \"%s\"", start);
+                free_tokens(tokens, count);
+                return -1;
+            }
+            t->text = strndup(start, p - start);
+            if (!forced && *p != '~')
+            {
+                if (strcmp(t->text, "AND") == 0)
+                    t->type = TOK_AND;
+                else if (strcmp(t->text, "OR") == 0)
+                    t->type = TOK_OR;
+                else if (strcmp(t->text, "NOT") == 0)
+                    t->type = TOK_NOT;
+            }
+            p = parse_fuzzy(p, t, max_dist);
+        }
+        if (!t->text)
+            break;
+        if (is_word_char(*p))
+        {
+            snprintf(err, err_size, "Unexpected \"%c\" after %s", *p, t->text);
+            free_tokens(tokens, count + 1);
+            return -1;
+        }
+        count++;
+    }
+
+    snprintf(err, err_size, "Out of memory");
+    if (tokens)
+        free_tokens(tokens, count);
+    return -1;
+}
+
+static QueryNode *new_node(QueryOp op)
+{
+    QueryNode *n = calloc(1, sizeof(QueryNode));
+    if (n)
+        n->op = op;
+    return n;
+}
+
+static int add_kid(QueryNode *n, QueryNode *kid)
+{
+    QueryNode **kids = realloc(n->kids, (n->kid_count + 1) * sizeof(QueryNode *));
+    if (!kids)
+        return -1;
+    n->kids = kids;
+    n->kids[n->kid_count++] = kid;
+    return 0;
+}
+
+static QueryNode *parse_or(Parser *ps);
+
+static Token *peek(Parser *ps)
+{
+    return &ps->tokens[ps->pos];
+}
+
+static QueryNode *parse_unary(Parser *ps)
+{
+    Token *t = peek(ps);
+    if (t->type == TOK_NOT)
+    {
+        ps->pos++;
+        QueryNode *kid = parse_unary(ps);
+        QueryNode *n = kid ? new_node(QUERY_NOT) : NULL;
+        if (!n || add_kid(n, kid) != 0)
+        {
+            query_free(kid);
+            free(n);
+            return NULL;
+        }
+        return n;
+    }
+    if (t->type == TOK_LPAREN)
+    {
+        ps->pos++;
+        QueryNode *n = parse_or(ps);
+        if (n && peek(ps)->type != TOK_RPAREN)
+        {
+            snprintf(ps->err, ps->err_size, "Missing \")\"");
+            query_free(n);
+            return NULL;
+        }
+        ps->pos++;
+        return n;
+    }
+    if (t->type != TOK_TERM)
+    {
+        snprintf(ps->err, ps->err_size, t->type == TOK_END ? "Query ends where a term is expected"
+                                                           : "Operator where a term is expected");
+        return NULL;
+    }
+
+    QueryNode *n = new_node(QUERY_TERM);
+    if (!n)
+        return NULL;
+    n->text = t->text;
+    n->mode = t->mode;
+    n->max_dist = t->max_dist;
+    t->text = NULL;
+    ps->pos++;
+    return n;
+}
+
+// Operands of one operator collected into a single n-ary node
+static QueryNode *parse_chain(Parser *ps, QueryOp op)
+{
+    QueryNode *first = op == QUERY_OR ? parse_chain(ps, QUERY_AND) : parse_unary(ps);
+    if (!first)
+        return NULL;
+
+    QueryNode *n = NULL;
+    for (;;)
+    {
+        int type = peek(ps)->type;
+        if (op == QUERY_OR ? type != TOK_OR : type == TOK_OR || type == TOK_RPAREN || type == TOK_END)
+            break;
+        if (type == TOK_OR || type == TOK_AND)
+            ps->pos++;
+
+        QueryNode *kid = op == QUERY_OR ? parse_chain(ps, QUERY_AND) : parse_unary(ps);
+        if (!kid)
+        {
+            query_free(n ? n : first);
+            return NULL;
+        }
+        if (!n)
+        {
+            n = new_node(op);
+            if (!n || add_kid(n, first) != 0)
+            {
+                free(n);
+                query_free(first);
+                query_free(kid);
+                return NULL;
+            }
+        }
+        if (add_kid(n, kid) != 0)
+        {
+            query_free(kid);
+            query_free(n);
+            return NULL;
+        }
+    }
+    return n ? n : first;
+}
+
+static QueryNode *parse_or(Parser *ps)
+{
+    return parse_chain(ps, QUERY_OR);
+}
+
+// Parse a query; plain terms use mode and fuzzy ones max_dist unless they say
+// otherwise. Returns NULL with a message in err on a syntax error.
+QueryNode *query_parse(const char *query, int mode, int max_dist, char *err, size_t err_size)
+{
+    Parser ps = {NULL, 0, 0, err, err_size};
+    snprintf(err, err_size, "Out of memory");
+    ps.count = tokenize(query, mode, max_dist, &ps.tokens, err, err_size);
+    if (ps.count < 0)
+        return NULL;
+
+    QueryNode *q = parse_or(&ps);
+    if (q && peek(&ps)->type != TOK_END)
+    {
+        snprintf(err, err_size, peek(&ps)->type == TOK_RPAREN ? "Unbalanced \")\"" : "Unexpected operator");
+        query_free(q);
+        q = NULL;
+    }
+    free_tokens(ps.tokens, ps.count);
+    return q;
+}
+
+void query_free(QueryNode *q)
+{
+    if (!q)
+        return;
+    for (int k = 0; k < q->kid_count; k++)
+        query_free(q->kids[k]);
+    free(q->kids);
+    free(q->text);
+    free(q->docs.ids);
+    free(q);
+}
+
+void query_print(const QueryNode *q)
+{
+    if (q->op == QUERY_TERM)
+    {
+        int phrase = strpbrk(q->text, " \t\n\r\f\v") != NULL;
+        printf(phrase ? "\"%s\"" : "%s", q->text);
+        if (q->mode)
+            printf("~%d", q->max_dist);
+        return;
+    }
+    if (q->op == QUERY_NOT)
+    {
+        printf("NOT ");
+        query_print(q->kids[0]);
+        return;
+    }
+    printf("(");
+    for (int k = 0; k < q->kid_count; k++)
+    {
+        if (k)
+            printf(q->op == QUERY_AND ? " AND " : " OR ");
+        query_print(q->kids[k]);
+    }
+    printf(")");
+}
+
+// First position at or after from where a[pos] >= x: probe 1, 2, 4, ...
+// entries ahead, then binary search the last step
+static uint32_t gallop(const uint32_t *a, uint32_t n, uint32_t from, uint32_t x)
+{
+    uint32_t lo = from, hi = from, step = 1;
+    while (hi < n && a[hi] < x)
+    {
+        lo = hi + 1;
+        hi += step;
+        step *= 2;
+    }
+    if (hi > n)
+        hi = n;
+    while (lo < hi)
+    {
+        uint32_t mid = lo + (hi - lo) / 2;
+        if (a[mid] < x)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+static int doc_member(const DocList *l, uint32_t doc)
+{
+    uint32_t pos = gallop(l->ids, l->count, 0, doc);
+    return pos < l->count && l->ids[pos] == doc;
+}
+
+// a = a AND b, walking the shorter list and galloping through the longer
+static void intersect(DocList *a, const DocList *b)
+{
+    const DocList *small = a->count <= b->count ? a : b;
+    const DocList *large = small == a ? b : a;
+    uint32_t n = 0, j = 0;
+    for (uint32_t i = 0; i < small->count && j < large->count; i++)
+    {
+        j = gallop(large->ids, large->count, j, small->ids[i]);
+        if (j < large->count && large->ids[j] == small->ids[i])
+            a->ids[n++] = small->ids[i];
+    }
+    a->count = n;
+}
+
+// a = a AND NOT b
+static void subtract(DocList *a, const DocList *b)
+{
+    uint32_t n = 0, j = 0;
+    for (uint32_t i = 0; i < a->count; i++)
+    {
+        j = gallop(b->ids, b->count, j, a->ids[i]);
+        if (j == b->count || b->ids[j] != a->ids[i])
+            a->ids[n++] = a->ids[i];
+    }
+    a->count = n;
+}
+
+// a = a OR b
+static int unite(DocList *a, const DocList *b)
+{
+    uint32_t *ids = malloc(((size_t)a->count + b->count + 1) * sizeof(uint32_t));
+    if (!ids)
+        return -1;
+    uint32_t i = 0, j = 0, n = 0;
+    while (i < a->count || j < b->count)
+    {
+        if (j == b->count || (i < a->count && a->ids[i] < b->ids[j]))
+            ids[n++] = a->ids[i++];
+        else if (i == a->count || b->ids[j] < a->ids[i])
+            ids[n++] = b->ids[j++];
+        else
+        {
+            ids[n++] = a->ids[i++];
+            j++;
+        }
+    }
+    free(a->ids);
+    a->ids = ids;
+    a->count = n;
+    return 0;
+}
+
+static int copy_list(DocList *dst, const DocList *src)
+{
+    dst->ids = malloc(((size_t)src->count + 1) * sizeof(uint32_t));
+    if (!dst->ids)
+        return -1;
+    memcpy(dst->ids, src->ids, (size_t)src->count * sizeof(uint32_t));
+    dst->count = src->count;
+    dst->exact = src->exact;
+    return 0;
+}
+
+static int all_docs(const DocIndex *idx, DocList *out)
+{
+    out->ids = malloc(((size_t)idx->doc_count + 1) * sizeof(uint32_t));
+    if (!out->ids)
+        return -1;
+    for (uint32_t d = 0; d < idx->doc_count; d++)
+        out->ids[d] = d;
+    out->count = idx->doc_count;
+    out->exact = 0;
+    return 0;
+}
+
+// Documents containing a term the index can answer for
+static int word_docs(const DocIndex *idx, const char *word, int mode, int max_dist, DocList *out)
+{
+    unsigned char *hits = index_lookup(idx, word, mode, max_dist);
+    out->ids = hits ? malloc(((size_t)idx->doc_count + 1) * sizeof(uint32_t)) : NULL;
+    if (!out->ids)
+    {
+        free(hits);
+        return -1;
+    }
+    out->count = 0;
+    for (uint32_t d = 0; d < idx->doc_count; d++)
+    {
+        if (hits[d])
+            out->ids[out->count++] = d;
+    }
+    out->exact = 1;
+    free(hits);
+    return 0;
+}
+
+static int compare_counts(const void *a, const void *b)
+{
+    const DocList *la = (const DocList *)a, *lb = (const DocList *)b;
+    return la->count < lb->count ? -1 : la->count > lb->count;
+}
+
+// A phrase can only occur where each of its words occurs inside some token
+static int phrase_docs(const DocIndex *idx, const char *phrase, DocList *out)
+{
+    char *copy = strdup(phrase);
+    int count = 0;
+    DocList *lists = copy ? malloc((strlen(phrase) / 2 + 1) * sizeof(DocList)) : NULL;
+    int rc = lists ? 0 : -1;
+    for (char *save, *w = lists ? strtok_r(copy, " \t\n\r\f\v", &save) : NULL; w && rc == 0;
+         w = strtok_r(NULL, " \t\n\r\f\v", &save))
+    {
+        if (index_can_answer(w))
+            rc = word_docs(idx, w, 0, 0, &lists[count++]);
+    }
+
+    if (rc == 0)
+    {
+        qsort(lists, count, sizeof(DocList), compare_counts);
+        rc = count ? copy_list(out, &lists[0]) : all_docs(idx, out);
+        for (int k = 1; k < count && rc == 0 && out->count > 0; k++)
+            intersect(out, &lists[k]);
+        out->exact = 0;
+    }
+    for (int k = 0; k < count; k++)
+        free(lists[k].ids);
+    free(lists);
+    free(copy);
+    return rc;
+}
+
+// Single words are answered from the dictionary
+static int is_word(const QueryNode *n)
+{
+    return n->op == QUERY_TERM && !strpbrk(n->text, " \t\n\r\f\v") && index_can_answer(n->text) &&
+           !(n->mode != 0 && matcher_get_substring());
+}
+
+static int term_filter(QueryNode *n, const DocIndex *idx)
+{
+    if (strpbrk(n->text, " \t\n\r\f\v"))
+        return n->mode == 0 ? phrase_docs(idx, n->text, &n->docs) : all_docs(idx, &n->docs);
+    if (!is_word(n))
+        return all_docs(idx, &n->docs);
+    return word_docs(idx, n->text, n->mode, n->max_dist, &n->docs);
+}
+
+// Rarest operands first, negations last (they only remove documents)
+static int compare_kids(const void *a, const void *b)
+{
+    const QueryNode *ka = *(QueryNode *const *)a, *kb = *(QueryNode *const *)b;
+    if ((ka->op == QUERY_NOT) != (kb->op == QUERY_NOT))
+        return ka->op == QUERY_NOT ? 1 : -1;
+    if (ka->op == QUERY_NOT)
+        return 0;
+    return compare_counts(&ka->docs, &kb->docs);
+}
+
+// A word operand of AND left as dictionary terms rather than a doc list
+typedef struct {
+    QueryNode *node;      // the word (under the NOT for a negated operand)
+    int negated;
+    uint32_t *terms;
+    int term_count;
+    uint64_t postings;    // over all its terms
+} Probe;
+
+static int compare_probes(const void *a, const void *b)
+{
+    const Probe *pa = (const Probe *)a, *pb = (const Probe *)b;
+    if (pa->negated != pb->negated)
+        return pa->negated ? 1 : -1;
+    return pa->postings < pb->postings ? -1 : pa->postings > pb->postings;
+}
+
+// Keep the documents of docs that some term of p occurs in (none, when
+// negated). The candidates ascend, so each cursor only moves forward.
+static int probe_docs(const DocIndex *idx, const Probe *p, DocList *docs)
+{
+    PostingCursor *cursors = malloc((p->term_count > 0 ? p->term_count : 1) * sizeof(PostingCursor));
+    if (!cursors)
+        return -1;
+    for (int t = 0; t < p->term_count; t++)
+        index_cursor(idx, p->terms[t], &cursors[t]);
+
+    uint32_t n = 0;
+    for (uint32_t i = 0; i < docs->count; i++)
+    {
+        uint32_t doc = docs->ids[i];
+        int found = 0;
+        for (int t = 0; t < p->term_count && !found; t++)
+            found = posting_seek(&cursors[t], doc) == doc;
+        if (found != p->negated)
+            docs->ids[n++] = doc;
+    }
+    docs->count = n;
+    free(cursors);
+    return 0;
+}
+
+static int filter_node(QueryNode *n, const DocIndex *idx);
+
+static int and_filter(QueryNode *n, const DocIndex *idx)
+{
+    // Word operands are only looked up in the dictionary for now; the other
+    // operands get their lists. Negated operands are filtered through their
+    // child, whose list is subtracted; the NOT node itself keeps no list.
+    Probe *probes = malloc(n->kid_count * sizeof(Probe));
+    if (!probes)
+        return -1;
+    int probe_count = 0, rc = 0;
+    for (int k = 0; k < n->kid_count && rc == 0; k++)
+    {
+        QueryNode *kid = n->kids[k]->op == QUERY_NOT ? n->kids[k]->kids[0] : n->kids[k];
+        if (!is_word(kid))
+        {
+            rc = filter_node(kid, idx);
+            continue;
+        }
+        Probe *p = &probes[probe_count];
+        p->node = kid;
+        p->negated = kid != n->kids[k];
+        p->postings = 0;
+        p->term_count = index_match_terms(idx, kid->text, kid->mode, kid->max_dist, &p->terms);
+        if (p->term_count < 0)
+        {
+            rc = -1;
+            continue;
+        }
+        for (int t = 0; t < p->term_count; t++)
+            p->postings += idx->terms[p->terms[t]].post_count;
+        probe_count++;
+    }
+    qsort(probes, probe_count, sizeof(Probe), compare_probes);
+
+    // The rarest positive operand seeds the result; when it is a word, its
+    // list is decoded after all
+    QueryNode **lists = malloc(n->kid_count * sizeof(QueryNode *));
+    int list_count = 0, seeded = 0;
+    for (int k = 0; k < n->kid_count && lists; k++)
+    {
+        if (n->kids[k]->op == QUERY_NOT ? !is_word(n->kids[k]->kids[0]) : !is_word(n->kids[k]))
+            lists[list_count++] = n->kids[k];
+    }
+    qsort(lists, list_count, sizeof(QueryNode *), compare_kids);
+    rc = lists && rc == 0 ? 0 : -1;
+    if (rc == 0 && probe_count > 0 && !probes[0].negated &&
+        (list_count == 0 || lists[0]->op == QUERY_NOT || probes[0].postings < lists[0]->docs.count))
+    {
+        rc = word_docs(idx, probes[0].node->text, probes[0].node->mode, probes[0].node->max_dist,
+                       &probes[0].node->docs);
+        if (rc == 0)
+            rc = copy_list(&n->docs, &probes[0].node->docs);
+        seeded = 1;
+    }
+    else if (rc == 0)
+    {
+        rc = list_count > 0 && lists[0]->op != QUERY_NOT ? copy_list(&n->docs, &lists[0]->docs)
+                                                          : all_docs(idx, &n->docs);
+    }
+
+    int exact = 1;
+    for (int k = 0; k < list_count && rc == 0; k++)
+    {
+        if (lists[k]->op != QUERY_NOT)
+        {
+            if (k > 0 || seeded)
+                intersect(&n->docs, &lists[k]->docs);
+            exact &= lists[k]->docs.exact;
+            continue;
+        }
+        const DocList *negated = &lists[k]->kids[0]->docs;
+        if (negated->exact)
+            subtract(&n->docs, negated);
+        exact &= negated->exact;
+    }
+    // With no positive operand the result started as every document
+    if (!seeded && (list_count == 0 || lists[0]->op == QUERY_NOT) && (probe_count == 0 || probes[0].negated))
+        exact = 0;
+
+    for (int k = seeded; k < probe_count && rc == 0; k++)
+        rc = probe_docs(idx, &probes[k], &n->docs);
+    n->docs.exact = exact || n->docs.count == 0;
+
+    // A probed word holds every document of the result and, negated, none:
+    // exact over the documents query_verify() asks it about
+    for (int k = seeded; k < probe_count && rc == 0; k++)
+    {
+        DocList *docs = &probes[k].node->docs;
+        if (probes[k].negated)
+        {
+            docs->ids = malloc(sizeof(uint32_t));
+            docs->count = 0;
+            rc = docs->ids ? 0 : -1;
+        }
+        else
+        {
+            rc = copy_list(docs, &n->docs);
+        }
+        docs->exact = 1;
+    }
+    for (int k = 0; k < probe_count; k++)
+        free(probes[k].terms);
+    free(probes);
+    free(lists);
+    return rc;
+}
+
+static int filter_node(QueryNode *n, const DocIndex *idx)
+{
+    if (n->op == QUERY_TERM)
+        return term_filter(n, idx);
+    if (n->op == QUERY_AND)
+        return and_filter(n, idx);
+
+    if (n->op == QUERY_NOT)
+    {
+        const DocList *kid = &n->kids[0]->docs;
+        if (filter_node(n->kids[0], idx) != 0 || all_docs(idx, &n->docs) != 0)
+            return -1;
+        if (kid->exact)
+            subtract(&n->docs, kid);
+        n->docs.exact = kid->exact;
+        return 0;
+    }
+
+    int exact = 1;
+    for (int k = 0; k < n->kid_count; k++)
+    {
+        if (filter_node(n->kids[k], idx) != 0)
+            return -1;
+        exact &= n->kids[k]->docs.exact;
+    }
+    if (copy_list(&n->docs, &n->kids[0]->docs) != 0)
+        return -1;
+    for (int k = 1; k < n->kid_count; k++)
+    {
+        if (unite(&n->docs, &n->kids[k]->docs) != 0)
+            return -1;
+    }
+    n->docs.exact = exact;
+    return 0;
+}
+
+// Candidate documents of the whole query, or NULL when out of memory. With
+// exact set they are the answer; otherwise query_verify() each of them.
+const DocList *query_filter(QueryNode *q, const DocIndex *idx)
+{
+    return filter_node(q, idx) == 0 ? &q->docs : NULL;
+}
+
+// Whether document doc (at path) matches, after query_filter(). Nodes with
+// an exact list answer from it; the others rule out what their list does not
+// hold and scan the file for the rest.
+int query_verify(const QueryNode *q, uint32_t doc, const char *path)
+{
+    if (q->op == QUERY_NOT)
+        return !query_verify(q->kids[0], doc, path);
+    if (!doc_member(&q->docs, doc))
+        return 0;
+    if (q->docs.exact)
+        return 1;
+
+    if (q->op == QUERY_TERM)
+        return do_scan(path, q->text, q->mode, q->max_dist);
+    for (int k = 0; k < q->kid_count; k++)
+    {
+        int match = query_verify(q->kids[k], doc, path);
+        if (q->op == QUERY_AND ? !match : match)
+            return match;
+    }
+    return q->op == QUERY_AND;
+}
+
+// Evaluate a query against the index on every rank. The filter is repeated
+// everywhere (it only reads the index); candidates needing verification are
+// spread across ranks and threads. Rank 0 prints the matching documents and
+// returns their count; -1 on a syntax error or out of memory (collective).
+int search_query(const DocIndex *idx, const char *query, int mode, int rank, int size)
+{
+    char err[256];
+    QueryNode *q = query_parse(query, mode, matcher_get_max_dist(), err, sizeof(err));
+    if (!q)
+    {
+        if (rank == 0)
+            printf("[QUERY] %s\n", err);
+        return -1;
+    }
+
+    // The filter runs on every rank, so every rank must have its result
+    const DocList *candidates = query_filter(q, idx);
+    int ok = candidates != NULL;
+    MPI_Allreduce(MPI_IN_PLACE, &ok, 1, MPI_INT, MPI_LAND, MPI_COMM_WORLD);
+    if (!ok)
+    {
+        if (rank == 0)
+            printf("[QUERY] Out of memory\n");
+        query_free(q);
+        return -1;
+    }
+    if (rank == 0)
+    {
+        printf("[QUERY] ");
+        query_print(q);
+        printf("\n[QUERY] Index filter: %u of %u documents%s\n", candidates->count, idx->doc_count,
+               candidates->exact ? "" : ", verifying");
+    }
+
+    size_t cells = idx->doc_count ? idx->doc_count : 1;
+    unsigned char *local_hits = calloc(cells, 1);
+    unsigned char *hits = rank == 0 ? calloc(cells, 1) : NULL;
+    ok = local_hits && (rank != 0 || hits);
+    MPI_Allreduce(MPI_IN_PLACE, &ok, 1, MPI_INT, MPI_LAND, MPI_COMM_WORLD);
+    if (!ok)
+    {
+        if (rank == 0)
+            printf("[QUERY] Out of memory\n");
+        free(local_hits);
+        free(hits);
+        query_free(q);
+        return -1;
+    }
+    if (candidates->exact)
+    {
+        for (uint32_t k = 0; rank == 0 && k < candidates->count; k++)
+            local_hits[candidates->ids[k]] = 1;
+    }
+    else
+    {
+#pragma omp parallel for schedule(dynamic)
+        for (uint32_t k = rank; k < candidates->count; k += size)
+        {
+            uint32_t doc = candidates->ids[k];
+            TRACE_BEGIN(scan_start);
+            local_hits[doc] = (unsigned char)query_verify(q, doc, idx->strings + idx->docs[doc].path_off);
+            TRACE_END(scan_start, TRACE_SCAN, idx->strings + idx->docs[doc].path_off, 0);
+        }
+    }
+
+    TRACE_BEGIN(gather_start);
+    for (size_t off = 0; off < cells; off += REDUCE_CHUNK)
+    {
+        size_t n = cells - off < REDUCE_CHUNK ? cells - off : REDUCE_CHUNK;
+        MPI_Reduce(local_hits + off, rank == 0 ? hits + off : NULL, (int)n, MPI_UNSIGNED_CHAR, MPI_BOR, 0,
+                   MPI_COMM_WORLD);
+    }
+    TRACE_END(gather_start, TRACE_GATHER, NULL, cells);
+    free(local_hits);
+
+    int found = 0;
+    for (uint32_t d = 0; rank == 0 && d < idx->doc_count; d++)
+    {
+        if (hits[d])
+        {
+            printf("[QUERY] Found in %s\n", idx->strings + idx->docs[d].path_off);
+            found++;
+        }
+    }
+    free(hits);
+    query_free(q);
+    return found;
+}
@@ -0,0 +1,42 @@
+#ifndef QUERY_H
+#define QUERY_H
+
+#include <stdint.h>
+#include "index.h"
+
+// Boolean query over the corpus:
+//   query := or
+//   or    := and ("OR" and)*
+//   and   := unary (["AND"] unary)*      adjacent terms are AND-ed
+//   unary := "NOT" unary | "(" or ")" | term
+//   term  := ["="] word ["~" [k]] | "\"phrase\"" ["~" [k]]
+// A plain term uses the search mode; "=" forces an exact match and "~" a
+// fuzzy one within k edits (default: --max-dist). A phrase matches as one
+// literal, or approximately as a substring with "~".
+typedef enum { QUERY_TERM, QUERY_AND, QUERY_OR, QUERY_NOT } QueryOp;
+
+// Sorted doc IDs; with exact unset only a superset of the matching documents
+typedef struct {
+    uint32_t *ids;
+    uint32_t count;
+    int exact;
+} DocList;
+
+typedef struct QueryNode {
+    QueryOp op;
+    struct QueryNode **kids;  // AND/OR: two or more, NOT: one
+    int kid_count;
+    char *text;               // TERM
+    int mode;
+    int max_dist;
+    DocList docs;             // filled in by query_filter()
+} QueryNode;
+
+QueryNode *query_parse(const char *query, int mode, int max_dist, char *err, size_t err_size);
+void query_free(QueryNode *q);
+void query_print(const QueryNode *q);
+const DocList *query_filter(QueryNode *q, const DocIndex *idx);
+int query_verify(const QueryNode *q, uint32_t doc, const char *path);
+int search_query(const DocIndex *idx, const char *query, int mode, int rank, int size);
+
+#endif
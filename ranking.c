@@ -0,0 +1,512 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <limits.h>
+#include <mpi.h>
+#include <omp.h>
+#include "ranking.h"
+#include "trace.h"
+
+// BM25 top-k over the index postings with MaxScore pruning. Each word of the
+// pattern is one scoring unit: it scores a document with the best of the
+// dictionary terms it matches there (see index_match_terms; several in fuzzy
+// mode), so a word with many variants weighs no more than an exact one. A
+// term's contribution is its IDF times its term-frequency factor, bounded by
+// the largest factor in its postings (stored in the index); a word's bound is
+// the largest bound of its terms. Documents are visited in doc-ID order;
+// once the top-k heap is full, words whose bounds together cannot beat its
+// weakest score are only probed for documents the other words bring up, and
+// only while the bound of what is left could still lift the document into
+// the heap. Probes skip whole posting blocks, and term frequencies are
+// decoded only for blocks that score a document.
+
+typedef struct {
+    uint32_t term;
+    PostingCursor post;
+    double idf;
+} TermCursor;
+
+typedef struct {
+    TermCursor *terms;  // the terms the word matches
+    int count;
+    double bound;       // highest score this word adds to any document
+} WordCursor;
+
+typedef struct {
+    uint32_t term;
+    int word;
+} TermMatch;
+
+static int compare_words(const void *a, const void *b)
+{
+    const WordCursor *ca = (const WordCursor *)a, *cb = (const WordCursor *)b;
+    return ca->bound < cb->bound ? -1 : ca->bound > cb->bound;
+}
+
+static int compare_matches(const void *a, const void *b)
+{
+    const TermMatch *x = (const TermMatch *)a, *y = (const TermMatch *)b;
+    if (x->term != y->term)
+        return x->term < y->term ? -1 : 1;
+    return x->word < y->word ? -1 : x->word > y->word;
+}
+
+// Distinct terms matched by the words of pattern, ascending, in *terms, and
+// the position of the word each belongs to in *words (both caller frees). A
+// term matched by several words belongs to the first. Returns the term
+// count, or -1 on failure.
+int ranking_terms(const DocIndex *idx, const char *pattern, int mode, int max_dist, uint32_t **terms, int **words)
+{
+    TermMatch *all = NULL;
+    int count = 0;
+    char *copy = strdup(pattern);
+    int rc = copy ? 0 : -1;
+    int word = 0;
+    for (char *save, *w = copy ? strtok_r(copy, " \t\n\r\f\v", &save) : NULL; w && rc == 0;
+         w = strtok_r(NULL, " \t\n\r\f\v", &save), word++)
+    {
+        uint32_t *matched;
+        int n = index_match_terms(idx, w, mode, max_dist, &matched);
+        if (n <= 0)
+            continue;
+        TermMatch *grown = realloc(all, (count + n) * sizeof(TermMatch));
+        if (!grown)
+            rc = -1;
+        else
+        {
+            all = grown;
+            for (int i = 0; i < n; i++)
+                all[count + i] = (TermMatch){matched[i], word};
+            count += n;
+        }
+        free(matched);
+    }
+    free(copy);
+
+    qsort(all, count, sizeof(TermMatch), compare_matches);
+    *terms = rc == 0 ? malloc((count > 0 ? count : 1) * sizeof(uint32_t)) : NULL;
+    *words = rc == 0 ? malloc((count > 0 ? count : 1) * sizeof(int)) : NULL;
+    if (!*terms || !*words)
+    {
+        free(all);
+        free(*terms);
+        free(*words);
+        *terms = NULL;
+        *words = NULL;
+        return -1;
+    }
+    int unique = 0;
+    for (int i = 0; i < count; i++)
+    {
+        if (unique == 0 || (*terms)[unique - 1] != all[i].term)
+        {
+            (*terms)[unique] = all[i].term;
+            (*words)[unique++] = all[i].word;
+        }
+    }
+    free(all);
+    return unique;
+}
+
+// IDF of a term found in df of doc_count documents
+double bm25_idf(uint64_t doc_count, uint64_t df)
+{
+    return log(1.0 + (doc_count - df + 0.5) / (df + 0.5));
+}
+
+// a ranks below b: lower score, or the same score and a later document
+static int ranks_below(const RankedDoc *a, const RankedDoc *b)
+{
+    return a->score < b->score || (a->score == b->score && a->doc > b->doc);
+}
+
+// Add to a min-heap of at most k entries whose root is the weakest
+static void heap_offer(RankedDoc *heap, int *size, int k, RankedDoc entry)
+{
+    int i;
+    if (*size < k)
+    {
+        i = (*size)++;
+        while (i > 0 && ranks_below(&entry, &heap[(i - 1) / 2]))
+        {
+            heap[i] = heap[(i - 1) / 2];
+            i = (i - 1) / 2;
+        }
+        heap[i] = entry;
+        return;
+    }
+    if (!ranks_below(&heap[0], &entry))
+        return;
+
+    i = 0;
+    for (;;)
+    {
+        int child = 2 * i + 1;
+        if (child >= k)
+            break;
+        if (child + 1 < k && ranks_below(&heap[child + 1], &heap[child]))
+            child++;
+        if (!ranks_below(&heap[child], &entry))
+            break;
+        heap[i] = heap[child];
+        i = child;
+    }
+    heap[i] = entry;
+}
+
+static double term_score(const DocIndex *idx, TermCursor *c, uint32_t doc, double avg_doc_len)
+{
+    return c->idf * bm25_weight(posting_tf(&c->post), idx->docs[doc].token_count, avg_doc_len);
+}
+
+// First document any term of the word is in, from the cursors' positions
+static uint32_t word_doc(const WordCursor *w)
+{
+    uint32_t doc = POSTING_END;
+    for (int t = 0; t < w->count; t++)
+    {
+        if (posting_doc(&w->terms[t].post) < doc)
+            doc = posting_doc(&w->terms[t].post);
+    }
+    return doc;
+}
+
+// Score of the word in doc, the best of its terms. With seek set the
+// cursors are moved up to doc first; otherwise those on doc move past it.
+static double word_score(const DocIndex *idx, WordCursor *w, uint32_t doc, double avg_doc_len, int seek)
+{
+    double best = 0.0;
+    for (int t = 0; t < w->count; t++)
+    {
+        TermCursor *c = &w->terms[t];
+        uint32_t at = seek ? posting_seek(&c->post, doc) : posting_doc(&c->post);
+        if (at != doc)
+            continue;
+        double score = term_score(idx, c, doc, avg_doc_len);
+        if (score > best)
+            best = score;
+        if (!seek)
+            posting_next(&c->post);
+    }
+    return best;
+}
+
+// MaxScore over documents [first, end). cur[] is sorted by bound and is
+// consumed. The best documents land in heap[0..*size), at most k of them.
+static void top_k_range(const DocIndex *idx, WordCursor *cur, int n, double avg_doc_len, uint32_t first,
+                        uint32_t end, int k, RankedDoc *heap, int *size, unsigned long long *scored)
+{
+    // prefix[i]: the most words 0..i can add together
+    double *prefix = malloc((n > 0 ? n : 1) * sizeof(double));
+    *size = 0;
+    if (!prefix)
+        return;
+    for (int i = 0; i < n; i++)
+    {
+        prefix[i] = cur[i].bound + (i ? prefix[i - 1] : 0.0);
+        for (int t = 0; t < cur[i].count; t++)
+        {
+            index_cursor(idx, cur[i].terms[t].term, &cur[i].terms[t].post);
+            posting_seek(&cur[i].terms[t].post, first);
+        }
+    }
+
+    double threshold = 0.0;
+    int essential = 0;  // cursors below this cannot reach the heap on their own
+    while (essential < n)
+    {
+        uint32_t doc = end;
+        for (int i = essential; i < n; i++)
+        {
+            uint32_t next = word_doc(&cur[i]);
+            if (next < doc)
+                doc = next;
+        }
+        if (doc >= end)
+            break;
+
+        double score = 0.0;
+        for (int i = essential; i < n; i++)
+            score += word_score(idx, &cur[i], doc, avg_doc_len, 0);
+        for (int i = essential - 1; i >= 0; i--)
+        {
+            if (score + prefix[i] <= threshold)
+                break;
+            score += word_score(idx, &cur[i], doc, avg_doc_len, 1);
+        }
+        (*scored)++;
+
+        RankedDoc entry = {doc, score};
+        heap_offer(heap, size, k, entry);
+        if (*size == k && heap[0].score > threshold)
+        {
+            threshold = heap[0].score;
+            while (essential < n && prefix[essential] <= threshold)
+                essential++;
+        }
+    }
+    free(prefix);
+}
+
+static int compare_ranked(const void *a, const void *b)
+{
+    const RankedDoc *ra = (const RankedDoc *)a, *rb = (const RankedDoc *)b;
+    if (ra->score != rb->score)
+        return ra->score > rb->score ? -1 : 1;
+    return ra->doc < rb->doc ? -1 : ra->doc > rb->doc;
+}
+
+// Best k documents among [first, end) of idx, best first in top[], for the
+// given terms and the words they belong to (see ranking_terms) and their
+// IDFs. Documents are scored against avg_doc_len, which need not be idx's
+// own: a shard scores with the statistics of the whole corpus. The range is
+// split across threads, each with its own heap. Returns the number of
+// documents in top (at most k), or -1 on failure.
+int ranking_top_k(const DocIndex *idx, const uint32_t *terms, const int *words, const double *idfs, int n,
+                  double avg_doc_len, int k, int threads, uint32_t first, uint32_t end, RankedDoc *top,
+                  unsigned long long *scored)
+{
+    int parts = threads > 0 ? threads : 1;
+    TermCursor *cursors = malloc((n > 0 ? n : 1) * sizeof(TermCursor));
+    WordCursor *groups = malloc((n > 0 ? n : 1) * sizeof(WordCursor));
+    int *group_of = malloc((n > 0 ? n : 1) * sizeof(int));
+    int *lead = malloc((n > 0 ? n : 1) * sizeof(int));    // first term of each word
+    RankedDoc *found = malloc((size_t)parts * k * sizeof(RankedDoc));
+    int *counts = calloc(parts, sizeof(int));
+    if (!cursors || !groups || !group_of || !lead || !found || !counts)
+    {
+        free(cursors);
+        free(groups);
+        free(group_of);
+        free(lead);
+        free(found);
+        free(counts);
+        return -1;
+    }
+
+    // Group the terms by word, each word's terms adjacent in cursors[]
+    int g = 0;
+    for (int i = 0; i < n; i++)
+    {
+        int w = 0;
+        while (w < g && words[lead[w]] != words[i])
+            w++;
+        if (w == g)
+        {
+            groups[g].count = 0;
+            groups[g].bound = 0.0;
+            lead[g++] = i;
+        }
+        group_of[i] = w;
+        groups[w].count++;
+    }
+    for (int w = 0, at = 0; w < g; w++)
+    {
+        groups[w].terms = cursors + at;
+        at += groups[w].count;
+        groups[w].count = 0;
+    }
+
+    // The stored bounds assume the index's own average document length; a
+    // longer average lifts weights by at most the ratio of the two
+    double scale = idx->avg_doc_len > 0 && avg_doc_len > idx->avg_doc_len ? avg_doc_len / idx->avg_doc_len : 1.0;
+    for (int i = 0; i < n; i++)
+    {
+        WordCursor *w = &groups[group_of[i]];
+        TermCursor *c = &w->terms[w->count++];
+        c->term = terms[i];
+        c->idf = idfs[i];
+        // max_weight is stored as a float; pad it so the bound stays an upper bound
+        double bound = idfs[i] * idx->terms[terms[i]].max_weight * scale * (1.0 + 1e-6);
+        if (bound > w->bound)
+            w->bound = bound;
+    }
+    free(group_of);
+    free(lead);
+    qsort(groups, g, sizeof(WordCursor), compare_words);
+
+    unsigned long long local_scored = 0;
+#pragma omp parallel for num_threads(parts) schedule(static, 1) reduction(+:local_scored)
+    for (int p = 0; p < parts; p++)
+    {
+        // Private cursors: the words point into this thread's copy of the terms
+        WordCursor *cur = malloc((g > 0 ? g : 1) * sizeof(WordCursor));
+        TermCursor *own = malloc((n > 0 ? n : 1) * sizeof(TermCursor));
+        if (!cur || !own)
+        {
+            free(cur);
+            free(own);
+            continue;
+        }
+        memcpy(own, cursors, n * sizeof(TermCursor));
+        for (int w = 0; w < g; w++)
+        {
+            cur[w] = groups[w];
+            cur[w].terms = own + (groups[w].terms - cursors);
+        }
+        uint32_t lo = first + (uint32_t)((uint64_t)(end - first) * p / parts);
+        uint32_t hi = first + (uint32_t)((uint64_t)(end - first) * (p + 1) / parts);
+        TRACE_BEGIN(scan_start);
+        top_k_range(idx, cur, g, avg_doc_len, lo, hi, k, found + (size_t)p * k, &counts[p], &local_scored);
+        TRACE_END(scan_start, TRACE_SCAN, NULL, 0);
+        free(cur);
+        free(own);
+    }
+    free(cursors);
+    free(groups);
+    *scored += local_scored;
+
+    int local = 0;
+    for (int p = 0; p < parts; p++)
+    {
+        memmove(found + local, found + (size_t)p * k, counts[p] * sizeof(RankedDoc));
+        local += counts[p];
+    }
+    qsort(found, local, sizeof(RankedDoc), compare_ranked);
+    if (local > k)
+        local = k;
+    memcpy(top, found, local * sizeof(RankedDoc));
+    free(found);
+    free(counts);
+    return local;
+}
+
+// Top k lists travel as one block: a count, then k slots best first
+typedef struct {
+    int count;
+    int pad;
+} TopKHeader;
+
+static RankedDoc *block_docs(void *block)
+{
+    return (RankedDoc *)((char *)block + sizeof(TopKHeader));
+}
+
+// MPI reduction operator: inout = best k of in and inout
+static void merge_top_k(void *in, void *inout, int *len, MPI_Datatype *type)
+{
+    int bytes;
+    MPI_Type_size(*type, &bytes);
+    int k = (int)((bytes - sizeof(TopKHeader)) / sizeof(RankedDoc));
+    for (int b = 0; b < *len; b++)
+    {
+        char *src = (char *)in + (size_t)b * bytes, *dst = (char *)inout + (size_t)b * bytes;
+        const TopKHeader *hs = (const TopKHeader *)src;
+        TopKHeader *hd = (TopKHeader *)dst;
+        const RankedDoc *a = block_docs(src), *c = block_docs(dst);
+        RankedDoc *merged = malloc((k > 0 ? k : 1) * sizeof(RankedDoc));
+        if (!merged)
+            continue;
+        int i = 0, j = 0, n = 0;
+        while (n < k && (i < hs->count || j < hd->count))
+        {
+            if (j == hd->count || (i < hs->count && compare_ranked(&a[i], &c[j]) < 0))
+                merged[n++] = a[i++];
+            else
+                merged[n++] = c[j++];
+        }
+        memcpy(block_docs(dst), merged, n * sizeof(RankedDoc));
+        hd->count = n;
+        free(merged);
+    }
+}
+
+// Merge every rank's top k (best first, count of them) into the best k of
+// all, on rank 0: MPI_Reduce combines the lists pairwise up its reduction
+// tree, so no rank ever holds more than two lists. Returns the merged count
+// on rank 0 (0 elsewhere), or -1 on failure (collective).
+int ranking_reduce(const RankedDoc *top, int count, int k, RankedDoc *out, int rank)
+{
+    // One block is a single MPI element; k is the same on every rank
+    size_t bytes = sizeof(TopKHeader) + (size_t)k * sizeof(RankedDoc);
+    if (bytes > INT_MAX)
+        return -1;
+    char *mine = calloc(1, bytes);
+    char *merged = rank == 0 ? calloc(1, bytes) : NULL;
+    int ok = mine && (rank != 0 || merged);
+    MPI_Allreduce(MPI_IN_PLACE, &ok, 1, MPI_INT, MPI_LAND, MPI_COMM_WORLD);
+    if (!ok)
+    {
+        free(mine);
+        free(merged);
+        return -1;
+    }
+    ((TopKHeader *)mine)->count = count;
+    memcpy(block_docs(mine), top, count * sizeof(RankedDoc));
+
+    MPI_Datatype block;
+    MPI_Op op;
+    MPI_Type_contiguous((int)bytes, MPI_BYTE, &block);
+    MPI_Type_commit(&block);
+    MPI_Op_create(merge_top_k, 1, &op);
+    TRACE_BEGIN(gather_start);
+    MPI_Reduce(mine, merged, 1, block, op, 0, MPI_COMM_WORLD);
+    TRACE_END(gather_start, TRACE_GATHER, NULL, bytes);
+    MPI_Op_free(&op);
+    MPI_Type_free(&block);
+
+    int n = 0;
+    if (rank == 0)
+    {
+        n = ((TopKHeader *)merged)->count;
+        memcpy(out, block_docs(merged), n * sizeof(RankedDoc));
+    }
+    free(mine);
+    free(merged);
+    return n;
+}
+
+// Best k documents for pattern (k is capped at the document count). Every
+// rank takes an equal slice of the doc IDs and splits it across its
+// threads; the per-slice top k are merged on rank 0, which prints the
+// ranking and returns the number of documents in it (collective; -1 on
+// failure).
+int search_ranked(const DocIndex *idx, const char *pattern, int mode, int max_dist, int k, int threads,
+                  int rank, int size)
+{
+    if ((uint32_t)k > idx->doc_count)
+        k = idx->doc_count > 0 ? (int)idx->doc_count : 1;
+    uint32_t *terms;
+    int *words;
+    int n = ranking_terms(idx, pattern, mode, max_dist, &terms, &words);
+    double *idfs = n >= 0 ? malloc((n > 0 ? n : 1) * sizeof(double)) : NULL;
+    RankedDoc *top = malloc((size_t)k * sizeof(RankedDoc));
+    for (int i = 0; idfs && i < n; i++)
+        idfs[i] = bm25_idf(idx->doc_count, idx->terms[terms[i]].post_count);
+
+    uint32_t lo = (uint32_t)((uint64_t)idx->doc_count * rank / size);
+    uint32_t hi = (uint32_t)((uint64_t)idx->doc_count * (rank + 1) / size);
+    unsigned long long scored = 0;
+    int local = idfs && top ? ranking_top_k(idx, terms, words, idfs, n, idx->avg_doc_len, k, threads, lo, hi, top,
+                                            &scored)
+                            : -1;
+    if (n >= 0)
+    {
+        free(terms);
+        free(words);
+    }
+    free(idfs);
+
+    int ok = local >= 0;
+    MPI_Allreduce(MPI_IN_PLACE, &ok, 1, MPI_INT, MPI_LAND, MPI_COMM_WORLD);
+    int ranked = ok ? ranking_reduce(top, local, k, top, rank) : -1;
+    unsigned long long total_scored = scored;
+    MPI_Reduce(&scored, &total_scored, 1, MPI_UNSIGNED_LONG_LONG, MPI_SUM, 0, MPI_COMM_WORLD);
+    if (ranked < 0)
+    {
+        if (rank == 0)
+            printf("[RANK] Out of memory\n");
+        free(top);
+        return -1;
+    }
+
+    if (rank == 0)
+    {
+        printf("[RANK] %d scoring terms, %llu of %u documents scored\n", n, total_scored, idx->doc_count);
+        for (int i = 0; i < ranked; i++)
+            printf("[RANK] %3d. %8.4f  %s\n", i + 1, top[i].score, idx->strings + idx->docs[top[i].doc].path_off);
+    }
+    free(top);
+    return ranked;
+}
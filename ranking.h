@@ -0,0 +1,23 @@
+#ifndef RANKING_H
+#define RANKING_H
+
+#include <stdint.h>
+#include "index.h"
+
+#define DEFAULT_TOP_K 20
+
+typedef struct {
+    uint32_t doc;
+    double score;
+} RankedDoc;
+
+int ranking_terms(const DocIndex *idx, const char *pattern, int mode, int max_dist, uint32_t **terms, int **words);
+double bm25_idf(uint64_t doc_count, uint64_t df);
+int ranking_top_k(const DocIndex *idx, const uint32_t *terms, const int *words, const double *idfs, int n,
+                  double avg_doc_len, int k, int threads, uint32_t first, uint32_t end, RankedDoc *top,
+                  unsigned long long *scored);
+int ranking_reduce(const RankedDoc *top, int count, int k, RankedDoc *out, int rank);
+int search_ranked(const DocIndex *idx, const char *pattern, int mode, int max_dist, int k, int threads,
+                  int rank, int size);
+
+#endif
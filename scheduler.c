@@ -0,0 +1,190 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <mpi.h>
+#include "scheduler.h"
+
+static int compare_items(const void *a, const void *b)
+{
+    const WorkItem *ia = (const WorkItem *)a;
+    const WorkItem *ib = (const WorkItem *)b;
+    size_t sa = ia->end - ia->start, sb = ib->end - ib->start;
+    if (sa != sb) return sa < sb ? 1 : -1;
+    if (ia->file != ib->file) return ia->file - ib->file;
+    return ia->start < ib->start ? -1 : ia->start > ib->start;
+}
+
+static size_t file_size(const char *path)
+{
+    struct stat st;
+    return stat(path, &st) == 0 ? (size_t)st.st_size : 0;
+}
+
+// Deterministically assign every file to a rank: largest files first, each
+// to the rank with the fewest bytes so far (LPT). All ranks see the same
+// sizes, so they compute the same owner[] without communicating. Returns 0,
+// or -1 on allocation failure.
+int assign_owners(const PathTable *files, int size, int *owner)
+{
+    int file_count = files->count;
+    WorkItem *order = malloc((file_count > 0 ? file_count : 1) * sizeof(WorkItem));
+    size_t *load = calloc(size, sizeof(size_t));
+    if (!order || !load)
+    {
+        free(order);
+        free(load);
+        return -1;
+    }
+    for (int i = 0; i < file_count; i++)
+    {
+        order[i].file = i;
+        order[i].start = 0;
+        order[i].end = file_size(path_at(files, i));
+        order[i].whole = 1;
+    }
+    qsort(order, file_count, sizeof(WorkItem), compare_items);
+
+    for (int k = 0; k < file_count; k++)
+    {
+        int best = 0;
+        for (int r = 1; r < size; r++)
+        {
+            if (load[r] < load[best])
+                best = r;
+        }
+        owner[order[k].file] = best;
+        load[best] += order[k].end;
+    }
+
+    free(load);
+    free(order);
+    return 0;
+}
+
+// Number of work items file i becomes
+static int item_pieces(size_t bytes, size_t split_bytes)
+{
+    return split_bytes > 0 && bytes > split_bytes ? (int)((bytes + split_bytes - 1) / split_bytes) : 1;
+}
+
+// Stat every file and split files larger than split_bytes into byte ranges.
+// Items are grouped by the rank owning their file (owner[i]; without owner,
+// rank 0 holds them all): rank r's share starts at first[r], and
+// first[size] is the item count (first has size + 1 entries). Each share is
+// ordered largest first; handing items out in that order lets every rank
+// pull the next one as soon as it is idle, which approximates LPT (longest
+// processing time first) scheduling. Every rank computes the same plan for
+// the same arguments. Returns the number of items, or -1 on allocation
+// failure.
+int plan_work(const PathTable *files, const int *owner, int size, size_t split_bytes, WorkItem **items, int *first)
+{
+    int file_count = files->count;
+    size_t *sizes = malloc((file_count > 0 ? file_count : 1) * sizeof(size_t));
+    if (!sizes) return -1;
+
+    memset(first, 0, (size + 1) * sizeof(int));
+    for (int i = 0; i < file_count; i++)
+    {
+        sizes[i] = file_size(path_at(files, i));
+        first[(owner ? owner[i] : 0) + 1] += item_pieces(sizes[i], split_bytes);
+    }
+    for (int r = 0; r < size; r++)
+        first[r + 1] += first[r];
+    int total = first[size];
+
+    WorkItem *list = malloc((total > 0 ? total : 1) * sizeof(WorkItem));
+    int *fill = malloc(size * sizeof(int));
+    if (!list || !fill)
+    {
+        free(sizes);
+        free(list);
+        free(fill);
+        return -1;
+    }
+    memcpy(fill, first, size * sizeof(int));
+
+    for (int i = 0; i < file_count; i++)
+    {
+        WorkItem *item = &list[fill[owner ? owner[i] : 0]];
+        int pieces = item_pieces(sizes[i], split_bytes);
+        fill[owner ? owner[i] : 0] += pieces;
+        if (pieces > 1)
+        {
+            for (size_t off = 0; off < sizes[i]; off += split_bytes, item++)
+            {
+                item->file = i;
+                item->start = off;
+                item->end = off + split_bytes < sizes[i] ? off + split_bytes : sizes[i];
+                item->whole = 0;
+            }
+        }
+        else
+        {
+            item->file = i;
+            item->start = 0;
+            item->end = sizes[i];
+            item->whole = 1;
+        }
+    }
+    free(sizes);
+    free(fill);
+
+    for (int r = 0; r < size; r++)
+        qsort(list + first[r], first[r + 1] - first[r], sizeof(WorkItem), compare_items);
+    *items = list;
+    return total;
+}
+
+// Collective: every rank keeps the counter of its own share (first, see
+// plan_work) in a one-sided window, so ranks claim items with an atomic
+// fetch-and-add and no rank runs a coordinator loop. Returns 0, or -1 on
+// every rank if any of them fails to get its window (left to MPI_Finalize
+// then, as freeing it is collective too).
+int work_queue_open(WorkQueue *q, const int *first, MPI_Comm comm)
+{
+    MPI_Comm_rank(comm, &q->rank);
+    MPI_Comm_size(comm, &q->size);
+    q->first = first;
+    q->victim = q->rank;
+    q->left = q->size;
+    q->counter = NULL;
+    int ok = MPI_Win_allocate(sizeof(int), sizeof(int), MPI_INFO_NULL, comm, &q->counter, &q->win) == MPI_SUCCESS;
+    MPI_Allreduce(MPI_IN_PLACE, &ok, 1, MPI_INT, MPI_LAND, comm);
+    if (!ok)
+        return -1;
+    *q->counter = 0;
+    MPI_Barrier(comm);
+    MPI_Win_lock_all(0, q->win);
+    return 0;
+}
+
+// Index of the next unclaimed work item, from this rank's share while it
+// lasts, then from the other ranks' in turn; -1 when all are taken
+int work_queue_next(WorkQueue *q)
+{
+    const int one = 1;
+    while (q->left > 0)
+    {
+        int r = q->victim;
+        int count = q->first[r + 1] - q->first[r];
+        if (count > 0)
+        {
+            int next;
+            MPI_Fetch_and_op(&one, &next, MPI_INT, r, 0, MPI_SUM, q->win);
+            MPI_Win_flush(r, q->win);
+            if (next < count)
+                return q->first[r] + next;
+        }
+        q->victim = (r + 1) % q->size;
+        q->left--;
+    }
+    return -1;
+}
+
+// Collective
+void work_queue_close(WorkQueue *q)
+{
+    MPI_Win_unlock_all(q->win);
+    MPI_Win_free(&q->win);
+}
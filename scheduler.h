@@ -0,0 +1,37 @@
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include <stddef.h>
+#include <mpi.h>
+#include "path_table.h"
+
+#define DEFAULT_SPLIT_MB 64
+
+// A unit of search work: bytes [start, end) of one file
+typedef struct {
+    int file;
+    size_t start;
+    size_t end;
+    int whole;    // the range covers the entire file
+} WorkItem;
+
+// Shared counters handing out work item indices: rank r's counter walks the
+// items planned for rank r (first[r] up to first[r + 1]). A rank drains its
+// own share first, then takes over what is left of the other shares.
+typedef struct {
+    MPI_Win win;
+    int *counter;
+    const int *first;
+    int rank;
+    int size;
+    int victim;    // rank whose share is drawn from next
+    int left;      // shares not yet found empty
+} WorkQueue;
+
+int assign_owners(const PathTable *files, int size, int *owner);
+int plan_work(const PathTable *files, const int *owner, int size, size_t split_bytes, WorkItem **items, int *first);
+int work_queue_open(WorkQueue *q, const int *first, MPI_Comm comm);
+int work_queue_next(WorkQueue *q);
+void work_queue_close(WorkQueue *q);
+
+#endif
@@ -0,0 +1,948 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <mpi.h>
+#include <omp.h>
+#include "segment.h"
+#include "file_utils.h"
+#include "doc_reader.h"
+#include "matcher.h"
+#include "trace.h"
+
+#define MANIFEST_MAGIC "DSSEG"
+#define OPEN_ATTEMPTS 5
+
+// Manifest changes within this process (ingest, merge commits) are
+// serialized; the manifest itself is replaced by rename, so readers in other
+// processes see either version and retry if a file vanished under them.
+static pthread_mutex_t segment_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// Background merging: one thread at a time, asked to look again whenever a
+// new segment lands while it runs
+static pthread_mutex_t merge_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_t merge_thread;
+static int merge_started;
+static int merge_running;
+static int merge_again;
+static int merge_count;
+static int merge_failed;
+static char merge_dir[PATH_MAX];
+
+typedef struct {
+    uint32_t id;
+    uint32_t del_gen;
+} ManifestEntry;
+
+// Segment directory of the corpus in docs_dir: SEGMENT_DIR/<FNV-1a hash of
+// its real path>, so every corpus keeps its own segments and texts. Returns
+// 0, or -1 if docs_dir cannot be resolved.
+int segment_dir(const char *docs_dir, char *out, size_t size)
+{
+    char real[PATH_MAX];
+    if (!realpath(docs_dir, real))
+        return -1;
+    uint64_t h = 14695981039346656037ULL;
+    for (const unsigned char *p = (const unsigned char *)real; *p; p++)
+        h = (h ^ *p) * 1099511628211ULL;
+    snprintf(out, size, "%s/%016llx", SEGMENT_DIR, (unsigned long long)h);
+    return 0;
+}
+
+static void segment_file(const char *dir, uint32_t id, const char *ext, char *out, size_t size)
+{
+    snprintf(out, size, "%s/seg-%06u.%s", dir, id, ext);
+}
+
+static void tombstone_file(const char *dir, uint32_t id, uint32_t gen, char *out, size_t size)
+{
+    snprintf(out, size, "%s/seg-%06u-%u.del", dir, id, gen);
+}
+
+// Read the manifest; a missing one is an empty set. Returns the entry count
+// (*entries: caller frees), or -1 if it cannot be read.
+static int read_manifest(const char *dir, uint32_t *next_id, ManifestEntry **entries)
+{
+    char path[PATH_MAX + 16];
+    snprintf(path, sizeof(path), "%s/%s", dir, SEGMENT_MANIFEST);
+    *next_id = 1;
+    *entries = NULL;
+    FILE *fp = fopen(path, "r");
+    if (!fp)
+        return errno == ENOENT ? 0 : -1;
+
+    unsigned next;
+    if (fscanf(fp, MANIFEST_MAGIC " %u", &next) != 1)
+    {
+        fclose(fp);
+        return -1;
+    }
+    *next_id = next;
+
+    int count = 0, cap = 0;
+    unsigned id, gen;
+    while (fscanf(fp, "%u %u", &id, &gen) == 2)
+    {
+        if (count == cap)
+        {
+            cap = cap ? cap * 2 : 16;
+            ManifestEntry *grown = realloc(*entries, cap * sizeof(ManifestEntry));
+            if (!grown)
+            {
+                free(*entries);
+                *entries = NULL;
+                fclose(fp);
+                return -1;
+            }
+            *entries = grown;
+        }
+        (*entries)[count].id = id;
+        (*entries)[count].del_gen = gen;
+        count++;
+    }
+    fclose(fp);
+    return count;
+}
+
+static int write_manifest(const char *dir, uint32_t next_id, const ManifestEntry *entries, int count)
+{
+    char path[PATH_MAX + 16], tmp_path[PATH_MAX + 32];
+    snprintf(path, sizeof(path), "%s/%s", dir, SEGMENT_MANIFEST);
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+    FILE *fp = fopen(tmp_path, "w");
+    if (!fp)
+        return -1;
+    fprintf(fp, MANIFEST_MAGIC " %u\n", next_id);
+    for (int i = 0; i < count; i++)
+        fprintf(fp, "%u %u\n", entries[i].id, entries[i].del_gen);
+    int rc = ferror(fp) ? -1 : 0;
+    if (fclose(fp) != 0)
+        rc = -1;
+    if (rc == 0 && rename(tmp_path, path) != 0)
+        rc = -1;
+    if (rc != 0)
+        remove(tmp_path);
+    return rc;
+}
+
+static int write_file(const char *path, const void *data, size_t size)
+{
+    FILE *fp = fopen(path, "wb");
+    if (!fp)
+        return -1;
+    int rc = fwrite(data, 1, size, fp) == size ? 0 : -1;
+    if (fclose(fp) != 0)
+        rc = -1;
+    if (rc != 0)
+        remove(path);
+    return rc;
+}
+
+// Read exactly size bytes from path
+static int read_file(const char *path, void *data, size_t size)
+{
+    FILE *fp = fopen(path, "rb");
+    if (!fp)
+        return -1;
+    int rc = fread(data, 1, size, fp) == size && fgetc(fp) == EOF ? 0 : -1;
+    fclose(fp);
+    return rc;
+}
+
+static void remove_segment(const char *dir, uint32_t id, uint32_t del_gen)
+{
+    char path[PATH_MAX + 32];
+    segment_file(dir, id, "idx", path, sizeof(path));
+    remove(path);
+    segment_file(dir, id, "src", path, sizeof(path));
+    remove(path);
+    if (del_gen > 0)
+    {
+        tombstone_file(dir, id, del_gen, path, sizeof(path));
+        remove(path);
+    }
+}
+
+static int open_segment(const char *dir, const ManifestEntry *entry, Segment *seg)
+{
+    char path[PATH_MAX + 32];
+    memset(seg, 0, sizeof(*seg));
+    seg->id = entry->id;
+    seg->del_gen = entry->del_gen;
+    segment_file(dir, entry->id, "idx", path, sizeof(path));
+    if (index_open(path, &seg->index) != 0)
+        return -1;
+
+    uint32_t n = seg->index.doc_count;
+    seg->sources = malloc((n > 0 ? n : 1) * sizeof(SegmentSource));
+    seg->dead = calloc(n > 0 ? n : 1, 1);
+    if (!seg->sources || !seg->dead)
+        return -1;
+    segment_file(dir, entry->id, "src", path, sizeof(path));
+    if (read_file(path, seg->sources, n * sizeof(SegmentSource)) != 0)
+        return -1;
+    if (entry->del_gen > 0)
+    {
+        tombstone_file(dir, entry->id, entry->del_gen, path, sizeof(path));
+        if (read_file(path, seg->dead, n) != 0)
+            return -1;
+    }
+    for (uint32_t d = 0; d < n; d++)
+        seg->live += !seg->dead[d];
+    return 0;
+}
+
+void segment_set_close(SegmentSet *set)
+{
+    for (int s = 0; s < set->count; s++)
+    {
+        index_close(&set->segs[s].index);
+        free(set->segs[s].sources);
+        free(set->segs[s].dead);
+    }
+    free(set->segs);
+    set->segs = NULL;
+    set->count = 0;
+}
+
+// Open the segments the manifest entries name
+static int open_entries(const char *dir, uint32_t next_id, const ManifestEntry *entries, int count, SegmentSet *set)
+{
+    memset(set, 0, sizeof(*set));
+    snprintf(set->dir, sizeof(set->dir), "%s", dir);
+    set->next_id = next_id;
+    set->segs = calloc(count > 0 ? count : 1, sizeof(Segment));
+    int rc = set->segs ? 0 : -1;
+    for (int s = 0; s < count && rc == 0; s++)
+    {
+        rc = open_segment(dir, &entries[s], &set->segs[s]);
+        set->count = s + 1;
+    }
+    if (rc != 0)
+        segment_set_close(set);
+    return rc;
+}
+
+static int open_once(const char *dir, SegmentSet *set)
+{
+    uint32_t next_id;
+    ManifestEntry *entries;
+    int count = read_manifest(dir, &next_id, &entries);
+    if (count < 0)
+    {
+        memset(set, 0, sizeof(*set));
+        return -1;
+    }
+    int rc = open_entries(dir, next_id, entries, count, set);
+    free(entries);
+    return rc;
+}
+
+// Map every live segment of dir with its tombstones. A commit by another
+// process can remove files between reading the manifest and opening them,
+// so a failed open is retried against the newer manifest.
+static int open_set(const char *dir, SegmentSet *set)
+{
+    for (int attempt = 0; attempt < OPEN_ATTEMPTS; attempt++)
+    {
+        if (open_once(dir, set) == 0)
+            return 0;
+        usleep(10000);
+    }
+    return -1;
+}
+
+// Collective: every rank opens the same segments, those named by the
+// manifest rank 0 reads, which it broadcasts. Rank 0 holds off its own
+// ingests and merge commits until every rank has them open, so none of their
+// files is removed in between (open segments outlive removal). A failed open
+// is retried against the newer manifest, as with open_set(). Returns 0 on
+// every rank, or -1 on every rank.
+int segment_set_open(const char *dir, SegmentSet *set, int rank)
+{
+    for (int attempt = 0; attempt < OPEN_ATTEMPTS; attempt++)
+    {
+        uint32_t next_id = 0;
+        ManifestEntry *entries = NULL;
+        int count = 0;
+        if (rank == 0)
+        {
+            pthread_mutex_lock(&segment_lock);
+            count = read_manifest(dir, &next_id, &entries);
+        }
+        int head[2] = {count, (int)next_id};
+        MPI_Bcast(head, 2, MPI_INT, 0, MPI_COMM_WORLD);
+        count = head[0];
+        next_id = (uint32_t)head[1];
+
+        int ok = count >= 0;
+        if (ok && rank != 0)
+        {
+            entries = malloc((count > 0 ? count : 1) * sizeof(ManifestEntry));
+            ok = entries != NULL;
+        }
+        MPI_Allreduce(MPI_IN_PLACE, &ok, 1, MPI_INT, MPI_LAND, MPI_COMM_WORLD);
+        if (ok)
+        {
+            MPI_Bcast(entries, count * 2, MPI_UINT32_T, 0, MPI_COMM_WORLD);
+            ok = open_entries(dir, next_id, entries, count, set) == 0;
+            MPI_Allreduce(MPI_IN_PLACE, &ok, 1, MPI_INT, MPI_LAND, MPI_COMM_WORLD);
+            if (!ok && set->segs)
+                segment_set_close(set);
+        }
+        if (rank == 0)
+            pthread_mutex_unlock(&segment_lock);
+        free(entries);
+        if (ok)
+            return 0;
+        usleep(10000);
+    }
+    return -1;
+}
+
+uint32_t segment_set_live(const SegmentSet *set)
+{
+    uint32_t live = 0;
+    for (int s = 0; s < set->count; s++)
+        live += set->segs[s].live;
+    return live;
+}
+
+// Live doc ID of path and its segment, or -1
+static int find_live(const SegmentSet *set, const char *path, int *seg)
+{
+    for (int s = 0; s < set->count; s++)
+    {
+        int doc = index_find_doc(&set->segs[s].index, path);
+        if (doc >= 0 && !set->segs[s].dead[doc])
+        {
+            *seg = s;
+            return doc;
+        }
+    }
+    return -1;
+}
+
+// Tombstone a document. Text converted into the segment directory goes with
+// a deleted document, once the manifest no longer names it: its path is
+// added to doomed (NULL for a replaced document, whose text the new version
+// overwrites). Returns 0, or -1 if memory runs out.
+static int kill_doc(SegmentSet *set, int s, int doc, unsigned char *touched, PathTable *doomed)
+{
+    set->segs[s].dead[doc] = 1;
+    set->segs[s].live--;
+    touched[s] = 1;
+
+    const DocIndex *idx = &set->segs[s].index;
+    const char *path = idx->strings + idx->docs[doc].path_off;
+    size_t len = strlen(set->dir);
+    if (doomed && strncmp(path, set->dir, len) == 0 && path[len] == '/')
+        return path_table_add(doomed, path) < 0 ? -1 : 0;
+    return 0;
+}
+
+// Commit the tombstones of touched segments plus an optional new segment
+// (new_id, 0 for none): segments left without live documents are dropped,
+// touched ones get a new tombstone generation. segment_lock held.
+static int commit_changes(SegmentSet *set, const unsigned char *touched, uint32_t new_id)
+{
+    ManifestEntry *entries = malloc((set->count + 1) * sizeof(ManifestEntry));
+    if (!entries)
+        return -1;
+
+    int count = 0, rc = 0;
+    char path[PATH_MAX + 32];
+    for (int s = 0; s < set->count && rc == 0; s++)
+    {
+        Segment *seg = &set->segs[s];
+        if (seg->live == 0)
+            continue;
+        entries[count].id = seg->id;
+        entries[count].del_gen = seg->del_gen + (touched[s] ? 1 : 0);
+        if (touched[s])
+        {
+            tombstone_file(set->dir, seg->id, entries[count].del_gen, path, sizeof(path));
+            rc = write_file(path, seg->dead, seg->index.doc_count);
+        }
+        count++;
+    }
+    if (new_id > 0)
+    {
+        entries[count].id = new_id;
+        entries[count].del_gen = 0;
+        count++;
+    }
+
+    if (rc == 0)
+        rc = write_manifest(set->dir, set->next_id, entries, count);
+    free(entries);
+    if (rc != 0)
+        return -1;
+
+    // Superseded files go once the manifest no longer names them
+    for (int s = 0; s < set->count; s++)
+    {
+        Segment *seg = &set->segs[s];
+        if (seg->live == 0)
+        {
+            remove_segment(set->dir, seg->id, seg->del_gen);
+        }
+        else if (touched[s] && seg->del_gen > 0)
+        {
+            tombstone_file(set->dir, seg->id, seg->del_gen, path, sizeof(path));
+            remove(path);
+        }
+    }
+    return 0;
+}
+
+// Bring the documents named by sources (already sorted and distinct) up to
+// date: new and modified files are extracted and indexed into one new
+// segment, the versions they replace and files that are gone are
+// tombstoned. With full set, live documents not named are deleted too.
+// segment_lock held.
+static int ingest(const char *src_dir, const char *dir, const PathTable *sources, int full, SegmentChanges *changes)
+{
+    memset(changes, 0, sizeof(*changes));
+    SegmentSet set;
+    if (open_set(dir, &set) != 0)
+        return -1;
+
+    unsigned char *touched = calloc(set.count > 0 ? set.count : 1, 1);
+    unsigned char **seen = full ? calloc(set.count > 0 ? set.count : 1, sizeof(unsigned char *)) : NULL;
+    PathTable inputs, outputs, doomed;
+    path_table_init(&inputs);
+    path_table_init(&outputs);
+    path_table_init(&doomed);
+    SegmentSource *fresh = malloc((sources->count > 0 ? sources->count : 1) * sizeof(SegmentSource));
+    int rc = touched && fresh && (!full || seen) ? 0 : -1;
+    for (int s = 0; seen && s < set.count && rc == 0; s++)
+    {
+        seen[s] = calloc(set.segs[s].index.doc_count > 0 ? set.segs[s].index.doc_count : 1, 1);
+        if (!seen[s])
+            rc = -1;
+    }
+
+    char key[PATH_MAX];
+    for (int i = 0; i < sources->count && rc == 0; i++)
+    {
+        const char *src = path_at(sources, i);
+        text_path(src_dir, src, dir, key, sizeof(key));
+        int s = -1;
+        int doc = find_live(&set, key, &s);
+        if (doc >= 0 && seen && seen[s])
+            seen[s][doc] = 1;
+
+        struct stat st;
+        if (stat(src, &st) != 0 || !S_ISREG(st.st_mode) || !is_supported_file(src))
+        {
+            if (doc >= 0)
+            {
+                rc = kill_doc(&set, s, doc, touched, &doomed);
+                changes->deleted++;
+            }
+            continue;
+        }
+
+        SegmentSource state = {st.st_size, st.st_mtim.tv_sec * 1000000000LL + st.st_mtim.tv_nsec};
+        if (doc >= 0 && set.segs[s].sources[doc].size == state.size &&
+            set.segs[s].sources[doc].mtime_ns == state.mtime_ns)
+        {
+            changes->unchanged++;
+            continue;
+        }
+        if (doc >= 0)
+        {
+            kill_doc(&set, s, doc, touched, NULL);
+            changes->modified++;
+        }
+        else
+        {
+            changes->added++;
+        }
+        fresh[inputs.count] = state;
+        path_table_add(&inputs, src);
+        path_table_add(&outputs, key);
+    }
+
+    // A full scan deletes whatever it did not come across
+    for (int s = 0; full && rc == 0 && s < set.count; s++)
+    {
+        for (uint32_t d = 0; d < set.segs[s].index.doc_count; d++)
+        {
+            if (!set.segs[s].dead[d] && !seen[s][d] && rc == 0)
+            {
+                rc = kill_doc(&set, s, (int)d, touched, &doomed);
+                changes->deleted++;
+            }
+        }
+    }
+
+    uint32_t new_id = 0;
+    if (rc == 0 && inputs.count > 0)
+    {
+        // A new version whose text cannot be extracted must not be indexed
+        // with the text of the version it replaces
+#pragma omp parallel for schedule(dynamic)
+        for (int i = 0; i < inputs.count; i++)
+        {
+            if (convert_file(path_at(&inputs, i), path_at(&outputs, i)) != 0)
+                unlink(path_at(&outputs, i));
+        }
+
+        char path[PATH_MAX + 32];
+        new_id = set.next_id++;
+        segment_file(dir, new_id, "idx", path, sizeof(path));
+        rc = index_build(&outputs, path);
+        segment_file(dir, new_id, "src", path, sizeof(path));
+        if (rc == 0)
+            rc = write_file(path, fresh, inputs.count * sizeof(SegmentSource));
+        for (int i = 0; i < outputs.count; i++)
+            doc_unregister(path_at(&outputs, i));
+        if (rc != 0)
+            remove_segment(dir, new_id, 0);
+    }
+
+    int changed = new_id > 0;
+    for (int s = 0; s < set.count; s++)
+        changed |= touched && touched[s];
+    if (rc == 0 && changed)
+        rc = commit_changes(&set, touched, new_id);
+    for (int i = 0; rc == 0 && i < doomed.count; i++)
+        unlink(path_at(&doomed, i));
+
+    for (int s = 0; seen && s < set.count; s++)
+        free(seen[s]);
+    free(seen);
+    free(touched);
+    free(fresh);
+    path_table_free(&inputs);
+    path_table_free(&outputs);
+    path_table_free(&doomed);
+    segment_set_close(&set);
+    return rc;
+}
+
+static void make_dir(const char *dir)
+{
+    char mkdir_cmd[PATH_MAX + 16];
+    snprintf(mkdir_cmd, sizeof(mkdir_cmd), "mkdir -p \"%s\"", dir);
+    system(mkdir_cmd);
+}
+
+// Walk src_dir and bring the segments in dir up to date with it. Unchanged
+// files cost a stat; only the change set is extracted and indexed. Returns 0
+// on success, -1 on failure.
+int segment_sync(const char *src_dir, const char *dir, SegmentChanges *changes)
+{
+    make_dir(dir);
+    PathTable sources;
+    if (list_files(src_dir, &sources) != 0)
+        return -1;
+
+    pthread_mutex_lock(&segment_lock);
+    int rc = ingest(src_dir, dir, &sources, 1, changes);
+    pthread_mutex_unlock(&segment_lock);
+    path_table_free(&sources);
+    return rc;
+}
+
+// Apply changes to the given files under src_dir (created, modified or
+// deleted; duplicates are fine) without walking the tree
+int segment_apply(const char *src_dir, const char *dir, const PathTable *paths, SegmentChanges *changes)
+{
+    make_dir(dir);
+    PathTable sources;
+    path_table_init(&sources);
+    path_table_append(&sources, paths);
+    path_table_sort(&sources);
+
+    // Keep each path once
+    PathTable distinct;
+    path_table_init(&distinct);
+    for (int i = 0; i < sources.count; i++)
+    {
+        if (i == 0 || strcmp(path_at(&sources, i), path_at(&sources, i - 1)) != 0)
+            path_table_add(&distinct, path_at(&sources, i));
+    }
+
+    pthread_mutex_lock(&segment_lock);
+    int rc = ingest(src_dir, dir, &distinct, 0, changes);
+    pthread_mutex_unlock(&segment_lock);
+    path_table_free(&sources);
+    path_table_free(&distinct);
+    return rc;
+}
+
+static int size_tier(uint32_t live)
+{
+    int tier = 0;
+    while (live >= SEGMENT_MERGE_FACTOR)
+    {
+        live /= SEGMENT_MERGE_FACTOR;
+        tier++;
+    }
+    return tier;
+}
+
+// Segments to merge next (indices into set), or 0 if none qualifies: the
+// smallest size tier holding SEGMENT_MERGE_FACTOR segments, else a single
+// segment with more dead documents than live ones, to expunge them
+static int pick_merge(const SegmentSet *set, int *victims)
+{
+    for (int tier = 0; tier < 32; tier++)
+    {
+        int n = 0;
+        for (int s = 0; s < set->count; s++)
+        {
+            if (size_tier(set->segs[s].live) == tier)
+                victims[n++] = s;
+        }
+        if (n >= SEGMENT_MERGE_FACTOR)
+            return n;
+    }
+    for (int s = 0; s < set->count; s++)
+    {
+        if (set->segs[s].index.doc_count - set->segs[s].live > set->segs[s].live)
+        {
+            victims[0] = s;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// Carry tombstones that landed on the victims while they were being merged
+// over to the merged segment. Returns its dead flags (NULL if none died).
+static unsigned char *late_tombstones(const SegmentSet *snap, const int *victims, int n,
+                                      const SegmentSet *cur, uint32_t merged_count, uint32_t *merged_live)
+{
+    unsigned char *dead = calloc(merged_count > 0 ? merged_count : 1, 1);
+    if (!dead)
+        return NULL;
+    *merged_live = merged_count;
+    uint32_t next = 0;
+    int any = 0;
+    for (int v = 0; v < n; v++)
+    {
+        const Segment *old = &snap->segs[victims[v]];
+        const Segment *now = NULL;
+        for (int s = 0; s < cur->count; s++)
+        {
+            if (cur->segs[s].id == old->id)
+                now = &cur->segs[s];
+        }
+        for (uint32_t d = 0; d < old->index.doc_count; d++)
+        {
+            if (old->dead[d])
+                continue;
+            // A victim missing from the manifest lost all its documents
+            if (!now || now->dead[d])
+            {
+                dead[next] = 1;
+                (*merged_live)--;
+                any = 1;
+            }
+            next++;
+        }
+    }
+    if (!any)
+    {
+        free(dead);
+        return NULL;
+    }
+    return dead;
+}
+
+// One merge step. Victims are picked and the merged segment's ID reserved
+// under segment_lock; the merge itself runs unlocked, so ingests go on
+// meanwhile. Returns 1 after a merge, 0 if nothing qualifies, -1 on failure.
+static int merge_once(const char *dir)
+{
+    SegmentSet snap;
+    pthread_mutex_lock(&segment_lock);
+    if (open_set(dir, &snap) != 0)
+    {
+        pthread_mutex_unlock(&segment_lock);
+        return -1;
+    }
+    int *victims = malloc((snap.count > 0 ? snap.count : 1) * sizeof(int));
+    int n = victims ? pick_merge(&snap, victims) : -1;
+    uint32_t id = snap.next_id;
+    if (n > 0)
+    {
+        ManifestEntry *entries;
+        uint32_t next_id;
+        int count = read_manifest(dir, &next_id, &entries);
+        if (count < 0 || write_manifest(dir, next_id + 1, entries, count) != 0)
+            n = -1;
+        id = next_id;
+        free(entries);
+    }
+    pthread_mutex_unlock(&segment_lock);
+    if (n <= 0)
+    {
+        free(victims);
+        segment_set_close(&snap);
+        return n;
+    }
+
+    // Merged sources follow the order index_merge() gives the documents
+    DocIndex *parts = malloc(n * sizeof(DocIndex));
+    const unsigned char **dead = malloc(n * sizeof(unsigned char *));
+    uint32_t total = 0;
+    for (int v = 0; v < n; v++)
+        total += snap.segs[victims[v]].live;
+    SegmentSource *sources = malloc((total > 0 ? total : 1) * sizeof(SegmentSource));
+    int rc = parts && dead && sources ? 0 : -1;
+    uint32_t next = 0;
+    for (int v = 0; v < n && rc == 0; v++)
+    {
+        const Segment *seg = &snap.segs[victims[v]];
+        parts[v] = seg->index;
+        dead[v] = seg->dead;
+        for (uint32_t d = 0; d < seg->index.doc_count; d++)
+        {
+            if (!seg->dead[d])
+                sources[next++] = seg->sources[d];
+        }
+    }
+
+    char path[PATH_MAX + 32];
+    segment_file(dir, id, "idx", path, sizeof(path));
+    if (rc == 0)
+        rc = index_merge(parts, dead, n, path);
+    segment_file(dir, id, "src", path, sizeof(path));
+    if (rc == 0)
+        rc = write_file(path, sources, total * sizeof(SegmentSource));
+
+    // Commit: the victims make way for the merged segment
+    SegmentSet cur;
+    pthread_mutex_lock(&segment_lock);
+    if (rc == 0)
+        rc = open_set(dir, &cur);
+    if (rc == 0)
+    {
+        uint32_t live = total;
+        unsigned char *late = late_tombstones(&snap, victims, n, &cur, total, &live);
+        ManifestEntry *entries = malloc((cur.count + 1) * sizeof(ManifestEntry));
+        int count = 0;
+        rc = entries ? 0 : -1;
+        for (int s = 0; s < cur.count && rc == 0; s++)
+        {
+            int victim = 0;
+            for (int v = 0; v < n; v++)
+                victim |= cur.segs[s].id == snap.segs[victims[v]].id;
+            if (!victim)
+            {
+                entries[count].id = cur.segs[s].id;
+                entries[count].del_gen = cur.segs[s].del_gen;
+                count++;
+            }
+        }
+        if (rc == 0 && live > 0)
+        {
+            entries[count].id = id;
+            entries[count].del_gen = late ? 1 : 0;
+            count++;
+            if (late)
+            {
+                tombstone_file(dir, id, 1, path, sizeof(path));
+                rc = write_file(path, late, total);
+            }
+        }
+        if (rc == 0)
+            rc = write_manifest(dir, cur.next_id, entries, count);
+        if (rc == 0)
+        {
+            for (int s = 0; s < cur.count; s++)
+            {
+                for (int v = 0; v < n; v++)
+                {
+                    if (cur.segs[s].id == snap.segs[victims[v]].id)
+                        remove_segment(dir, cur.segs[s].id, cur.segs[s].del_gen);
+                }
+            }
+            if (live == 0)
+                remove_segment(dir, id, late ? 1 : 0);
+        }
+        free(entries);
+        free(late);
+        segment_set_close(&cur);
+    }
+    pthread_mutex_unlock(&segment_lock);
+    if (rc != 0)
+        remove_segment(dir, id, 1);
+
+    free(parts);
+    free(dead);
+    free(sources);
+    free(victims);
+    segment_set_close(&snap);
+    return rc == 0 ? 1 : -1;
+}
+
+// Run the merge policy until no tier is full. Returns the number of merges,
+// or -1 on failure.
+int segment_merge(const char *dir)
+{
+    int merges = 0, rc;
+    while ((rc = merge_once(dir)) > 0)
+        merges++;
+    return rc < 0 ? -1 : merges;
+}
+
+static void *merge_main(void *arg)
+{
+    (void)arg;
+    for (;;)
+    {
+        int merges = segment_merge(merge_dir);
+        pthread_mutex_lock(&merge_lock);
+        if (merges < 0)
+            merge_failed = 1;
+        else
+            merge_count += merges;
+        if (!merge_again || merges < 0)
+        {
+            merge_running = 0;
+            pthread_mutex_unlock(&merge_lock);
+            return NULL;
+        }
+        merge_again = 0;
+        pthread_mutex_unlock(&merge_lock);
+    }
+}
+
+// Merge dir's segments on a background thread. Called again while one is
+// running, it has the running thread check once more before it stops.
+void segment_merge_start(const char *dir)
+{
+    pthread_mutex_lock(&merge_lock);
+    if (merge_running)
+    {
+        merge_again = 1;
+        pthread_mutex_unlock(&merge_lock);
+        return;
+    }
+    if (merge_started)
+        pthread_join(merge_thread, NULL);
+    snprintf(merge_dir, sizeof(merge_dir), "%s", dir);
+    merge_again = 0;
+    merge_running = 1;
+    merge_started = pthread_create(&merge_thread, NULL, merge_main, NULL) == 0;
+    if (!merge_started)
+        merge_running = 0;
+    pthread_mutex_unlock(&merge_lock);
+}
+
+// Wait for background merging to finish. Returns the number of merges it
+// made since the last wait, or -1 if one failed.
+int segment_merge_wait(void)
+{
+    pthread_mutex_lock(&merge_lock);
+    int started = merge_started;
+    merge_started = 0;
+    pthread_mutex_unlock(&merge_lock);
+    if (started)
+        pthread_join(merge_thread, NULL);
+
+    pthread_mutex_lock(&merge_lock);
+    int merges = merge_failed ? -1 : merge_count;
+    merge_count = 0;
+    merge_failed = 0;
+    pthread_mutex_unlock(&merge_lock);
+    return merges;
+}
+
+static int compare_paths(const void *a, const void *b)
+{
+    return strcmp(*(const char *const *)a, *(const char *const *)b);
+}
+
+// Search the live documents of every segment (collective). Word queries
+// the index can answer come from each segment's postings on rank 0; other
+// patterns are scanned, live documents strided across ranks and threads.
+// Rank 0 prints the matches and gets their count; -1 on failure.
+int segment_search(const SegmentSet *set, const char *pattern, int mode, int rank, int size)
+{
+    uint32_t total = 0;
+    uint32_t *base = malloc((set->count > 0 ? set->count : 1) * sizeof(uint32_t));
+    for (int s = 0; base && s < set->count; s++)
+    {
+        base[s] = total;
+        total += set->segs[s].index.doc_count;
+    }
+    unsigned char *hits = base ? calloc(total > 0 ? total : 1, 1) : NULL;
+    int ok = hits != NULL;
+    MPI_Allreduce(MPI_IN_PLACE, &ok, 1, MPI_INT, MPI_LAND, MPI_COMM_WORLD);
+    if (!ok)
+    {
+        free(base);
+        free(hits);
+        return -1;
+    }
+
+    int max_dist = matcher_get_max_dist();
+    if (index_can_answer(pattern) && !(mode != 0 && matcher_get_substring()))
+    {
+        for (int s = 0; rank == 0 && s < set->count; s++)
+        {
+            const Segment *seg = &set->segs[s];
+            unsigned char *found = index_lookup(&seg->index, pattern, mode, max_dist);
+            for (uint32_t d = 0; found && d < seg->index.doc_count; d++)
+                hits[base[s] + d] = found[d] && !seg->dead[d];
+            free(found);
+        }
+    }
+    else
+    {
+        for (int s = 0; s < set->count; s++)
+        {
+            const Segment *seg = &set->segs[s];
+            int count = (int)seg->index.doc_count;
+#pragma omp parallel for schedule(dynamic)
+            for (int d = 0; d < count; d++)
+            {
+                if (seg->dead[d] || (int)((base[s] + d) % size) != rank)
+                    continue;
+                TRACE_BEGIN(scan_start);
+                const char *path = seg->index.strings + seg->index.docs[d].path_off;
+                hits[base[s] + d] = do_search(path, pattern, mode) > 0;
+                TRACE_END(scan_start, TRACE_SCAN, path, 0);
+            }
+        }
+    }
+
+    TRACE_BEGIN(gather_start);
+    MPI_Reduce(rank == 0 ? MPI_IN_PLACE : hits, hits, (int)total, MPI_UNSIGNED_CHAR, MPI_BOR, 0, MPI_COMM_WORLD);
+    TRACE_END(gather_start, TRACE_GATHER, NULL, total);
+
+    int found = 0;
+    if (rank == 0)
+    {
+        const char **paths = malloc((total > 0 ? total : 1) * sizeof(char *));
+        for (int s = 0; paths && s < set->count; s++)
+        {
+            const DocIndex *idx = &set->segs[s].index;
+            for (uint32_t d = 0; d < idx->doc_count; d++)
+            {
+                if (hits[base[s] + d])
+                    paths[found++] = idx->strings + idx->docs[d].path_off;
+            }
+        }
+        if (paths)
+        {
+            qsort(paths, found, sizeof(char *), compare_paths);
+            for (int i = 0; i < found; i++)
+                printf("[UPDATE] Found in %s\n", paths[i]);
+        }
+        free(paths);
+    }
+    free(base);
+    free(hits);
+    return found;
+}
@@ -0,0 +1,68 @@
+#ifndef SEGMENT_H
+#define SEGMENT_H
+
+#include <stdint.h>
+#include <limits.h>
+#include "index.h"
+#include "path_table.h"
+
+#define SEGMENT_DIR "/tmp/doc_segments"   // one directory per corpus below it, see segment_dir()
+#define SEGMENT_MANIFEST "segments"
+#define SEGMENT_MERGE_FACTOR 4  // segments of one size tier that get merged
+
+// Index maintained incrementally, LSM-style. Each ingest indexes only the
+// documents that changed into a new segment and marks the versions they
+// replace, and deleted documents, dead in their old segments (tombstones).
+// Merges fold the segments of a size tier into one, dropping dead documents.
+// Files in the segment directory:
+//   segments               "DSSEG <next id>", then "<id> <tombstone gen>" per live segment
+//   seg-<id>.idx           the segment's inverted index (see index.h)
+//   seg-<id>.src           SegmentSource per doc ID
+//   seg-<id>-<gen>.del     one dead flag per doc ID (only for gen > 0)
+// Segment files never change once written; new tombstones get a new
+// generation, and the manifest is replaced atomically.
+
+// State of the source file a document was indexed from
+typedef struct {
+    long long size;
+    long long mtime_ns;
+} SegmentSource;
+
+typedef struct {
+    uint32_t id;
+    uint32_t del_gen;
+    DocIndex index;
+    SegmentSource *sources;
+    unsigned char *dead;    // per doc ID
+    uint32_t live;
+} Segment;
+
+typedef struct {
+    char dir[PATH_MAX];
+    uint32_t next_id;
+    Segment *segs;
+    int count;
+} SegmentSet;
+
+typedef struct {
+    int added;
+    int modified;
+    int deleted;
+    int unchanged;
+} SegmentChanges;
+
+int segment_dir(const char *docs_dir, char *out, size_t size);
+int segment_set_open(const char *dir, SegmentSet *set, int rank);
+void segment_set_close(SegmentSet *set);
+uint32_t segment_set_live(const SegmentSet *set);
+
+int segment_sync(const char *src_dir, const char *dir, SegmentChanges *changes);
+int segment_apply(const char *src_dir, const char *dir, const PathTable *paths, SegmentChanges *changes);
+
+int segment_merge(const char *dir);
+void segment_merge_start(const char *dir);
+int segment_merge_wait(void);
+
+int segment_search(const SegmentSet *set, const char *pattern, int mode, int rank, int size);
+
+#endif
@@ -0,0 +1,498 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <mpi.h>
+#include <omp.h>
+#include "server.h"
+#include "file_utils.h"
+#include "doc_reader.h"
+#include "matcher.h"
+#include "index.h"
+#include "shard.h"
+
+// Protocol: one request per line on a Unix stream socket.
+//   "<mode> <pattern>"  ->  "OK <files> <milliseconds>" then one path per line
+//   "PING"              ->  "PONG"
+//   "SHUTDOWN"          ->  "OK 0 0", then the server exits
+// Anything else gets "ERR <reason>", as do a pattern of SERVER_MAX_PATTERN
+// bytes or more and a query the ranks ran out of memory for. A connection
+// may send many requests.
+//
+// Rank 0 runs the socket on a pool of worker threads. Workers queue parsed
+// queries for the main thread, which is the only one calling MPI: it
+// broadcasts up to SERVER_MAX_BATCH queued queries at a time to the other
+// ranks (which wait in MPI_Bcast between batches), every rank searches the
+// documents it owns, and the per-query hit bitmaps are OR-reduced back.
+
+typedef struct {
+    int mode;
+    char pattern[SERVER_MAX_PATTERN];
+} QuerySpec;
+
+typedef struct Query {
+    QuerySpec spec;
+    unsigned char *hits;    // file bitmap, filled by the dispatcher (NULL if out of memory)
+    double seconds;
+    int done;
+    struct Query *next;
+} Query;
+
+// Corpus kept resident for the lifetime of the server (same on every rank)
+static PathTable files;          // text searched for each document
+static PathTable sources;        // document as named by clients
+static int *owner;
+static int file_count;
+static int bitmap_bytes;
+
+// Rank 0 request plumbing
+static pthread_mutex_t server_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t pending_cond = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t done_cond = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t conn_cond = PTHREAD_COND_INITIALIZER;
+static Query *pending_head, *pending_tail;
+static int conn_fds[SERVER_THREADS * 4];
+static int conn_head, conn_count;
+static int active_fds[SERVER_THREADS];   // connection each worker serves, or -1
+static int stopping;
+static int listen_fd = -1;
+
+// Convert the corpus once, then hold every owned document's text in memory.
+// Documents converted by this run are registered already and stay as they
+// are; only the rest (plain text and cache hits) are read in. Collective;
+// returns 0, or -1 on every rank if the corpus cannot be listed.
+static int load_corpus(const char *docs_dir, int rank)
+{
+    if (preprocess_files_mpi(docs_dir, SERVER_OUT_DIR, &sources, &files, &owner, 1) != 0)
+        return -1;
+    file_count = files.count;
+    bitmap_bytes = (file_count + 7) / 8;
+
+    for (int i = 0; i < file_count; i++)
+    {
+        if (owner[i] != rank)
+            continue;
+        DocView doc;
+        if (doc_open(path_at(&files, i), &doc) != 0)
+            continue;
+        if (doc.entry)
+        {
+            doc_close(&doc);
+            continue;
+        }
+        char *copy = malloc(doc.len ? doc.len : 1);
+        if (copy)
+            memcpy(copy, doc.data, doc.len);
+        size_t len = doc.len;
+        doc_close(&doc);
+        if (copy && doc_register(path_at(&files, i), copy, len) != 0)
+            free(copy);
+    }
+    return 0;
+}
+
+// Search a batch of queries over this rank's documents and OR the hit
+// bitmaps into all_bits on rank 0 (count * bitmap_bytes bytes, NULL if it
+// could not be allocated). Collective; returns 0, or -1 on every rank if
+// memory runs out anywhere.
+static int search_queries(const QuerySpec *specs, int count, unsigned char *all_bits)
+{
+    int rank;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+
+    size_t bytes = (size_t)count * bitmap_bytes;
+    unsigned char *bits = calloc(bytes ? bytes : 1, 1);
+    int ok = bits && (rank != 0 || all_bits);
+    MPI_Allreduce(MPI_IN_PLACE, &ok, 1, MPI_INT, MPI_LAND, MPI_COMM_WORLD);
+    if (!ok)
+    {
+        free(bits);
+        return -1;
+    }
+
+#pragma omp parallel for collapse(2) schedule(dynamic)
+    for (int q = 0; q < count; q++)
+    {
+        for (int i = 0; i < file_count; i++)
+        {
+            if (owner[i] == rank && do_search(path_at(&files, i), specs[q].pattern, specs[q].mode))
+            {
+#pragma omp atomic
+                bits[(size_t)q * bitmap_bytes + i / 8] |= (unsigned char)(1u << (i % 8));
+            }
+        }
+    }
+
+    MPI_Reduce(bits, all_bits, (int)bytes, MPI_UNSIGNED_CHAR, MPI_BOR, 0, MPI_COMM_WORLD);
+    free(bits);
+    return 0;
+}
+
+// Ranks other than 0: answer broadcast batches until told to stop
+static void serve_remote(void)
+{
+    for (;;)
+    {
+        int header[2];  // query count, stop flag
+        MPI_Bcast(header, 2, MPI_INT, 0, MPI_COMM_WORLD);
+        if (header[0] > 0)
+        {
+            QuerySpec specs[SERVER_MAX_BATCH];
+            MPI_Bcast(specs, header[0] * (int)sizeof(QuerySpec), MPI_BYTE, 0, MPI_COMM_WORLD);
+            search_queries(specs, header[0], NULL);
+        }
+        if (header[1])
+            break;
+    }
+}
+
+// Rank 0 main thread: drain the queue in batches until shutdown
+static void dispatch(void)
+{
+    Query *batch[SERVER_MAX_BATCH];
+    QuerySpec specs[SERVER_MAX_BATCH];
+
+    for (;;)
+    {
+        int count = 0, stop;
+        pthread_mutex_lock(&server_lock);
+        while (!pending_head && !stopping)
+            pthread_cond_wait(&pending_cond, &server_lock);
+        while (pending_head && count < SERVER_MAX_BATCH)
+        {
+            batch[count] = pending_head;
+            specs[count] = pending_head->spec;
+            pending_head = pending_head->next;
+            count++;
+        }
+        if (!pending_head)
+            pending_tail = NULL;
+        stop = stopping && !pending_head;
+        pthread_mutex_unlock(&server_lock);
+
+        double start = MPI_Wtime();
+        int header[2] = { count, stop };
+        MPI_Bcast(header, 2, MPI_INT, 0, MPI_COMM_WORLD);
+        if (count > 0)
+        {
+            unsigned char *all_bits = malloc((size_t)count * bitmap_bytes + 1);
+            MPI_Bcast(specs, count * (int)sizeof(QuerySpec), MPI_BYTE, 0, MPI_COMM_WORLD);
+            int searched = search_queries(specs, count, all_bits) == 0;
+            double seconds = MPI_Wtime() - start;
+
+            // A query left without hits is answered with an error
+            pthread_mutex_lock(&server_lock);
+            for (int q = 0; q < count; q++)
+            {
+                batch[q]->hits = searched ? malloc(bitmap_bytes + 1) : NULL;
+                if (batch[q]->hits)
+                    memcpy(batch[q]->hits, all_bits + (size_t)q * bitmap_bytes, bitmap_bytes);
+                batch[q]->seconds = seconds;
+                batch[q]->done = 1;
+            }
+            pthread_cond_broadcast(&done_cond);
+            pthread_mutex_unlock(&server_lock);
+            free(all_bits);
+        }
+        if (stop)
+            break;
+    }
+}
+
+// Queue a query and wait for the dispatcher. Returns -1 during shutdown.
+static int run_query(Query *query)
+{
+    pthread_mutex_lock(&server_lock);
+    if (stopping)
+    {
+        pthread_mutex_unlock(&server_lock);
+        return -1;
+    }
+    query->next = NULL;
+    if (pending_tail)
+        pending_tail->next = query;
+    else
+        pending_head = query;
+    pending_tail = query;
+    pthread_cond_signal(&pending_cond);
+    while (!query->done)
+        pthread_cond_wait(&done_cond, &server_lock);
+    pthread_mutex_unlock(&server_lock);
+    return 0;
+}
+
+static void request_shutdown(void)
+{
+    pthread_mutex_lock(&server_lock);
+    stopping = 1;
+    pthread_cond_broadcast(&pending_cond);
+    pthread_cond_broadcast(&conn_cond);
+    pthread_mutex_unlock(&server_lock);
+    shutdown(listen_fd, SHUT_RDWR);  // wakes the acceptor
+}
+
+// Answer every request on one connection. Returns when the client closes it
+// (or the server shuts its reading side down).
+static void handle_connection(int fd, int slot)
+{
+    FILE *in = fdopen(fd, "r");
+    FILE *out = fdopen(dup(fd), "w");
+    if (!in || !out)
+    {
+        pthread_mutex_lock(&server_lock);
+        active_fds[slot] = -1;
+        pthread_mutex_unlock(&server_lock);
+        if (in) fclose(in); else close(fd);
+        if (out) fclose(out);
+        return;
+    }
+
+    char line[SERVER_MAX_PATTERN + 16];
+    while (fgets(line, sizeof(line), in))
+    {
+        size_t len = strcspn(line, "\r\n");
+        if (line[len] == '\0' && !feof(in))
+        {
+            // No end of line within the buffer: drop the rest of the request
+            int c;
+            while ((c = fgetc(in)) != EOF && c != '\n')
+                ;
+            fprintf(out, "ERR request too long\n");
+            fflush(out);
+            continue;
+        }
+        line[len] = '\0';
+        Query query;
+        memset(&query, 0, sizeof(query));
+
+        if (strcmp(line, "PING") == 0)
+        {
+            fprintf(out, "PONG\n");
+        }
+        else if (strcmp(line, "SHUTDOWN") == 0)
+        {
+            fprintf(out, "OK 0 0\n");
+            fflush(out);
+            request_shutdown();
+            break;
+        }
+        else if ((line[0] != '0' && line[0] != '1') || line[1] != ' ' || line[2] == '\0')
+        {
+            fprintf(out, "ERR expected \"<mode> <pattern>\"\n");
+        }
+        else if (strlen(line + 2) >= sizeof(query.spec.pattern))
+        {
+            fprintf(out, "ERR pattern too long\n");
+        }
+        else
+        {
+            query.spec.mode = line[0] - '0';
+            snprintf(query.spec.pattern, sizeof(query.spec.pattern), "%s", line + 2);
+            if (run_query(&query) != 0)
+            {
+                fprintf(out, "ERR shutting down\n");
+                break;
+            }
+            if (!query.hits)
+            {
+                fprintf(out, "ERR out of memory\n");
+                fflush(out);
+                continue;
+            }
+
+            int found = 0;
+            for (int i = 0; i < file_count; i++)
+                found += (query.hits[i / 8] >> (i % 8)) & 1;
+            fprintf(out, "OK %d %.3f\n", found, query.seconds * 1000.0);
+            for (int i = 0; i < file_count; i++)
+            {
+                if ((query.hits[i / 8] >> (i % 8)) & 1)
+                    fprintf(out, "%s\n", path_at(&sources, i));
+            }
+            free(query.hits);
+        }
+        fflush(out);
+    }
+
+    pthread_mutex_lock(&server_lock);
+    active_fds[slot] = -1;
+    pthread_mutex_unlock(&server_lock);
+    fclose(in);
+    fclose(out);
+}
+
+// Serve queued connections until shutdown. arg is the worker's slot in
+// active_fds.
+static void *worker_main(void *arg)
+{
+    int slot = (int)(intptr_t)arg;
+    for (;;)
+    {
+        pthread_mutex_lock(&server_lock);
+        while (conn_count == 0 && !stopping)
+            pthread_cond_wait(&conn_cond, &server_lock);
+        if (stopping)
+        {
+            pthread_mutex_unlock(&server_lock);
+            return NULL;
+        }
+        int fd = conn_fds[conn_head];
+        conn_head = (conn_head + 1) % (int)(sizeof(conn_fds) / sizeof(conn_fds[0]));
+        conn_count--;
+        active_fds[slot] = fd;
+        pthread_mutex_unlock(&server_lock);
+
+        handle_connection(fd, slot);
+    }
+}
+
+// Rank 0 after the last batch: wake the workers still reading a connection,
+// wait for every thread, and close the connections nobody picked up, so the
+// corpus can be released
+static void stop_threads(pthread_t acceptor, const pthread_t *workers)
+{
+    pthread_mutex_lock(&server_lock);
+    for (int t = 0; t < SERVER_THREADS; t++)
+    {
+        if (active_fds[t] >= 0)
+            shutdown(active_fds[t], SHUT_RD);
+    }
+    pthread_mutex_unlock(&server_lock);
+
+    pthread_join(acceptor, NULL);
+    for (int t = 0; t < SERVER_THREADS; t++)
+        pthread_join(workers[t], NULL);
+
+    const int capacity = (int)(sizeof(conn_fds) / sizeof(conn_fds[0]));
+    for (; conn_count > 0; conn_count--)
+    {
+        close(conn_fds[conn_head]);
+        conn_head = (conn_head + 1) % capacity;
+    }
+}
+
+static void *acceptor_main(void *arg)
+{
+    (void)arg;
+    const int capacity = (int)(sizeof(conn_fds) / sizeof(conn_fds[0]));
+    for (;;)
+    {
+        int fd = accept(listen_fd, NULL, NULL);
+        if (fd < 0)
+        {
+            pthread_mutex_lock(&server_lock);
+            int done = stopping;
+            pthread_mutex_unlock(&server_lock);
+            if (done)
+                return NULL;
+            continue;
+        }
+
+        pthread_mutex_lock(&server_lock);
+        if (conn_count == capacity || stopping)
+        {
+            pthread_mutex_unlock(&server_lock);
+            const char busy[] = "ERR busy\n";
+            if (write(fd, busy, sizeof(busy) - 1) < 0) { /* client already gone */ }
+            close(fd);
+            continue;
+        }
+        conn_fds[(conn_head + conn_count) % capacity] = fd;
+        conn_count++;
+        pthread_cond_signal(&conn_cond);
+        pthread_mutex_unlock(&server_lock);
+    }
+}
+
+static int open_socket(const char *socket_path)
+{
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen(socket_path) >= sizeof(addr.sun_path))
+        return -1;
+    strcpy(addr.sun_path, socket_path);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0)
+        return -1;
+    unlink(socket_path);
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 || listen(fd, 64) != 0)
+    {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// Collective: keep the corpus (and index) resident and answer queries on
+// socket_path until a client sends SHUTDOWN. Returns 0, or 1 if the corpus
+// could not be loaded or the socket opened.
+int run_server(const char *docs_dir, const char *socket_path, int use_index, int rank, int size)
+{
+    double start = MPI_Wtime();
+    if (load_corpus(docs_dir, rank) != 0)
+    {
+        if (rank == 0)
+            printf("[SERVER] Out of memory listing %s\n", docs_dir);
+        return 1;
+    }
+
+    // Each rank only searches the files it owns, so it only needs the shard
+    // of the index covering them
+    Shard shard;
+    int indexed = use_index && shard_open(&files, owner, SERVER_OUT_DIR, rank, size, &shard) == 0;
+    if (indexed)
+        matcher_set_index(&shard.index);
+
+    int ok = 1;
+    if (rank == 0)
+    {
+        listen_fd = open_socket(socket_path);
+        ok = listen_fd >= 0;
+    }
+    MPI_Bcast(&ok, 1, MPI_INT, 0, MPI_COMM_WORLD);
+
+    if (ok && rank == 0)
+    {
+        printf("[SERVER] %d documents resident on %d ranks (%.2f s), listening on %s\n",
+               file_count, size, MPI_Wtime() - start, socket_path);
+        fflush(stdout);
+
+        pthread_t acceptor, workers[SERVER_THREADS];
+        for (int t = 0; t < SERVER_THREADS; t++)
+            active_fds[t] = -1;
+        pthread_create(&acceptor, NULL, acceptor_main, NULL);
+        for (int t = 0; t < SERVER_THREADS; t++)
+            pthread_create(&workers[t], NULL, worker_main, (void *)(intptr_t)t);
+
+        dispatch();
+        stop_threads(acceptor, workers);
+        close(listen_fd);
+        unlink(socket_path);
+        printf("[SERVER] Shut down\n");
+    }
+    else if (ok)
+    {
+        serve_remote();
+    }
+    else if (rank == 0)
+    {
+        printf("[SERVER] Cannot listen on %s\n", socket_path);
+    }
+
+    if (indexed)
+    {
+        matcher_set_index(NULL);
+        shard_close(&shard);
+    }
+    doc_unregister_all();
+    path_table_free(&files);
+    path_table_free(&sources);
+    free(owner);
+    return ok ? 0 : 1;
+}
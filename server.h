@@ -0,0 +1,11 @@
+#ifndef SERVER_H
+#define SERVER_H
+
+#define SERVER_THREADS 4
+#define SERVER_MAX_PATTERN 256
+#define SERVER_MAX_BATCH 32
+#define SERVER_OUT_DIR "/tmp/doc_server"
+
+int run_server(const char *docs_dir, const char *socket_path, int use_index, int rank, int size);
+
+#endif
@@ -0,0 +1,446 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <sys/stat.h>
+#include <mpi.h>
+#include <omp.h>
+#include "shard.h"
+#include "query.h"
+#include "matcher.h"
+#include "batch.h"
+#include "file_utils.h"
+#include "doc_reader.h"
+#include "trace.h"
+
+// Scatter-gather over document-partitioned shards. Every rank indexes only
+// the documents preprocess_files_mpi() assigned it, so building the index
+// scales with the ranks, and keeps that shard mapped. A query reaches every
+// rank, each evaluates it against its own shard alone, and the per-shard
+// answers are combined on rank 0 by reductions: hit bitmaps OR-ed together,
+// or top-k lists merged pairwise up the reduction tree (ranking_reduce()).
+
+static void shard_file(const char *dir, int rank, int size, char *out, size_t out_size)
+{
+    snprintf(out, out_size, "%s/shard-%d-of-%d.idx", dir, rank, size);
+}
+
+// a was modified after b
+static int newer(const struct stat *a, const struct stat *b)
+{
+    return a->st_mtim.tv_sec > b->st_mtim.tv_sec ||
+           (a->st_mtim.tv_sec == b->st_mtim.tv_sec && a->st_mtim.tv_nsec > b->st_mtim.tv_nsec);
+}
+
+// Whether the shard at path indexes exactly the documents in mine, none of
+// them changed since it was written
+static int shard_current(const char *path, const PathTable *mine)
+{
+    struct stat index_st;
+    DocIndex idx;
+    if (stat(path, &index_st) != 0 || index_open(path, &idx) != 0)
+        return 0;
+
+    int current = idx.doc_count == (uint32_t)mine->count;
+    for (int i = 0; i < mine->count && current; i++)
+    {
+        struct stat st;
+        int doc = index_find_doc(&idx, path_at(mine, i));
+        if (doc < 0)
+            current = 0;
+        else if (stat(path_at(mine, i), &st) == 0)
+            current = !newer(&st, &index_st);
+        else
+            current = idx.docs[doc].token_count == 0;  // no text was extracted then either
+    }
+    index_close(&idx);
+    return current;
+}
+
+// Collective: every rank maps the shard of the documents it owns (owner[i]
+// for files[i]) from dir, building it first unless the one on disk is still
+// current, and the corpus statistics are summed across the shards. Returns
+// 0 once every rank has its shard, -1 otherwise.
+int shard_open(const PathTable *files, const int *owner, const char *dir, int rank, int size, Shard *shard)
+{
+    memset(shard, 0, sizeof(*shard));
+    char path[PATH_MAX];
+    shard_file(dir, rank, size, path, sizeof(path));
+
+    PathTable mine;
+    path_table_init(&mine);
+    for (int i = 0; i < files->count; i++)
+    {
+        if (owner[i] == rank)
+            path_table_add(&mine, path_at(files, i));
+    }
+    shard->reused = shard_current(path, &mine);
+    int ok = shard->reused || index_build(&mine, path) == 0;
+    ok = ok && index_open(path, &shard->index) == 0;
+    path_table_free(&mine);
+
+    // Shard doc IDs follow the order the shard was built in; map each back
+    // to its position in the file list. Every shard doc must be claimed by
+    // exactly one file, or some global ID would be left undefined.
+    if (ok)
+    {
+        uint32_t count = shard->index.doc_count, mapped = 0;
+        shard->global = malloc((count > 0 ? count : 1) * sizeof(uint32_t));
+        for (uint32_t d = 0; shard->global && d < count; d++)
+            shard->global[d] = UINT32_MAX;
+        for (int i = 0; shard->global && ok && i < files->count; i++)
+        {
+            int doc = owner[i] == rank ? index_find_doc(&shard->index, path_at(files, i)) : -1;
+            if (doc < 0)
+                continue;
+            ok = shard->global[doc] == UINT32_MAX;
+            shard->global[doc] = (uint32_t)i;
+            mapped++;
+        }
+        ok = ok && shard->global && mapped == count;
+    }
+
+    MPI_Allreduce(MPI_IN_PLACE, &ok, 1, MPI_INT, MPI_LAND, MPI_COMM_WORLD);
+    if (!ok)
+    {
+        shard_close(shard);
+        return -1;
+    }
+    uint64_t stats[2] = {shard->index.doc_count, shard->index.total_tokens};
+    MPI_Allreduce(MPI_IN_PLACE, stats, 2, MPI_UINT64_T, MPI_SUM, MPI_COMM_WORLD);
+    shard->corpus_docs = (uint32_t)stats[0];
+    shard->corpus_tokens = stats[1];
+    shard->avg_doc_len = stats[0] > 0 ? (double)stats[1] / stats[0] : 0.0;
+    return 0;
+}
+
+void shard_close(Shard *shard)
+{
+    index_close(&shard->index);
+    free(shard->global);
+    memset(shard, 0, sizeof(*shard));
+}
+
+static void mark_hit(unsigned char *hits, uint32_t doc)
+{
+#pragma omp atomic
+    hits[doc / 8] |= (unsigned char)(1u << (doc % 8));
+}
+
+// Hits of a plain pattern in the shard: from its postings when the index
+// can answer the pattern, otherwise by scanning the shard's documents
+static int pattern_hits(const Shard *shard, const char *pattern, int mode, unsigned char *hits)
+{
+    const DocIndex *idx = &shard->index;
+    if (index_can_answer(pattern) && !(mode != 0 && matcher_get_substring()))
+    {
+        unsigned char *found = index_lookup(idx, pattern, mode, matcher_get_max_dist());
+        if (!found)
+            return -1;
+        for (uint32_t d = 0; d < idx->doc_count; d++)
+        {
+            if (found[d])
+                mark_hit(hits, shard->global[d]);
+        }
+        free(found);
+        return 0;
+    }
+
+    int count = (int)idx->doc_count;
+#pragma omp parallel for schedule(dynamic)
+    for (int d = 0; d < count; d++)
+    {
+        const char *path = idx->strings + idx->docs[d].path_off;
+        TRACE_BEGIN(scan_start);
+        if (do_search(path, pattern, mode) > 0)
+            mark_hit(hits, shard->global[d]);
+        TRACE_END(scan_start, TRACE_SCAN, path, 0);
+    }
+    return 0;
+}
+
+// Hits of a boolean query in the shard: filtered by its postings, with the
+// candidates the filter cannot settle verified by scanning
+static int query_hits(const Shard *shard, const char *text, int mode, unsigned char *hits, char *err,
+                      size_t err_size)
+{
+    QueryNode *q = query_parse(text, mode, matcher_get_max_dist(), err, err_size);
+    if (!q)
+        return -1;
+    const DocList *candidates = query_filter(q, &shard->index);
+    if (!candidates)
+    {
+        query_free(q);
+        return -1;
+    }
+
+    const DocIndex *idx = &shard->index;
+    int count = (int)candidates->count;
+#pragma omp parallel for schedule(dynamic)
+    for (int i = 0; i < count; i++)
+    {
+        uint32_t doc = candidates->ids[i];
+        if (candidates->exact || query_verify(q, doc, idx->strings + idx->docs[doc].path_off))
+            mark_hit(hits, shard->global[doc]);
+    }
+    query_free(q);
+    return 0;
+}
+
+// Collective: evaluate pattern (a boolean query with query set, see
+// query.h) on every shard and OR the hit bitmaps, one bit per file of the
+// corpus, into hits on rank 0. Returns the number of files hit on rank 0
+// (0 elsewhere), or -1 on failure.
+int shard_search(const Shard *shard, const char *pattern, int mode, int query, uint32_t file_count,
+                 unsigned char *hits, int rank)
+{
+    size_t bytes = ((size_t)file_count + 7) / 8;
+    unsigned char *local = calloc(bytes > 0 ? bytes : 1, 1);
+    char err[256] = "Out of memory";
+    int ok = local && (query ? query_hits(shard, pattern, mode, local, err, sizeof(err))
+                             : pattern_hits(shard, pattern, mode, local)) == 0;
+    int all_ok = ok;
+    MPI_Allreduce(MPI_IN_PLACE, &all_ok, 1, MPI_INT, MPI_LAND, MPI_COMM_WORLD);
+    if (!all_ok)
+    {
+        if (rank == 0)
+            printf("[SHARD] %s\n", ok ? "Search failed on another rank" : err);
+        free(local);
+        return -1;
+    }
+
+    TRACE_BEGIN(gather_start);
+    MPI_Reduce(local, hits, (int)bytes, MPI_UNSIGNED_CHAR, MPI_BOR, 0, MPI_COMM_WORLD);
+    TRACE_END(gather_start, TRACE_GATHER, NULL, bytes);
+    free(local);
+
+    int found = 0;
+    for (uint32_t i = 0; rank == 0 && i < file_count; i++)
+        found += (hits[i / 8] >> (i % 8)) & 1;
+    return found;
+}
+
+// Corpus-wide document frequency of each of terms[0..n) (ascending, as from
+// ranking_terms()): every shard publishes the frequencies of the terms it
+// matched, keyed by text, and each adds up those of its own (collective)
+static int corpus_dfs(const DocIndex *idx, const uint32_t *terms, int n, uint64_t *dfs, int size)
+{
+    // Records: uint32 document frequency, then the NUL-terminated term
+    int bytes = 0;
+    for (int i = 0; i < n; i++)
+        bytes += (int)(sizeof(uint32_t) + idx->terms[terms[i]].str_len + 1);
+    char *mine = malloc(bytes > 0 ? bytes : 1);
+    int *counts = malloc(size * sizeof(int));
+    int *offsets = malloc(size * sizeof(int));
+    int ok = mine && counts && offsets;
+    MPI_Allreduce(MPI_IN_PLACE, &ok, 1, MPI_INT, MPI_LAND, MPI_COMM_WORLD);
+    char *all = NULL;
+    if (ok)
+    {
+        char *p = mine;
+        for (int i = 0; i < n; i++)
+        {
+            const IndexTerm *term = &idx->terms[terms[i]];
+            memcpy(p, &term->post_count, sizeof(uint32_t));
+            memcpy(p + sizeof(uint32_t), idx->strings + term->str_off, term->str_len + 1);
+            p += sizeof(uint32_t) + term->str_len + 1;
+        }
+        MPI_Allgather(&bytes, 1, MPI_INT, counts, 1, MPI_INT, MPI_COMM_WORLD);
+        int total = 0;
+        for (int r = 0; r < size; r++)
+        {
+            offsets[r] = total;
+            total += counts[r];
+        }
+        all = malloc(total > 0 ? total : 1);
+        ok = all != NULL;
+        MPI_Allreduce(MPI_IN_PLACE, &ok, 1, MPI_INT, MPI_LAND, MPI_COMM_WORLD);
+        if (ok)
+            MPI_Allgatherv(mine, bytes, MPI_BYTE, all, counts, offsets, MPI_BYTE, MPI_COMM_WORLD);
+
+        memset(dfs, 0, n * sizeof(uint64_t));
+        for (const char *p = all; ok && p < all + total;)
+        {
+            uint32_t df;
+            memcpy(&df, p, sizeof(df));
+            const char *text = p + sizeof(df);
+            p = text + strlen(text) + 1;
+            int lo = 0, hi = n;
+            while (lo < hi)
+            {
+                int mid = lo + (hi - lo) / 2;
+                if (strcmp(idx->strings + idx->terms[terms[mid]].str_off, text) < 0)
+                    lo = mid + 1;
+                else
+                    hi = mid;
+            }
+            if (lo < n && strcmp(idx->strings + idx->terms[terms[lo]].str_off, text) == 0)
+                dfs[lo] += df;
+        }
+    }
+    free(mine);
+    free(counts);
+    free(offsets);
+    free(all);
+    return ok ? 0 : -1;
+}
+
+// Collective: BM25 top k for pattern over all shards. Each shard scores its
+// documents with corpus-wide document frequencies and length, so the
+// per-shard lists merge into exactly the ranking of a single index. top
+// (k slots, rank 0; k is capped at the corpus size) receives global doc IDs,
+// best first, and *scored the documents scored on all ranks. Returns the
+// count in top on rank 0 (0 elsewhere), or -1 on failure.
+int shard_rank(const Shard *shard, const char *pattern, int mode, int k, int threads, RankedDoc *top,
+               unsigned long long *scored, int rank)
+{
+    int size;
+    MPI_Comm_size(MPI_COMM_WORLD, &size);
+    const DocIndex *idx = &shard->index;
+    if ((uint64_t)k > shard->corpus_docs)
+        k = shard->corpus_docs > 0 ? (int)shard->corpus_docs : 1;
+    uint32_t *terms = NULL;
+    int *words = NULL;
+    int n = ranking_terms(idx, pattern, mode, matcher_get_max_dist(), &terms, &words);
+    uint64_t *dfs = n >= 0 ? malloc((n > 0 ? n : 1) * sizeof(uint64_t)) : NULL;
+    double *idfs = n >= 0 ? malloc((n > 0 ? n : 1) * sizeof(double)) : NULL;
+    RankedDoc *local = malloc((size_t)k * sizeof(RankedDoc));
+    int ok = dfs && idfs && local;
+    MPI_Allreduce(MPI_IN_PLACE, &ok, 1, MPI_INT, MPI_LAND, MPI_COMM_WORLD);
+    ok = ok && corpus_dfs(idx, terms, n, dfs, size) == 0;
+
+    int count = -1;
+    unsigned long long mine = 0;
+    if (ok)
+    {
+        for (int i = 0; i < n; i++)
+            idfs[i] = bm25_idf(shard->corpus_docs, dfs[i]);
+        count = ranking_top_k(idx, terms, words, idfs, n, shard->avg_doc_len, k, threads, 0, idx->doc_count, local,
+                              &mine);
+        for (int i = 0; i < count; i++)
+            local[i].doc = shard->global[local[i].doc];
+        ok = count >= 0;
+        MPI_Allreduce(MPI_IN_PLACE, &ok, 1, MPI_INT, MPI_LAND, MPI_COMM_WORLD);
+    }
+    int ranked = ok ? ranking_reduce(local, count, k, top, rank) : -1;
+    if (ranked >= 0)
+        MPI_Reduce(&mine, scored, 1, MPI_UNSIGNED_LONG_LONG, MPI_SUM, 0, MPI_COMM_WORLD);
+
+    free(terms);
+    free(words);
+    free(dfs);
+    free(idfs);
+    free(local);
+    return ranked;
+}
+
+// Collective: shard the corpus of docs_dir across the ranks, then answer
+// pattern, or with batch set every line of the pattern file, from the
+// resident shards: plain searches, boolean queries (query set) or BM25 top
+// top_k rankings. Returns 0, or 1 on failure.
+int run_shards(const char *docs_dir, const char *pattern, int mode, int query, int top_k, int batch, int threads,
+               int rank, int size)
+{
+    double t0 = MPI_Wtime();
+    PathTable queries;
+    path_table_init(&queries);
+    int loaded = 1;
+    if (rank == 0 && batch)
+    {
+        char **patterns = NULL;
+        int count = 0;
+        loaded = load_patterns(pattern, &patterns, &count) == 0;
+        for (int i = 0; i < count; i++)
+            path_table_add(&queries, patterns[i]);
+        if (patterns)
+            free_patterns(patterns, count);
+    }
+    else if (rank == 0)
+    {
+        path_table_add(&queries, pattern);
+    }
+    MPI_Bcast(&loaded, 1, MPI_INT, 0, MPI_COMM_WORLD);
+    if (!loaded)
+    {
+        if (rank == 0)
+            printf("[SHARD] Cannot read pattern file %s\n", pattern);
+        path_table_free(&queries);
+        return 1;
+    }
+    path_table_bcast(&queries, 0, MPI_COMM_WORLD);
+
+    PathTable files;
+    int *owner;
+    Shard shard;
+    memset(&shard, 0, sizeof(shard));
+    int ok = preprocess_files_mpi(docs_dir, SHARD_TEXT_DIR, NULL, &files, &owner, 1) == 0 &&
+             shard_open(&files, owner, SHARD_DIR, rank, size, &shard) == 0;
+    int reused = ok && shard.reused, reused_total = 0;
+    MPI_Reduce(&reused, &reused_total, 1, MPI_INT, MPI_SUM, 0, MPI_COMM_WORLD);
+    if (rank == 0 && ok)
+        printf("[SHARD] %u documents in %d shards (%d reused): %.4f seconds\n", shard.corpus_docs, size,
+               reused_total, MPI_Wtime() - t0);
+    else if (rank == 0)
+        printf("[SHARD] Cannot build the shards in %s\n", SHARD_DIR);
+
+    if (ok && (uint32_t)top_k > shard.corpus_docs)
+        top_k = shard.corpus_docs > 0 ? (int)shard.corpus_docs : 1;
+    unsigned char *hits = rank == 0 ? malloc(((size_t)files.count + 7) / 8 + 1) : NULL;
+    RankedDoc *top = rank == 0 ? malloc(((size_t)top_k + 1) * sizeof(RankedDoc)) : NULL;
+    int allocated = rank != 0 || (hits && top);
+    MPI_Bcast(&allocated, 1, MPI_INT, 0, MPI_COMM_WORLD);
+    ok = ok && allocated;
+
+    double search_start = MPI_Wtime();
+    long long total = 0;
+    for (int q = 0; ok && q < queries.count; q++)
+    {
+        const char *text = path_at(&queries, q);
+        double start = MPI_Wtime();
+        int found;
+        if (top_k > 0)
+        {
+            unsigned long long scored = 0;
+            found = shard_rank(&shard, text, mode, top_k, threads, top, &scored, rank);
+            if (rank == 0 && found >= 0 && !batch)
+            {
+                printf("[SHARD] %llu of %u documents scored\n", scored, shard.corpus_docs);
+                for (int i = 0; i < found; i++)
+                    printf("[SHARD] %3d. %8.4f  %s\n", i + 1, top[i].score, path_at(&files, top[i].doc));
+            }
+        }
+        else
+        {
+            found = shard_search(&shard, text, mode, query, (uint32_t)files.count, hits, rank);
+            for (int i = 0; rank == 0 && found > 0 && !batch && i < files.count; i++)
+            {
+                if ((hits[i / 8] >> (i % 8)) & 1)
+                    printf("[SHARD] Found in %s\n", path_at(&files, i));
+            }
+        }
+        if (rank == 0 && found >= 0 && batch)
+            printf("[SHARD] %s: %d files (%.3f ms)\n", text, found, (MPI_Wtime() - start) * 1000.0);
+        ok = found >= 0;
+        total += found;
+    }
+    double search_time = MPI_Wtime() - search_start;
+
+    if (rank == 0 && ok)
+    {
+        if (batch)
+            printf("[SHARD] %d queries: %.4f seconds (%.1f queries/s), %lld files found\n", queries.count,
+                   search_time, search_time > 0 ? queries.count / search_time : 0.0, total);
+        else
+            printf("[SHARD] Search: %.4f seconds, Found: %lld files\n", search_time, total);
+        printf("[SHARD] Total: %.4f seconds\n", MPI_Wtime() - t0);
+    }
+
+    free(hits);
+    free(top);
+    shard_close(&shard);
+    path_table_free(&queries);
+    path_table_free(&files);
+    free(owner);
+    doc_unregister_all();
+    return ok ? 0 : 1;
+}
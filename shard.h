@@ -0,0 +1,35 @@
+#ifndef SHARD_H
+#define SHARD_H
+
+#include <stdint.h>
+#include "index.h"
+#include "path_table.h"
+#include "ranking.h"
+
+#define SHARD_DIR "/tmp/doc_shards"
+#define SHARD_TEXT_DIR SHARD_DIR "/text"
+
+// One rank's part of a document-partitioned index: the inverted index of the
+// documents the rank owns (shard-<rank>-of-<size>.idx), kept on disk between
+// runs and mapped for as long as the rank answers queries. Doc IDs inside a
+// shard are local; global IDs are positions in the shared file list. The
+// corpus-wide statistics let every shard score BM25 as the whole index would.
+typedef struct {
+    DocIndex index;
+    uint32_t *global;        // global doc ID of each shard doc
+    uint32_t corpus_docs;    // in all shards together
+    uint64_t corpus_tokens;
+    double avg_doc_len;      // over the whole corpus
+    int reused;              // the shard on disk was still current
+} Shard;
+
+int shard_open(const PathTable *files, const int *owner, const char *dir, int rank, int size, Shard *shard);
+void shard_close(Shard *shard);
+int shard_search(const Shard *shard, const char *pattern, int mode, int query, uint32_t file_count,
+                 unsigned char *hits, int rank);
+int shard_rank(const Shard *shard, const char *pattern, int mode, int k, int threads, RankedDoc *top,
+               unsigned long long *scored, int rank);
+int run_shards(const char *docs_dir, const char *pattern, int mode, int query, int top_k, int batch, int threads,
+               int rank, int size);
+
+#endif
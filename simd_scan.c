@@ -0,0 +1,188 @@
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <pthread.h>
+#include "simd_scan.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HAVE_X86_SIMD 1
+#endif
+
+typedef long (*find_fn)(const LiteralScanner *ls, const char *buf, size_t len);
+
+static find_fn find_impl = NULL;
+static const char *find_name = "scalar";
+static pthread_once_t dispatch_once = PTHREAD_ONCE_INIT;
+
+// Rough frequency of a byte in English text (higher = more common), used to
+// pick the pattern bytes least likely to produce false candidates
+static int byte_frequency(unsigned char c)
+{
+    static const char common[] = " etaoinshrdlcumwfgypbvkjxqz";  // most to least frequent
+    c = (unsigned char)tolower(c);
+    const char *p = c ? strchr(common, c) : NULL;
+    if (p) return 255 - (int)(p - common) * 8;
+    if (c == '\n' || c == '.' || c == ',') return 60;
+    if (isdigit(c)) return 40;
+    return 10;
+}
+
+// Compare the candidate at buf against the lowercased pattern
+static inline int verify_at(const LiteralScanner *ls, const char *buf)
+{
+    for (size_t i = 0; i < ls->len; i++) {
+        if (tolower((unsigned char)buf[i]) != (unsigned char)ls->pattern[i])
+            return 0;
+    }
+    return 1;
+}
+
+static inline int rare_bytes_at(const LiteralScanner *ls, const char *buf)
+{
+    return ((unsigned char)buf[ls->pos1] | ls->fold1) == ls->byte1 &&
+           ((unsigned char)buf[ls->pos2] | ls->fold2) == ls->byte2;
+}
+
+static long find_scalar_from(const LiteralScanner *ls, const char *buf, size_t len, size_t start)
+{
+    if (len < ls->len) return -1;
+    for (size_t s = start; s <= len - ls->len; s++) {
+        if (rare_bytes_at(ls, buf + s) && verify_at(ls, buf + s))
+            return (long)s;
+    }
+    return -1;
+}
+
+static long find_scalar(const LiteralScanner *ls, const char *buf, size_t len)
+{
+    return find_scalar_from(ls, buf, len, 0);
+}
+
+#ifdef HAVE_X86_SIMD
+// Candidate starts are the lanes where both rare bytes match; the loads at
+// s + pos stay inside buf because every start in the block is <= len - plen
+static long find_sse2(const LiteralScanner *ls, const char *buf, size_t len)
+{
+    if (len < ls->len) return -1;
+    size_t last = len - ls->len;
+    const __m128i t1 = _mm_set1_epi8((char)ls->byte1), f1 = _mm_set1_epi8((char)ls->fold1);
+    const __m128i t2 = _mm_set1_epi8((char)ls->byte2), f2 = _mm_set1_epi8((char)ls->fold2);
+
+    size_t s = 0;
+    for (; s + 16 <= last + 1; s += 16) {
+        __m128i v1 = _mm_loadu_si128((const __m128i *)(buf + s + ls->pos1));
+        __m128i v2 = _mm_loadu_si128((const __m128i *)(buf + s + ls->pos2));
+        __m128i eq = _mm_and_si128(_mm_cmpeq_epi8(_mm_or_si128(v1, f1), t1),
+                                   _mm_cmpeq_epi8(_mm_or_si128(v2, f2), t2));
+        unsigned mask = (unsigned)_mm_movemask_epi8(eq);
+        while (mask) {
+            size_t cand = s + (size_t)__builtin_ctz(mask);
+            if (verify_at(ls, buf + cand))
+                return (long)cand;
+            mask &= mask - 1;
+        }
+    }
+    return find_scalar_from(ls, buf, len, s);
+}
+
+__attribute__((target("avx2")))
+static long find_avx2(const LiteralScanner *ls, const char *buf, size_t len)
+{
+    if (len < ls->len) return -1;
+    size_t last = len - ls->len;
+    const __m256i t1 = _mm256_set1_epi8((char)ls->byte1), f1 = _mm256_set1_epi8((char)ls->fold1);
+    const __m256i t2 = _mm256_set1_epi8((char)ls->byte2), f2 = _mm256_set1_epi8((char)ls->fold2);
+
+    size_t s = 0;
+    for (; s + 32 <= last + 1; s += 32) {
+        __m256i v1 = _mm256_loadu_si256((const __m256i *)(buf + s + ls->pos1));
+        __m256i v2 = _mm256_loadu_si256((const __m256i *)(buf + s + ls->pos2));
+        __m256i eq = _mm256_and_si256(_mm256_cmpeq_epi8(_mm256_or_si256(v1, f1), t1),
+                                      _mm256_cmpeq_epi8(_mm256_or_si256(v2, f2), t2));
+        unsigned mask = (unsigned)_mm256_movemask_epi8(eq);
+        while (mask) {
+            size_t cand = s + (size_t)__builtin_ctz(mask);
+            if (verify_at(ls, buf + cand))
+                return (long)cand;
+            mask &= mask - 1;
+        }
+    }
+    return find_scalar_from(ls, buf, len, s);
+}
+#endif
+
+static void select_backend(void)
+{
+    find_impl = find_scalar;
+    find_name = "scalar";
+#ifdef HAVE_X86_SIMD
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        find_impl = find_avx2;
+        find_name = "avx2";
+    } else if (__builtin_cpu_supports("sse2")) {
+        find_impl = find_sse2;
+        find_name = "sse2";
+    }
+#endif
+}
+
+// Prepare a scanner for pattern. Returns 0 on success, -1 for an empty pattern
+// or allocation failure.
+int literal_scanner_init(LiteralScanner *ls, const char *pattern)
+{
+    pthread_once(&dispatch_once, select_backend);
+    memset(ls, 0, sizeof(*ls));
+
+    ls->len = strlen(pattern);
+    if (ls->len == 0) return -1;
+    ls->pattern = malloc(ls->len + 1);
+    if (!ls->pattern) return -1;
+    for (size_t i = 0; i <= ls->len; i++)
+        ls->pattern[i] = (char)tolower((unsigned char)pattern[i]);
+
+    // Rarest byte first, then the rarest one with a different value (falling
+    // back to a different position, or the same one for 1-byte patterns)
+    ls->pos1 = 0;
+    for (size_t i = 1; i < ls->len; i++) {
+        if (byte_frequency(ls->pattern[i]) < byte_frequency(ls->pattern[ls->pos1]))
+            ls->pos1 = i;
+    }
+    ls->pos2 = ls->len > 1 ? (ls->pos1 == 0 ? 1 : 0) : 0;
+    int pos2_distinct = ls->pattern[ls->pos2] != ls->pattern[ls->pos1];
+    for (size_t i = 0; i < ls->len; i++) {
+        if (i == ls->pos1) continue;
+        int distinct = ls->pattern[i] != ls->pattern[ls->pos1];
+        if ((distinct && !pos2_distinct) ||
+            (distinct == pos2_distinct &&
+             byte_frequency(ls->pattern[i]) < byte_frequency(ls->pattern[ls->pos2]))) {
+            ls->pos2 = i;
+            pos2_distinct = distinct;
+        }
+    }
+
+    ls->byte1 = (unsigned char)ls->pattern[ls->pos1];
+    ls->byte2 = (unsigned char)ls->pattern[ls->pos2];
+    ls->fold1 = isalpha(ls->byte1) ? 0x20 : 0;
+    ls->fold2 = isalpha(ls->byte2) ? 0x20 : 0;
+    return 0;
+}
+
+void literal_scanner_free(LiteralScanner *ls)
+{
+    free(ls->pattern);
+    ls->pattern = NULL;
+}
+
+// Offset of the first case-insensitive occurrence in buf, or -1
+long literal_find(const LiteralScanner *ls, const char *buf, size_t len)
+{
+    return find_impl(ls, buf, len);
+}
+
+const char *literal_scanner_backend(void)
+{
+    pthread_once(&dispatch_once, select_backend);
+    return find_name;
+}
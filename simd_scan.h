@@ -0,0 +1,22 @@
+#ifndef SIMD_SCAN_H
+#define SIMD_SCAN_H
+
+#include <stddef.h>
+
+// Case-insensitive single-literal scanner. Candidates are found by comparing
+// the two rarest pattern bytes across whole vector blocks; only candidate
+// positions are verified against the full pattern.
+typedef struct {
+    char *pattern;       // lowercased copy
+    size_t len;
+    size_t pos1, pos2;   // offsets of the rare bytes within the pattern
+    unsigned char byte1, byte2;
+    unsigned char fold1, fold2;  // 0x20 for letters (matched in both cases), else 0
+} LiteralScanner;
+
+int literal_scanner_init(LiteralScanner *ls, const char *pattern);
+void literal_scanner_free(LiteralScanner *ls);
+long literal_find(const LiteralScanner *ls, const char *buf, size_t len);
+const char *literal_scanner_backend(void);
+
+#endif
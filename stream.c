@@ -0,0 +1,72 @@
+#include <stdlib.h>
+#include "stream.h"
+
+int stream_queue_init(StreamQueue *q, int slot_count, int capacity)
+{
+    q->capacity = capacity > 0 ? capacity : 1;
+    q->ready = malloc(q->capacity * sizeof(int));
+    if (!q->ready)
+        return -1;
+    q->head = 0;
+    q->count = 0;
+    q->next_slot = 0;
+    q->slot_count = slot_count;
+    q->producing = 0;
+    pthread_mutex_init(&q->lock, NULL);
+    pthread_cond_init(&q->changed, NULL);
+    return 0;
+}
+
+// Next task for the calling thread: a ready slot to search if there is one,
+// else a slot to produce, else wait for the slots still being produced.
+// STREAM_DONE once every slot has been handed out for searching.
+StreamTask stream_queue_next(StreamQueue *q, int *slot)
+{
+    StreamTask task = STREAM_DONE;
+    pthread_mutex_lock(&q->lock);
+    for (;;)
+    {
+        if (q->count > 0)
+        {
+            *slot = q->ready[q->head];
+            q->head = (q->head + 1) % q->capacity;
+            q->count--;
+            task = STREAM_SEARCH;
+            pthread_cond_broadcast(&q->changed);
+            break;
+        }
+        if (q->next_slot < q->slot_count)
+        {
+            *slot = q->next_slot++;
+            q->producing++;
+            task = STREAM_PRODUCE;
+            break;
+        }
+        if (q->producing == 0)
+            break;
+        pthread_cond_wait(&q->changed, &q->lock);
+    }
+    pthread_mutex_unlock(&q->lock);
+    return task;
+}
+
+// Hand a produced slot to the searchers, waiting while the queue is full
+void stream_queue_push(StreamQueue *q, int slot)
+{
+    pthread_mutex_lock(&q->lock);
+    while (q->count == q->capacity)
+        pthread_cond_wait(&q->changed, &q->lock);
+    q->ready[(q->head + q->count) % q->capacity] = slot;
+    q->count++;
+    q->producing--;
+    pthread_cond_broadcast(&q->changed);
+    pthread_mutex_unlock(&q->lock);
+}
+
+void stream_queue_destroy(StreamQueue *q)
+{
+    pthread_mutex_destroy(&q->lock);
+    pthread_cond_destroy(&q->changed);
+    free(q->ready);
+    q->ready = NULL;
+}
@@ -0,0 +1,35 @@
+#ifndef STREAM_H
+#define STREAM_H
+
+#include <pthread.h>
+
+// Bounded hand-off between producing documents (extracting them, or just
+// listing them for .txt) and searching them, shared by the threads of one
+// rank. Every thread does both: it searches whatever is ready and produces
+// the next document only when nothing is, so at most one produced document
+// per thread waits in the queue and extracted text is searched, then
+// released, while the rest of the corpus is still being converted.
+typedef struct {
+    int *ready;         // ring of produced slots, capacity entries
+    int capacity;
+    int head;
+    int count;
+    int next_slot;      // next slot to produce
+    int slot_count;
+    int producing;      // slots being produced right now
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+} StreamQueue;
+
+typedef enum {
+    STREAM_DONE,
+    STREAM_SEARCH,      // search the slot
+    STREAM_PRODUCE      // produce the slot, then stream_queue_push() it
+} StreamTask;
+
+int stream_queue_init(StreamQueue *q, int slot_count, int capacity);
+StreamTask stream_queue_next(StreamQueue *q, int *slot);
+void stream_queue_push(StreamQueue *q, int slot);
+void stream_queue_destroy(StreamQueue *q);
+
+#endif
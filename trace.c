@@ -0,0 +1,400 @@
+#ifdef DOCSEARCH_TRACE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <time.h>
+#include <pthread.h>
+#include <mpi.h>
+#include "trace.h"
+#include "bench.h"
+
+#define INITIAL_EVENTS 4096
+#define HISTOGRAM_BUCKETS 7   // <10us, <100us, <1ms, <10ms, <100ms, <1s, >=1s
+
+typedef struct {
+    double start;               // seconds since the session opened on this rank
+    double dur;
+    unsigned long long bytes;
+    int kind;
+    int tid;
+    long detail;                // offset into the string arena, -1 if none
+} TraceEvent;
+
+// Events of one thread, appended without locking
+typedef struct TraceBuffer {
+    TraceEvent *events;
+    int count, cap;
+    char *strings;
+    size_t str_len, str_cap;
+    int tid;
+    struct TraceBuffer *next;
+} TraceBuffer;
+
+static const char *kind_names[TRACE_KIND_COUNT] = {
+    "open", "extract", "subprocess", "cache", "ac_build", "index_build",
+    "index_merge", "scan", "queue_wait", "gather", "barrier", "bcast"};
+static const char *kind_cats[TRACE_KIND_COUNT] = {
+    "io", "extract", "extract", "io", "build", "build",
+    "build", "scan", "queue", "mpi", "mpi", "mpi"};
+
+// Work counted as busy time. The other kinds nest inside these (open,
+// subprocess) or are waits. A cache lookup is timed on its own, before any
+// extraction, so it counts too.
+static const int kind_busy[TRACE_KIND_COUNT] = {0, 1, 0, 1, 1, 1, 1, 1, 0, 0, 0, 0};
+
+static int enabled;
+static char trace_path[4096];
+static double session_start;
+static pthread_mutex_t buffers_lock = PTHREAD_MUTEX_INITIALIZER;
+static TraceBuffer *buffers;
+static int thread_count;
+static __thread TraceBuffer *local;
+
+double trace_now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Start recording; the trace goes to path on trace_close. Call on every rank
+// right after a barrier, so rank timelines line up.
+void trace_open(const char *path)
+{
+    snprintf(trace_path, sizeof(trace_path), "%s", path);
+    session_start = trace_now();
+    enabled = 1;
+}
+
+static TraceBuffer *local_buffer(void)
+{
+    if (local)
+        return local;
+    TraceBuffer *b = calloc(1, sizeof(TraceBuffer));
+    if (!b)
+        return NULL;
+    pthread_mutex_lock(&buffers_lock);
+    b->tid = thread_count++;
+    b->next = buffers;
+    buffers = b;
+    pthread_mutex_unlock(&buffers_lock);
+    local = b;
+    return b;
+}
+
+// Record an event that began at start (a trace_now() value) and ends now
+void trace_event(TraceKind kind, const char *detail, double start, unsigned long long bytes)
+{
+    if (!enabled)
+        return;
+    double end = trace_now();
+    TraceBuffer *b = local_buffer();
+    if (!b)
+        return;
+
+    if (b->count == b->cap)
+    {
+        int cap = b->cap ? b->cap * 2 : INITIAL_EVENTS;
+        TraceEvent *grown = realloc(b->events, cap * sizeof(TraceEvent));
+        if (!grown)
+            return;
+        b->events = grown;
+        b->cap = cap;
+    }
+
+    long offset = -1;
+    if (detail)
+    {
+        size_t len = strlen(detail) + 1;
+        if (b->str_len + len > b->str_cap)
+        {
+            size_t cap = b->str_cap ? b->str_cap : 1 << 16;
+            while (cap < b->str_len + len) cap *= 2;
+            char *grown = realloc(b->strings, cap);
+            if (grown)
+            {
+                b->strings = grown;
+                b->str_cap = cap;
+            }
+        }
+        if (b->str_len + len <= b->str_cap)
+        {
+            memcpy(b->strings + b->str_len, detail, len);
+            offset = (long)b->str_len;
+            b->str_len += len;
+        }
+    }
+
+    TraceEvent *e = &b->events[b->count++];
+    e->start = start - session_start;
+    e->dur = end - start;
+    e->bytes = bytes;
+    e->kind = kind;
+    e->tid = b->tid;
+    e->detail = offset;
+}
+
+static void write_chrome_trace(FILE *out, const TraceEvent *events, const int *event_rank, long count,
+                               const char *strings, const long *string_base, int size)
+{
+    fprintf(out, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n");
+    for (int r = 0; r < size; r++)
+    {
+        fprintf(out, "{\"name\": \"process_name\", \"ph\": \"M\", \"pid\": %d, \"args\": {\"name\": \"rank %d\"}},\n",
+                r, r);
+    }
+    for (long i = 0; i < count; i++)
+    {
+        const TraceEvent *e = &events[i];
+        fprintf(out, "{\"name\": \"%s\", \"cat\": \"%s\", \"ph\": \"X\", \"ts\": %.3f, \"dur\": %.3f, "
+                     "\"pid\": %d, \"tid\": %d, \"args\": {\"bytes\": %llu",
+                kind_names[e->kind], kind_cats[e->kind], e->start * 1e6, e->dur * 1e6,
+                event_rank[i], e->tid, e->bytes);
+        if (e->detail >= 0)
+        {
+            fprintf(out, ", \"file\": ");
+            bench_write_json_string(out, strings + string_base[event_rank[i]] + e->detail);
+        }
+        fprintf(out, "}}%s\n", i + 1 < count ? "," : "");
+    }
+    fprintf(out, "]}\n");
+}
+
+static int bucket_of(double seconds)
+{
+    double limit = 1e-5;
+    int b = 0;
+    while (b < HISTOGRAM_BUCKETS - 1 && seconds >= limit)
+    {
+        limit *= 10;
+        b++;
+    }
+    return b;
+}
+
+// Per-kind latency table and histogram, then busy/idle time per rank and thread
+static void print_summary(const TraceEvent *events, const int *event_rank, long count,
+                          const double *walls, const int *threads, int size)
+{
+    double *durs = malloc((count > 0 ? count : 1) * sizeof(double));
+    if (!durs)
+    {
+        printf("[TRACE] Out of memory summarizing the trace\n");
+        return;
+    }
+
+    printf("\n=== TRACE SUMMARY ===\n");
+    printf("Event       | Count    | Total s   | p50 ms    | p95 ms    | Max ms    | MB\n");
+    printf("------------|----------|-----------|-----------|-----------|-----------|----------\n");
+    long histogram[TRACE_KIND_COUNT][HISTOGRAM_BUCKETS];
+    memset(histogram, 0, sizeof(histogram));
+    for (int k = 0; k < TRACE_KIND_COUNT; k++)
+    {
+        long n = 0;
+        double total = 0.0;
+        unsigned long long bytes = 0;
+        for (long i = 0; i < count; i++)
+        {
+            if (events[i].kind != k)
+                continue;
+            durs[n++] = events[i].dur;
+            total += events[i].dur;
+            bytes += events[i].bytes;
+            histogram[k][bucket_of(events[i].dur)]++;
+        }
+        if (n == 0)
+            continue;
+        qsort(durs, n, sizeof(double), bench_compare_doubles);
+        printf("%-11s | %8ld | %9.4f | %9.3f | %9.3f | %9.3f | %9.1f\n", kind_names[k], n, total,
+               durs[n / 2] * 1e3, durs[(95 * n + 99) / 100 - 1] * 1e3, durs[n - 1] * 1e3, bytes / 1e6);
+    }
+
+    printf("\nEvent       | <10us    | <100us   | <1ms     | <10ms    | <100ms   | <1s      | >=1s\n");
+    printf("------------|----------|----------|----------|----------|----------|----------|---------\n");
+    for (int k = 0; k < TRACE_KIND_COUNT; k++)
+    {
+        long n = 0;
+        for (int b = 0; b < HISTOGRAM_BUCKETS; b++)
+            n += histogram[k][b];
+        if (n == 0)
+            continue;
+        printf("%-11s", kind_names[k]);
+        for (int b = 0; b < HISTOGRAM_BUCKETS; b++)
+            printf(" | %8ld", histogram[k][b]);
+        printf("\n");
+    }
+
+    printf("\nRank | Thread | Busy s    | Idle s    | Queue wait s | MPI wait s\n");
+    printf("-----|--------|-----------|-----------|--------------|-----------\n");
+    for (int r = 0; r < size; r++)
+    {
+        for (int t = 0; t < threads[r]; t++)
+        {
+            double busy = 0.0, queue = 0.0, mpi = 0.0;
+            for (long i = 0; i < count; i++)
+            {
+                const TraceEvent *e = &events[i];
+                if (event_rank[i] != r || e->tid != t)
+                    continue;
+                if (kind_busy[e->kind])
+                    busy += e->dur;
+                else if (e->kind == TRACE_QUEUE_WAIT)
+                    queue += e->dur;
+                else if (e->kind == TRACE_GATHER || e->kind == TRACE_BARRIER || e->kind == TRACE_BCAST)
+                    mpi += e->dur;
+            }
+            printf("%4d | %6d | %9.4f | %9.4f | %12.4f | %9.4f\n", r, t, busy,
+                   walls[r] > busy ? walls[r] - busy : 0.0, queue, mpi);
+        }
+    }
+    free(durs);
+}
+
+// Collective: gather every rank's events on rank 0, which writes the Chrome
+// trace and prints the summary. Returns 0, or -1 if the trace file could not
+// be written or memory ran out (on every rank).
+int trace_close(MPI_Comm comm)
+{
+    if (!enabled)
+        return 0;
+    enabled = 0;
+    double wall = trace_now() - session_start;
+
+    int rank, size;
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &size);
+
+    // Flatten this rank's buffers
+    long count = 0;
+    size_t str_len = 0;
+    for (TraceBuffer *b = buffers; b; b = b->next)
+    {
+        count += b->count;
+        str_len += b->str_len;
+    }
+    TraceEvent *events = malloc((count > 0 ? count : 1) * sizeof(TraceEvent));
+    char *strings = malloc(str_len > 0 ? str_len : 1);
+    int ok = events && strings && count <= INT_MAX && str_len <= INT_MAX;
+    long n = 0;
+    size_t base = 0;
+    for (TraceBuffer *b = ok ? buffers : NULL; b; b = b->next)
+    {
+        for (int i = 0; i < b->count; i++)
+        {
+            events[n] = b->events[i];
+            if (events[n].detail >= 0)
+                events[n].detail += (long)base;
+            n++;
+        }
+        memcpy(strings + base, b->strings, b->str_len);
+        base += b->str_len;
+    }
+
+    // Gather counts (events, string bytes), then events and strings
+    int local_info[2] = {ok ? (int)count : 0, ok ? (int)str_len : 0};
+    int *info = rank == 0 ? malloc(2 * size * sizeof(int)) : NULL;
+    double *walls = rank == 0 ? malloc(size * sizeof(double)) : NULL;
+    int *threads = rank == 0 ? malloc(size * sizeof(int)) : NULL;
+    int *event_counts = rank == 0 ? malloc(size * sizeof(int)) : NULL;
+    int *event_displs = rank == 0 ? malloc(size * sizeof(int)) : NULL;
+    int *str_counts = rank == 0 ? malloc(size * sizeof(int)) : NULL;
+    int *str_displs = rank == 0 ? malloc(size * sizeof(int)) : NULL;
+    ok = ok && (rank != 0 || (info && walls && threads && event_counts && event_displs && str_counts && str_displs));
+    MPI_Allreduce(MPI_IN_PLACE, &ok, 1, MPI_INT, MPI_LAND, comm);
+    TraceEvent *all_events = NULL;
+    char *all_strings = NULL;
+    long total_events = 0;
+    if (ok)
+    {
+        MPI_Gather(local_info, 2, MPI_INT, info, 2, MPI_INT, 0, comm);
+        MPI_Gather(&wall, 1, MPI_DOUBLE, walls, 1, MPI_DOUBLE, 0, comm);
+        MPI_Gather(&thread_count, 1, MPI_INT, threads, 1, MPI_INT, 0, comm);
+        if (rank == 0)
+        {
+            // Displacements count elements, so both totals must fit an int
+            long long string_bytes = 0;
+            for (int r = 0; r < size; r++)
+            {
+                event_counts[r] = info[2 * r];
+                event_displs[r] = (int)total_events;
+                str_counts[r] = info[2 * r + 1];
+                str_displs[r] = (int)string_bytes;
+                total_events += event_counts[r];
+                string_bytes += str_counts[r];
+                if (total_events > INT_MAX || string_bytes > INT_MAX)
+                    ok = 0;
+            }
+            all_events = ok ? malloc((total_events > 0 ? total_events : 1) * sizeof(TraceEvent)) : NULL;
+            all_strings = ok ? malloc(string_bytes > 0 ? string_bytes : 1) : NULL;
+            ok = all_events && all_strings;
+        }
+        MPI_Bcast(&ok, 1, MPI_INT, 0, comm);
+    }
+    if (ok)
+    {
+        MPI_Datatype event_type;
+        MPI_Type_contiguous((int)sizeof(TraceEvent), MPI_BYTE, &event_type);
+        MPI_Type_commit(&event_type);
+        MPI_Gatherv(events, local_info[0], event_type, all_events, event_counts, event_displs, event_type, 0, comm);
+        MPI_Gatherv(strings, local_info[1], MPI_CHAR, all_strings, str_counts, str_displs, MPI_CHAR, 0, comm);
+        MPI_Type_free(&event_type);
+    }
+    else if (rank == 0)
+    {
+        printf("[TRACE] Out of memory gathering the trace\n");
+    }
+
+    int rc = ok ? 0 : -1;
+    if (ok && rank == 0)
+    {
+        int *event_rank = malloc((total_events > 0 ? total_events : 1) * sizeof(int));
+        long *string_base = malloc(size * sizeof(long));
+        FILE *out = event_rank && string_base ? fopen(trace_path, "w") : NULL;
+        if (out)
+        {
+            long i = 0;
+            for (int r = 0; r < size; r++)
+            {
+                string_base[r] = str_displs[r];
+                for (int k = 0; k < event_counts[r]; k++)
+                    event_rank[i++] = r;
+            }
+            write_chrome_trace(out, all_events, event_rank, total_events, all_strings, string_base, size);
+            fclose(out);
+            printf("[TRACE] %ld events from %d ranks written to %s\n", total_events, size, trace_path);
+            print_summary(all_events, event_rank, total_events, walls, threads, size);
+        }
+        else
+        {
+            printf("[TRACE] Cannot write %s\n", trace_path);
+            rc = -1;
+        }
+
+        free(event_rank);
+        free(string_base);
+    }
+
+    free(events);
+    free(strings);
+    free(info);
+    free(walls);
+    free(threads);
+    free(event_counts);
+    free(event_displs);
+    free(str_counts);
+    free(str_displs);
+    free(all_events);
+    free(all_strings);
+
+    // Buffers stay registered with their threads; just empty them
+    for (TraceBuffer *b = buffers; b; b = b->next)
+    {
+        b->count = 0;
+        b->str_len = 0;
+    }
+    return rc;
+}
+
+#endif
@@ -0,0 +1,48 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <mpi.h>
+
+// Hot-path instrumentation. Built with -DDOCSEARCH_TRACE (make TRACE=1), the
+// TRACE_* macros record timed events into per-thread buffers that --trace
+// gathers on rank 0, writes as Chrome trace JSON (chrome://tracing, Perfetto)
+// and summarizes. Without it every macro expands to nothing.
+
+typedef enum {
+    TRACE_OPEN,          // doc_open: map or read one document (bytes: its size)
+    TRACE_EXTRACT,       // in-process text extraction of one document
+    TRACE_SUBPROCESS,    // pdftotext fallback
+    TRACE_CACHE,         // extraction cache lookup
+    TRACE_AC_BUILD,      // Aho-Corasick automaton build
+    TRACE_INDEX_BUILD,   // inverted index build
+    TRACE_INDEX_MERGE,   // merge of index segments
+    TRACE_SCAN,          // search of one file or byte range
+    TRACE_QUEUE_WAIT,    // waiting for the next work item
+    TRACE_GATHER,        // result aggregation across ranks
+    TRACE_BARRIER,       // waiting for the other ranks
+    TRACE_BCAST,         // file list broadcast
+    TRACE_KIND_COUNT
+} TraceKind;
+
+#ifdef DOCSEARCH_TRACE
+
+void trace_open(const char *path);
+int trace_close(MPI_Comm comm);
+double trace_now(void);
+void trace_event(TraceKind kind, const char *detail, double start, unsigned long long bytes);
+
+#define TRACE_BEGIN(t) double t = trace_now()
+#define TRACE_END(t, kind, detail, bytes) trace_event(kind, detail, t, bytes)
+#define TRACE_OPEN(path) trace_open(path)
+#define TRACE_CLOSE(comm) trace_close(comm)
+
+#else
+
+#define TRACE_BEGIN(t) do {} while (0)
+#define TRACE_END(t, kind, detail, bytes) do {} while (0)
+#define TRACE_OPEN(path) do {} while (0)
+#define TRACE_CLOSE(comm) do {} while (0)
+
+#endif
+
+#endif
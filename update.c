@@ -0,0 +1,291 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <poll.h>
+#include <signal.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <mpi.h>
+#include "update.h"
+#include "segment.h"
+#include "file_utils.h"
+#include "doc_reader.h"
+
+#define WATCH_EVENTS (IN_CLOSE_WRITE | IN_MOVED_TO | IN_MOVED_FROM | IN_DELETE | IN_CREATE)
+
+// Directories under watch, indexed by inotify watch descriptor
+typedef struct {
+    int fd;
+    char **dirs;
+    int cap;
+} Watcher;
+
+static volatile sig_atomic_t stop_requested;
+
+static void request_stop(int sig)
+{
+    (void)sig;
+    stop_requested = 1;
+}
+
+// Watch dir and every directory below it
+static void watch_tree(Watcher *w, const char *dir)
+{
+    int wd = inotify_add_watch(w->fd, dir, WATCH_EVENTS);
+    if (wd < 0)
+        return;
+    if (wd >= w->cap)
+    {
+        int cap = w->cap ? w->cap : 64;
+        while (cap <= wd)
+            cap *= 2;
+        char **dirs = realloc(w->dirs, cap * sizeof(char *));
+        if (!dirs)
+            return;
+        memset(dirs + w->cap, 0, (cap - w->cap) * sizeof(char *));
+        w->dirs = dirs;
+        w->cap = cap;
+    }
+    free(w->dirs[wd]);
+    w->dirs[wd] = strdup(dir);
+
+    DIR *d = opendir(dir);
+    if (!d)
+        return;
+    struct dirent *entry;
+    char path[PATH_MAX];
+    while ((entry = readdir(d)))
+    {
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0)
+            continue;
+        if (snprintf(path, sizeof(path), "%s/%s", dir, entry->d_name) >= (int)sizeof(path))
+            continue;
+        struct stat st;
+        if (entry->d_type == DT_DIR || (entry->d_type == DT_UNKNOWN && lstat(path, &st) == 0 && S_ISDIR(st.st_mode)))
+            watch_tree(w, path);
+    }
+    closedir(d);
+}
+
+static void watcher_close(Watcher *w)
+{
+    for (int i = 0; i < w->cap; i++)
+        free(w->dirs[i]);
+    free(w->dirs);
+    if (w->fd >= 0)
+        close(w->fd);
+}
+
+// Collect the files touched by one inotify read. Directory events (and a
+// queue overflow) set *rescan: the whole tree is walked again instead.
+static void read_events(Watcher *w, PathTable *changed, int *rescan)
+{
+    char buf[64 * 1024] __attribute__((aligned(__alignof__(struct inotify_event))));
+    ssize_t len = read(w->fd, buf, sizeof(buf));
+    char path[PATH_MAX];
+    for (char *p = buf; len > 0 && p < buf + len;)
+    {
+        const struct inotify_event *ev = (const struct inotify_event *)p;
+        p += sizeof(struct inotify_event) + ev->len;
+
+        if (ev->mask & IN_Q_OVERFLOW)
+        {
+            *rescan = 1;
+            continue;
+        }
+        const char *dir = ev->wd >= 0 && ev->wd < w->cap ? w->dirs[ev->wd] : NULL;
+        if (ev->mask & IN_IGNORED)
+        {
+            if (dir)
+            {
+                free(w->dirs[ev->wd]);
+                w->dirs[ev->wd] = NULL;
+            }
+            continue;
+        }
+        if (!dir || ev->len == 0 || snprintf(path, sizeof(path), "%s/%s", dir, ev->name) >= (int)sizeof(path))
+            continue;
+
+        if (ev->mask & IN_ISDIR)
+        {
+            if (ev->mask & (IN_CREATE | IN_MOVED_TO))
+                watch_tree(w, path);
+            if (ev->mask & (IN_CREATE | IN_MOVED_TO | IN_MOVED_FROM | IN_DELETE))
+                *rescan = 1;
+        }
+        else if (!(ev->mask & IN_CREATE) && is_supported_file(ev->name))
+        {
+            // A file is picked up once written (IN_CLOSE_WRITE), not when created
+            path_table_add(changed, path);
+        }
+    }
+}
+
+// Block until a batch of changes arrives: events are gathered until
+// WATCH_QUIET_MS pass without one, or WATCH_MAX_BATCH_MS after the first.
+// Returns 0 with changes in *changed / *rescan, or -1 once a stop is asked.
+static int wait_changes(Watcher *w, PathTable *changed, int *rescan)
+{
+    *rescan = 0;
+    struct pollfd pfd = {w->fd, POLLIN, 0};
+    double first = 0.0;
+    for (;;)
+    {
+        if (stop_requested)
+            return -1;
+        int batching = changed->count > 0 || *rescan;
+        if (batching && first == 0.0)
+            first = MPI_Wtime();
+        if (batching && (MPI_Wtime() - first) * 1000 >= WATCH_MAX_BATCH_MS)
+            return 0;
+        int ready = poll(&pfd, 1, batching ? WATCH_QUIET_MS : 500);
+        if (ready < 0 && errno != EINTR)
+            return -1;
+        if (ready > 0)
+            read_events(w, changed, rescan);
+        else if (batching && ready == 0)
+            return 0;
+    }
+}
+
+static void print_changes(const SegmentChanges *c, double seconds)
+{
+    printf("[UPDATE] %d added, %d modified, %d deleted, %d unchanged (%.4f seconds)\n",
+           c->added, c->modified, c->deleted, c->unchanged, seconds);
+}
+
+// Search every live segment of dir and report (collective)
+static int search_segments(const char *dir, const char *pattern, int mode, int rank, int size)
+{
+    SegmentSet set;
+    double start = MPI_Wtime();
+    if (segment_set_open(dir, &set, rank) != 0)
+    {
+        if (rank == 0)
+            printf("[UPDATE] Cannot open the segments in %s\n", dir);
+        return -1;
+    }
+
+    int found = segment_search(&set, pattern, mode, rank, size);
+    if (rank == 0 && found >= 0)
+    {
+        printf("[UPDATE] %u live documents in %d segments\n", segment_set_live(&set), set.count);
+        printf("[UPDATE] Search: %.4f seconds, Found: %d files\n", MPI_Wtime() - start, found);
+        fflush(stdout);
+    }
+    segment_set_close(&set);
+    return found;
+}
+
+// Collective: bring the segmented index of docs_dir up to date and search
+// it. With watch set, rank 0 then follows the tree with inotify and every
+// batch of changes is applied and searched again, until SIGINT or SIGTERM.
+// Merges run in the background meanwhile. Returns 0, or 1 on failure.
+int run_update(const char *docs_dir, const char *pattern, int mode, int watch, int rank, int size)
+{
+    // Rank 0 names the segment directory for everyone
+    char dir[PATH_MAX];
+    int ok = rank != 0 || segment_dir(docs_dir, dir, sizeof(dir)) == 0;
+    MPI_Bcast(&ok, 1, MPI_INT, 0, MPI_COMM_WORLD);
+    if (!ok)
+    {
+        if (rank == 0)
+            printf("[UPDATE] Cannot resolve %s\n", docs_dir);
+        return 1;
+    }
+    MPI_Bcast(dir, sizeof(dir), MPI_CHAR, 0, MPI_COMM_WORLD);
+
+    if (rank == 0)
+    {
+        SegmentChanges changes;
+        double start = MPI_Wtime();
+        ok = segment_sync(docs_dir, dir, &changes) == 0;
+        if (ok)
+        {
+            print_changes(&changes, MPI_Wtime() - start);
+            segment_merge_start(dir);
+        }
+        else
+        {
+            printf("[UPDATE] Cannot update the segments in %s\n", dir);
+        }
+    }
+    MPI_Bcast(&ok, 1, MPI_INT, 0, MPI_COMM_WORLD);
+    if (ok)
+        ok = search_segments(dir, pattern, mode, rank, size) >= 0;
+
+    Watcher w = {-1, NULL, 0};
+    if (ok && watch && rank == 0)
+    {
+        w.fd = inotify_init1(IN_CLOEXEC);
+        if (w.fd >= 0)
+            watch_tree(&w, docs_dir);
+        if (w.fd < 0 || w.cap == 0)
+        {
+            printf("[UPDATE] Cannot watch %s\n", docs_dir);
+            ok = 0;
+        }
+        else
+        {
+            printf("[UPDATE] Watching %s (Ctrl-C to stop)\n", docs_dir);
+            fflush(stdout);
+        }
+    }
+    if (watch)
+    {
+        // Every rank outlives the signal; rank 0 then stops the others
+        signal(SIGINT, request_stop);
+        signal(SIGTERM, request_stop);
+        MPI_Bcast(&ok, 1, MPI_INT, 0, MPI_COMM_WORLD);
+    }
+
+    // Other ranks wait in MPI_Bcast for each batch
+    while (ok && watch)
+    {
+        int go = 1;
+        if (rank == 0)
+        {
+            PathTable changed;
+            path_table_init(&changed);
+            int rescan;
+            go = wait_changes(&w, &changed, &rescan) == 0;
+            if (go)
+            {
+                SegmentChanges changes;
+                double start = MPI_Wtime();
+                int rc = rescan ? segment_sync(docs_dir, dir, &changes)
+                                : segment_apply(docs_dir, dir, &changed, &changes);
+                if (rc == 0)
+                {
+                    print_changes(&changes, MPI_Wtime() - start);
+                    segment_merge_start(dir);
+                }
+                else
+                {
+                    printf("[UPDATE] Cannot apply the changes\n");
+                }
+            }
+            path_table_free(&changed);
+        }
+        MPI_Bcast(&go, 1, MPI_INT, 0, MPI_COMM_WORLD);
+        if (!go)
+            break;
+        ok = search_segments(dir, pattern, mode, rank, size) >= 0;
+    }
+
+    if (rank == 0)
+    {
+        int merges = segment_merge_wait();
+        if (merges > 0)
+            printf("[UPDATE] %d segment merges\n", merges);
+        else if (merges < 0)
+            printf("[UPDATE] A segment merge failed\n");
+        watcher_close(&w);
+    }
+    doc_unregister_all();
+    return ok ? 0 : 1;
+}
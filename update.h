@@ -0,0 +1,9 @@
+#ifndef UPDATE_H
+#define UPDATE_H
+
+#define WATCH_QUIET_MS 200     // a change batch ends after this long without events
+#define WATCH_MAX_BATCH_MS 2000
+
+int run_update(const char *docs_dir, const char *pattern, int mode, int watch, int rank, int size);
+
+#endif